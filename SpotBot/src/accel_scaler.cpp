@@ -0,0 +1,40 @@
+/** @file accel_scaler.cpp
+ *  This program contains the class which turns raw accelerometer readings into
+ *  acceleration in micrometers per second squared using only integer math.
+ *  Keeping the per-sample path in integers gives the same number of cycles for
+ *  every sample and pairs with the integer integrator.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "accel_scaler.h"
+
+/** @brief   Constructor which precomputes the integer scale factors
+ *  @param   ticks_per_ms2 Calibration constant, ticks per 1 m/s^2
+ *  @param   offset_ms2 Acceleration subtracted after scaling, e.g. gravity
+ *  @param   dead_band_ms2 Accelerations smaller than this are treated as noise
+ */
+AccelScaler::AccelScaler (float ticks_per_ms2, float offset_ms2, float dead_band_ms2)
+{
+    scale_q16 = (int32_t)(1e6f / ticks_per_ms2 * 65536.0f + 0.5f);
+    offset = (int32_t)(offset_ms2 * 1e6f + 0.5f);
+    dead_band = (int32_t)(dead_band_ms2 * 1e6f + 0.5f);
+}
+
+/** @brief   Method which converts one raw reading
+ *  @param   raw Acceleration in ticks straight from the sensor
+ *  @return  Acceleration in um/s^2 with the offset taken out
+ */
+int32_t AccelScaler::to_um_s2(int32_t raw)
+{
+    return (int32_t)(((int64_t)raw * scale_q16) >> 16) - offset;
+}
+
+/** @brief   Method which checks if an acceleration is small enough to be noise
+ *  @param   accel_um_s2 Acceleration in um/s^2
+ */
+bool AccelScaler::in_dead_band(int32_t accel_um_s2)
+{
+    return accel_um_s2 < dead_band && accel_um_s2 > -dead_band;
+}
@@ -0,0 +1,30 @@
+/** @file accel_scaler.h
+ *  This is the header for the acceleration scaler file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _ACCEL_SCALER_H_
+#define _ACCEL_SCALER_H_
+
+#include <stdint.h>
+
+/** @brief   Class which converts raw accelerometer ticks to integer um/s^2
+ *  @details The calibration constant is folded into a Q16.16 scale factor when
+ *           the object is made, so converting a sample is one multiply, one
+ *           shift and one subtract with no floating point.
+ */
+class AccelScaler
+{
+protected:
+    int32_t scale_q16;
+    int32_t offset;
+    int32_t dead_band;
+public:
+    AccelScaler (float ticks_per_ms2, float offset_ms2, float dead_band_ms2);
+    int32_t to_um_s2(int32_t raw);
+    bool in_dead_band(int32_t accel_um_s2);
+};
+
+#endif // _ACCEL_SCALER_H_
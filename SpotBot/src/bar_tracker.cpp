@@ -0,0 +1,121 @@
+/** @file bar_tracker.cpp
+ *  This program contains the class which turns bar velocity and position into
+ *  heights the spot task can use. It measures each rep's range of motion and
+ *  sticking point, notices the bar sinking back toward the chest and works out
+ *  how far the motor has to pull to get the bar back up to the rack.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "bar_tracker.h"
+
+/** @brief   Constructor which creates a tracker that hasn't seen the bar yet
+ */
+BarTracker::BarTracker (void)
+{
+}
+
+/** @brief   Method called while the bar is still on the rack
+ *  @param   bar_pos Bar position from the IMUs in m
+ */
+void BarTracker::rack(float bar_pos)
+{
+    rack_pos = bar_pos;
+    pos = bar_pos;
+    have_rack = true;
+    have_chest = false;
+}
+
+/** @brief   Method called when the bar stops on the chest
+ *  @param   bar_pos Bar position from the IMUs in m
+ */
+void BarTracker::chest(float bar_pos)
+{
+    chest_pos = bar_pos;
+    pos = bar_pos;
+    descent = have_rack ? rack_pos - bar_pos : 0;
+    have_chest = true;
+    top = 0;
+    peak_vel = 0;
+    stick_vel = 0;
+    stick_height = 0;
+}
+
+/** @brief   Method called with every new bar velocity and position
+ *  @details On the way up the highest point is kept, and once the bar has
+ *           slowed by @c BAR_STICK_DIP after its first push the slowest point
+ *           after that is taken as the sticking point.
+ *  @param   bar_vel Bar velocity in m/s, positive up
+ *  @param   bar_pos Bar position from the IMUs in m
+ */
+void BarTracker::update(float bar_vel, float bar_pos)
+{
+    pos = bar_pos;
+    if (!have_chest){
+        return;
+    }
+    float now = height();
+    top = now > top ? now : top;
+    peak_vel = bar_vel > peak_vel ? bar_vel : peak_vel;
+    if (bar_vel > 0 && bar_vel < peak_vel - BAR_STICK_DIP){
+        if (stick_height == 0 || bar_vel < stick_vel){
+            stick_vel = bar_vel;
+            stick_height = now;
+        }
+    }
+}
+
+/** @brief   Method which returns the height of the bar
+ *  @return  Height above the chest in m once the bar has touched it, or
+ *           height above the rack before that
+ */
+float BarTracker::height(void)
+{
+    return have_chest ? pos - chest_pos : pos - rack_pos;
+}
+
+/** @brief   Method which returns true if the bar has sunk back toward the chest
+ *           by more than @c BAR_SPOT_DROP from the highest point of the press
+ */
+bool BarTracker::sagging(void)
+{
+    return have_chest && top - height() > BAR_SPOT_DROP;
+}
+
+/** @brief   Method which returns true if the bar is still well below where the
+ *           press started
+ *  @details A press slows to a stop at lockout as well as when it fails, so a
+ *           stall is only believed below @c BAR_STALL_ROM of the descent. Without
+ *           a rack height to go by this is always false.
+ */
+bool BarTracker::short_of_top(void)
+{
+    return have_chest && descent > 0 && height() < descent * BAR_STALL_ROM;
+}
+
+/** @brief   Method which works out how far the motor must pull to get the bar
+ *           from where it is back to the rack
+ *  @return  Distance in m
+ */
+float BarTracker::spot_distance(void)
+{
+    if (!have_rack){
+        return BAR_SPOT_DEFAULT;
+    }
+    float distance = rack_pos - pos + BAR_SPOT_MARGIN;
+    return distance < BAR_SPOT_MIN ? BAR_SPOT_MIN : distance > BAR_SPOT_MAX ? BAR_SPOT_MAX : distance;
+}
+
+/** @brief   Method which sums up the rep that just ended
+ *  @param   motion Structure which gets the range of motion, sticking point
+ *           and highest point in m, and whether the press went high enough to
+ *           be a full rep
+ */
+void BarTracker::finish(RepMotion& motion)
+{
+    motion.rom = descent;
+    motion.sticking = stick_height;
+    motion.top = top;
+    motion.full = have_chest && top >= descent * BAR_FULL_ROM;
+}
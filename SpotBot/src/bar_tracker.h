@@ -0,0 +1,65 @@
+/** @file bar_tracker.h
+ *  This is the header for the bar tracker file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _BAR_TRACKER_H_
+#define _BAR_TRACKER_H_
+
+#include <stdint.h>
+
+#define BAR_FULL_ROM 0.9f     ///< Part of the descent a press must cover to be a full rep
+#define BAR_STALL_ROM 0.8f    ///< Part of the descent under which a stalling press can't be lockout
+#define BAR_STICK_DIP 0.05f   ///< Slow down after the first push that marks a sticking point, m/s
+#define BAR_SPOT_DROP 0.03f   ///< Sag below the highest point of a press which calls for a spot, m
+#define BAR_SPOT_MARGIN 0.02f ///< Extra pull so the bar clears the rack, m
+#define BAR_SPOT_MIN 0.05f    ///< Shortest spot pull, m
+#define BAR_SPOT_MAX 0.40f    ///< Longest spot pull, m
+#define BAR_SPOT_DEFAULT 0.207f ///< Spot pull used before the rack height is known, m
+
+/** @brief   Where the bar went during one rep
+ */
+struct RepMotion
+{
+    float rom;
+    float sticking;
+    float top;
+    bool full;
+};
+
+/** @brief   Class which tracks the height of the bar through a rep
+ *  @details The bar position from the IMUs drifts, so it is only ever used as
+ *           a difference from the last zero velocity point. While the bar is
+ *           racked the rack height is re-measured, and when the bar stops on
+ *           the chest the chest height is, so drift only builds up over one
+ *           half of a rep. Heights are above the chest once the bar has
+ *           touched it and below the rack (negative) on the way down.
+ */
+class BarTracker
+{
+protected:
+    float rack_pos = 0;
+    float chest_pos = 0;
+    float pos = 0;
+    bool have_rack = false;
+    bool have_chest = false;
+    float descent = 0;
+    float top = 0;
+    float peak_vel = 0;
+    float stick_vel = 0;
+    float stick_height = 0;
+public:
+    BarTracker (void);
+    void rack(float bar_pos);
+    void chest(float bar_pos);
+    void update(float bar_vel, float bar_pos);
+    float height(void);
+    bool sagging(void);
+    bool short_of_top(void);
+    float spot_distance(void);
+    void finish(RepMotion& motion);
+};
+
+#endif // _BAR_TRACKER_H_
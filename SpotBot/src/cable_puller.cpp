@@ -0,0 +1,155 @@
+/** @file cable_puller.cpp
+ *  This program contains the logic behind the spotter motor, kept apart from
+ *  the encoder and the motor driver so it can be run against a model of the
+ *  cable as well as the real one. It pulls the bar up to the rack for a spot,
+ *  and takes up the slack in the cable ahead of a spot that looks likely, so
+ *  the lifter feels the spot sooner.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "cable_puller.h"
+
+/** @brief   Constructor which creates a puller with the motor off
+ *  @param   duty_spot Duty the motor pulls at during a spot
+ */
+CablePuller::CablePuller (int16_t duty_spot)
+    : spot_duty (duty_spot)
+{
+}
+
+/** @brief   Method which starts a spot
+ *  @details From rest the pull is measured from here; if the motor was getting
+ *           ready it is measured from where the cable rested before that.
+ *  @param   pos_mm Cable wound in, from the encoder, mm
+ *  @param   distance Cable to pull in from rest to get the bar to the rack, mm
+ *  @param   time_us Time the spot was fired in microseconds
+ *  @return  Duty to drive the motor at
+ */
+int16_t CablePuller::fire(float pos_mm, float distance, int64_t time_us)
+{
+    if (state == PULL_IDLE || state == PULL_SPOT){
+        rest_mm = pos_mm;
+    }
+    distance_mm = distance;
+    fired_us = time_us;
+    force_us = 0;
+    state = PULL_SPOT;
+    duty = spot_duty;
+    return duty;
+}
+
+/** @brief   Method which moves the puller along after a new encoder reading
+ *  @param   pos_mm Cable wound in, from the encoder, mm
+ *  @param   ready True if the press looks like it may need a spot
+ *  @param   time_us Time of the reading in microseconds
+ *  @return  Duty to drive the motor at, positive winds the cable in and zero
+ *           stops the motor
+ */
+int16_t CablePuller::update(float pos_mm, bool ready, int64_t time_us)
+{
+    float pulled = pos_mm - rest_mm;
+    if (ready){
+        ready_us = time_us;
+    }
+    bool dropped = !ready && time_us - ready_us >= READY_DROP_US;
+
+    if (state == PULL_IDLE && ready){
+        rest_mm = pos_mm;
+        moved_mm = pos_mm;
+        moved_us = time_us + READY_SPINUP_US;
+        duty = READY_DUTY;
+        state = PULL_READY;
+    }
+    else if (state == PULL_SPOT){
+        if (force_us == 0 && pulled >= slack_mm + FORCE_MM){
+            force_us = time_us - fired_us;
+        }
+        if (pulled >= distance_mm){
+            duty = 0;
+            done = true;
+            state = PULL_IDLE;
+        }
+    }
+    else if (state == PULL_READY){
+        if (dropped){
+            duty = -READY_DUTY;
+            state = PULL_UNWIND;
+        }
+        else if (pos_mm - moved_mm > READY_STOP_MM){
+            moved_mm = pos_mm;
+            moved_us = time_us > moved_us ? time_us : moved_us;
+        }
+        else if (time_us - moved_us >= READY_STOP_US){
+            // The cable has come up against the bar, so this is how much slack there was
+            slack_mm = pulled;
+            duty = READY_HOLD_DUTY;
+            state = PULL_HOLD;
+        }
+        if (state == PULL_READY && pulled >= READY_SLACK_MM){
+            duty = READY_HOLD_DUTY;
+            state = PULL_HOLD;
+        }
+    }
+    else if (state == PULL_HOLD){
+        if (dropped){
+            duty = -READY_DUTY;
+            state = PULL_UNWIND;
+        }
+        // Cut off at READY_SLACK_MM, the hold duty is still taking up what is left
+        else if (pos_mm - moved_mm > READY_STOP_MM){
+            moved_mm = pos_mm;
+            moved_us = time_us;
+        }
+        else if (time_us - moved_us >= READY_STOP_US){
+            slack_mm = pulled;
+        }
+    }
+    else if (state == PULL_UNWIND){
+        if (ready){
+            moved_mm = pos_mm;
+            moved_us = time_us + READY_SPINUP_US;
+            duty = READY_DUTY;
+            state = PULL_READY;
+        }
+        else if (pulled <= 0){
+            duty = 0;
+            state = PULL_IDLE;
+        }
+    }
+    return duty;
+}
+
+/** @brief   Method which returns what the puller is doing, e.g. @c PULL_SPOT
+ */
+uint8_t CablePuller::get_state(void)
+{
+    return state;
+}
+
+/** @brief   Method which returns true once after a spot has reached the rack
+ */
+bool CablePuller::take_done(void)
+{
+    bool was_done = done;
+    done = false;
+    return was_done;
+}
+
+/** @brief   Method which returns how long the last spot took to start lifting
+ *           the bar after it was fired
+ *  @return  Time in microseconds, or zero if it hasn't yet
+ */
+int64_t CablePuller::get_force_us(void)
+{
+    return force_us;
+}
+
+/** @brief   Method which returns the slack last measured in the cable
+ *  @return  Slack in mm, @c READY_SLACK_MM until it has been measured
+ */
+float CablePuller::get_slack_mm(void)
+{
+    return slack_mm;
+}
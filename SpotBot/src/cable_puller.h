@@ -0,0 +1,68 @@
+/** @file cable_puller.h
+ *  This is the header for the cable puller file
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _CABLE_PULLER_H_
+#define _CABLE_PULLER_H_
+
+#include <stdint.h>
+
+#define PULL_IDLE 0           ///< Motor off, waiting for a spot or a reason to get ready
+#define PULL_SPOT 1           ///< Pulling the bar up to the rack
+#define PULL_READY 2          ///< Winding in slack ahead of a spot that looks likely
+#define PULL_HOLD 3           ///< Slack wound in, holding the cable taut
+#define PULL_UNWIND 4         ///< Letting the cable back out to where it rested
+
+#define READY_DUTY 30         ///< Duty which winds in slack, to be kept under what lifts the bar
+#define READY_HOLD_DUTY 12    ///< Duty which keeps a taut cable taut, to be kept under what lifts the bar
+#define READY_SLACK_MM 15.0f  ///< Most cable wound in while getting ready, and the slack until it is measured, mm
+#define READY_STOP_MM 0.5f    ///< Winding under which the cable counts as stopped, mm
+#define READY_STOP_US 40000   ///< Time stopped which means the cable is taut (40 ms)
+#define READY_SPINUP_US 60000 ///< Time the motor gets to start turning before it can count as stopped (60 ms)
+#define READY_DROP_US 200000  ///< Time the press must stop looking bad before the cable is let out (200 ms)
+#define FORCE_MM 2.0f         ///< Pull past the slack at which the cable is lifting the bar, mm
+
+/** @brief   Class which decides how hard the motor pulls on the spotter cable
+ *  @details Positions are in mm of cable wound in, from the encoder. Every pull
+ *           is measured from where the cable rested before the motor started,
+ *           so a spot lifts the bar the same distance whether or not the motor
+ *           had got ready first. While a press looks like it might fail the
+ *           motor winds in slack at @c READY_DUTY until the encoder stops,
+ *           which means the cable has come taut against the bar, and then drops
+ *           to @c READY_HOLD_DUTY. The winding is also cut off at
+ *           @c READY_SLACK_MM in case the encoder never stops, leaving the
+ *           hold duty to take up any slack past that. How far the
+ *           winding got before it stopped is kept as the slack in the cable,
+ *           which tells when a spot has taken it up and is lifting the bar.
+ *           Once the press stops looking bad the cable is let back out to
+ *           where it rested.
+ */
+class CablePuller
+{
+protected:
+    int16_t spot_duty;
+    uint8_t state = PULL_IDLE;
+    int16_t duty = 0;
+    float rest_mm = 0;
+    float slack_mm = READY_SLACK_MM;
+    float distance_mm = 0;
+    float moved_mm = 0;
+    int64_t moved_us = 0;
+    int64_t ready_us = 0;
+    int64_t fired_us = 0;
+    int64_t force_us = 0;
+    bool done = false;
+public:
+    CablePuller (int16_t duty_spot);
+    int16_t fire(float pos_mm, float distance, int64_t time_us);
+    int16_t update(float pos_mm, bool ready, int64_t time_us);
+    uint8_t get_state(void);
+    bool take_done(void);
+    int64_t get_force_us(void);
+    float get_slack_mm(void);
+};
+
+#endif // _CABLE_PULLER_H_
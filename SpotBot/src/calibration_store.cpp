@@ -0,0 +1,68 @@
+/** @file calibration_store.cpp
+ *  This program keeps IMU calibrations in the ESP32's non-volatile storage
+ *  (NVS) so that after the first boot the IMUs are ready to go as soon as the
+ *  robot turns on, without waiting for a still window.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "calibration_store.h"
+
+/// NVS namespace which holds one calibration per IMU
+const char* cal_namespace = "imu_cal";
+
+/** @brief   Puts together the NVS key of one IMU
+ */
+static void cal_key(uint8_t index, char* key)
+{
+    key[0] = 'i';
+    key[1] = 'm';
+    key[2] = 'u';
+    key[3] = '0' + index;
+    key[4] = '\0';
+}
+
+/** @brief   Loads the calibration of one IMU from NVS
+ *  @param   index Position of the IMU in the sensor array
+ *  @param   cal Filled with the stored calibration
+ *  @return  True if a calibration of the current layout was found
+ */
+bool load_calibration(uint8_t index, ImuCalibration& cal)
+{
+    Preferences prefs;
+    char key[5];
+    cal_key(index, key);
+    if (!prefs.begin(cal_namespace, true)){
+        return false;
+    }
+    ImuCalibration stored;
+    bool found = prefs.getBytesLength(key) == sizeof(stored)
+                 && prefs.getBytes(key, &stored, sizeof(stored)) == sizeof(stored)
+                 && stored.version == CAL_VERSION;
+    prefs.end();
+    if (found){
+        cal = stored;
+    }
+    return found;
+}
+
+/** @brief   Saves the calibration of one IMU to NVS
+ *  @param   index Position of the IMU in the sensor array
+ *  @param   cal Calibration to store
+ *  @return  True if it was written
+ */
+bool save_calibration(uint8_t index, const ImuCalibration& cal)
+{
+    Preferences prefs;
+    char key[5];
+    cal_key(index, key);
+    if (!prefs.begin(cal_namespace, false)){
+        return false;
+    }
+    bool ok = prefs.putBytes(key, &cal, sizeof(cal)) == sizeof(cal);
+    prefs.end();
+    return ok;
+}
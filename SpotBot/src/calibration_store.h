@@ -0,0 +1,18 @@
+/** @file calibration_store.h
+ *  This is the header for the calibration store file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _CALIBRATION_STORE_H_
+#define _CALIBRATION_STORE_H_
+
+#include <stdint.h>
+#include "imu_calibration.h"
+
+bool load_calibration(uint8_t index, ImuCalibration& cal);
+
+bool save_calibration(uint8_t index, const ImuCalibration& cal);
+
+#endif // _CALIBRATION_STORE_H_
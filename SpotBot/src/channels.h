@@ -0,0 +1,638 @@
+/** @file channels.h
+ *  This file contains lock free versions of the @c Share and @c Queue classes
+ *  for data which moves between tasks many times a second. @c Share and
+ *  @c Queue go through a kernel queue, entering a critical section and copying
+ *  the data on every put and get. These classes only use atomic loads and
+ *  stores, so the fast side never waits on the kernel. They can be put into
+ *  from ISRs just like the originals.
+ *
+ *  - @c SpscQueue is a ring for one task (or ISR) putting and one task getting
+ *  - @c Mailbox holds only the latest value, like a @c Share
+ *  - @c MpscQueue is a ring which any number of tasks and ISRs can put into
+ *  - @c Trigger wakes one task the moment something has to happen, carrying
+ *    one value along with it
+ *
+ *  A task blocked in @c get() sleeps on its task notification and is woken
+ *  by the next put, so a task shouldn't wait on a channel and use its
+ *  notification for something else at the same time.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _CHANNELS_H_
+#define _CHANNELS_H_
+
+#include <Arduino.h>
+#include "esp_timer.h"
+
+/** @brief   Class which lets a task sleep until something is put in a channel
+ *  @details The task sets @c waiter before it checks the channel one last
+ *           time and the putter checks @c waiter after the item is in, with a
+ *           full fence on both sides, so a put can't slip in between the last
+ *           check and the sleep without waking the task.
+ */
+class ChannelWaiter
+{
+protected:
+    const char* name;
+    TickType_t wait_ticks;
+    TaskHandle_t volatile waiter = NULL;
+
+    ChannelWaiter (const char* p_name, TickType_t wait)
+        : name (p_name), wait_ticks (wait)
+    {
+    }
+
+    /** @brief   Method which wakes the waiting task, if there is one
+     */
+    inline void wake(void)
+    {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        TaskHandle_t task = waiter;
+        if (task != NULL){
+            xTaskNotifyGive(task);
+        }
+    }
+
+    /** @brief   Method which wakes the waiting task from an ISR
+     */
+    inline void ISR_wake(void)
+    {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        TaskHandle_t task = waiter;
+        if (task != NULL){
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(task, &woken);
+            if (woken){
+                portYIELD_FROM_ISR();
+            }
+        }
+    }
+
+    /** @brief   Method called by a task which is about to sleep on the channel
+     */
+    inline void listen(void)
+    {
+        waiter = xTaskGetCurrentTaskHandle();
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+
+    /** @brief   Method called by a task which is done waiting on the channel
+     */
+    inline void unlisten(void)
+    {
+        waiter = NULL;
+    }
+
+    /** @brief   Method which sleeps until the channel is put into
+     *  @return  False if the wait timed out
+     */
+    inline bool sleep(void)
+    {
+        return ulTaskNotifyTake(pdTRUE, wait_ticks) > 0;
+    }
+public:
+    /** @brief   Method which returns the name given to the channel
+     */
+    const char* get_name(void)
+    {
+        return name;
+    }
+};
+
+/** @brief   Class which passes items from one task or ISR to one other task
+ *  @details Only the putter writes @c head and only the getter writes
+ *           @c tail, so neither side needs a lock. A put into a full queue
+ *           doesn't wait, it returns false and the item is dropped.
+ *  @tparam  T Type of the items
+ *  @tparam  N Number of items which fit; must be a power of two
+ */
+template <class T, uint16_t N>
+class SpscQueue : public ChannelWaiter
+{
+    static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+protected:
+    T items[N];
+    volatile uint32_t head = 0;
+    volatile uint32_t tail = 0;
+
+    /** @brief   Method which puts an item in without waking anyone
+     */
+    inline bool push(const T& item)
+    {
+        uint32_t h = head;
+        if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == N){
+            return false;
+        }
+        items[h % N] = item;
+        __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+public:
+    /** @brief   Constructor which creates an empty queue
+     *  @param   p_name Name of the queue, for debugging
+     *  @param   wait Ticks @c get() waits for an item before giving up
+     */
+    SpscQueue (const char* p_name = NULL, TickType_t wait = portMAX_DELAY)
+        : ChannelWaiter (p_name, wait)
+    {
+    }
+
+    /** @brief   Method which puts an item in the queue from a task
+     *  @return  False if the queue was full and the item was dropped
+     */
+    bool put(const T& item)
+    {
+        if (!push(item)){
+            return false;
+        }
+        wake();
+        return true;
+    }
+
+    /** @brief   Method which puts an item in the queue from an ISR
+     *  @return  False if the queue was full and the item was dropped
+     */
+    bool ISR_put(const T& item)
+    {
+        if (!push(item)){
+            return false;
+        }
+        ISR_wake();
+        return true;
+    }
+
+    /** @brief   Method which takes the oldest item out of the queue if there
+     *           is one, without waiting
+     *  @return  False if the queue was empty
+     */
+    bool take(T& item)
+    {
+        uint32_t t = tail;
+        if (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == t){
+            return false;
+        }
+        item = items[t % N];
+        __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /** @brief   Method which takes the oldest item out of the queue, waiting
+     *           for one if the queue is empty
+     *  @return  False if no item came before the wait timed out
+     */
+    bool get(T& item)
+    {
+        if (take(item)){
+            return true;
+        }
+        listen();
+        bool got;
+        while (!(got = take(item))){
+            if (!sleep()){
+                break;
+            }
+        }
+        unlisten();
+        return got;
+    }
+
+    /** @brief   Method which takes the oldest item out of the queue, waiting
+     *           for one if the queue is empty
+     */
+    T get(void)
+    {
+        T item = T();
+        get(item);
+        return item;
+    }
+
+    /** @brief   Method which returns true if there is anything in the queue
+     */
+    bool any(void)
+    {
+        return __atomic_load_n(&head, __ATOMIC_ACQUIRE) != tail;
+    }
+
+    /** @brief   Method which returns the number of items in the queue
+     */
+    uint16_t available(void)
+    {
+        return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    }
+
+    /** @brief   Method which returns true if the queue is empty
+     */
+    bool is_empty(void)
+    {
+        return !any();
+    }
+
+    /** @brief   Method which returns the number of items that can be put
+     *           before the queue is full
+     *  @details Only the getter can make room, so the putter can count on
+     *           at least this much space.
+     */
+    uint16_t space(void)
+    {
+        return N - available();
+    }
+};
+
+/** @brief   Class which holds the latest value put into it
+ *  @details There are two copies of the value guarded by a sequence lock.
+ *           @c seq is odd while a put is writing and even otherwise, and each
+ *           put writes the copy the previous put didn't, so readers always
+ *           copy the one finished last. A reader checks @c seq again after
+ *           copying and tries again if a later put could have started writing
+ *           the copy it was reading. An ISR interrupting a put on the same
+ *           core reads the finished copy, which the put isn't touching, so it
+ *           never waits. Any number of tasks can put; an ISR put gives up if a
+ *           task is in the middle of one, since it can't wait for that task to
+ *           finish.
+ *  @tparam  T Type of the value
+ */
+template <class T>
+class Mailbox
+{
+protected:
+    const char* name;
+    T values[2];
+    volatile uint32_t seq = 0;
+    volatile uint32_t writing = 0;
+
+    /** @brief   Method which writes the copy readers aren't using and flips
+     *           readers over to it; the caller must hold @c writing
+     */
+    inline void write(const T& value)
+    {
+        uint32_t s = seq;
+        __atomic_store_n(&seq, s + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        values[((s >> 1) + 1) & 1] = value;
+        __atomic_store_n(&seq, s + 2, __ATOMIC_RELEASE);
+        __atomic_store_n(&writing, 0, __ATOMIC_RELEASE);
+    }
+
+    /** @brief   Method which tries once to become the one task writing
+     */
+    inline bool lock(void)
+    {
+        uint32_t expected = 0;
+        return __atomic_compare_exchange_n(&writing, &expected, 1, false,
+                                           __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    }
+public:
+    /** @brief   Constructor which creates a mailbox holding a default value
+     *  @param   p_name Name of the mailbox, for debugging
+     */
+    Mailbox (const char* p_name = NULL)
+        : name (p_name)
+    {
+        values[0] = T();
+        values[1] = T();
+    }
+
+    /** @brief   Method which puts a new value in the mailbox from a task
+     *  @details If another task is in the middle of a put this one sleeps for
+     *           a tick rather than spinning, since the other task may have a
+     *           lower priority and need the CPU to finish.
+     */
+    void put(const T& value)
+    {
+        while (!lock()){
+            vTaskDelay(1);
+        }
+        write(value);
+    }
+
+    /** @brief   Method which puts a new value in the mailbox from an ISR
+     *  @return  False if a task was putting a value at the same time, in
+     *           which case the task's value wins
+     */
+    bool ISR_put(const T& value)
+    {
+        if (!lock()){
+            return false;
+        }
+        write(value);
+        return true;
+    }
+
+    /** @brief   Method which copies the latest value out of the mailbox
+     */
+    void get(T& value)
+    {
+        uint32_t s;
+        do{
+            s = __atomic_load_n(&seq, __ATOMIC_ACQUIRE);
+            value = values[(s >> 1) & 1];
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            // The put after next writes this copy again, and it makes seq odd before it starts
+        } while (__atomic_load_n(&seq, __ATOMIC_RELAXED) - (s & ~1u) > 2);
+    }
+
+    /** @brief   Method which returns the latest value in the mailbox
+     */
+    T get(void)
+    {
+        T value;
+        get(value);
+        return value;
+    }
+
+    /** @brief   Method which copies the latest value out of the mailbox from
+     *           an ISR
+     */
+    void ISR_get(T& value)
+    {
+        get(value);
+    }
+
+    /** @brief   Method which returns the latest value in the mailbox from an ISR
+     */
+    T ISR_get(void)
+    {
+        return get();
+    }
+
+    /** @brief   Method which returns the number of values ever put, so a
+     *           reader can tell if anything new has arrived
+     */
+    uint32_t count(void)
+    {
+        return __atomic_load_n(&seq, __ATOMIC_ACQUIRE) >> 1;
+    }
+
+    /** @brief   Method which returns the name given to the mailbox
+     */
+    const char* get_name(void)
+    {
+        return name;
+    }
+};
+
+/** @brief   Class which passes items from any number of tasks and ISRs to one
+ *           task
+ *  @details Each spot in the ring has a sequence number which says whether it
+ *           is ready to be filled or ready to be read. A putter claims a spot
+ *           by moving @c head on with a compare and swap, fills it and then
+ *           marks it ready, so putters never wait for each other. If a putter
+ *           is interrupted between claiming and marking its spot the getter
+ *           sees the queue as empty until it is marked.
+ *  @tparam  T Type of the items
+ *  @tparam  N Number of items which fit; must be a power of two
+ */
+template <class T, uint16_t N>
+class MpscQueue : public ChannelWaiter
+{
+    static_assert((N & (N - 1)) == 0, "MpscQueue size must be a power of two");
+protected:
+    struct Cell
+    {
+        volatile uint32_t seq;
+        T item;
+    };
+    Cell cells[N];
+    volatile uint32_t head = 0;
+    uint32_t tail = 0;
+
+    /** @brief   Method which puts an item in without waking anyone
+     */
+    inline bool push(const T& item)
+    {
+        uint32_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        Cell* p_cell;
+        while (1){
+            p_cell = &cells[pos % N];
+            int32_t diff = (int32_t)(__atomic_load_n(&p_cell->seq, __ATOMIC_ACQUIRE) - pos);
+            if (diff == 0){
+                if (__atomic_compare_exchange_n(&head, &pos, pos + 1, true,
+                                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+                    break;
+                }
+            }
+            else if (diff < 0){
+                return false;
+            }
+            else{
+                pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+            }
+        }
+        p_cell->item = item;
+        __atomic_store_n(&p_cell->seq, pos + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+public:
+    /** @brief   Constructor which creates an empty queue
+     *  @param   p_name Name of the queue, for debugging
+     *  @param   wait Ticks @c get() waits for an item before giving up
+     */
+    MpscQueue (const char* p_name = NULL, TickType_t wait = portMAX_DELAY)
+        : ChannelWaiter (p_name, wait)
+    {
+        for (uint16_t i = 0; i < N; i++){
+            cells[i].seq = i;
+        }
+    }
+
+    /** @brief   Method which puts an item in the queue from a task
+     *  @return  False if the queue was full and the item was dropped
+     */
+    bool put(const T& item)
+    {
+        if (!push(item)){
+            return false;
+        }
+        wake();
+        return true;
+    }
+
+    /** @brief   Method which puts an item in the queue from an ISR
+     *  @return  False if the queue was full and the item was dropped
+     */
+    bool ISR_put(const T& item)
+    {
+        if (!push(item)){
+            return false;
+        }
+        ISR_wake();
+        return true;
+    }
+
+    /** @brief   Method which takes the oldest item out of the queue if there
+     *           is one, without waiting
+     *  @return  False if the queue was empty
+     */
+    bool take(T& item)
+    {
+        Cell& cell = cells[tail % N];
+        if ((int32_t)(__atomic_load_n(&cell.seq, __ATOMIC_ACQUIRE) - (tail + 1)) < 0){
+            return false;
+        }
+        item = cell.item;
+        __atomic_store_n(&cell.seq, tail + N, __ATOMIC_RELEASE);
+        tail++;
+        return true;
+    }
+
+    /** @brief   Method which takes the oldest item out of the queue, waiting
+     *           for one if the queue is empty
+     *  @return  False if no item came before the wait timed out
+     */
+    bool get(T& item)
+    {
+        if (take(item)){
+            return true;
+        }
+        listen();
+        bool got;
+        while (!(got = take(item))){
+            if (!sleep()){
+                break;
+            }
+        }
+        unlisten();
+        return got;
+    }
+
+    /** @brief   Method which takes the oldest item out of the queue, waiting
+     *           for one if the queue is empty
+     */
+    T get(void)
+    {
+        T item = T();
+        get(item);
+        return item;
+    }
+
+    /** @brief   Method which returns true if there is an item ready to take
+     */
+    bool any(void)
+    {
+        return (int32_t)(__atomic_load_n(&cells[tail % N].seq, __ATOMIC_ACQUIRE) - (tail + 1)) >= 0;
+    }
+
+    /** @brief   Method which returns true if there is no item ready to take
+     */
+    bool is_empty(void)
+    {
+        return !any();
+    }
+};
+
+/** @brief   Class which wakes one task the moment it is fired
+ *  @details Made for events which can't wait, like a spot. Firing stores the
+ *           value and the time, raises a flag and notifies the waiting task
+ *           straight away, so the wait is only as long as it takes the
+ *           scheduler to switch to that task. Firing again before the task
+ *           has woken only replaces the value; the task wakes once.
+ *  @tparam  T Type of the value passed along when firing
+ */
+template <class T>
+class Trigger : public ChannelWaiter
+{
+protected:
+    T value;
+    volatile int64_t fire_us = 0;
+    volatile uint32_t fired = 0;
+
+    /** @brief   Method which sets the value and raises the flag without
+     *           waking anyone
+     */
+    inline void raise(const T& new_value)
+    {
+        value = new_value;
+        fire_us = esp_timer_get_time();
+        __atomic_store_n(&fired, 1, __ATOMIC_RELEASE);
+    }
+public:
+    /** @brief   Constructor which creates a trigger which hasn't been fired
+     *  @param   p_name Name of the trigger, for debugging
+     *  @param   wait Longest time to wait for a fire, forever by default
+     */
+    Trigger (const char* p_name = NULL, TickType_t wait = portMAX_DELAY)
+        : ChannelWaiter (p_name, wait), value (T())
+    {
+    }
+
+    /** @brief   Method which fires the trigger from a task
+     */
+    void fire(const T& new_value)
+    {
+        raise(new_value);
+        wake();
+    }
+
+    /** @brief   Method which fires the trigger from an ISR
+     */
+    void ISR_fire(const T& new_value)
+    {
+        raise(new_value);
+        ISR_wake();
+    }
+
+    /** @brief   Method which lowers the flag if the trigger was fired, without
+     *           waiting
+     *  @return  False if it hadn't been fired
+     */
+    bool take(T& new_value)
+    {
+        if (__atomic_exchange_n(&fired, 0, __ATOMIC_ACQUIRE) == 0){
+            return false;
+        }
+        new_value = value;
+        return true;
+    }
+
+    /** @brief   Method which waits for the trigger to be fired
+     *  @return  False if it wasn't fired before the wait timed out
+     */
+    bool wait(T& new_value)
+    {
+        if (take(new_value)){
+            return true;
+        }
+        listen();
+        bool got;
+        while (!(got = take(new_value))){
+            if (!sleep()){
+                break;
+            }
+        }
+        unlisten();
+        return got;
+    }
+
+    /** @brief   Method which waits a limited time for the trigger to be fired,
+     *           so the task can look after other things in between
+     *  @param   new_value Gets the value it was fired with
+     *  @param   ticks Longest time to wait
+     *  @return  False if it wasn't fired in time
+     */
+    bool wait(T& new_value, TickType_t ticks)
+    {
+        if (take(new_value)){
+            return true;
+        }
+        listen();
+        bool got = take(new_value);
+        if (!got){
+            ulTaskNotifyTake(pdTRUE, ticks);
+            got = take(new_value);
+        }
+        unlisten();
+        return got;
+    }
+
+    /** @brief   Method which returns when the trigger was last fired
+     *  @return  Time from @c esp_timer_get_time() in microseconds
+     */
+    int64_t get_time(void)
+    {
+        return fire_us;
+    }
+};
+
+#endif // _CHANNELS_H_
@@ -0,0 +1,156 @@
+/** @file decimator.cpp
+ *  This program contains the filter which brings the raw IMU stream down to the
+ *  control rate. Summing a block of samples is a boxcar filter, which lets a lot
+ *  of noise through its side lobes and delays the signal by half a block. A
+ *  proper low pass FIR filter with a cutoff just under the new Nyquist rate
+ *  rejects far more noise with a shorter delay.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <math.h>
+#include "decimator.h"
+
+#define DECIM_CUTOFF 0.8f   ///< Cutoff as a fraction of the output Nyquist rate
+
+/** @brief   Constructor which designs the filter for a decimation factor
+ *  @param   decimation Input samples per output sample; 1 passes samples through
+ *  @param   reject_outliers True to run a median of three ahead of the filter
+ */
+Decimator::Decimator (uint16_t decimation, bool reject_outliers)
+    : median (reject_outliers)
+{
+    design(decimation);
+}
+
+/** @brief   Method which works out one tap of the windowed sinc, before scaling
+ *  @param   n Index of the tap
+ *  @param   fc Cutoff as a fraction of the input sample rate
+ */
+float Decimator::tap(uint16_t n, float fc)
+{
+    float x = n - (taps - 1) / 2.0f;
+    float sinc = x == 0 ? 2 * fc : sinf(2 * 3.14159265f * fc * x) / (3.14159265f * x);
+    float hamming = taps > 1 ? 0.54f - 0.46f * cosf(2 * 3.14159265f * n / (taps - 1)) : 1;
+    return sinc * hamming;
+}
+
+/** @brief   Method which designs the filter for a decimation factor
+ *  @details The coefficients are a Hamming windowed sinc, scaled to Q15 with a
+ *           DC gain of exactly one. The history is filled with the last output
+ *           so the filter starts out settled where it left off.
+ *  @param   decimation Input samples per output sample
+ */
+void Decimator::design(uint16_t decimation)
+{
+    factor = decimation;
+    if (factor < 1){
+        factor = 1;
+    }
+    if (factor > DECIM_MAX_FACTOR){
+        factor = DECIM_MAX_FACTOR;
+    }
+    taps = factor * DECIM_TAPS_PER_PHASE;
+    if (taps > DECIM_MAX_TAPS){
+        taps = DECIM_MAX_TAPS;
+    }
+    if (factor == 1){
+        taps = 1;
+    }
+
+    // Each tap is worked out twice, once for the total and once to scale it, rather than keeping
+    // them in a float array as big as the filter on the stack of whichever task redesigns it
+    float fc = 0.5f * DECIM_CUTOFF / factor;
+    float total = 0;
+    for (uint16_t n = 0; n < taps; n++){
+        total += tap(n, fc);
+    }
+    int32_t q15_total = 0;
+    for (uint16_t n = 0; n < taps; n++){
+        coeffs[n] = (int16_t)lroundf(tap(n, fc) / total * 32767.0f);
+        q15_total += coeffs[n];
+        history[n] = last_output;
+    }
+    // Rounding error goes into the center tap so DC passes unchanged
+    coeffs[taps / 2] += 32767 - q15_total;
+    pos = 0;
+    phase = 0;
+}
+
+/** @brief   Method which changes the decimation factor after the input rate
+ *           has changed
+ *  @details Samples at the old rate mean nothing to a filter designed for the
+ *           new one, so the filter starts over from the last output instead,
+ *           which keeps the output from jumping.
+ *  @param   decimation New number of input samples per output sample
+ */
+void Decimator::set_factor(uint16_t decimation)
+{
+    design(decimation);
+}
+
+/** @brief   Method which returns the median of an input and the two before it
+ */
+int32_t Decimator::median_of_3(int32_t input)
+{
+    int32_t a = recent[0];
+    int32_t b = recent[1];
+    recent[0] = b;
+    recent[1] = input;
+    if (recent_fill < 2){
+        recent_fill++;
+        return input;
+    }
+    if ((a <= b && b <= input) || (input <= b && b <= a)){
+        return b;
+    }
+    if ((b <= a && a <= input) || (input <= a && a <= b)){
+        return a;
+    }
+    return input;
+}
+
+/** @brief   Method which puts one input sample through the filter
+ *  @param   input New sample at the input rate
+ *  @param   output Filled with the filtered sample when one is due
+ *  @return  True every @c factor th input, when @c output was filled
+ */
+bool Decimator::put(int32_t input, int32_t& output)
+{
+    if (median){
+        input = median_of_3(input);
+    }
+    history[pos] = input;
+    pos = (pos + 1) % taps;
+    phase++;
+    if (phase < factor){
+        return false;
+    }
+    phase = 0;
+
+    // pos now points at the oldest sample
+    int64_t sum = 0;
+    uint16_t index = pos;
+    for (uint16_t n = 0; n < taps; n++){
+        sum += (int64_t)coeffs[n] * history[index];
+        index = index + 1 == taps ? 0 : index + 1;
+    }
+    output = (int32_t)(sum / 32767);
+    last_output = output;
+    return true;
+}
+
+/** @brief   Method which returns the number of input samples per output sample
+ */
+uint16_t Decimator::get_factor(void)
+{
+    return factor;
+}
+
+/** @brief   Method which returns how late the output is, in input samples
+ */
+uint16_t Decimator::get_delay(void)
+{
+    return (taps - 1) / 2 + (median ? 1 : 0);
+}
@@ -0,0 +1,51 @@
+/** @file decimator.h
+ *  This is the header for the decimator file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _DECIMATOR_H_
+#define _DECIMATOR_H_
+
+#include <stdint.h>
+
+#define DECIM_TAPS_PER_PHASE 4   ///< Filter taps for each output sample's worth of input
+#define DECIM_MAX_TAPS 160       ///< Longest filter, enough for 4 kHz down to 100 Hz
+#define DECIM_MAX_FACTOR (DECIM_MAX_TAPS / DECIM_TAPS_PER_PHASE) ///< Largest decimation factor
+
+/** @brief   Class which low pass filters and decimates a sampled signal
+ *  @details A windowed sinc FIR filter is designed for the decimation factor
+ *           when the object is made. Only every @c factor th output is ever
+ *           computed, so each input costs @c DECIM_TAPS_PER_PHASE multiplies,
+ *           the same as a polyphase filter bank. An optional median of three
+ *           in front knocks out single sample spikes before they are smeared
+ *           over the filter. The factor can be changed on the fly when the
+ *           input rate changes without a step in the output.
+ */
+class Decimator
+{
+protected:
+    int16_t coeffs[DECIM_MAX_TAPS];
+    int32_t history[DECIM_MAX_TAPS];
+    uint16_t taps;
+    uint16_t factor;
+    uint16_t pos = 0;
+    uint16_t phase = 0;
+    bool median;
+    int32_t recent[2] = {0, 0};
+    uint8_t recent_fill = 0;
+    int32_t last_output = 0;
+
+    float tap(uint16_t n, float fc);
+    void design(uint16_t decimation);
+    int32_t median_of_3(int32_t input);
+public:
+    Decimator (uint16_t decimation, bool reject_outliers);
+    void set_factor(uint16_t decimation);
+    bool put(int32_t input, int32_t& output);
+    uint16_t get_factor(void);
+    uint16_t get_delay(void);
+};
+
+#endif // _DECIMATOR_H_
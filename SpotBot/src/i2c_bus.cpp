@@ -0,0 +1,171 @@
+/** @file i2c_bus.cpp
+ *  This program contains the @c Wire implementation of the I2C bus interface.
+ *  Every register access is a single transaction with a repeated start so the
+ *  bus is only held for as long as the transfer itself. Transactions have a
+ *  hard timeout, and a bus left stuck by a device is cleared and restarted so
+ *  one bad IMU can't hold up the IMU task for longer than a few milliseconds.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "esp_timer.h"
+#include "i2c_bus.h"
+
+/// Largest block the ESP32 Wire library can return from one requestFrom()
+#define WIRE_MAX_READ 128
+/// Error code used for a read which came back short, same as a NACK from Wire
+#define WIRE_NACK 2
+/// First Wire error code which means the bus itself is in trouble (4 other, 5 timeout)
+#define WIRE_BUS_ERROR 4
+/// Half of one SCL period while the bus is cleared by hand, 100 kHz
+#define CLEAR_HALF_US 5
+
+/** @brief   Constructor which creates a bus object on top of a @c TwoWire
+ *  @param   a_wire The Wire object the devices are on
+ *  @param   sda SDA pin of that controller
+ *  @param   scl SCL pin of that controller
+ *  @param   clock Bus clock in Hz
+ */
+WireBus::WireBus (TwoWire& a_wire, int8_t sda, int8_t scl, uint32_t clock)
+    : wire (a_wire), sda_pin (sda), scl_pin (scl), clock_hz (clock)
+{
+}
+
+/** @brief   Method which starts the controller with the transaction timeout set
+ *  @return  True if the controller started
+ */
+bool WireBus::begin(void)
+{
+    bool ok = wire.begin(sda_pin, scl_pin, clock_hz);
+    wire.setTimeOut(I2C_TIMEOUT_MS);
+    return ok;
+}
+
+/** @brief   Method which frees a stuck bus and starts the controller again
+ *  @details A device which lost clocks in the middle of a read keeps driving
+ *           SDA low while it waits for the rest of its byte. The controller is
+ *           stopped and SCL is clocked by hand, up to 9 times, until the device
+ *           lets go of SDA, then a STOP is sent so every device goes back to
+ *           idle and the controller is started again.
+ *  @return  True if SDA was released and the controller started
+ */
+bool WireBus::recover(void)
+{
+    int64_t start = esp_timer_get_time();
+    wire.end();
+    pinMode(sda_pin, INPUT_PULLUP);
+    pinMode(scl_pin, OUTPUT_OPEN_DRAIN);
+    digitalWrite(scl_pin, HIGH);
+    delayMicroseconds(CLEAR_HALF_US);
+    for (uint8_t i = 0; i < 9 && digitalRead(sda_pin) == LOW; i++){
+        digitalWrite(scl_pin, LOW);
+        delayMicroseconds(CLEAR_HALF_US);
+        digitalWrite(scl_pin, HIGH);
+        delayMicroseconds(CLEAR_HALF_US);
+    }
+    // STOP condition, SDA going high while SCL is high
+    pinMode(sda_pin, OUTPUT_OPEN_DRAIN);
+    digitalWrite(scl_pin, LOW);
+    digitalWrite(sda_pin, LOW);
+    delayMicroseconds(CLEAR_HALF_US);
+    digitalWrite(scl_pin, HIGH);
+    delayMicroseconds(CLEAR_HALF_US);
+    digitalWrite(sda_pin, HIGH);
+    delayMicroseconds(CLEAR_HALF_US);
+    pinMode(sda_pin, INPUT_PULLUP);
+    bool ok = digitalRead(sda_pin) == HIGH;
+
+    ok = begin() && ok;
+    failures = 0;
+    recoveries++;
+    recovery_us = (uint32_t)(esp_timer_get_time() - start);
+    return ok;
+}
+
+/** @brief   Method which keeps track of failed transactions
+ *  @details A bus error, a timeout or SDA found low after a failure recovers the
+ *           bus straight away. A device which just doesn't answer can't be fixed
+ *           from here, but the bus is still recovered after @c I2C_FAIL_LIMIT
+ *           failures in a row in case the controller itself got stuck.
+ *  @param   error Wire error code of the transaction, 0 if it worked
+ *  @return  True if the transaction worked
+ */
+bool WireBus::check(uint8_t error)
+{
+    if (error == 0){
+        failures = 0;
+        return true;
+    }
+    failures++;
+    if (error >= WIRE_BUS_ERROR || digitalRead(sda_pin) == LOW || failures >= I2C_FAIL_LIMIT){
+        recover();
+    }
+    return false;
+}
+
+/** @brief   Method which returns how many times the bus has been recovered
+ */
+uint32_t WireBus::get_recoveries(void)
+{
+    return recoveries;
+}
+
+/** @brief   Method which returns how long the last recovery took in microseconds
+ */
+uint32_t WireBus::get_recovery_us(void)
+{
+    return recovery_us;
+}
+
+/** @brief   Method which writes a single byte to a device with no registers
+ *  @return  True if the device acknowledged
+ */
+bool WireBus::write_byte(uint8_t addr, uint8_t value)
+{
+    wire.beginTransmission(addr);
+    wire.write(value);
+    return check(wire.endTransmission(true));
+}
+
+/** @brief   Method which writes one value into one register of a device
+ *  @return  True if the device acknowledged the whole transfer
+ */
+bool WireBus::write_reg(uint8_t addr, uint8_t reg, uint8_t value)
+{
+    wire.beginTransmission(addr);
+    wire.write(reg);
+    wire.write(value);
+    return check(wire.endTransmission(true));
+}
+
+/** @brief   Method which reads a block of consecutive registers from a device
+ *  @details The register address is sent and then a repeated start is used so
+ *           the read follows without releasing the bus.
+ *           A short read is thrown away rather than handed back as garbage.
+ *  @return  True if all @c len bytes were received
+ */
+bool WireBus::read_regs(uint8_t addr, uint8_t reg, uint8_t* p_buf, uint16_t len)
+{
+    wire.beginTransmission(addr);
+    wire.write(reg);
+    if (!check(wire.endTransmission(false))){
+        return false;
+    }
+    if (wire.requestFrom((uint16_t)addr, (size_t)len, true) != len){
+        return check(WIRE_NACK);
+    }
+    for (uint16_t i = 0; i < len; i++){
+        p_buf[i] = wire.read();
+    }
+    return check(0);
+}
+
+/** @brief   Method which returns the largest number of bytes one read can return
+ */
+uint16_t WireBus::max_read(void)
+{
+    return WIRE_MAX_READ;
+}
@@ -0,0 +1,65 @@
+/** @file i2c_bus.h
+ *  This is the header for the I2C bus file. It contains a small interface which
+ *  the sensor drivers use to talk to registers so they are not tied directly to
+ *  the Arduino @c Wire object.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _I2C_BUS_H_
+#define _I2C_BUS_H_
+
+#include <stdint.h>
+
+#define I2C_TIMEOUT_MS 5    ///< Longest any one transaction may take
+#define I2C_FAIL_LIMIT 3    ///< Failures in a row before the bus is recovered
+
+class TwoWire;
+
+/** @brief   Class which describes a register based I2C bus
+ *  @details Drivers only ever write single registers and read blocks of
+ *           consecutive registers, so that is all this interface asks for,
+ *           plus a bare one byte write for devices without registers.
+ */
+class I2CBus
+{
+public:
+    virtual bool write_byte(uint8_t addr, uint8_t value) = 0;
+    virtual bool write_reg(uint8_t addr, uint8_t reg, uint8_t value) = 0;
+    virtual bool read_regs(uint8_t addr, uint8_t reg, uint8_t* p_buf, uint16_t len) = 0;
+    virtual uint16_t max_read(void) = 0;
+};
+
+/** @brief   Class which runs the I2C bus interface on an Arduino @c TwoWire
+ *  @details Every transaction gives up after @c I2C_TIMEOUT_MS. A device which
+ *           stops answering in the middle of a read can leave SDA held low,
+ *           which no amount of retrying fixes, so after a bus error, a stuck
+ *           SDA line or a few failures in a row the bus is cleared by hand and
+ *           the controller started again.
+ */
+class WireBus : public I2CBus
+{
+protected:
+    TwoWire& wire;
+    int8_t sda_pin;
+    int8_t scl_pin;
+    uint32_t clock_hz;
+    uint8_t failures = 0;
+    uint32_t recoveries = 0;
+    uint32_t recovery_us = 0;
+
+    bool check(uint8_t error);
+public:
+    WireBus (TwoWire& a_wire, int8_t sda, int8_t scl, uint32_t clock);
+    bool begin(void);
+    bool recover(void);
+    uint32_t get_recoveries(void);
+    uint32_t get_recovery_us(void);
+    bool write_byte(uint8_t addr, uint8_t value);
+    bool write_reg(uint8_t addr, uint8_t reg, uint8_t value);
+    bool read_regs(uint8_t addr, uint8_t reg, uint8_t* p_buf, uint16_t len);
+    uint16_t max_read(void);
+};
+
+#endif // _I2C_BUS_H_
@@ -0,0 +1,89 @@
+/** @file i2c_mux.cpp
+ *  This program contains the classes for a TCA9548A I2C multiplexer, which lets
+ *  several MPU-6050s with the same address share one I2C bus by putting each
+ *  pair of them on their own channel.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "i2c_mux.h"
+
+/** @brief   Constructor which creates a multiplexer object
+ *  @param   a_bus The bus the multiplexer itself is on
+ *  @param   address I2C address of the multiplexer
+ */
+I2CMux::I2CMux (I2CBus& a_bus, uint8_t address)
+    : bus (a_bus), addr (address)
+{
+}
+
+/** @brief   Method which connects one channel, unless it is already connected
+ *  @details The TCA9548A has no registers, the byte written is the channel mask.
+ *  @param   channel Channel from 0 to 7
+ *  @return  True if the channel is connected
+ */
+bool I2CMux::select(uint8_t channel)
+{
+    if (current == channel){
+        return true;
+    }
+    current = -1;
+    if (!bus.write_byte(addr, 1 << channel)){
+        return false;
+    }
+    current = channel;
+    switches++;
+    return true;
+}
+
+/** @brief   Method which returns the bus the multiplexer is on
+ */
+I2CBus& I2CMux::get_bus(void)
+{
+    return bus;
+}
+
+/** @brief   Method which returns how many times the channel has been switched
+ */
+uint32_t I2CMux::get_switches(void)
+{
+    return switches;
+}
+
+/** @brief   Constructor which creates a bus for one multiplexer channel
+ *  @param   a_mux The multiplexer
+ *  @param   a_channel Channel the devices using this bus are wired to
+ */
+MuxChannelBus::MuxChannelBus (I2CMux& a_mux, uint8_t a_channel)
+    : mux (a_mux), channel (a_channel)
+{
+}
+
+/** @brief   Method which writes a byte to a device behind the multiplexer
+ */
+bool MuxChannelBus::write_byte(uint8_t addr, uint8_t value)
+{
+    return mux.select(channel) && mux.get_bus().write_byte(addr, value);
+}
+
+/** @brief   Method which writes a register on a device behind the multiplexer
+ */
+bool MuxChannelBus::write_reg(uint8_t addr, uint8_t reg, uint8_t value)
+{
+    return mux.select(channel) && mux.get_bus().write_reg(addr, reg, value);
+}
+
+/** @brief   Method which reads registers from a device behind the multiplexer
+ */
+bool MuxChannelBus::read_regs(uint8_t addr, uint8_t reg, uint8_t* p_buf, uint16_t len)
+{
+    return mux.select(channel) && mux.get_bus().read_regs(addr, reg, p_buf, len);
+}
+
+/** @brief   Method which returns the largest read of the bus underneath
+ */
+uint16_t MuxChannelBus::max_read(void)
+{
+    return mux.get_bus().max_read();
+}
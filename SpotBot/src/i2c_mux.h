@@ -0,0 +1,51 @@
+/** @file i2c_mux.h
+ *  This is the header for the I2C multiplexer file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _I2C_MUX_H_
+#define _I2C_MUX_H_
+
+#include <stdint.h>
+#include "i2c_bus.h"
+
+#define MUX_ADDR 0x70   ///< I2C address of the TCA9548A with A0-A2 tied low
+
+/** @brief   Class which drives a TCA9548A eight channel I2C multiplexer
+ *  @details The channel which is currently connected is remembered so that
+ *           talking to several registers on one channel only switches once.
+ */
+class I2CMux
+{
+protected:
+    I2CBus& bus;
+    uint8_t addr;
+    int8_t current = -1;
+    uint32_t switches = 0;
+public:
+    I2CMux (I2CBus& a_bus, uint8_t address);
+    bool select(uint8_t channel);
+    I2CBus& get_bus(void);
+    uint32_t get_switches(void);
+};
+
+/** @brief   Class which makes one channel of a multiplexer look like its own bus
+ *  @details Drivers are handed one of these instead of the real bus, and every
+ *           access selects the right channel first.
+ */
+class MuxChannelBus : public I2CBus
+{
+protected:
+    I2CMux& mux;
+    uint8_t channel;
+public:
+    MuxChannelBus (I2CMux& a_mux, uint8_t a_channel);
+    bool write_byte(uint8_t addr, uint8_t value);
+    bool write_reg(uint8_t addr, uint8_t reg, uint8_t value);
+    bool read_regs(uint8_t addr, uint8_t reg, uint8_t* p_buf, uint16_t len);
+    uint16_t max_read(void);
+};
+
+#endif // _I2C_MUX_H_
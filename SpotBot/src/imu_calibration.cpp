@@ -0,0 +1,260 @@
+/** @file imu_calibration.cpp
+ *  This program contains the automatic IMU calibration. While an IMU sits still
+ *  its gyro should read zero and its accelerometer should read exactly one g,
+ *  so averaging a still window gives the gyro bias and the accelerometer scale,
+ *  and the noise in the window sets the dead band. Every new window also adds a
+ *  point to a fit of accelerometer scale against temperature and to a fit of
+ *  the accelerometer bias over the orientations the IMU has been still in.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <math.h>
+#include "imu_calibration.h"
+
+#define GRAVITY 9.81f
+
+/** @brief   Fills in the calibration used before an IMU has ever been calibrated
+ *  @param   cal Calibration to fill in
+ *  @param   ticks_per_ms2 Hand tuned accelerometer scale
+ *  @param   dead_band_ms2 Hand tuned dead band
+ */
+void default_calibration(ImuCalibration& cal, float ticks_per_ms2, float dead_band_ms2)
+{
+    cal.version = CAL_VERSION;
+    cal.accel_scale = ticks_per_ms2;
+    cal.gyro_bias[0] = cal.gyro_bias[1] = cal.gyro_bias[2] = 0;
+    cal.accel_bias[0] = cal.accel_bias[1] = cal.accel_bias[2] = 0;
+    cal.dead_band = dead_band_ms2;
+    cal.temp_ref = 0;
+    cal.temp_slope = 0;
+    cal.fit_n = cal.fit_t = cal.fit_s = cal.fit_tt = cal.fit_ts = 0;
+    cal.fit_last = 0;
+    cal.bias_n = 0;
+    for (uint8_t i = 0; i < 10; i++){
+        cal.bias_ata[i] = 0;
+    }
+    for (uint8_t i = 0; i < 4; i++){
+        cal.bias_atb[i] = 0;
+    }
+}
+
+/** @brief   Adds a still window to the temperature fit and refits the slope
+ *  @details A point is only added once the temperature has moved, otherwise a
+ *           bar sitting in the rack would fill the fit with one temperature.
+ *           Once the fit is full every sum is scaled down before the new point
+ *           goes in, so old points fade out.
+ *  @param   cal Calibration holding the fit
+ *  @param   temp_c Temperature of the window, deg C
+ *  @param   scale Accelerometer scale measured in the window
+ */
+static void fit_temperature(ImuCalibration& cal, float temp_c, float scale)
+{
+    if (cal.fit_n > 0 && fabsf(temp_c - cal.fit_last) < CAL_TEMP_STEP){
+        return;
+    }
+    if (cal.fit_n >= CAL_FIT_MAX){
+        float keep = (CAL_FIT_MAX - 1) / cal.fit_n;
+        cal.fit_n *= keep;
+        cal.fit_t *= keep;
+        cal.fit_s *= keep;
+        cal.fit_tt *= keep;
+        cal.fit_ts *= keep;
+    }
+    cal.fit_n += 1;
+    cal.fit_t += temp_c;
+    cal.fit_s += scale;
+    cal.fit_tt += temp_c * temp_c;
+    cal.fit_ts += temp_c * scale;
+    cal.fit_last = temp_c;
+    float spread = cal.fit_n * cal.fit_tt - cal.fit_t * cal.fit_t;
+    if (cal.fit_n >= 2 && spread > cal.fit_n * cal.fit_n * CAL_TEMP_SPREAD * CAL_TEMP_SPREAD / 4){
+        cal.temp_slope = (cal.fit_n * cal.fit_ts - cal.fit_t * cal.fit_s) / spread;
+    }
+}
+
+/** @brief   Adds a still window to the accelerometer bias fit and solves it
+ *  @details With the bias b and the mean acceleration m in one g units,
+ *           |m - b|^2 = r^2 can be written as |m|^2 = 2 m.b + c, which is
+ *           linear in b and c. The 4x4 normal equations are solved by Gaussian
+ *           elimination. If the IMU has only been still in one orientation a
+ *           pivot comes out near zero and the bias is left as it was.
+ *  @param   cal Calibration holding the fit
+ *  @param   mean Mean accelerometer reading of the window, ticks
+ *  @return  True if the bias moved by more than @c CAL_BIAS_REFIT
+ */
+static bool fit_bias(ImuCalibration& cal, const float* mean)
+{
+    float row[4];
+    float y = 0;
+    for (uint8_t i = 0; i < 3; i++){
+        float u = mean[i] / CAL_SPHERE_UNIT;
+        row[i] = 2 * u;
+        y += u * u;
+    }
+    row[3] = 1;
+    if (cal.bias_n >= CAL_FIT_MAX){
+        float keep = (CAL_FIT_MAX - 1) / cal.bias_n;
+        cal.bias_n *= keep;
+        for (uint8_t k = 0; k < 10; k++){
+            cal.bias_ata[k] *= keep;
+        }
+        for (uint8_t i = 0; i < 4; i++){
+            cal.bias_atb[i] *= keep;
+        }
+    }
+    cal.bias_n += 1;
+    uint8_t k = 0;
+    for (uint8_t i = 0; i < 4; i++){
+        for (uint8_t j = i; j < 4; j++){
+            cal.bias_ata[k++] += row[i] * row[j];
+        }
+        cal.bias_atb[i] += row[i] * y;
+    }
+
+    // Unpacking into an augmented matrix and eliminating with partial pivoting
+    float a[4][5];
+    k = 0;
+    for (uint8_t i = 0; i < 4; i++){
+        for (uint8_t j = i; j < 4; j++){
+            a[i][j] = a[j][i] = cal.bias_ata[k++];
+        }
+        a[i][4] = cal.bias_atb[i];
+    }
+    for (uint8_t col = 0; col < 4; col++){
+        uint8_t best = col;
+        for (uint8_t r = col + 1; r < 4; r++){
+            if (fabsf(a[r][col]) > fabsf(a[best][col])){
+                best = r;
+            }
+        }
+        if (fabsf(a[best][col]) < CAL_BIAS_PIVOT * cal.bias_n){
+            return false;
+        }
+        for (uint8_t c = 0; c < 5; c++){
+            float swap = a[col][c];
+            a[col][c] = a[best][c];
+            a[best][c] = swap;
+        }
+        for (uint8_t r = 0; r < 4; r++){
+            if (r != col){
+                float f = a[r][col] / a[col][col];
+                for (uint8_t c = col; c < 5; c++){
+                    a[r][c] -= f * a[col][c];
+                }
+            }
+        }
+    }
+    float bias[3];
+    for (uint8_t i = 0; i < 3; i++){
+        bias[i] = a[i][4] / a[i][i] * CAL_SPHERE_UNIT;
+        if (fabsf(bias[i]) > CAL_BIAS_MAX){
+            return false;
+        }
+    }
+    bool moved = false;
+    for (uint8_t i = 0; i < 3; i++){
+        moved = moved || fabsf(bias[i] - cal.accel_bias[i]) > CAL_BIAS_REFIT;
+        cal.accel_bias[i] = bias[i];
+    }
+    return moved;
+}
+
+/** @brief   Finds the accelerometer scale at a given temperature
+ *  @param   cal Calibration of the IMU
+ *  @param   temp_c Temperature of the IMU in deg C
+ *  @return  Accelerometer ticks per m/s^2
+ */
+float scale_at(const ImuCalibration& cal, float temp_c)
+{
+    return cal.accel_scale + cal.temp_slope * (temp_c - cal.temp_ref);
+}
+
+/** @brief   Constructor which creates a calibrator
+ *  @param   window_samples Samples in one still window
+ */
+ImuCalibrator::ImuCalibrator (uint16_t window_samples)
+    : window (window_samples)
+{
+    restart();
+}
+
+/** @brief   Method which throws away the window collected so far
+ */
+void ImuCalibrator::restart(void)
+{
+    count = 0;
+    sum_temp = 0;
+    for (uint8_t i = 0; i < 6; i++){
+        sum[i] = 0;
+        sum_sq[i] = 0;
+    }
+}
+
+/** @brief   Method which adds a sample to the window
+ *  @param   s Raw sample from the IMU
+ *  @param   temp_c Temperature of the IMU in deg C
+ *  @return  True once the window is full
+ */
+bool ImuCalibrator::add(const ImuSample& s, float temp_c)
+{
+    const int16_t values[6] = {s.accel_x, s.accel_y, s.accel_z, s.gyro_x, s.gyro_y, s.gyro_z};
+    for (uint8_t i = 0; i < 6; i++){
+        sum[i] += values[i];
+        sum_sq[i] += (int32_t)values[i] * values[i];
+    }
+    sum_temp += temp_c;
+    count++;
+    return count >= window;
+}
+
+/** @brief   Method which turns a full window into a new calibration
+ *  @details The gyro bias is the mean gyro reading and the accelerometer scale
+ *           is the size of the mean acceleration, less the bias, divided by one
+ *           g. If any axis was too noisy the window is rejected. Either way a
+ *           new window is started.
+ *  @param   cal Calibration to update; the fit sums are carried on
+ *  @return  True if the window was still and @c cal was updated
+ */
+bool ImuCalibrator::finish(ImuCalibration& cal)
+{
+    float mean[6];
+    float std[6];
+    for (uint8_t i = 0; i < 6; i++){
+        // Done in double once per window, the sums are too big for float
+        double m = (double)sum[i] / count;
+        double var = (double)sum_sq[i] / count - m * m;
+        mean[i] = m;
+        std[i] = var > 0 ? sqrt(var) : 0;
+    }
+    float temp_c = sum_temp / count;
+    restart();
+
+    float accel_std = sqrtf(std[0]*std[0] + std[1]*std[1] + std[2]*std[2]);
+    float gyro_std = sqrtf(std[3]*std[3] + std[4]*std[4] + std[5]*std[5]);
+    if (accel_std > CAL_ACCEL_STD || gyro_std > CAL_GYRO_STD){
+        return false;
+    }
+
+    // Scales measured against a very different bias don't belong in the same temperature fit
+    if (fit_bias(cal, mean)){
+        cal.fit_n = cal.fit_t = cal.fit_s = cal.fit_tt = cal.fit_ts = 0;
+    }
+    float g[3];
+    for (uint8_t i = 0; i < 3; i++){
+        g[i] = mean[i] - cal.accel_bias[i];
+    }
+    float scale = sqrtf(g[0]*g[0] + g[1]*g[1] + g[2]*g[2]) / GRAVITY;
+    cal.version = CAL_VERSION;
+    cal.accel_scale = scale;
+    cal.temp_ref = temp_c;
+    for (uint8_t i = 0; i < 3; i++){
+        cal.gyro_bias[i] = mean[3 + i];
+    }
+    float dead_band = CAL_DEAD_BAND_SIGMAS * accel_std / scale;
+    cal.dead_band = dead_band < CAL_DEAD_BAND_MIN ? CAL_DEAD_BAND_MIN
+                  : dead_band > CAL_DEAD_BAND_MAX ? CAL_DEAD_BAND_MAX : dead_band;
+    fit_temperature(cal, temp_c, scale);
+    return true;
+}
@@ -0,0 +1,85 @@
+/** @file imu_calibration.h
+ *  This is the header for the IMU calibration file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _IMU_CALIBRATION_H_
+#define _IMU_CALIBRATION_H_
+
+#include <stdint.h>
+#include "imu_driver.h"
+
+#define CAL_VERSION 2            ///< Bumped whenever ImuCalibration changes layout
+#define CAL_ACCEL_STD 200.0f     ///< Largest accelerometer noise for a still window, ticks
+#define CAL_GYRO_STD 100.0f      ///< Largest gyro noise for a still window, ticks
+#define CAL_DEAD_BAND_SIGMAS 4.0f ///< Dead band as a multiple of the accelerometer noise
+#define CAL_DEAD_BAND_MIN 0.05f  ///< Smallest dead band, m/s^2
+#define CAL_DEAD_BAND_MAX 0.5f   ///< Largest dead band, m/s^2
+#define CAL_TEMP_SPREAD 2.0f     ///< Temperature spread needed before a slope is fit, deg C
+#define CAL_TEMP_STEP 0.5f       ///< Temperature change needed before another point goes into the fit, deg C
+#define CAL_FIT_MAX 50.0f        ///< Points the fits remember; older ones fade out so aging is followed
+#define CAL_SPHERE_UNIT 16384.0f ///< Accelerometer ticks the bias fit is scaled by, about one g
+#define CAL_BIAS_PIVOT 0.2f      ///< Smallest pivot per point before the bias fit is trusted
+#define CAL_BIAS_MAX 1600.0f     ///< Largest believable accelerometer bias, ticks (about 0.1 g)
+#define CAL_BIAS_REFIT 50.0f     ///< Bias change after which the temperature fit starts over, ticks
+
+/** @brief   Calibration of one IMU, as stored in NVS
+ *  @details The accelerometer scale drifts with temperature, so it is stored
+ *           at a reference temperature along with a slope. The slope is a
+ *           least squares fit of still windows at different temperatures, kept
+ *           as running sums so no history has to be stored. Each axis of the
+ *           accelerometer also has a bias, found by fitting a sphere to the
+ *           still windows: wherever the IMU points, the mean acceleration less
+ *           the bias should be one g long. That can only be solved once the IMU
+ *           has been seen still in several orientations, until then the bias
+ *           stays at zero. Both fits forget old points so the sums can't grow
+ *           without bound and they follow the sensor as it ages.
+ */
+struct ImuCalibration
+{
+    uint16_t version;
+    float accel_scale;      ///< Accelerometer ticks per m/s^2 at @c temp_ref
+    float gyro_bias[3];     ///< Gyro reading when still, ticks
+    float accel_bias[3];    ///< Accelerometer reading with no acceleration, ticks
+    float dead_band;        ///< Accelerations below this are noise, m/s^2
+    float temp_ref;         ///< Temperature @c accel_scale was measured at, deg C
+    float temp_slope;       ///< Change in @c accel_scale per deg C
+    float fit_n;            ///< Running sums for the temperature fit
+    float fit_t;
+    float fit_s;
+    float fit_tt;
+    float fit_ts;
+    float fit_last;         ///< Temperature of the last point in the fit, deg C
+    float bias_n;           ///< Running sums for the bias fit, upper triangle of the
+    float bias_ata[10];     ///  normal matrix row by row and the right hand side
+    float bias_atb[4];
+};
+
+/** @brief   Class which measures an IMU's calibration from a still window
+ *  @details Samples are summed until a full window is in. If the window was
+ *           noisy the bar was moving, so it is thrown away and a new one starts.
+ *           A window is judged by its own spread rather than by the current
+ *           calibration, so a badly calibrated IMU can still be calibrated.
+ */
+class ImuCalibrator
+{
+protected:
+    uint16_t window;
+    uint16_t count = 0;
+    int64_t sum[6];
+    int64_t sum_sq[6];
+    float sum_temp = 0;
+public:
+    ImuCalibrator (uint16_t window_samples);
+    void restart(void);
+    bool add(const ImuSample& s, float temp_c);
+    bool finish(ImuCalibration& cal);
+};
+
+void default_calibration(ImuCalibration& cal, float ticks_per_ms2, float dead_band_ms2);
+
+float scale_at(const ImuCalibration& cal, float temp_c);
+
+#endif // _IMU_CALIBRATION_H_
@@ -0,0 +1,229 @@
+/** @file imu_driver.cpp
+ *  This program contains the register level driver shared by the MPU-6050 style
+ *  IMUs. Besides waking the chip up it sets the low pass filter, full scale
+ *  ranges and output data rate, and can queue samples in the on-chip FIFO. The
+ *  FIFO is then drained in bulk reads every so often, which uses far less of
+ *  the bus than addressing the chip for every sample and lets the IMU task
+ *  sleep between reads.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "imu_driver.h"
+
+/** @brief   Constructor which creates the shared part of an IMU driver
+ *  @param   fifo_bytes Size of the FIFO inside the chip
+ */
+ImuDriver::ImuDriver (uint16_t fifo_bytes)
+    : fifo_size (fifo_bytes)
+{
+}
+
+/** @brief   Method which wakes up the IMU
+ *  @return  True if the chip acknowledged
+ */
+bool ImuDriver::begin(void)
+{
+    return write_reg(MPU_PWR_MGMT_1, 0);
+}
+
+/** @brief   Method which writes every setting in a configuration and starts the FIFO
+ *  @return  True if every register write was acknowledged
+ */
+bool ImuDriver::configure(const ImuConfig& config)
+{
+    bool ok = set_dlpf(config.dlpf);
+    ok = ok && set_rate_div(config.rate_div);
+    ok = ok && set_accel_range(config.accel_range);
+    ok = ok && set_gyro_range(config.gyro_range);
+    ok = ok && begin_fifo(config.gyro_fifo);
+    return ok;
+}
+
+/** @brief   Method which sets the digital low pass filter
+ *  @param   dlpf DLPF_CFG from 0 (260 Hz, 8 kHz sample clock) to 6 (5 Hz)
+ */
+bool ImuDriver::set_dlpf(uint8_t dlpf)
+{
+    return write_reg(MPU_CONFIG, dlpf & 0x07);
+}
+
+/** @brief   Method which sets the sample rate divider
+ *  @param   rate_div Output data rate is the sample clock divided by 1 + @c rate_div
+ */
+bool ImuDriver::set_rate_div(uint8_t rate_div)
+{
+    return write_reg(MPU_SMPLRT_DIV, rate_div);
+}
+
+/** @brief   Method which sets the accelerometer full scale range
+ *  @param   range 0 for +-2 g up to 3 for +-16 g
+ */
+bool ImuDriver::set_accel_range(uint8_t range)
+{
+    return write_reg(MPU_ACCEL_CONFIG, (range & 0x03) << 3);
+}
+
+/** @brief   Method which sets the gyro full scale range
+ *  @param   range 0 for +-250 deg/s up to 3 for +-2000 deg/s
+ */
+bool ImuDriver::set_gyro_range(uint8_t range)
+{
+    return write_reg(MPU_GYRO_CONFIG, (range & 0x03) << 3);
+}
+
+/** @brief   Method which decodes one big endian frame of sensor registers
+ *  @param   p_frame Accelerometer bytes, followed by gyro bytes
+ *  @param   sample Sample the values are decoded into
+ *  @param   gyro_follows True if the gyro bytes come right after the accelerometer
+ */
+void ImuDriver::decode(const uint8_t* p_frame, ImuSample& sample, bool gyro_follows)
+{
+    sample.accel_x = (int16_t)(p_frame[0] << 8 | p_frame[1]);
+    sample.accel_y = (int16_t)(p_frame[2] << 8 | p_frame[3]);
+    sample.accel_z = (int16_t)(p_frame[4] << 8 | p_frame[5]);
+    if (gyro_follows){
+        sample.gyro_x = (int16_t)(p_frame[6] << 8 | p_frame[7]);
+        sample.gyro_y = (int16_t)(p_frame[8] << 8 | p_frame[9]);
+        sample.gyro_z = (int16_t)(p_frame[10] << 8 | p_frame[11]);
+    }
+    else{
+        sample.gyro_x = sample.gyro_y = sample.gyro_z = 0;
+    }
+}
+
+/** @brief   Method which reads the newest sample straight from the data registers
+ *  @details The accelerometer, temperature and gyro registers are read in one
+ *           burst and the temperature is skipped.
+ *  @return  True if the read went through
+ */
+bool ImuDriver::read_sample(ImuSample& sample)
+{
+    uint8_t buf[14];
+    if (!read_regs(MPU_ACCEL_XOUT_H, buf, 14)){
+        return false;
+    }
+    decode(buf, sample, false);
+    ImuSample gyro;
+    decode(buf + 2, gyro, true);
+    sample.gyro_x = gyro.gyro_x;
+    sample.gyro_y = gyro.gyro_y;
+    sample.gyro_z = gyro.gyro_z;
+    return true;
+}
+
+/** @brief   Method which reads the temperature of the chip
+ *  @details The MPU-60x0 conversion is used for every part; on the ICM-20689
+ *           this is offset by a few degrees, which doesn't matter since the
+ *           temperature is only compared against earlier readings of itself.
+ *  @param   temp_c Filled with the temperature in deg C
+ *  @return  True if the read went through
+ */
+bool ImuDriver::read_temperature(float& temp_c)
+{
+    uint8_t buf[2];
+    if (!read_regs(MPU_TEMP_OUT_H, buf, 2)){
+        return false;
+    }
+    temp_c = (int16_t)(buf[0] << 8 | buf[1]) / 340.0f + 36.53f;
+    return true;
+}
+
+/** @brief   Method which starts queueing samples in the FIFO at the output data rate
+ *  @param   gyro True to queue the gyro axes along with the accelerometer
+ *  @return  True if every register write was acknowledged
+ */
+bool ImuDriver::begin_fifo(bool gyro)
+{
+    with_gyro = gyro;
+    frame_size = with_gyro ? 12 : 6;
+    bool ok = write_reg(MPU_FIFO_EN, with_gyro ? MPU_FIFO_ACCEL | MPU_FIFO_GYRO : MPU_FIFO_ACCEL);
+    ok = ok && reset_fifo();
+    return ok;
+}
+
+/** @brief   Method which throws away everything in the FIFO and restarts it
+ *  @details Reading INT_STATUS afterwards clears a stale overflow flag.
+ */
+bool ImuDriver::reset_fifo(void)
+{
+    uint8_t status;
+    bool ok = write_reg(MPU_USER_CTRL, user_ctrl);
+    ok = ok && write_reg(MPU_USER_CTRL, user_ctrl | MPU_USER_FIFO_RST);
+    ok = ok && write_reg(MPU_USER_CTRL, user_ctrl | MPU_USER_FIFO_EN);
+    ok = ok && read_regs(MPU_INT_STATUS, &status, 1);
+    return ok;
+}
+
+/** @brief   Method which makes the INT pin pulse every time a sample is taken
+ *  @details INT is set active high, push-pull with a 50 us pulse, which is
+ *           what the data ready interrupt on the ESP32 is attached to.
+ *  @return  True if both register writes were acknowledged
+ */
+bool ImuDriver::enable_data_ready(void)
+{
+    bool ok = write_reg(MPU_INT_PIN_CFG, 0);
+    ok = ok && write_reg(MPU_INT_ENABLE, MPU_DATA_RDY_EN);
+    return ok;
+}
+
+/** @brief   Method which finds how many whole samples are waiting in the FIFO
+ *  @details If the FIFO overflowed the oldest bytes were overwritten and the
+ *           frames are no longer lined up, so the FIFO is reset and counted as
+ *           an overflow. The same is done if the byte count isn't a whole
+ *           number of frames.
+ *  @return  Number of samples ready, or -1 if the chip could not be read
+ */
+int16_t ImuDriver::fifo_samples(void)
+{
+    uint8_t status;
+    uint8_t buf[2];
+    if (!read_regs(MPU_INT_STATUS, &status, 1)){
+        return -1;
+    }
+    if (!read_regs(MPU_FIFO_COUNT_H, buf, 2)){
+        return -1;
+    }
+    uint16_t count = buf[0] << 8 | buf[1];
+    if ((status & MPU_FIFO_OFLOW) || count >= fifo_size || count % frame_size){
+        overflows++;
+        reset_fifo();
+        return 0;
+    }
+    return count / frame_size;
+}
+
+/** @brief   Method which drains samples out of the FIFO in as few reads as the
+ *           bus allows
+ *  @details The caller asks @c fifo_samples() first so that the count is only
+ *           read once per drain; asking for more than that returns junk.
+ *  @param   p_samples Array the samples are decoded into
+ *  @param   todo Number of samples to read; any more are left in the FIFO
+ *  @return  Number of samples which were read
+ */
+uint16_t ImuDriver::read_fifo(ImuSample* p_samples, uint16_t todo)
+{
+    uint16_t per_read = (max_read() < IMU_BURST_BYTES ? max_read() : IMU_BURST_BYTES) / frame_size;
+    uint16_t done = 0;
+    while (done < todo){
+        uint16_t n = todo - done < per_read ? todo - done : per_read;
+        if (!read_regs(MPU_FIFO_R_W, burst, n * frame_size)){
+            // A partial read leaves the FIFO misaligned so start over clean
+            reset_fifo();
+            break;
+        }
+        for (uint16_t i = 0; i < n; i++){
+            decode(burst + i * frame_size, p_samples[done + i], with_gyro);
+        }
+        done += n;
+    }
+    return done;
+}
+
+/** @brief   Method which returns how many times the FIFO has had to be reset
+ */
+uint32_t ImuDriver::get_overflows(void)
+{
+    return overflows;
+}
@@ -0,0 +1,106 @@
+/** @file imu_driver.h
+ *  This is the header for the IMU driver file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _IMU_DRIVER_H_
+#define _IMU_DRIVER_H_
+
+#include <stdint.h>
+
+#define MPU_SMPLRT_DIV   0x19
+#define MPU_CONFIG       0x1A
+#define MPU_GYRO_CONFIG  0x1B
+#define MPU_ACCEL_CONFIG 0x1C
+#define MPU_FIFO_EN      0x23
+#define MPU_INT_PIN_CFG  0x37
+#define MPU_INT_ENABLE   0x38
+#define MPU_INT_STATUS   0x3A
+#define MPU_ACCEL_XOUT_H 0x3B
+#define MPU_TEMP_OUT_H   0x41
+#define MPU_USER_CTRL    0x6A
+#define MPU_PWR_MGMT_1   0x6B
+#define MPU_FIFO_COUNT_H 0x72
+#define MPU_FIFO_R_W     0x74
+#define MPU_WHO_AM_I     0x75
+
+#define MPU_FIFO_ACCEL   0x08   ///< FIFO_EN bit for all three accelerometer axes
+#define MPU_FIFO_GYRO    0x70   ///< FIFO_EN bits for all three gyro axes
+#define MPU_FIFO_OFLOW   0x10   ///< INT_STATUS bit set when the FIFO overflowed
+#define MPU_DATA_RDY_EN  0x01   ///< INT_ENABLE bit which pulses INT for every sample
+#define MPU_USER_FIFO_EN 0x40   ///< USER_CTRL bit which turns the FIFO on
+#define MPU_USER_I2C_DIS 0x10   ///< USER_CTRL bit which turns off the I2C interface on SPI parts
+#define MPU_USER_FIFO_RST 0x04  ///< USER_CTRL bit which clears the FIFO
+
+#define IMU_BURST_BYTES 240     ///< Largest single FIFO read, 20 frames with gyro
+
+/** @brief   One sample from an IMU in raw ticks
+ *  @details The hardware can only queue all three accelerometer axes together,
+ *           so x and y come along with z. Gyro values are left at zero unless
+ *           the FIFO was started with the gyro enabled.
+ */
+struct ImuSample
+{
+    int16_t accel_x;
+    int16_t accel_y;
+    int16_t accel_z;
+    int16_t gyro_x;
+    int16_t gyro_y;
+    int16_t gyro_z;
+};
+
+/** @brief   Settings written into an IMU when it is started
+ *  @details The output data rate is 1 kHz/(1 + @c rate_div) when the digital
+ *           low pass filter is on (@c dlpf 1 to 6) and 8 kHz/(1 + @c rate_div)
+ *           when it is off. Ranges go from 0 (+-2 g, +-250 deg/s) to 3 (+-16 g,
+ *           +-2000 deg/s); the calibration constants assume range 0.
+ */
+struct ImuConfig
+{
+    uint8_t dlpf;
+    uint8_t rate_div;
+    uint8_t accel_range;
+    uint8_t gyro_range;
+    bool gyro_fifo;
+};
+
+/** @brief   Class which runs an InvenSense MPU-6050 style IMU at the register level
+ *  @details The MPU-6050, MPU-6000 and ICM-20689 share one register map, so the
+ *           configuration and FIFO handling live here and each backend only has
+ *           to say how to write a register and read a block of registers.
+ */
+class ImuDriver
+{
+protected:
+    uint16_t fifo_size;
+    uint8_t user_ctrl = 0;
+    uint8_t frame_size = 6;
+    bool with_gyro = false;
+    uint32_t overflows = 0;
+    uint8_t burst[IMU_BURST_BYTES];
+
+    virtual bool write_reg(uint8_t reg, uint8_t value) = 0;
+    virtual bool read_regs(uint8_t reg, uint8_t* p_buf, uint16_t len) = 0;
+    virtual uint16_t max_read(void) = 0;
+    void decode(const uint8_t* p_frame, ImuSample& sample, bool gyro_follows);
+public:
+    ImuDriver (uint16_t fifo_bytes);
+    virtual bool begin(void);
+    bool configure(const ImuConfig& config);
+    bool set_dlpf(uint8_t dlpf);
+    bool set_rate_div(uint8_t rate_div);
+    bool set_accel_range(uint8_t range);
+    bool set_gyro_range(uint8_t range);
+    bool read_sample(ImuSample& sample);
+    bool read_temperature(float& temp_c);
+    bool begin_fifo(bool gyro);
+    bool reset_fifo(void);
+    bool enable_data_ready(void);
+    int16_t fifo_samples(void);
+    uint16_t read_fifo(ImuSample* p_samples, uint16_t todo);
+    uint32_t get_overflows(void);
+};
+
+#endif // _IMU_DRIVER_H_
@@ -0,0 +1,99 @@
+/** @file imu_spi.cpp
+ *  This program contains the SPI backend of the IMU driver. Registers are
+ *  written slowly as the data sheets ask, while the FIFO is read in long bursts
+ *  at a much faster clock with the chip select held low the whole time.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <Arduino.h>
+#include <SPI.h>
+#include "imu_spi.h"
+
+#define SPI_READ 0x80   ///< Set in the register address to read instead of write
+#define PWR_SELF_CLEARING 0x80  ///< PWR_MGMT_1 bit which reads back as zero (device reset)
+#define USER_SELF_CLEARING 0x07 ///< USER_CTRL bits which read back as zero (FIFO and signal resets)
+
+/** @brief   Constructor which creates an SPI IMU object
+ *  @param   a_spi The SPI controller (already started) the chip is on
+ *  @param   cs Chip select pin of the IMU
+ *  @param   fifo_bytes Size of the chip's FIFO, e.g. @c ICM20689_FIFO_SIZE
+ *  @param   id WHO_AM_I the chip must answer with, e.g. @c ICM20689_ID
+ *  @param   read_hz SPI clock used for reading data
+ */
+ImuSpi::ImuSpi (SPIClass& a_spi, uint8_t cs, uint16_t fifo_bytes, uint8_t id, uint32_t read_hz)
+    : ImuDriver (fifo_bytes), spi (a_spi), cs_pin (cs), chip_id (id), fast_hz (read_hz)
+{
+}
+
+/** @brief   Method which wakes the IMU up with its I2C interface turned off
+ *  @details The I2C interface is turned off first so that SPI traffic on the
+ *           shared pins can't be taken as I2C, and it is kept off every time the
+ *           FIFO is reset.
+ *  @return  False if the chip didn't answer with the right WHO_AM_I or a
+ *           register didn't read back as written
+ */
+bool ImuSpi::begin(void)
+{
+    pinMode(cs_pin, OUTPUT);
+    digitalWrite(cs_pin, HIGH);
+    user_ctrl = MPU_USER_I2C_DIS;
+    bool ok = write_reg(MPU_USER_CTRL, user_ctrl);
+    ok = ok && read_slow(MPU_WHO_AM_I) == chip_id;
+    return ImuDriver::begin() && ok;
+}
+
+/** @brief   Method which reads one register at the slow configuration clock
+ */
+uint8_t ImuSpi::read_slow(uint8_t reg)
+{
+    spi.beginTransaction(SPISettings(IMU_SPI_SLOW_HZ, MSBFIRST, SPI_MODE3));
+    digitalWrite(cs_pin, LOW);
+    spi.transfer(reg | SPI_READ);
+    uint8_t value = spi.transfer(0);
+    digitalWrite(cs_pin, HIGH);
+    spi.endTransaction();
+    return value;
+}
+
+/** @brief   Method which writes one register at the slow configuration clock
+ *  @details The register is read back to stand in for the acknowledge SPI
+ *           doesn't have. Reset bits clear themselves, so they aren't compared.
+ *  @return  False if the register didn't read back as written
+ */
+bool ImuSpi::write_reg(uint8_t reg, uint8_t value)
+{
+    spi.beginTransaction(SPISettings(IMU_SPI_SLOW_HZ, MSBFIRST, SPI_MODE3));
+    digitalWrite(cs_pin, LOW);
+    spi.transfer(reg);
+    spi.transfer(value);
+    digitalWrite(cs_pin, HIGH);
+    spi.endTransaction();
+    uint8_t mask = reg == MPU_PWR_MGMT_1 ? ~PWR_SELF_CLEARING
+                 : reg == MPU_USER_CTRL ? ~USER_SELF_CLEARING : 0xFF;
+    return (read_slow(reg) & mask) == (value & mask);
+}
+
+/** @brief   Method which reads a block of registers in one burst
+ *  @details Nothing on the bus says if the chip answered, so this can't fail;
+ *           see the class description for how a dead chip is caught.
+ */
+bool ImuSpi::read_regs(uint8_t reg, uint8_t* p_buf, uint16_t len)
+{
+    spi.beginTransaction(SPISettings(fast_hz, MSBFIRST, SPI_MODE3));
+    digitalWrite(cs_pin, LOW);
+    spi.transfer(reg | SPI_READ);
+    memset(p_buf, 0, len);
+    spi.transfer(p_buf, len); // Data is read back into the same buffer
+    digitalWrite(cs_pin, HIGH);
+    spi.endTransaction();
+    return true;
+}
+
+/** @brief   Method which returns the largest burst; SPI has no limit of its own
+ */
+uint16_t ImuSpi::max_read(void)
+{
+    return IMU_BURST_BYTES;
+}
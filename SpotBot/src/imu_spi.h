@@ -0,0 +1,51 @@
+/** @file imu_spi.h
+ *  This is the header for the SPI IMU driver file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _IMU_SPI_H_
+#define _IMU_SPI_H_
+
+#include <stdint.h>
+#include "imu_driver.h"
+
+#define MPU6000_FIFO_SIZE 1024   ///< Bytes of FIFO inside the MPU-6000
+#define ICM20689_FIFO_SIZE 4096  ///< Bytes of FIFO inside the ICM-20689
+#define MPU6000_ID 0x68          ///< WHO_AM_I of the MPU-6000
+#define ICM20689_ID 0x98         ///< WHO_AM_I of the ICM-20689
+#define IMU_SPI_SLOW_HZ 1000000  ///< SPI clock for configuration registers
+#define IMU_SPI_FAST_HZ 8000000  ///< SPI clock for reading data and the FIFO
+
+class SPIClass;
+
+/** @brief   Class which runs an MPU-6000 or ICM-20689 over SPI
+ *  @details These parts are register compatible with the MPU-6050 but can be
+ *           read at several MHz, which is what multi-kHz output data rates need.
+ *           SPI has no acknowledge, so a missing or dead chip can't fail a
+ *           transfer the way it does on I2C. Instead the chip has to answer
+ *           with the right WHO_AM_I when it is started and every register
+ *           written is read back, so configuring and resetting the FIFO fail
+ *           the same way they do on I2C. Data reads can't be checked, so a chip
+ *           that dies while streaming shows up in its health score, and then
+ *           fails at the next FIFO reset.
+ */
+class ImuSpi : public ImuDriver
+{
+protected:
+    SPIClass& spi;
+    uint8_t cs_pin;
+    uint8_t chip_id;
+    uint32_t fast_hz;
+
+    uint8_t read_slow(uint8_t reg);
+    bool write_reg(uint8_t reg, uint8_t value);
+    bool read_regs(uint8_t reg, uint8_t* p_buf, uint16_t len);
+    uint16_t max_read(void);
+public:
+    ImuSpi (SPIClass& a_spi, uint8_t cs, uint16_t fifo_bytes, uint8_t id, uint32_t read_hz = IMU_SPI_FAST_HZ);
+    bool begin(void);
+};
+
+#endif // _IMU_SPI_H_
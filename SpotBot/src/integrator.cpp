@@ -0,0 +1,62 @@
+/** @file integrator.cpp
+ *  This program contains a trapezoid rule integrator used to turn acceleration
+ *  into velocity. Every input comes with the time it was measured, so samples
+ *  which arrive late or early because of task jitter or Wi-Fi still add the
+ *  right area instead of assuming a fixed 1 ms between samples. All of the math
+ *  is done in integers so the sum doesn't lose resolution as it grows.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "integrator.h"
+
+/// Sum units per output unit: microseconds per second times two for the trapezoid
+#define SUM_PER_UNIT 2000000LL
+/// Longest gap between samples which is still integrated across
+#define MAX_GAP_US 50000
+
+/** @brief   Constructor which creates an integrator starting at zero
+ */
+Integrator::Integrator (void)
+{
+}
+
+/** @brief   Method which adds one sample to the integral
+ *  @details The first sample only sets the starting point since there is no
+ *           previous sample to make a trapezoid with. The same goes for the
+ *           first sample after the sensor dropped out for more than
+ *           @c MAX_GAP_US, since nothing is known about what happened during
+ *           the gap.
+ *  @param   input Value of the signal being integrated in micro units
+ *  @param   time_us Time the value was measured in microseconds
+ *  @return  The integral after this sample in micro units
+ */
+int32_t Integrator::update(int32_t input, int64_t time_us)
+{
+    if (primed && time_us - last_time <= MAX_GAP_US){
+        sum += ((int64_t)input + last_input) * (time_us - last_time);
+    }
+    primed = true;
+    last_input = input;
+    last_time = time_us;
+    return get();
+}
+
+/** @brief   Method which sets the integral to a new value
+ *  @details The last sample is kept so the next one still integrates over the
+ *           real time between them.
+ *  @param   new_value New value of the integral in micro units
+ */
+void Integrator::reset(int32_t new_value)
+{
+    sum = (int64_t)new_value * SUM_PER_UNIT;
+}
+
+/** @brief   Method which returns the current value of the integral
+ *  @return  The integral in micro units
+ */
+int32_t Integrator::get(void)
+{
+    return (int32_t)(sum / SUM_PER_UNIT);
+}
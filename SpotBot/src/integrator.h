@@ -0,0 +1,33 @@
+/** @file integrator.h
+ *  This is the header for the integrator file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _INTEGRATOR_H_
+#define _INTEGRATOR_H_
+
+#include <stdint.h>
+
+/** @brief   Class which integrates a timestamped signal with the trapezoid rule
+ *  @details Inputs and outputs are in micro units (um/s^2 in, um/s out when
+ *           integrating acceleration). The running sum is kept in 64 bits in
+ *           units of input times microseconds times two, so no low bits are
+ *           ever thrown away between samples.
+ */
+class Integrator
+{
+protected:
+    int64_t sum = 0;
+    int32_t last_input = 0;
+    int64_t last_time = 0;
+    bool primed = false;
+public:
+    Integrator (void);
+    int32_t update(int32_t input, int64_t time_us);
+    void reset(int32_t new_value);
+    int32_t get(void);
+};
+
+#endif // _INTEGRATOR_H_
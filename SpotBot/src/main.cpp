@@ -13,114 +13,396 @@
 #include <Arduino.h>
 #include <PrintStream.h>
 #include <Wire.h>
+#include <SPI.h>
 #include <cstdlib>
 #include "taskqueue.h"
 #include "shares.h"
 #include "task_spot.h"
 #include "task_motor.h"
 #include "task_webserver.h"
+#include "esp_timer.h"
+#include "i2c_bus.h"
+#include "i2c_mux.h"
+#include "imu_driver.h"
+#include "mpu6050.h"
+#include "imu_spi.h"
+#include "sample_clock.h"
+#include "sensor_array.h"
+#include "velocity_estimator.h"
+#include "imu_calibration.h"
+#include "calibration_store.h"
+#include "sample_history.h"
+#include "session_store.h"
+#include "velocity_fusion.h"
+#include "tilt_monitor.h"
+#include "stall_predictor.h"
+#include "phase_classifier.h"
+
+// #define USE_DUAL_I2C to put IMU 2 on the second I2C controller and read both IMUs at
+// the same time from the two cores, or #undef USE_DUAL_I2C to read both IMUs one after
+// the other on the same bus
+#define USE_DUAL_I2C
+
+// #define USE_IMU_MUX to run the bar IMUs and a bench IMU behind a TCA9548A multiplexer
+// on the first I2C controller, or #undef USE_IMU_MUX for the two bar IMUs on their own
+#undef USE_IMU_MUX
+
+// #define USE_SPI_IMU to use MPU-6000/ICM-20689 IMUs on SPI sampling at 4 kHz, or
+// #undef USE_SPI_IMU for MPU-6050s on I2C sampling at 1 kHz
+#undef USE_SPI_IMU
+
+// #define MEASURE_STACK to print the least stack each task has had left, which the stack
+// sizes above should keep well clear of, or #undef MEASURE_STACK for normal use
+#undef MEASURE_STACK
+
+#if defined(USE_IMU_MUX) && defined(USE_DUAL_I2C)
+#error "The IMU multiplexer is only wired to the first I2C controller"
+#endif
+#if defined(USE_SPI_IMU) && (defined(USE_IMU_MUX) || defined(USE_DUAL_I2C))
+#error "SPI IMUs replace the I2C IMUs, #undef USE_IMU_MUX and USE_DUAL_I2C"
+#endif
+
+#define SDA1 21            ///< SDA pin of the first I2C controller
+#define SCL1 22            ///< SCL pin of the first I2C controller
+#define SDA2 25            ///< SDA pin of the second I2C controller
+#define SCL2 26            ///< SCL pin of the second I2C controller
+#define CS_PIN 5           ///< Chip select of IMU 1 when it is on SPI
+#define CS_PIN2 15         ///< Chip select of IMU 2 when it is on SPI
+#define INT_PIN 32         ///< GPIO connected to the INT pin of IMU 1
+#define INT_PIN2 33        ///< GPIO connected to the INT pin of IMU 2
+#define I2C_HZ 400000      ///< I2C clock, fast enough for two IMU FIFOs on one bus
+#ifdef USE_SPI_IMU
+#define SAMPLE_HZ 4000     ///< IMU output data rate during a rep
+#define IDLE_HZ 500        ///< IMU output data rate while the bar sits in the rack
+#define FIFO_DRAIN 20      ///< Samples taken by IMU 1 between FIFO drains (5 ms)
+#else
+#define SAMPLE_HZ 1000     ///< IMU output data rate during a rep
+#define IDLE_HZ 200        ///< IMU output data rate while the bar sits in the rack
+#define FIFO_DRAIN 10      ///< Samples taken by IMU 1 between FIFO drains (10 ms)
+#endif
+#define SAMPLE_US (1000000/SAMPLE_HZ) ///< Time between IMU samples
+#define FIFO_TIMEOUT_DRAINS 2 ///< Drains worth of time to wait if an interrupt is missed
+#define PUBLISH_TIMEOUT_MS 150 ///< Longest time between velocity updates even if IMUs stop
+#define CAL_SAMPLES SAMPLE_HZ ///< Samples in a still window used for calibration (1 s)
+#define DECIMATION (SAMPLE_HZ/100) ///< Samples per integration step, 100 Hz control rate
+#define IMU_STACK 6144     ///< Stack of task_IMU, which also writes calibrations to NVS and prints floats
+#define IMU2_STACK 3072    ///< Stack of task_IMU2, which only drains the second controller
+#define SPOT_STACK 4096    ///< Stack of task_spot, which prints floats and works out the rep summaries
+#define MOTOR_STACK 3072   ///< Stack of task_motor
+#define WEB_STACK 8192     ///< Stack of task_webserver
+#define STACK_REPORT 50    ///< Publishes between stack reports (5 s)
 
 const int MPU_ADDR = 0x68; // I2C address of the MPU-6050. If AD0 pin is set to HIGH, the I2C address will be 0x69.
 const int MPU_ADDR2 = 0x69;
-float calib_const = 1825.5; // Calibrating IMU 1 acceleration to m/s^2
-float calib_const2 = 1485.2; // Calibrating IMU 2 acceleration to m/s^2
-float thresh = 0.3; // Threshold to get rid of acceleration noise when IMU isn't moving
+float calib_const = 1825.5; // Calibrating IMU 1 acceleration to m/s^2 until it has calibrated itself
+float calib_const2 = 1485.2; // Calibrating IMU 2 acceleration to m/s^2 until it has calibrated itself
+float thresh = 0.3; // Threshold to get rid of acceleration noise until the IMUs have calibrated themselves
 float vel = 0; // IMU 1 current velocity
 float vel2 = 0; // IMU 2 current velocity
-float vel_init = 0; //IMU 1 initial velocity
-float vel_init2 = 0; //IMU 2 initial velocity
 uint8_t IMU_state = 0; //State variable for IMU task
-uint16_t tim_count = 0;
 
-uint16_t vel_size = 100; //Number of acceleration values averaged to calculate velocity
+uint16_t rate_hz = SAMPLE_HZ; //IMU output data rate right now, lower while the bar is racked
+uint16_t vel_size = SAMPLE_HZ/10; //Number of acceleration samples between status updates (100ms)
 
 int16_t accelerometer_x, accelerometer_y, accelerometer_z, accelerometer_z_2; // variables for accelerometer raw data
 int16_t gyro_x, gyro_y, gyro_z; // variables for gyro raw data
 int16_t temperature; // variables for temperature data
 
-Queue<float> vel_queue(2, "Velocities");
+SpscQueue<ImuVelocities, BAR_SAMPLES_SIZE> bar_samples("Bar samples");
+uint16_t dropped = 0; // Records task_spot fell too far behind to take since the last status update
+
+#ifdef USE_SPI_IMU
+// DLPF off for the 8 kHz sample clock divided by 2, +-2 g, +-250 deg/s, gyro in the FIFO
+const ImuConfig imu_config = {0, 1, 0, 0, true};
+// 94 Hz DLPF for the 1 kHz sample clock divided by 2 while racked
+const ImuConfig idle_config = {2, 1, 0, 0, true};
+#else
+// 184 Hz DLPF for the 1 kHz sample clock, +-2 g, +-250 deg/s, gyro in the FIFO
+const ImuConfig imu_config = {1, 0, 0, 0, true};
+// 44 Hz DLPF for the 1 kHz sample clock divided by 5 while racked
+const ImuConfig idle_config = {3, 4, 0, 0, true};
+#endif
+
+WireBus imu_bus(Wire, SDA1, SCL1, I2C_HZ);
+#if defined(USE_SPI_IMU)
+ImuSpi imu_1(SPI, CS_PIN, ICM20689_FIFO_SIZE, ICM20689_ID);
+ImuSpi imu_2(SPI, CS_PIN2, ICM20689_FIFO_SIZE, ICM20689_ID);
+#elif defined(USE_IMU_MUX)
+float calib_const3 = 1670.2; // Nominal MPU-6050 ticks per m/s^2 until the bench IMU is calibrated
+I2CMux imu_mux(imu_bus, MUX_ADDR);
+MuxChannelBus bar_bus(imu_mux, 0); // Multiplexer channel with the two bar IMUs
+MuxChannelBus bench_bus(imu_mux, 1); // Multiplexer channel with the bench IMU
+MPU6050 imu_1(bar_bus, MPU_ADDR);
+MPU6050 imu_2(bar_bus, MPU_ADDR2);
+MPU6050 imu_3(bench_bus, MPU_ADDR);
+VelocityEstimator est_3(calib_const3, thresh, CAL_SAMPLES, DECIMATION);
+#elif defined(USE_DUAL_I2C)
+WireBus imu_bus2(Wire1, SDA2, SCL2, I2C_HZ);
+MPU6050 imu_1(imu_bus, MPU_ADDR);
+MPU6050 imu_2(imu_bus2, MPU_ADDR2);
+TaskHandle_t imu2_task = NULL; // Handle used to start a drain of the second controller on the other core
+Queue<bool> imu2_done(1, "Second I2C controller drained"); // Kernel queue, task_IMU's notification is taken by the ISR
+#else
+MPU6050 imu_1(imu_bus, MPU_ADDR);
+MPU6050 imu_2(imu_bus, MPU_ADDR2);
+#endif
+
+SampleClock clock_1; // Times IMU 1 took each sample, filled by its data ready ISR
+SampleClock clock_2; // Times IMU 2 took each sample, filled by its data ready ISR
+
+VelocityEstimator est_1(calib_const, thresh, CAL_SAMPLES, DECIMATION); // Turns IMU 1 samples into vertical velocity
+VelocityEstimator est_2(calib_const2, thresh, CAL_SAMPLES, DECIMATION); // Turns IMU 2 samples into vertical velocity
+
+SensorArray sensors(SAMPLE_US); // Every IMU on the robot, IMU 1 and 2 first
 
-Queue<float> vel_r(1000, "Right Velocities recorded over a rep");
+VelocityFusion fusion(0x03); // Combines IMU 1 and 2, the ones on the bar, into the bar velocity
 
-Queue<float> vel_l(1000, "Left Velocities recorded over a rep");
+TiltMonitor tilt(0, 1); // Compares IMU 1 on the right end of the bar with IMU 2 on the left
 
-Queue<float> timer(1000, "Time over rep");
+StallPredictor stall; // Watches the bar velocity for a press that is grinding to a halt
+
+#ifdef USE_PHASE_MODEL
+PhaseClassifier classifier(phase_model); // Tells the phase of the rep from the shape of the bar velocity
+#endif
+
+TaskHandle_t imu_task = NULL; // Handle used by the ISR to wake up task_IMU
+#ifdef MEASURE_STACK
+TaskHandle_t spot_task = NULL;
+TaskHandle_t motor_task = NULL;
+TaskHandle_t web_task = NULL;
+uint16_t stack_count = 0;
+#endif
+
+SampleHistory vel_history; // Right and left velocities over time for the web server
+
+SessionStore session; // The whole workout at 100 Hz, 100 ms and per rep resolution
+
+/** @brief ISR which stamps every sample IMU 1 takes and wakes task_IMU to drain the FIFOs
+ *  @details The task is only notified every @c FIFO_DRAIN samples, so it sleeps in between
+ *  instead of polling the bus.
+ */
+void IRAM_ATTR imu_1_ready(){
+  clock_1.stamp(esp_timer_get_time());
+  if (clock_1.count() % FIFO_DRAIN == 0 && imu_task != NULL){
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(imu_task, &woken);
+    if (woken){
+      portYIELD_FROM_ISR();
+    }
+  }
+}
+
+/** @brief ISR which stamps every sample IMU 2 takes
+ */
+void IRAM_ATTR imu_2_ready(){
+  clock_2.stamp(esp_timer_get_time());
+}
+
+/** @brief Function which hands one control step's velocities to task_spot
+ *  @details The stall predictor and the phase classifier run on the fused bar velocity, then
+ *  everything worked out for the step goes to task_spot in one record, which wakes it.
+ *  @param velocities Velocities of the step, already fused; filled in with the rest
+ *  @param time_us Time of the step, or the time now for a record with no new samples so the
+ *  rep timer keeps running when the IMUs stop answering
+ */
+void publish(ImuVelocities& velocities, int64_t time_us){
+  float bar_vel = velocities.mode == FUSE_NONE ? NAN : velocities.bar_vel;
+  stall.update(bar_vel);
+  tilt.fill(velocities);
+  velocities.stalling = stall.stalling();
+  velocities.slowing = stall.slowing();
+#ifdef USE_PHASE_MODEL
+  classifier.update(bar_vel);
+  velocities.phase = classifier.get_phase();
+  velocities.fail_pct = classifier.get_fail_pct();
+#else
+  velocities.phase = PHASE_NONE;
+  velocities.fail_pct = 0;
+#endif
+  velocities.time_us = time_us;
+  if (!bar_samples.put(velocities)){
+    dropped++;
+  }
+}
+
+#ifdef USE_DUAL_I2C
+
+/** @brief Task IMU 2 drains the IMUs on the second I2C controller
+ *  @details This task is pinned to the other core from task_IMU. It waits to be told to
+ *  drain, reads the FIFOs on the second controller while task_IMU reads the ones on the
+ *  first and then tells task_IMU it is done.
+ */
+void task_IMU2(void* p_params){
+  while (1){
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    sensors.drain(1, esp_timer_get_time());
+    imu2_done.put(true);
+  }
+}
+#endif
 
 /** @brief Task IMU grabs data from IMUs and converts into velocities to be used by other tasks
- *  @details First transmision is made between MCU and I2C devices where the IMUs are "woken up".
- *  Next, we combine the upper and lower byte values from the z acceleration data address to get
- *  the "tick" value of acceleration in z. This is then converted to m/s^2 and zero'd after some
- *  data analysis. The acceleration noise is set to zero and values are summed up in order to integrate.
- *  Velociteis are found through numerical integration and error propogation is somewhat mitigated and
- *  the values are put in their respective queues.  
+ *  @details First the IMUs are put in the sensor array, which "wakes them up", sets their
+ *  filter, ranges and output data rate, starts their FIFOs and has them pulse their INT pins
+ *  for every sample. The IMUs are MPU-6050s on I2C or MPU-6000/ICM-20689s on SPI. The ISRs use
+ *  the pulses to timestamp each sample. The task sleeps until IMU 1 has taken a batch of
+ *  samples and then drains every FIFO in bulk. With two I2C controllers the controllers are
+ *  drained at the same time on both cores, otherwise one after the other. The array lines
+ *  the IMUs up by their timestamps and runs every sample through that IMU's velocity
+ *  estimator, which uses the gyro to find the acceleration along gravity, integrates it
+ *  using the real time between samples and zeroes the velocity only when the IMU is actually
+ *  still. Calibrations saved in NVS are loaded at startup, and whenever an IMU sits still
+ *  its calibration is re-measured, corrected for temperature and saved again if it moved.
+ *  Every I2C transaction times out and a stuck bus is cleared and restarted, and velocities
+ *  are published at least every @c PUBLISH_TIMEOUT_MS even if the IMUs stop answering, with
+ *  the IMUs that did stop flagged as stale, so task_spot is never left waiting on the queue.
+ *  Every IMU's raw samples are checked for being stuck, out of range or dead, and the bar
+ *  velocity task_spot works from combines only the bar IMUs that pass, weighted by health.
+ *  Every control step the two ends of the bar are also compared, so task_spot can tell when
+ *  the bar tips to one side, and the trend of the bar velocity is checked for a press that
+ *  is about to stall.
+ *  While task_spot says the bar is sitting in the rack the IMUs run at @c IDLE_HZ to leave
+ *  the bus and CPU to Wi-Fi, and they go back to @c SAMPLE_HZ as soon as the bar moves.
+ *  Every control step the velocities, the bar velocity and everything worked out from them go
+ *  to task_spot together in one record, which wakes task_spot as soon as it is put, so a
+ *  decision is at most one FIFO drain behind the bar. Printing, temperatures, calibrations
+ *  and the web page history stay at one update every 100 ms.
 */
 void task_IMU(void* p_params){
-  Wire.begin();
-  Wire.beginTransmission(MPU_ADDR); // Begins a transmission to the I2C slave (GY-521 board)
-  Wire.write(0x6B); // PWR_MGMT_1 register
-  Wire.write(0); // set to zero (wakes up the MPU-6050)
-  Wire.endTransmission(true);
-
-  Wire.beginTransmission(MPU_ADDR2); // Begins a transmission to the I2C slave (GY-521 board)
-  Wire.write(0x6B); // PWR_MGMT_1 register
-  Wire.write(0); // set to zero (wakes up the MPU-6050)
-  Wire.endTransmission(true);
+  imu_bus.begin();
+#if defined(USE_SPI_IMU)
+  SPI.begin();
+  sensors.add(&imu_1, &est_1, &clock_1, 0, -1);
+  sensors.add(&imu_2, &est_2, &clock_2, 0, -1);
+#elif defined(USE_IMU_MUX)
+  sensors.add(&imu_1, &est_1, &clock_1, 0, 0);
+  sensors.add(&imu_2, &est_2, &clock_2, 0, 0);
+  sensors.add(&imu_3, &est_3, NULL, 0, 1);
+#elif defined(USE_DUAL_I2C)
+  imu_bus2.begin();
+  sensors.add(&imu_1, &est_1, &clock_1, 0, -1);
+  sensors.add(&imu_2, &est_2, &clock_2, 1, -1);
+#else
+  sensors.add(&imu_1, &est_1, &clock_1, 0, -1);
+  sensors.add(&imu_2, &est_2, &clock_2, 0, -1);
+#endif
+  pinMode(INT_PIN, INPUT);
+  pinMode(INT_PIN2, INPUT);
+  attachInterrupt(INT_PIN, imu_1_ready, RISING);
+  attachInterrupt(INT_PIN2, imu_2_ready, RISING);
+  sensors.begin(imu_config);
+  //Loading calibrations from earlier boots, IMUs without one calibrate the first time they are still.
+  //The temperature comes first so the stored scale is corrected for it from the start
+  ImuCalibration cal;
+  for (uint8_t i = 0; i < sensors.size(); i++){
+    float temp_c;
+    if (sensors.get_imu(i)->read_temperature(temp_c)){
+      sensors.get_estimator(i)->set_temperature(temp_c);
+    }
+    if (load_calibration(i, cal)){
+      sensors.get_estimator(i)->set_calibration(cal);
+    }
+  }
+  ImuVelocities velocities = {};
+  bool stepped = false; // A control step has been published since the last status update
   while (1){
     if (IMU_state == 0){
-      for (uint8_t i = 0; i < vel_size; i++){
-      //Reading IMU 1
-      Wire.beginTransmission(MPU_ADDR);
-      Wire.write(0x3F); // starting with register 0x3F (ACCEL_ZOUT_H) 
-      Wire.endTransmission(false); // the parameter indicates that the ESP32 will send a restart. As a result, the connection is kept active.
-      Wire.requestFrom(MPU_ADDR, 2, true); // request a total of 2 registers
-      accelerometer_z = Wire.read()<<8 | Wire.read(); // reading registers: 0x3F (ACCEL_ZOUT_H) and 0x40 (ACCEL_ZOUT_L)
-      float az = accelerometer_z/calib_const - 9.81;  //Adjusting acceleration in z to be 0 m/s^2
-
-      //Reading IMU 2
-      Wire.beginTransmission(MPU_ADDR2);
-      Wire.write(0x3F); // starting with register 0x3F (ACCEL_ZOUT_H) 
-      Wire.endTransmission(false); // the parameter indicates that the ESP32 will send a restart. As a result, the connection is kept active.
-      Wire.requestFrom(MPU_ADDR2, 2, true); // request a total of 2 registers
-      accelerometer_z_2 = Wire.read()<<8 | Wire.read();
-      float az_2 = accelerometer_z_2/calib_const2 - 9.81; //Adjusting acceleration in z to be 0 m/s^2
-
-      //Using threshold value to get rid of acceleration noise
-      if (abs(az) < thresh || abs(az_2) < thresh){
-        az = 0;
-        az_2 = 0;
+      //Running the IMUs slowly while the bar sits in the rack and at full rate as soon as it moves
+      bool fast = !bar_idle.get() || velocities.bar_vel != 0;
+      if (fast != (rate_hz == SAMPLE_HZ)){
+        rate_hz = fast ? SAMPLE_HZ : IDLE_HZ;
+        sensors.set_rate(fast ? imu_config : idle_config, 1000000 / rate_hz);
+        vel_size = rate_hz / 10;
+        Serial << "IMU rate: " << rate_hz << " Hz" << endl;
       }
-      //Serial << "IMU 1: " << az << " | IMU 2: " << az_2 << endl;
-      //Summing velocities together to eventually average over 1 second (v = v0 + a*dt)
-        vel += az;
-        vel2 += az_2;
-        vTaskDelay(1);
+      uint16_t decimation = rate_hz / 100;
+      uint16_t samples = 0;
+      stepped = false;
+      int64_t start = esp_timer_get_time();
+      while (samples < vel_size && esp_timer_get_time() - start < PUBLISH_TIMEOUT_MS * 1000LL){
+        //Using up samples already drained before reading the IMUs again, one control
+        //period at a time so every new velocity goes into the session store
+        uint16_t steps;
+        do{
+          steps = sensors.update(decimation - samples % decimation);
+          samples += steps;
+          if (steps > 0 && samples % decimation == 0){
+            //Every control step goes straight to task_spot
+            sensors.get_velocities(velocities);
+            tilt.update(velocities, sensors.get_time());
+            fusion.fuse(velocities);
+            publish(velocities, sensors.get_time());
+            stepped = true;
+            session.add((uint32_t)(sensors.get_time() / 1000), velocities.vel[0], velocities.vel[1],
+                        velocities.mode == FUSE_NONE ? 0 : velocities.bar_vel);
+          }
+        } while (steps > 0 && samples < vel_size);
+        if (samples >= vel_size){
+          break;
+        }
+        //Sleeping until IMU 1 has a batch ready, the timeout keeps things going if an interrupt is missed
+        ulTaskNotifyTake(pdTRUE, FIFO_TIMEOUT_DRAINS * FIFO_DRAIN * 1000 / rate_hz);
+#ifdef USE_DUAL_I2C
+        xTaskNotifyGive(imu2_task);
+        sensors.drain(0, esp_timer_get_time());
+        imu2_done.get();
+#else
+        sensors.drain(0, esp_timer_get_time());
+#endif
       }
-      IMU_state = 1; //Done with acceleration data collection now we have to convert to velocity
+      IMU_state = 1; //Done with acceleration data collection now we have to share the velocity
     }
     if (IMU_state == 1){
-      //New velocity being averaged and adding to previous velocity (NUMERICAL INTEGRATION)
-      vel = vel/vel_size*.1 + vel_init;
-      vel2 = vel2/vel_size*.1 + vel_init2;
-
-      //IMU loses track of velocity due to error propogation so if it is stopped it may still read nonzero values
-      //that don't change so this condition checks for that and sets velocity back to 0
-      if(vel < vel_init+.02 && vel > vel_init-0.02){
-        vel = 0;
-        vel2 = 0;
+      //With no new samples for a whole update task_spot still gets a record, with the IMUs marked stale
+      if (!stepped){
+        sensors.get_velocities(velocities);
+        fusion.fuse(velocities);
+        publish(velocities, esp_timer_get_time());
       }
-      //Setting initial velocities to new velocity to calculate for the next time the task is run
-      vel_init = vel;
-      vel_init2 = vel2;
+      if (dropped > 0){
+        Serial << "Bar samples dropped: " << dropped << endl;
+        dropped = 0;
+      }
+      vel = velocities.vel[0];
+      vel2 = velocities.vel[1];
 
       Serial << "IMU 1: " << vel << " | IMU 2: " << vel2 << endl;
+      if (velocities.stale){
+        Serial << "Stale IMUs: " << velocities.stale << endl;
+      }
+      if (velocities.mode != FUSE_ALL){
+        Serial << "Bar IMUs in use: " << velocities.used << endl;
+      }
+      if (velocities.tilted){
+        Serial << "Bar tilted: " << velocities.tilt << " m" << endl;
+      }
 
-      //Putting values into queues to be shared with other tasks and make use of data
-      vel_queue.put(vel);
-      vel_queue.put(vel2);
-      tim_count++; // Counts roughly every 100ms (vtaskdelay value)*100 iterations
-      timer.put(tim_count); 
-      vel_r.put(vel);
-      vel_l.put(vel2);
+      //Following temperature drift and saving calibrations re-measured while the bar sat still
+      for (uint8_t i = 0; i < sensors.size(); i++){
+        VelocityEstimator* p_est = sensors.get_estimator(i);
+        float temp_c;
+        if (sensors.get_imu(i)->read_temperature(temp_c)){
+          p_est->set_temperature(temp_c);
+        }
+        if (p_est->take_calibration(cal)){
+          save_calibration(i, cal);
+        }
+      }
+
+      //Putting values into the history to be shown by the web server
+      vel_history.put((uint32_t)(esp_timer_get_time() / 1000), vel, vel2);
+#ifdef MEASURE_STACK
+      if (++stack_count == STACK_REPORT){
+        stack_count = 0;
+        Serial << "Stack left | IMU: " << uxTaskGetStackHighWaterMark(imu_task)
+#ifdef USE_DUAL_I2C
+               << " | IMU 2: " << uxTaskGetStackHighWaterMark(imu2_task)
+#endif
+               << " | Spot: " << uxTaskGetStackHighWaterMark(spot_task)
+               << " | Motor: " << uxTaskGetStackHighWaterMark(motor_task)
+               << " | Web: " << uxTaskGetStackHighWaterMark(web_task) << endl;
+      }
+#endif
 
       IMU_state = 0;
     }
@@ -131,10 +413,19 @@ void setup() {
   while (!Serial) { } 
   //Set up network connection for ESP32 to interface with PC
   setup_wifi();
-  xTaskCreate(task_IMU, "IMU", 2048, NULL, 5, NULL);
-  xTaskCreate(task_spot, "Ey you need a spot bro", 2048, NULL, 4, NULL);
-  xTaskCreate(task_motor, "Motor go brrr", 2048, NULL, 3, NULL);
-  xTaskCreate(task_webserver, "Handle Webserver", 8192, NULL, 2, NULL);
+  xTaskCreatePinnedToCore(task_IMU, "IMU", IMU_STACK, NULL, 5, &imu_task, 1);
+#ifdef USE_DUAL_I2C
+  xTaskCreatePinnedToCore(task_IMU2, "IMU 2", IMU2_STACK, NULL, 5, &imu2_task, 0);
+#endif
+#ifdef MEASURE_STACK
+  xTaskCreate(task_spot, "Ey you need a spot bro", SPOT_STACK, NULL, 4, &spot_task);
+  xTaskCreate(task_motor, "Motor go brrr", MOTOR_STACK, NULL, 6, &motor_task); //Highest so a spot starts at once
+  xTaskCreate(task_webserver, "Handle Webserver", WEB_STACK, NULL, 2, &web_task);
+#else
+  xTaskCreate(task_spot, "Ey you need a spot bro", SPOT_STACK, NULL, 4, NULL);
+  xTaskCreate(task_motor, "Motor go brrr", MOTOR_STACK, NULL, 6, NULL); //Highest so a spot starts at once
+  xTaskCreate(task_webserver, "Handle Webserver", WEB_STACK, NULL, 2, NULL);
+#endif
 }
 
 void loop() {
@@ -0,0 +1,40 @@
+/** @file mpu6050.cpp
+ *  This program contains the I2C backend of the IMU driver for the MPU-6050.
+ *  The register handling is all in @c ImuDriver; this only moves bytes over
+ *  the I2C bus.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "mpu6050.h"
+
+/** @brief   Constructor which creates an MPU-6050 object
+ *  @param   a_bus The I2C bus the chip is attached to
+ *  @param   address The I2C address of the chip, 0x68 or 0x69 depending on AD0
+ */
+MPU6050::MPU6050 (I2CBus& a_bus, uint8_t address)
+    : ImuDriver (MPU6050_FIFO_SIZE), bus (a_bus), addr (address)
+{
+}
+
+/** @brief   Method which writes one register of the MPU-6050
+ */
+bool MPU6050::write_reg(uint8_t reg, uint8_t value)
+{
+    return bus.write_reg(addr, reg, value);
+}
+
+/** @brief   Method which reads a block of registers from the MPU-6050
+ */
+bool MPU6050::read_regs(uint8_t reg, uint8_t* p_buf, uint16_t len)
+{
+    return bus.read_regs(addr, reg, p_buf, len);
+}
+
+/** @brief   Method which returns the largest read the I2C bus can do at once
+ */
+uint16_t MPU6050::max_read(void)
+{
+    return bus.max_read();
+}
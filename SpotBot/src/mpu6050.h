@@ -0,0 +1,32 @@
+/** @file mpu6050.h
+ *  This is the header for the MPU-6050 driver file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _MPU6050_H_
+#define _MPU6050_H_
+
+#include <stdint.h>
+#include "i2c_bus.h"
+#include "imu_driver.h"
+
+#define MPU6050_FIFO_SIZE 1024   ///< Bytes of FIFO inside the MPU-6050
+
+/** @brief   Class which runs an MPU-6050 over I2C
+ */
+class MPU6050 : public ImuDriver
+{
+protected:
+    I2CBus& bus;
+    uint8_t addr;
+
+    bool write_reg(uint8_t reg, uint8_t value);
+    bool read_regs(uint8_t reg, uint8_t* p_buf, uint16_t len);
+    uint16_t max_read(void);
+public:
+    MPU6050 (I2CBus& a_bus, uint8_t address);
+};
+
+#endif // _MPU6050_H_
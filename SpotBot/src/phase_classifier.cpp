@@ -0,0 +1,245 @@
+/** @file phase_classifier.cpp
+ *  This program contains the phase classifier, a different way for the rep
+ *  machine to tell which way the bar is going and if a press is failing, which
+ *  looks at the shape of the last 160 ms of velocity instead of comparing one
+ *  velocity to fixed thresholds, so slow grinds and bounces aren't mistaken for
+ *  stops.
+ *
+ *  The tables between the markers are trained and written by
+ *  tools/phase_model.py. test_phase_model runs them against the speed
+ *  thresholds; the thresholds still count reps better, so they stay the
+ *  default until the model is trained on recorded sets.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "phase_classifier.h"
+
+// BEGIN PHASE MODEL
+// Made by tools/phase_model.py from 300 synthetic sets, seed 507, don't edit by hand
+
+/// Leaf scores for still, down, up and fail
+static const int8_t phase_leaves[][PHASE_CLASSES] =
+{
+    {  0, 127,   0,   0},    // 0
+    {  0,  45,   0,  82},    // 1
+    {  0, 110,   0,  17},    // 2
+    {  0,   6,   0, 121},    // 3
+    {  2, 125,   0,   0},    // 4
+    {120,   2,   4,   1},    // 5
+    {  0,   0, 123,   3},    // 6
+    {  0,  73,   0,   1},    // 7
+    {  0,   0,   0,  74},    // 8
+    {  0,  74,   0,   0},    // 9
+    { 17,   0,  51,   6},    // 10
+    {  1,   3,   6,  64},    // 11
+    {  0,   0,  73,   1},    // 12
+    {  0,   4,   0,  70},    // 13
+    { 24,  34,  16,   0},    // 14
+    {  3,   0,  70,   1},    // 15
+    {  0,  56,   0,  10},    // 16
+    {  0,   9,   0,  57},    // 17
+    {  0,  46,   0,  19},    // 18
+    { 17,   5,   0,  44},    // 19
+    { 65,   0,   1,   0},    // 20
+    { 16,  48,   1,   1},    // 21
+    { 38,  25,   0,   3},    // 22
+    { 54,   1,  10,   2},    // 23
+    {  7,   0,  56,   2},    // 24
+    { 54,   0,  11,   1},    // 25
+    {  1,   0,  21,  43},    // 26
+    { 14,  15,  37,   0},    // 27
+    { 50,   2,  15,   0},    // 28
+    { 40,   7,  20,   0},    // 29
+    {  7,   0,  58,   0},    // 30
+};
+
+/// Nodes of every tree, feature -1 marks a leaf
+static const PhaseNode phase_nodes[] =
+{
+    // Tree 0
+    {FEAT_NOW,     -2,   1,  10},   // 0
+    {FEAT_MIN,    -16,   2,   3},   // 1
+    {-1,            0,   0,   0},   // 2 down
+    {FEAT_MAX,     -5,   4,   7},   // 3
+    {FEAT_SLOPE,    2,   5,   6},   // 4
+    {-1,            0,   1,   0},   // 5 fail
+    {-1,            0,   0,   0},   // 6 down
+    {FEAT_MAX,      1,   8,   9},   // 7
+    {-1,            0,   2,   0},   // 8 down
+    {-1,            0,   3,   0},   // 9 fail
+    {FEAT_PEAK,     1,  11,  14},   // 10
+    {FEAT_MAX,     -1,  12,  13},   // 11
+    {-1,            0,   4,   0},   // 12 down
+    {-1,            0,   5,   0},   // 13 still
+    {-1,            0,   6,   0},   // 14 up
+    // Tree 1
+    {FEAT_MAX,     -5,  16,  19},   // 15
+    {FEAT_MIN,     -9,  17,  18},   // 16
+    {-1,            0,   7,   0},   // 17 down
+    {-1,            0,   8,   0},   // 18 fail
+    {FEAT_SLOPE,   -2,  20,  27},   // 19
+    {FEAT_SLOPE,  -12,  21,  24},   // 20
+    {FEAT_NOW,    -11,  22,  23},   // 21
+    {-1,            0,   9,   0},   // 22 down
+    {-1,            0,  10,   0},   // 23 up
+    {FEAT_MEAN,    20,  25,  26},   // 24
+    {-1,            0,  11,   0},   // 25 fail
+    {-1,            0,  12,   0},   // 26 up
+    {FEAT_NOW,      0,  28,  31},   // 27
+    {FEAT_NOW,     -3,  29,  30},   // 28
+    {-1,            0,  13,   0},   // 29 fail
+    {-1,            0,  14,   0},   // 30 down
+    {-1,            0,  15,   0},   // 31 up
+    // Tree 2
+    {FEAT_NOW,     -1,  33,  46},   // 32
+    {FEAT_NOW,     -3,  34,  39},   // 33
+    {FEAT_MIN,    -11,  35,  36},   // 34
+    {-1,            0,  16,   0},   // 35 down
+    {FEAT_MAX,     -1,  37,  38},   // 36
+    {-1,            0,  17,   0},   // 37 fail
+    {-1,            0,  18,   0},   // 38 down
+    {FEAT_SLOPE,   -3,  40,  43},   // 39
+    {FEAT_MAX,     11,  41,  42},   // 40
+    {-1,            0,  19,   0},   // 41 fail
+    {-1,            0,  20,   0},   // 42 still
+    {FEAT_SLOPE,   -2,  44,  45},   // 43
+    {-1,            0,  21,   0},   // 44 down
+    {-1,            0,  22,   0},   // 45 still
+    {FEAT_SLOPE,   -1,  47,  54},   // 46
+    {FEAT_PEAK,     1,  48,  51},   // 47
+    {FEAT_MIN,     -1,  49,  50},   // 48
+    {-1,            0,  23,   0},   // 49 still
+    {-1,            0,  24,   0},   // 50 up
+    {FEAT_SLOPE,  -15,  52,  53},   // 51
+    {-1,            0,  25,   0},   // 52 still
+    {-1,            0,  26,   0},   // 53 fail
+    {FEAT_NOW,      0,  55,  58},   // 54
+    {FEAT_MEAN,    -3,  56,  57},   // 55
+    {-1,            0,  27,   0},   // 56 up
+    {-1,            0,  28,   0},   // 57 still
+    {FEAT_MIN,     -1,  59,  60},   // 58
+    {-1,            0,  29,   0},   // 59 still
+    {-1,            0,  30,   0},   // 60 up
+};
+
+/// Root node of every tree
+static const uint8_t phase_roots[PHASE_TREES] = {0, 15, 32};
+// END PHASE MODEL
+
+const PhaseModel phase_model = {phase_nodes, phase_roots, PHASE_TREES, phase_leaves};
+
+/** @brief   Function which quantizes a velocity in m/s to a feature
+ */
+static int8_t quantize(float vel)
+{
+    float q = vel * (1000.0f / PHASE_UNIT);
+    q = q > 127 ? 127 : q < -127 ? -127 : q;
+    return (int8_t)(q < 0 ? q - 0.5f : q + 0.5f);
+}
+
+/** @brief   Constructor which creates a classifier running one model
+ *  @param   phase_model Trees and leaf scores to run
+ */
+PhaseClassifier::PhaseClassifier (const PhaseModel& phase_model)
+    : model (phase_model)
+{
+    reset();
+}
+
+/** @brief   Method which empties the window, such as when the bar velocity
+ *           can't be trusted
+ */
+void PhaseClassifier::reset(void)
+{
+    idx = 0;
+    fill = 0;
+    sum = 0;
+    peak = 0;
+    phase = PHASE_NONE;
+    fail_pct = 0;
+}
+
+/** @brief   Method which adds one control step's bar velocity and classifies
+ *           the phase
+ *  @param   bar_vel Bar velocity in m/s, positive up, NaN if it can't be trusted
+ */
+void PhaseClassifier::update(float bar_vel)
+{
+    if (bar_vel != bar_vel){
+        reset();
+        return;
+    }
+    int8_t vel = quantize(bar_vel);
+    if (fill == PHASE_WINDOW){
+        sum -= window[idx];
+    }
+    else{
+        fill++;
+    }
+    window[idx] = vel;
+    sum += vel;
+    idx = (idx + 1) % PHASE_WINDOW;
+    peak = vel <= 0 ? 0 : vel > peak ? vel : peak;
+    if (fill < PHASE_WINDOW){
+        phase = PHASE_NONE;
+        return;
+    }
+
+    // idx is now the oldest sample
+    int8_t low = vel;
+    int8_t high = vel;
+    for (uint8_t i = 0; i < PHASE_WINDOW; i++){
+        low = window[i] < low ? window[i] : low;
+        high = window[i] > high ? window[i] : high;
+    }
+    int16_t slope = vel - window[idx];
+    features[FEAT_NOW] = vel;
+    features[FEAT_MEAN] = sum / PHASE_WINDOW;
+    features[FEAT_SLOPE] = slope < -127 ? -127 : slope > 127 ? 127 : slope;
+    features[FEAT_MIN] = low;
+    features[FEAT_MAX] = high;
+    features[FEAT_PEAK] = peak;
+
+    for (uint8_t c = 0; c < PHASE_CLASSES; c++){
+        scores[c] = 0;
+    }
+    for (uint8_t t = 0; t < model.trees; t++){
+        const PhaseNode* p_node = &model.nodes[model.roots[t]];
+        for (uint8_t depth = 0; depth < PHASE_DEPTH && p_node->feature >= 0; depth++){
+            bool left = features[p_node->feature] <= p_node->threshold;
+            p_node = &model.nodes[left ? p_node->left : p_node->right];
+        }
+        if (p_node->feature < 0){
+            for (uint8_t c = 0; c < PHASE_CLASSES; c++){
+                scores[c] += model.leaves[p_node->left][c];
+            }
+        }
+    }
+
+    uint8_t best = PHASE_STILL;
+    int16_t total = 0;
+    for (uint8_t c = 0; c < PHASE_CLASSES; c++){
+        best = scores[c] > scores[best] ? c : best;
+        total += scores[c] > 0 ? scores[c] : 0;
+    }
+    phase = best;
+    fail_pct = total > 0 && scores[PHASE_FAIL] > 0 ? scores[PHASE_FAIL] * 100 / total : 0;
+}
+
+/** @brief   Method which returns the phase the bar is in
+ *  @return  One of the @c PHASE_ values, @c PHASE_NONE until the window is full
+ */
+uint8_t PhaseClassifier::get_phase(void)
+{
+    return phase;
+}
+
+/** @brief   Method which returns the chance the press is failing
+ *  @return  Chance in percent
+ */
+uint8_t PhaseClassifier::get_fail_pct(void)
+{
+    return fail_pct;
+}
@@ -0,0 +1,95 @@
+/** @file phase_classifier.h
+ *  This is the header for the phase classifier file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _PHASE_CLASSIFIER_H_
+#define _PHASE_CLASSIFIER_H_
+
+#include <stdint.h>
+
+// #define USE_PHASE_MODEL to have the rep machine go by the phase classifier or
+// #undef USE_PHASE_MODEL to have it go by the speed thresholds of the exercise
+#undef USE_PHASE_MODEL
+
+#define PHASE_STILL 0         ///< Bar is still
+#define PHASE_DOWN 1          ///< Bar is moving down
+#define PHASE_UP 2            ///< Bar is moving up
+#define PHASE_FAIL 3          ///< Press is failing
+#define PHASE_CLASSES 4       ///< Number of phases the model scores
+#define PHASE_NONE 0xFF       ///< No phase, the speed thresholds are used
+
+#define PHASE_WINDOW 16       ///< Control steps of bar velocity the features look at (160 ms)
+#define PHASE_UNIT 10         ///< Velocity of one step of a quantized feature, mm/s
+#define PHASE_FEATURES 6      ///< Features worked out from the window
+#define PHASE_TREES 3         ///< Trees in the model
+#define PHASE_DEPTH 4         ///< Most nodes visited in any one tree
+
+#define FEAT_NOW 0            ///< Latest velocity
+#define FEAT_MEAN 1           ///< Mean velocity over the window
+#define FEAT_SLOPE 2          ///< Latest velocity less the oldest in the window
+#define FEAT_MIN 3            ///< Slowest velocity in the window
+#define FEAT_MAX 4            ///< Fastest velocity in the window
+#define FEAT_PEAK 5           ///< Fastest velocity since the bar last stopped going up
+
+/** @brief   One node of a tree in the model
+ *  @details A node with @c feature of -1 is a leaf and @c left is the row of
+ *           the leaf scores. Otherwise the left child is taken if the feature
+ *           is at most @c threshold and the right one if it is more.
+ */
+struct PhaseNode
+{
+    int8_t feature;
+    int8_t threshold;
+    uint8_t left;
+    uint8_t right;
+};
+
+/** @brief   A whole model, laid out the way the tables are exported
+ */
+struct PhaseModel
+{
+    const PhaseNode* nodes;
+    const uint8_t* roots;
+    uint8_t trees;
+    const int8_t (*leaves)[PHASE_CLASSES];
+};
+
+extern const PhaseModel phase_model;
+
+/** @brief   Class which classifies the phase of a rep with a small quantized
+ *           tree ensemble
+ *  @details The bar velocity is quantized to int8 in @c PHASE_UNIT steps and
+ *           kept in a window, from which a handful of int8 features are made.
+ *           Every tree is walked from its root to a leaf and the leaves' int8
+ *           scores for each phase are added up; the phase with the highest
+ *           total wins and the failure score's share of the total is the
+ *           chance the press is failing. All memory is the fixed arena of
+ *           this object and each step visits at most @c PHASE_TREES times
+ *           @c PHASE_DEPTH nodes after one pass over the window, so the time
+ *           it takes is bounded.
+ */
+class PhaseClassifier
+{
+protected:
+    const PhaseModel& model;
+    int8_t window[PHASE_WINDOW];
+    uint8_t idx = 0;
+    uint8_t fill = 0;
+    int16_t sum = 0;
+    int8_t peak = 0;
+    int8_t features[PHASE_FEATURES];
+    int16_t scores[PHASE_CLASSES];
+    uint8_t phase = PHASE_NONE;
+    uint8_t fail_pct = 0;
+public:
+    PhaseClassifier (const PhaseModel& phase_model);
+    void reset(void);
+    void update(float bar_vel);
+    uint8_t get_phase(void);
+    uint8_t get_fail_pct(void);
+};
+
+#endif // _PHASE_CLASSIFIER_H_
@@ -0,0 +1,87 @@
+/** @file rep_analytics.cpp
+ *  This program contains the class which works out how each rep went, its
+ *  velocities and how long it spent lowering, pausing and pressing, from the
+ *  bar velocity as it is measured.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "rep_analytics.h"
+
+/** @brief   Function which caps a time in ms to what a summary can hold
+ */
+static uint16_t to_u16(uint32_t ms)
+{
+    return ms > 0xFFFF ? 0xFFFF : ms;
+}
+
+/** @brief   Constructor which creates analytics with no rep started
+ */
+RepAnalytics::RepAnalytics (void)
+{
+}
+
+/** @brief   Method which starts over for a new rep
+ *  @param   time_ms Time the rep started in milliseconds
+ */
+void RepAnalytics::begin(uint32_t time_ms)
+{
+    last_ms = time_ms;
+    started = true;
+    peak_down = 0;
+    peak_up = 0;
+    down_sum = 0;
+    up_sum = 0;
+    down_ms = 0;
+    up_ms = 0;
+    pause_ms = 0;
+}
+
+/** @brief   Method which adds one bar velocity to the rep
+ *  @param   time_ms Time the velocity was measured in milliseconds
+ *  @param   bar_mm_s Bar velocity in mm/s, positive up
+ */
+void RepAnalytics::add(uint32_t time_ms, int16_t bar_mm_s)
+{
+    if (!started){
+        return;
+    }
+    uint32_t dt = time_ms - last_ms;
+    last_ms = time_ms;
+    if (dt > ANALYTICS_MAX_GAP){
+        return;
+    }
+    peak_down = bar_mm_s < peak_down ? bar_mm_s : peak_down;
+    peak_up = bar_mm_s > peak_up ? bar_mm_s : peak_up;
+    if (bar_mm_s < -ANALYTICS_STILL){
+        down_sum += (int32_t)bar_mm_s * dt;
+        down_ms += dt;
+    }
+    else if (bar_mm_s > ANALYTICS_STILL){
+        up_sum += (int32_t)bar_mm_s * dt;
+        up_ms += dt;
+    }
+    else{
+        pause_ms += dt;
+    }
+}
+
+/** @brief   Method which fills in the velocities and phase times of the rep
+ *           and stops adding to it
+ *  @param   summary Summary which gets @c peak_down, @c peak_up, @c mean_down,
+ *           @c mean_up, @c eccentric_ms, @c concentric_ms, @c pause_ms and
+ *           @c tut_ms; the rest is left alone
+ */
+void RepAnalytics::finish(RepSummary& summary)
+{
+    summary.peak_down = peak_down;
+    summary.peak_up = peak_up;
+    summary.mean_down = down_ms > 0 ? down_sum / (int32_t)down_ms : 0;
+    summary.mean_up = up_ms > 0 ? up_sum / (int32_t)up_ms : 0;
+    summary.eccentric_ms = to_u16(down_ms);
+    summary.concentric_ms = to_u16(up_ms);
+    summary.pause_ms = to_u16(pause_ms);
+    summary.tut_ms = to_u16(down_ms + up_ms + pause_ms);
+    started = false;
+}
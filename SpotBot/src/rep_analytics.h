@@ -0,0 +1,68 @@
+/** @file rep_analytics.h
+ *  This is the header for the rep analytics file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _REP_ANALYTICS_H_
+#define _REP_ANALYTICS_H_
+
+#include <stdint.h>
+
+#define ANALYTICS_STILL 20    ///< Bar speed under which the bar counts as paused, mm/s
+#define ANALYTICS_MAX_GAP 50  ///< Longest time between samples which is counted, ms
+
+/** @brief   Summary of one rep
+ *  @details Velocities are of the bar in mm/s, the mean concentric and
+ *           eccentric velocities are averaged over time in that phase, the
+ *           range of motion and sticking point height are in mm and the phase
+ *           times are in ms. Time under tension is the whole time from the
+ *           bar leaving the rack to it stopping again.
+ */
+struct RepSummary
+{
+    uint32_t start_ms;
+    uint16_t duration_ms;
+    uint8_t set;
+    bool failed;
+    int16_t peak_down;
+    int16_t peak_up;
+    int16_t mean_down;
+    int16_t mean_up;
+    int16_t rom;
+    int16_t sticking;
+    uint16_t eccentric_ms;
+    uint16_t concentric_ms;
+    uint16_t pause_ms;
+    uint16_t tut_ms;
+};
+
+/** @brief   Class which sums up a rep as the bar velocities come in
+ *  @details Each sample is sorted into the eccentric phase, the concentric
+ *           phase or a pause by its direction, and only running sums, extremes
+ *           and phase timers are kept, so every sample costs the same however
+ *           long the rep or the session is and the summary is ready the moment
+ *           the rep ends. Gaps longer than @c ANALYTICS_MAX_GAP, such as a
+ *           stalled bus, aren't counted toward any phase.
+ */
+class RepAnalytics
+{
+protected:
+    uint32_t last_ms = 0;
+    bool started = false;
+    int16_t peak_down = 0;
+    int16_t peak_up = 0;
+    int32_t down_sum = 0;
+    int32_t up_sum = 0;
+    uint32_t down_ms = 0;
+    uint32_t up_ms = 0;
+    uint32_t pause_ms = 0;
+public:
+    RepAnalytics (void);
+    void begin(uint32_t time_ms);
+    void add(uint32_t time_ms, int16_t bar_mm_s);
+    void finish(RepSummary& summary);
+};
+
+#endif // _REP_ANALYTICS_H_
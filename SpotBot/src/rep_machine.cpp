@@ -0,0 +1,176 @@
+/** @file rep_machine.cpp
+ *  This program contains the state machine which follows the lifter through each
+ *  rep, along with the transition tables of the exercises it knows. Adding an
+ *  exercise only takes a new table and set of thresholds, not new code.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <math.h>
+#include "rep_machine.h"
+
+/// Bench press, the bar has to stop on the chest before it is pressed back up
+static const RepTransition bench_table[] =
+{
+    {REP_WAIT,    GUARD_STILL,   REP_RACKED,  ACT_RACK},
+    {REP_RACKED,  GUARD_DOWN,    REP_DESCENT, ACT_START},
+    {REP_RACKED,  GUARD_STILL,   REP_RACKED,  ACT_RACK},
+    {REP_DESCENT, GUARD_TILTED,  REP_SPOT,    ACT_SPOT},
+    {REP_DESCENT, GUARD_TIMEOUT, REP_SPOT,    ACT_SPOT},
+    {REP_DESCENT, GUARD_STILL,   REP_BOTTOM,  ACT_BOTTOM},
+    {REP_BOTTOM,  GUARD_TILTED,  REP_SPOT,    ACT_SPOT},
+    {REP_BOTTOM,  GUARD_TIMEOUT, REP_SPOT,    ACT_SPOT},
+    {REP_BOTTOM,  GUARD_UP,      REP_ASCENT,  ACT_NONE},
+    {REP_ASCENT,  GUARD_FALLING, REP_SPOT,    ACT_SPOT},
+    {REP_ASCENT,  GUARD_STALLING, REP_SPOT,   ACT_SPOT},
+    {REP_ASCENT,  GUARD_TILTED,  REP_SPOT,    ACT_SPOT},
+    {REP_ASCENT,  GUARD_TIMEOUT, REP_SPOT,    ACT_SPOT},
+    {REP_ASCENT,  GUARD_STILL,   REP_RACKED,  ACT_REP},
+    {REP_SPOT,    GUARD_SPOTTED, REP_DONE,    ACT_SPOT_DONE},
+};
+
+/// Squat, the lifter may bounce out of the bottom without stopping
+static const RepTransition squat_table[] =
+{
+    {REP_WAIT,    GUARD_STILL,   REP_RACKED,  ACT_RACK},
+    {REP_RACKED,  GUARD_DOWN,    REP_DESCENT, ACT_START},
+    {REP_RACKED,  GUARD_STILL,   REP_RACKED,  ACT_RACK},
+    {REP_DESCENT, GUARD_TILTED,  REP_SPOT,    ACT_SPOT},
+    {REP_DESCENT, GUARD_TIMEOUT, REP_SPOT,    ACT_SPOT},
+    {REP_DESCENT, GUARD_STILL,   REP_BOTTOM,  ACT_BOTTOM},
+    {REP_DESCENT, GUARD_UP,      REP_ASCENT,  ACT_BOTTOM},
+    {REP_BOTTOM,  GUARD_TILTED,  REP_SPOT,    ACT_SPOT},
+    {REP_BOTTOM,  GUARD_TIMEOUT, REP_SPOT,    ACT_SPOT},
+    {REP_BOTTOM,  GUARD_UP,      REP_ASCENT,  ACT_NONE},
+    {REP_ASCENT,  GUARD_FALLING, REP_SPOT,    ACT_SPOT},
+    {REP_ASCENT,  GUARD_STALLING, REP_SPOT,   ACT_SPOT},
+    {REP_ASCENT,  GUARD_TILTED,  REP_SPOT,    ACT_SPOT},
+    {REP_ASCENT,  GUARD_TIMEOUT, REP_SPOT,    ACT_SPOT},
+    {REP_ASCENT,  GUARD_STILL,   REP_RACKED,  ACT_REP},
+    {REP_SPOT,    GUARD_SPOTTED, REP_DONE,    ACT_SPOT_DONE},
+};
+
+const ExerciseDef bench_press = {"bench", 0.005f, 0.02f, 0.06f, 0.17f, 6 * REP_HZ, REP_HZ / 10,
+                                 bench_table, sizeof(bench_table) / sizeof(bench_table[0])};
+const ExerciseDef squat = {"squat", 0.005f, 0.02f, 0.08f, 0.30f, 10 * REP_HZ, REP_HZ / 10,
+                           squat_table, sizeof(squat_table) / sizeof(squat_table[0])};
+
+/// Every exercise which can be picked, the first is used at startup
+const ExerciseDef* const exercises[] = {&bench_press, &squat};
+const uint8_t exercise_count = sizeof(exercises) / sizeof(exercises[0]);
+
+/** @brief   Constructor which creates a machine for one exercise
+ *  @param   def Exercise to follow, its table must be grouped by state in
+ *           order of state
+ */
+RepMachine::RepMachine (const ExerciseDef& def)
+{
+    select(def);
+}
+
+/** @brief   Method which switches to another exercise and starts over
+ *  @details The first row of every state is found here so updates don't have
+ *           to look through the table.
+ *  @param   def Exercise to follow, its table must be grouped by state in
+ *           order of state
+ */
+void RepMachine::select(const ExerciseDef& def)
+{
+    p_def = &def;
+    uint8_t row = 0;
+    for (uint8_t s = 0; s <= REP_STATES; s++){
+        while (row < def.size && def.table[row].from < s){
+            row++;
+        }
+        first[s] = row;
+    }
+    state = REP_WAIT;
+    ticks = 0;
+    fall_count = 0;
+}
+
+/** @brief   Method which moves the machine along one update
+ *  @param   in Latest bar velocity and the other things the guards look at
+ *  @return  Action of the row which was taken, or @c ACT_NONE
+ */
+uint8_t RepMachine::update(const RepInputs& in)
+{
+    const ExerciseDef& def = *p_def;
+    // With every IMU dead the records come far apart, so the rep is timed by the
+    // clock, with at least one step an update
+    int64_t elapsed = (in.time_us - last_us + REP_STEP_US / 2) / REP_STEP_US;
+    last_us = in.time_us;
+    uint16_t steps = elapsed < 1 ? 1 : elapsed > def.max_ticks ? def.max_ticks : elapsed;
+    if (state == REP_DESCENT || state == REP_BOTTOM || state == REP_ASCENT){
+        ticks = ticks + steps > def.max_ticks ? def.max_ticks : ticks + steps;
+    }
+
+    // NaN fails every comparison, so with no bar IMU only the timeout can fire
+    bool still = fabsf(in.bar_vel) < def.still;
+    bool down = in.bar_vel < -def.move;
+    bool up = in.bar_vel > def.move;
+    bool fall = in.bar_vel < -def.fall || in.sagging;
+    if (in.phase != PHASE_NONE){
+        // The classifier knows a slow grind or a bounce from a stop, the falling
+        // speed is still checked in case it misses a failure
+        still = in.phase == PHASE_STILL;
+        down = in.phase == PHASE_DOWN;
+        up = in.phase == PHASE_UP;
+        fall = fall || in.phase == PHASE_FAIL;
+    }
+
+    // A fall has to be seen more than once when there is only one IMU to go on
+    if (fall){
+        fall_count = fall_count < 255 ? fall_count + 1 : fall_count;
+    }
+    else{
+        fall_count = 0;
+    }
+
+    uint8_t guards = 0;
+    guards |= still ? GUARD_STILL : 0;
+    guards |= down ? GUARD_DOWN : 0;
+    guards |= up ? GUARD_UP : 0;
+    guards |= fall_count >= (in.single ? def.single_confirm : 1) ? GUARD_FALLING : 0;
+    guards |= in.tilted ? GUARD_TILTED : 0;
+    guards |= ticks >= def.max_ticks ? GUARD_TIMEOUT : 0;
+    guards |= in.spotted ? GUARD_SPOTTED : 0;
+    guards |= in.stalling ? GUARD_STALLING : 0;
+
+    for (uint8_t row = first[state]; row < first[state + 1]; row++){
+        const RepTransition& t = def.table[row];
+        if ((guards & t.guard) == t.guard){
+            if (t.to != state){
+                fall_count = 0;
+            }
+            if (t.to == REP_DESCENT || t.to == REP_RACKED){
+                ticks = 0;
+            }
+            state = t.to;
+            return t.action;
+        }
+    }
+    return ACT_NONE;
+}
+
+/** @brief   Method which returns the state the machine is in
+ */
+uint8_t RepMachine::get_state(void)
+{
+    return state;
+}
+
+/** @brief   Method which returns how many control steps the current rep has taken
+ */
+uint16_t RepMachine::get_ticks(void)
+{
+    return ticks;
+}
+
+/** @brief   Method which returns the exercise being followed
+ */
+const ExerciseDef& RepMachine::get_exercise(void)
+{
+    return *p_def;
+}
@@ -0,0 +1,123 @@
+/** @file rep_machine.h
+ *  This is the header for the rep machine file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _REP_MACHINE_H_
+#define _REP_MACHINE_H_
+
+#include <stdint.h>
+#include "phase_classifier.h"
+
+#define REP_HZ 100          ///< Updates per second, one for every control step
+#define REP_STEP_US (1000000 / REP_HZ) ///< Time of one control step, us
+
+#define REP_WAIT 0          ///< Waiting for the bar to settle after starting up
+#define REP_RACKED 1        ///< Bar is still in the rack
+#define REP_DESCENT 2       ///< Bar is on its way down
+#define REP_BOTTOM 3        ///< Bar is stopped at the bottom of the rep
+#define REP_ASCENT 4        ///< Bar is on its way up
+#define REP_SPOT 5          ///< Rep failed, the motor is pulling the bar up
+#define REP_DONE 6          ///< Spot finished, slack has to be reset by hand
+#define REP_STATES 7        ///< Number of states
+
+#define GUARD_ALWAYS 0x00   ///< Transition taken on every update
+#define GUARD_STILL 0x01    ///< Bar speed under the exercise's still band
+#define GUARD_DOWN 0x02     ///< Bar moving down faster than the exercise's move speed
+#define GUARD_UP 0x04       ///< Bar moving up faster than the exercise's move speed
+#define GUARD_FALLING 0x08  ///< Bar falling back or sagging for long enough to trust
+#define GUARD_TILTED 0x10   ///< One end of the bar is higher than the other
+#define GUARD_TIMEOUT 0x20  ///< Rep has taken longer than the exercise allows
+#define GUARD_SPOTTED 0x40  ///< Motor has finished pulling the bar up
+#define GUARD_STALLING 0x80 ///< Press is slowing toward a stop well short of the top
+
+#define ACT_NONE 0          ///< Nothing for the caller to do
+#define ACT_RACK 1          ///< Bar is still in the rack, measure its height
+#define ACT_START 2         ///< A rep has started
+#define ACT_BOTTOM 3        ///< Bar has reached the bottom, measure its height
+#define ACT_REP 4           ///< The bar made it back up, the rep is over
+#define ACT_SPOT 5          ///< The rep failed, size and start a spot
+#define ACT_SPOT_DONE 6     ///< The spot is over
+
+/** @brief   One row of an exercise's transition table
+ *  @details The row is taken when the machine is in state @c from and every
+ *           guard bit in @c guard is true. Rows for one state are tried in the
+ *           order they appear in the table and the first match wins.
+ */
+struct RepTransition
+{
+    uint8_t from;
+    uint8_t guard;
+    uint8_t to;
+    uint8_t action;
+};
+
+/** @brief   Everything which makes one exercise different from another
+ *  @details There is a gap between @c still and @c move, so a bar that is
+ *           barely moving is neither still nor moving and the state doesn't
+ *           flip back and forth on noise. Times are in control steps of
+ *           @c REP_STEP_US, counted by the clock rather than by updates.
+ */
+struct ExerciseDef
+{
+    const char* name;
+    float still;            ///< Speed under which the bar is still, m/s
+    float move;             ///< Speed over which the bar is moving, m/s
+    float fall;             ///< Downward speed on the way up which fails the rep, m/s
+    float mvt;              ///< Mean concentric speed of the last rep a lifter can make, m/s
+    uint16_t max_ticks;     ///< Longest a rep may take, control steps
+    uint8_t single_confirm; ///< Updates in a row a fall must last with only one bar IMU
+    const RepTransition* table;
+    uint8_t size;
+};
+
+/** @brief   What the machine is told every update
+ */
+struct RepInputs
+{
+    float bar_vel;          ///< Bar velocity in m/s, NaN if no bar IMU can be trusted
+    bool sagging;           ///< Bar has sunk back from the highest point of the press
+    bool tilted;            ///< One end of the bar is higher than the other
+    bool single;            ///< Only one bar IMU is in use
+    bool spotted;           ///< Motor has finished the spot
+    bool stalling;          ///< Press looks like it will stall short of the top
+    uint8_t phase;          ///< Phase from the phase classifier, @c PHASE_NONE to use the thresholds
+    int64_t time_us;        ///< Time of the record in microseconds
+};
+
+extern const ExerciseDef bench_press;
+extern const ExerciseDef squat;
+extern const ExerciseDef* const exercises[];
+extern const uint8_t exercise_count;
+
+/** @brief   Class which runs one exercise's transition table
+ *  @details Each update the guards are all worked out once into a set of
+ *           bits, then only the rows of the current state are tried, which
+ *           were found when the exercise was picked, so an update costs the
+ *           same no matter how big the table is. The machine never prints or
+ *           touches anything else; it returns the action of the row it took
+ *           and the caller does the work. Which way the bar is going comes
+ *           either from the exercise's speed thresholds or, when it is given a
+ *           phase, from the phase classifier.
+ */
+class RepMachine
+{
+protected:
+    const ExerciseDef* p_def;
+    uint8_t first[REP_STATES + 1];
+    uint8_t state = REP_WAIT;
+    uint16_t ticks = 0;
+    int64_t last_us = 0;
+    uint8_t fall_count = 0;
+public:
+    RepMachine (const ExerciseDef& def);
+    void select(const ExerciseDef& def);
+    uint8_t update(const RepInputs& in);
+    uint8_t get_state(void);
+    uint16_t get_ticks(void);
+    const ExerciseDef& get_exercise(void);
+};
+
+#endif // _REP_MACHINE_H_
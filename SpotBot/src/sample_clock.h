@@ -0,0 +1,71 @@
+/** @file sample_clock.h
+ *  This file contains a small ring of sample timestamps. An interrupt service
+ *  routine puts the time of every data ready interrupt into the ring and the
+ *  task that drains the sensor takes them back out in the same order, so each
+ *  sample gets the time it was actually taken instead of an assumed period.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _SAMPLE_CLOCK_H_
+#define _SAMPLE_CLOCK_H_
+
+#include <stdint.h>
+
+#define SAMPLE_CLOCK_SIZE 256   ///< Timestamps kept; must be a power of two
+
+/** @brief   Class which holds the timestamps of samples not yet read out
+ *  @details Only the ISR writes @c head and only the reading task writes
+ *           @c tail, so no lock is needed as long as the reader never falls
+ *           more than @c SAMPLE_CLOCK_SIZE samples behind.
+ */
+class SampleClock
+{
+protected:
+    volatile int64_t stamps[SAMPLE_CLOCK_SIZE];
+    volatile uint32_t head = 0;
+    uint32_t tail = 0;
+public:
+    /** @brief   Method called from the ISR to record when a sample was taken
+     *  @param   time_us Time of the sample in microseconds
+     */
+    inline void stamp(int64_t time_us)
+    {
+        stamps[head & (SAMPLE_CLOCK_SIZE - 1)] = time_us;
+        head = head + 1;
+    }
+
+    /** @brief   Method which returns the number of samples stamped so far
+     */
+    inline uint32_t count(void)
+    {
+        return head;
+    }
+
+    /** @brief   Method which lines the ring up with the samples in a FIFO
+     *  @details If interrupts were missed, the FIFO was reset or the reader fell
+     *           too far behind, the newest @c ready stamps are taken to belong
+     *           to the @c ready samples waiting in the sensor.
+     *  @param   ready Number of samples waiting to be read from the sensor
+     */
+    inline void align(uint32_t ready)
+    {
+        uint32_t now = head;
+        uint32_t pending = now - tail;
+        if (pending < ready || pending > ready + 2 || pending > SAMPLE_CLOCK_SIZE){
+            tail = now - ready;
+        }
+    }
+
+    /** @brief   Method which returns the timestamp of the next sample read out
+     */
+    inline int64_t next(void)
+    {
+        int64_t time_us = stamps[tail & (SAMPLE_CLOCK_SIZE - 1)];
+        tail++;
+        return time_us;
+    }
+};
+
+#endif // _SAMPLE_CLOCK_H_
@@ -0,0 +1,120 @@
+/** @file sample_history.cpp
+ *  This program contains the ring that keeps a history of bar velocities for
+ *  the web server. It replaces three separate queues of floats with one ring
+ *  of packed rows, which holds twice the history in the same memory and can be
+ *  read as often as needed without taking anything out of it.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "sample_history.h"
+
+/// Velocity units stored per m/s, so rows hold mm/s
+#define HISTORY_PER_MS 1000.0f
+
+/** @brief   Constructor which creates an empty history
+ */
+SampleHistory::SampleHistory (void)
+{
+}
+
+/** @brief   Method which adds one row to the history, overwriting the oldest
+ *           row once the history is full
+ *  @param   time_ms Time the velocities were measured in milliseconds
+ *  @param   vel_r Right velocity in m/s
+ *  @param   vel_l Left velocity in m/s
+ */
+void SampleHistory::put(uint32_t time_ms, float vel_r, float vel_l)
+{
+    uint32_t row = written;
+    uint16_t index = row % HISTORY_SIZE;
+    uint16_t block = index / HISTORY_BLOCK;
+    if (index % HISTORY_BLOCK == 0){
+        base_ms[block] = time_ms;
+    }
+    uint32_t offset = time_ms - base_ms[block];
+    offset_ms[index] = offset > 0xFFFF ? 0xFFFF : offset;
+
+    float r = vel_r * HISTORY_PER_MS;
+    float l = vel_l * HISTORY_PER_MS;
+    r = r > 32767.0f ? 32767.0f : (r < -32767.0f ? -32767.0f : r);
+    l = l > 32767.0f ? 32767.0f : (l < -32767.0f ? -32767.0f : l);
+    right[index] = (int16_t)(r < 0 ? r - 0.5f : r + 0.5f);
+    left[index] = (int16_t)(l < 0 ? l - 0.5f : l + 0.5f);
+
+    // Publishing the row only after all of it has been written
+    __atomic_store_n(&written, row + 1, __ATOMIC_RELEASE);
+}
+
+/** @brief   Method which finds the oldest row a reader can trust
+ *  @details The row being written next may have changed the base time of its
+ *           block, which is shared with the oldest rows, so the whole oldest
+ *           block is treated as gone as soon as the writer reaches it.
+ *  @param   total Number of rows written
+ *  @return  Number of the oldest row which can't be changed by the next write
+ */
+uint32_t SampleHistory::first_safe(uint32_t total)
+{
+    uint32_t block = total / HISTORY_BLOCK;
+    if (block < HISTORY_BLOCKS){
+        return 0;
+    }
+    return (block - HISTORY_BLOCKS + 1) * HISTORY_BLOCK;
+}
+
+/** @brief   Method which returns the number of the oldest row still kept
+ */
+uint32_t SampleHistory::oldest(void)
+{
+    return first_safe(__atomic_load_n(&written, __ATOMIC_ACQUIRE));
+}
+
+/** @brief   Method which returns the number the next row written will get
+ */
+uint32_t SampleHistory::newest(void)
+{
+    return __atomic_load_n(&written, __ATOMIC_ACQUIRE);
+}
+
+/** @brief   Method which copies rows out of the history
+ *  @details Reading doesn't remove anything, so any number of readers can keep
+ *           their own place. If the writer overwrote some of the rows while they
+ *           were being copied those rows are dropped from the front.
+ *  @param   row Number of the first row wanted. It is moved up to the oldest
+ *           row if those rows are gone, and is left one past the last row read
+ *  @param   p_rows Array which gets the rows
+ *  @param   max_rows Most rows to read
+ *  @return  Number of rows put in @c p_rows
+ */
+uint16_t SampleHistory::read(uint32_t& row, HistoryRow* p_rows, uint16_t max_rows)
+{
+    uint32_t total = __atomic_load_n(&written, __ATOMIC_ACQUIRE);
+    uint32_t first = first_safe(total);
+    if (row < first){
+        row = first;
+    }
+    if (row > total){
+        row = total;
+    }
+    uint16_t n = total - row < max_rows ? total - row : max_rows;
+    for (uint16_t i = 0; i < n; i++){
+        uint16_t index = (row + i) % HISTORY_SIZE;
+        p_rows[i].time_ms = base_ms[index / HISTORY_BLOCK] + offset_ms[index];
+        p_rows[i].vel_r = right[index] / HISTORY_PER_MS;
+        p_rows[i].vel_l = left[index] / HISTORY_PER_MS;
+    }
+
+    // Dropping rows the writer got to while they were copied
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    first = first_safe(__atomic_load_n(&written, __ATOMIC_ACQUIRE));
+    uint16_t lost = 0;
+    if (first > row){
+        lost = first - row < n ? first - row : n;
+    }
+    for (uint16_t i = lost; i < n; i++){
+        p_rows[i - lost] = p_rows[i];
+    }
+    row += n;
+    return n - lost;
+}
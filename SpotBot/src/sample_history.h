@@ -0,0 +1,53 @@
+/** @file sample_history.h
+ *  This is the header for the sample history file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _SAMPLE_HISTORY_H_
+#define _SAMPLE_HISTORY_H_
+
+#include <stdint.h>
+
+#define HISTORY_SIZE 2048   ///< Rows kept, 204 s at one row every 100 ms
+#define HISTORY_BLOCK 64    ///< Rows sharing one 32 bit base time
+#define HISTORY_BLOCKS (HISTORY_SIZE / HISTORY_BLOCK) ///< Base times kept
+
+/** @brief   One row of the history unpacked for a reader
+ */
+struct HistoryRow
+{
+    uint32_t time_ms;
+    float vel_r;
+    float vel_l;
+};
+
+/** @brief   Class which keeps the right and left bar velocities over time
+ *  @details Rows are packed into separate arrays, each velocity as an
+ *           @c int16_t in mm/s and each time as a 16 bit offset from the 32 bit
+ *           base time of its block of @c HISTORY_BLOCK rows, so a row takes 6
+ *           bytes and the three values can never get out of step. Rows are
+ *           numbered from the first one ever written. Only one task may write.
+ *           Readers never block the writer: they copy rows and then throw away
+ *           any which the writer got to while they were copying.
+ */
+class SampleHistory
+{
+protected:
+    uint32_t base_ms[HISTORY_BLOCKS];
+    uint16_t offset_ms[HISTORY_SIZE];
+    int16_t right[HISTORY_SIZE];
+    int16_t left[HISTORY_SIZE];
+    volatile uint32_t written = 0;
+
+    static uint32_t first_safe(uint32_t total);
+public:
+    SampleHistory (void);
+    void put(uint32_t time_ms, float vel_r, float vel_l);
+    uint32_t oldest(void);
+    uint32_t newest(void);
+    uint16_t read(uint32_t& row, HistoryRow* p_rows, uint16_t max_rows);
+};
+
+#endif // _SAMPLE_HISTORY_H_
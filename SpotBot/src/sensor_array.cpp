@@ -0,0 +1,291 @@
+/** @file sensor_array.cpp
+ *  This program contains the class which runs every IMU on the robot as one
+ *  array. It takes care of draining their FIFOs with as few multiplexer channel
+ *  switches as possible, stamping samples from IMUs whose INT pin isn't wired
+ *  and lining the IMUs up in time before their velocities are estimated.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "sensor_array.h"
+
+/** @brief   Constructor which creates an empty sensor array
+ *  @param   sample_period_us Time between samples of every IMU in microseconds
+ */
+SensorArray::SensorArray (int32_t sample_period_us)
+    : period_us (sample_period_us)
+{
+}
+
+/** @brief   Method which adds an IMU to the array
+ *  @param   p_imu The IMU
+ *  @param   p_est Velocity estimator for that IMU
+ *  @param   p_clock Timestamps from that IMU's data ready ISR, or NULL if its
+ *           INT pin isn't wired and sample times should be worked out from the
+ *           sample period
+ *  @param   bus Which I2C controller the IMU is on, 0 or 1
+ *  @param   channel Multiplexer channel of the IMU, or -1 if it isn't behind one
+ *  @return  False if the array is full
+ */
+bool SensorArray::add(ImuDriver* p_imu, VelocityEstimator* p_est, SampleClock* p_clock, uint8_t bus, int8_t channel)
+{
+    if (count == SENSOR_MAX || bus >= SENSOR_BUSES){
+        return false;
+    }
+    SensorSlot& slot = slots[count];
+    slot.p_imu = p_imu;
+    slot.p_est = p_est;
+    slot.p_clock = p_clock;
+    slot.bus = bus;
+    slot.channel = channel;
+    slot.head = 0;
+    slot.fill = 0;
+    slot.last_fresh = 0;
+    slot.stale = false;
+    slot.skipped = 0;
+
+    // Keeping the drain order sorted by channel
+    uint8_t i = count;
+    while (i > 0 && slots[order[i - 1]].channel > channel){
+        order[i] = order[i - 1];
+        i--;
+    }
+    order[i] = count;
+    count++;
+    return true;
+}
+
+/** @brief   Method which wakes every IMU up, configures them and starts their FIFOs
+ *  @param   config Filter, range and rate settings used for every IMU
+ *  @return  True if every IMU answered
+ */
+bool SensorArray::begin(const ImuConfig& config)
+{
+    bool ok = true;
+    for (uint8_t i = 0; i < count; i++){
+        ImuDriver* p_imu = slots[order[i]].p_imu;
+        ok = p_imu->begin() && ok;
+        ok = p_imu->configure(config) && ok;
+        ok = p_imu->enable_data_ready() && ok;
+    }
+    return ok;
+}
+
+/** @brief   Method which changes the sample rate of every IMU
+ *  @details Only the filter and rate divider are written, so the FIFOs keep
+ *           running. Samples already in them keep their real timestamps, and
+ *           each velocity estimator switches its decimation when the first
+ *           sample at the new rate reaches it.
+ *  @param   config Settings with the new filter and rate divider
+ *  @param   sample_period_us Time between samples at the new rate
+ *  @return  True if every IMU answered
+ */
+bool SensorArray::set_rate(const ImuConfig& config, int32_t sample_period_us)
+{
+    bool ok = true;
+    for (uint8_t i = 0; i < count; i++){
+        ImuDriver* p_imu = slots[order[i]].p_imu;
+        ok = p_imu->set_dlpf(config.dlpf) && ok;
+        ok = p_imu->set_rate_div(config.rate_div) && ok;
+    }
+    period_us = sample_period_us;
+    return ok;
+}
+
+/** @brief   Method which drains one IMU's FIFO into its pending samples
+ *  @details An IMU that hasn't given samples for @c SENSOR_STALE_US is marked
+ *           stale. Reads of a stale IMU fail on the bus timeout, so it is only
+ *           tried again every @c SENSOR_RETRY drains, until it answers.
+ *  @param   slot The IMU
+ *  @param   now_us Time of the drain, used when the IMU has no timestamps
+ */
+void SensorArray::drain_slot(SensorSlot& slot, int64_t now_us)
+{
+    if (slot.last_fresh == 0){
+        slot.last_fresh = now_us;
+    }
+    if (slot.stale && ++slot.skipped < SENSOR_RETRY){
+        return;
+    }
+    slot.skipped = 0;
+    int16_t ready = slot.p_imu->fifo_samples();
+    if (ready <= 0){
+        slot.stale = now_us - slot.last_fresh > SENSOR_STALE_US;
+        if (ready == 0){
+            // It answered, most likely with a FIFO that overflowed while it was
+            // skipped, and waiting another SENSOR_RETRY drains would only let it
+            // overflow again, so it is read on the next drain
+            slot.skipped = SENSOR_RETRY;
+        }
+        return;
+    }
+    slot.last_fresh = now_us;
+    slot.stale = false;
+    if (slot.p_clock != NULL){
+        slot.p_clock->align(ready);
+    }
+    uint16_t n = ready < SENSOR_BATCH ? ready : SENSOR_BATCH;
+    if (n > SENSOR_PENDING - slot.fill){
+        n = SENSOR_PENDING - slot.fill;
+    }
+    ImuSample* p_batch = scratch[slot.bus];
+    n = slot.p_imu->read_fifo(p_batch, n);
+    for (uint16_t i = 0; i < n; i++){
+        StampedSample& dest = slot.pending[(slot.head + slot.fill) % SENSOR_PENDING];
+        dest.sample = p_batch[i];
+        if (slot.p_clock != NULL){
+            dest.time_us = slot.p_clock->next();
+        }
+        else{
+            // The newest sample in the FIFO was taken about now
+            dest.time_us = now_us - (int64_t)(ready - 1 - i) * period_us;
+        }
+        slot.fill++;
+    }
+}
+
+/** @brief   Method which drains every IMU on one I2C controller
+ *  @details IMUs on different controllers don't share anything here, so the
+ *           two controllers can be drained at the same time from two tasks.
+ *  @param   bus Which I2C controller to drain
+ *  @param   now_us Time of the drain in microseconds
+ */
+void SensorArray::drain(uint8_t bus, int64_t now_us)
+{
+    for (uint8_t i = 0; i < count; i++){
+        uint8_t index = reverse[bus] ? order[count - 1 - i] : order[i];
+        if (slots[index].bus == bus){
+            drain_slot(slots[index], now_us);
+        }
+    }
+    reverse[bus] = !reverse[bus];
+}
+
+/** @brief   Method which runs the oldest pending sample of an IMU through its
+ *           estimator
+ */
+void SensorArray::feed(SensorSlot& slot)
+{
+    StampedSample& oldest = slot.pending[slot.head];
+    slot.health.update(oldest.sample);
+    slot.p_est->update(oldest.sample, oldest.time_us);
+    slot.head = (slot.head + 1) % SENSOR_PENDING;
+    slot.fill--;
+}
+
+/** @brief   Method which picks the IMU the others are lined up against
+ *  @return  Index of the first IMU which isn't stale, or 0 if they all are
+ */
+uint8_t SensorArray::reference(void)
+{
+    for (uint8_t i = 0; i < count; i++){
+        if (!slots[i].stale){
+            return i;
+        }
+    }
+    return 0;
+}
+
+/** @brief   Method which runs pending samples through the estimators in time order
+ *  @details Each step uses the oldest sample of the first IMU and every sample
+ *           of the other IMUs up to half a period after it. A step is only taken
+ *           once every IMU has a sample that recent, unless the first IMU is
+ *           backing up, in which case a missing IMU is left behind rather than
+ *           holding up the rest. Stale IMUs are skipped, and if the first IMU is
+ *           stale the next one takes its place.
+ *  @param   max_steps Most samples of the first IMU to use
+ *  @return  Number of steps taken
+ */
+uint16_t SensorArray::update(uint16_t max_steps)
+{
+    uint16_t steps = 0;
+    if (count == 0){
+        return 0;
+    }
+    uint8_t ref = reference();
+    SensorSlot& first = slots[ref];
+    while (steps < max_steps && first.fill > 0){
+        int64_t step_time = first.pending[first.head].time_us;
+        bool caught_up = true;
+        for (uint8_t i = 0; i < count; i++){
+            SensorSlot& other = slots[i];
+            if (i == ref || other.stale){
+                continue;
+            }
+            if (other.fill == 0){
+                caught_up = false;
+                break;
+            }
+            int64_t newest = other.pending[(other.head + other.fill - 1) % SENSOR_PENDING].time_us;
+            if (newest < step_time - period_us / 2){
+                caught_up = false;
+                break;
+            }
+        }
+        if (!caught_up && first.fill <= SENSOR_PENDING / 2){
+            break;
+        }
+        feed(first);
+        step_us = step_time;
+        for (uint8_t i = 0; i < count; i++){
+            if (i == ref){
+                continue;
+            }
+            SensorSlot& other = slots[i];
+            while (other.fill > 0 && other.pending[other.head].time_us <= step_time + period_us / 2){
+                feed(other);
+            }
+        }
+        steps++;
+    }
+    return steps;
+}
+
+/** @brief   Method which fills in the latest velocity and position of every IMU
+ *  @param   velocities Structure which gets the velocities in m/s and positions
+ *           in m, in the order the IMUs were added, their health and which of
+ *           them are stale
+ */
+void SensorArray::get_velocities(ImuVelocities& velocities)
+{
+    velocities.count = count;
+    velocities.stale = 0;
+    for (uint8_t i = 0; i < count; i++){
+        velocities.vel[i] = slots[i].p_est->get_velocity() * 1e-6f;
+        velocities.pos[i] = slots[i].p_est->get_position() * 1e-6f;
+        velocities.health[i] = slots[i].health.get_score();
+        if (slots[i].stale){
+            velocities.stale |= 1 << i;
+        }
+    }
+}
+
+/** @brief   Method which returns the time of the last step in microseconds
+ *  @details This is when the samples behind the current velocities were taken.
+ */
+int64_t SensorArray::get_time(void)
+{
+    return step_us;
+}
+
+/** @brief   Method which returns the number of IMUs in the array
+ */
+uint8_t SensorArray::size(void)
+{
+    return count;
+}
+
+/** @brief   Method which returns one IMU, in the order they were added
+ */
+ImuDriver* SensorArray::get_imu(uint8_t index)
+{
+    return slots[index].p_imu;
+}
+
+/** @brief   Method which returns one IMU's velocity estimator
+ */
+VelocityEstimator* SensorArray::get_estimator(uint8_t index)
+{
+    return slots[index].p_est;
+}
@@ -0,0 +1,131 @@
+/** @file sensor_array.h
+ *  This is the header for the sensor array file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _SENSOR_ARRAY_H_
+#define _SENSOR_ARRAY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "imu_driver.h"
+#include "sample_clock.h"
+#include "velocity_estimator.h"
+#include "sensor_health.h"
+
+#define SENSOR_MAX 6        ///< Most IMUs one array can hold
+#define SENSOR_BUSES 2      ///< I2C controllers the IMUs can be spread over
+#define SENSOR_PENDING 48   ///< Samples which can wait to be lined up per IMU
+#define SENSOR_BATCH 32     ///< Most samples taken out of one FIFO per drain
+#define SENSOR_STALE_US 50000 ///< Time without new samples before an IMU is stale
+#define SENSOR_RETRY 10     ///< Drains skipped between tries at reading a stale IMU
+
+#define FUSE_NONE 0         ///< No bar IMU can be trusted
+#define FUSE_SINGLE 1       ///< Only one bar IMU can be trusted
+#define FUSE_ALL 2          ///< Two or more bar IMUs agree
+
+/** @brief   An IMU sample along with the time it was taken
+ */
+struct StampedSample
+{
+    ImuSample sample;
+    int64_t time_us;
+};
+
+/** @brief   Velocities and positions of every IMU in an array at one instant
+ *  @details Bit i of @c stale is set if IMU i hasn't given any samples for
+ *           @c SENSOR_STALE_US, in which case its velocity is out of date.
+ *           Positions drift and are only good for differences over a rep.
+ *           The bar velocity and position combine the IMUs in @c used, and
+ *           @c mode says how many of them there were. @c diff_vel is the right
+ *           end's velocity less the left's, @c tilt how much higher the right
+ *           end is and @c tilted is set while the bar is lopsided. @c stalling
+ *           is set while the bar's slowing down looks like a press that won't
+ *           make it, and @c slowing as soon as it looks like it might not. @c phase and @c fail_pct are the phase classifier's
+ *           verdict, @c phase being @c PHASE_NONE when it isn't in use.
+ *           @c time_us is when the samples behind it all were taken.
+ */
+struct ImuVelocities
+{
+    uint8_t count;
+    uint8_t stale;
+    float vel[SENSOR_MAX];
+    float pos[SENSOR_MAX];
+    uint8_t health[SENSOR_MAX];
+    float bar_vel;
+    float bar_pos;
+    uint8_t used;
+    uint8_t mode;
+    float diff_vel;
+    float tilt;
+    bool tilted;
+    bool stalling;
+    bool slowing;
+    uint8_t phase;
+    uint8_t fail_pct;
+    int64_t time_us;
+};
+
+/** @brief   One IMU in the array and the samples drained from it which haven't
+ *           been used yet
+ */
+struct SensorSlot
+{
+    ImuDriver* p_imu;
+    VelocityEstimator* p_est;
+    SampleClock* p_clock;
+    uint8_t bus;
+    int8_t channel;
+    StampedSample pending[SENSOR_PENDING];
+    uint8_t head;
+    uint8_t fill;
+    int64_t last_fresh;
+    bool stale;
+    uint8_t skipped;
+    SensorHealth health;
+};
+
+/** @brief   Class which reads any number of MPU-6050s and keeps their
+ *           velocities lined up in time
+ *  @details IMUs can sit on either I2C controller, directly or behind a
+ *           multiplexer channel. They are drained in order of channel, going
+ *           forward on one pass and backward on the next, so each channel is
+ *           selected once per pass and the last channel of a pass is still
+ *           selected at the start of the next one. Samples are then run through
+ *           each IMU's velocity estimator in time order, one step of the first
+ *           IMU at a time, so all velocities describe the same instant. An IMU
+ *           which stops giving samples is marked stale, only tried every
+ *           @c SENSOR_RETRY drains so it doesn't eat up bus time, and left out
+ *           of the time alignment until it comes back.
+ */
+class SensorArray
+{
+protected:
+    SensorSlot slots[SENSOR_MAX];
+    uint8_t order[SENSOR_MAX];
+    uint8_t count = 0;
+    bool reverse[SENSOR_BUSES] = {false, false};
+    ImuSample scratch[SENSOR_BUSES][SENSOR_BATCH];
+    int32_t period_us;
+    int64_t step_us = 0;
+
+    void drain_slot(SensorSlot& slot, int64_t now_us);
+    void feed(SensorSlot& slot);
+    uint8_t reference(void);
+public:
+    SensorArray (int32_t sample_period_us);
+    bool add(ImuDriver* p_imu, VelocityEstimator* p_est, SampleClock* p_clock, uint8_t bus, int8_t channel);
+    bool begin(const ImuConfig& config);
+    bool set_rate(const ImuConfig& config, int32_t sample_period_us);
+    void drain(uint8_t bus, int64_t now_us);
+    uint16_t update(uint16_t max_steps);
+    void get_velocities(ImuVelocities& velocities);
+    int64_t get_time(void);
+    uint8_t size(void);
+    ImuDriver* get_imu(uint8_t index);
+    VelocityEstimator* get_estimator(uint8_t index);
+};
+
+#endif // _SENSOR_ARRAY_H_
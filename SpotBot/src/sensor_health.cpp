@@ -0,0 +1,75 @@
+/** @file sensor_health.cpp
+ *  This program contains the class which keeps an eye on the raw samples of one
+ *  IMU so a stuck, railed or dead sensor can be left out before its velocity
+ *  misleads the spotter.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <string.h>
+#include "sensor_health.h"
+
+/** @brief   Constructor which creates a health check that trusts the IMU until
+ *           it has seen a reason not to
+ */
+SensorHealth::SensorHealth (void)
+{
+    memset(&last, 0, sizeof(last));
+}
+
+/** @brief   Method which checks one raw sample
+ *  @param   s Raw accelerometer and gyro sample
+ */
+void SensorHealth::update(const ImuSample& s)
+{
+    if (memcmp(&s, &last, sizeof(s)) == 0){
+        if (++same >= HEALTH_STUCK){
+            score = 0;
+        }
+    }
+    else{
+        same = 0;
+    }
+    last = s;
+
+    int16_t axes[3] = {s.accel_x, s.accel_y, s.accel_z};
+    int64_t mag_sq = 0;
+    bool railed = false;
+    for (uint8_t i = 0; i < 3; i++){
+        sum[i] += axes[i];
+        sq[i] += (int32_t)axes[i] * axes[i];
+        mag_sq += (int32_t)axes[i] * axes[i];
+        railed = railed || axes[i] == 32767 || axes[i] == -32768;
+    }
+    if (railed || mag_sq < (int64_t)HEALTH_MIN_MAG * HEALTH_MIN_MAG){
+        bad++;
+    }
+
+    if (++count == HEALTH_WINDOW){
+        // Variance times the window squared, kept in integers so it isn't lost
+        // next to the much larger mean
+        int64_t spread = 0;
+        for (uint8_t i = 0; i < 3; i++){
+            spread += sq[i] * HEALTH_WINDOW - (int64_t)sum[i] * sum[i];
+            sum[i] = 0;
+            sq[i] = 0;
+        }
+        // Half the samples out of range brings the score down to zero
+        int16_t new_score = 100 - 200 * bad / HEALTH_WINDOW;
+        if (same >= HEALTH_STUCK || spread < (int64_t)HEALTH_MIN_VAR * HEALTH_WINDOW * HEALTH_WINDOW || new_score < 0){
+            new_score = 0;
+        }
+        score = new_score;
+        count = 0;
+        bad = 0;
+    }
+}
+
+/** @brief   Method which returns how much the IMU can be trusted
+ *  @return  0 for not at all up to 100 for fully
+ */
+uint8_t SensorHealth::get_score(void)
+{
+    return score;
+}
@@ -0,0 +1,44 @@
+/** @file sensor_health.h
+ *  This is the header for the sensor health file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _SENSOR_HEALTH_H_
+#define _SENSOR_HEALTH_H_
+
+#include <stdint.h>
+#include "imu_driver.h"
+
+#define HEALTH_WINDOW 256     ///< Samples in each health check
+#define HEALTH_STUCK 32       ///< Identical samples in a row which mean the IMU is stuck
+#define HEALTH_MIN_VAR 4      ///< Smallest total accelerometer variance of a working IMU, ticks^2
+#define HEALTH_MIN_MAG 4096   ///< Smallest believable acceleration, ticks (0.25 g at +-2 g)
+
+/** @brief   Class which scores how much one IMU's raw samples can be trusted
+ *  @details Three things are checked. An IMU which keeps sending exactly the
+ *           same sample is stuck, since real sensor noise never repeats all six
+ *           axes; this is caught within @c HEALTH_STUCK samples. Samples with an
+ *           axis on the rail or almost no acceleration at all are out of range.
+ *           An IMU whose accelerometer noise disappears over a whole window has
+ *           stopped measuring. The score is 0 to 100 and is worked out again
+ *           at the end of every window, so a recovered IMU earns its way back.
+ */
+class SensorHealth
+{
+protected:
+    ImuSample last;
+    uint16_t same = 0;
+    uint16_t count = 0;
+    uint16_t bad = 0;
+    int32_t sum[3] = {0, 0, 0};
+    int64_t sq[3] = {0, 0, 0};
+    uint8_t score = 100;
+public:
+    SensorHealth (void);
+    void update(const ImuSample& s);
+    uint8_t get_score(void);
+};
+
+#endif // _SENSOR_HEALTH_H_
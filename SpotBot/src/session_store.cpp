@@ -0,0 +1,271 @@
+/** @file session_store.cpp
+ *  This program contains the store which keeps the history of a whole workout.
+ *  Velocities from the IMU task are kept raw for a few seconds, boiled down to
+ *  100 ms aggregates for the set being lifted and to one summary per rep for
+ *  the rest of the session, all as they arrive.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "session_store.h"
+
+/** @brief   Function which turns a velocity in m/s into a whole number of mm/s
+ */
+static int16_t to_mm_s(float vel)
+{
+    float mm_s = vel * 1000.0f;
+    mm_s = mm_s > 32767.0f ? 32767.0f : (mm_s < -32767.0f ? -32767.0f : mm_s);
+    return (int16_t)(mm_s < 0 ? mm_s - 0.5f : mm_s + 0.5f);
+}
+
+/** @brief   Constructor which creates an empty store
+ */
+SessionStore::SessionStore (void)
+{
+    memset(&rep, 0, sizeof(rep));
+    memset(&session, 0, sizeof(session));
+}
+
+/** @brief   Method which finishes the open aggregate and puts it in its ring
+ */
+void SessionStore::close_aggregate(void)
+{
+    AggregateRow& row = aggs[agg_written % STORE_AGG_SIZE];
+    row.time_ms = agg_ms;
+    row.min_r = agg_min[0];
+    row.max_r = agg_max[0];
+    row.mean_r = agg_sum[0] / agg_count;
+    row.min_l = agg_min[1];
+    row.max_l = agg_max[1];
+    row.mean_l = agg_sum[1] / agg_count;
+    agg_written++;
+    agg_count = 0;
+}
+
+/** @brief   Method which adds one pair of velocities to every level of the store
+ *  @param   time_ms Time the velocities were measured in milliseconds
+ *  @param   vel_r Right velocity in m/s
+ *  @param   vel_l Left velocity in m/s
+ *  @param   bar_vel Bar velocity combined from the healthy bar IMUs in m/s
+ */
+void SessionStore::add(uint32_t time_ms, float vel_r, float vel_l, float bar_vel)
+{
+    int16_t bar = to_mm_s(bar_vel);
+    int16_t vel[2] = {to_mm_s(vel_r), to_mm_s(vel_l)};
+    uint32_t bucket = time_ms - time_ms % STORE_AGG_MS;
+
+    portENTER_CRITICAL(&lock);
+    if (session.start_ms == 0){
+        session.start_ms = time_ms;
+    }
+
+    RawRow& row = raw[raw_written % STORE_RAW_SIZE];
+    row.time_ms = time_ms;
+    row.vel_r = vel[0];
+    row.vel_l = vel[1];
+    raw_written++;
+
+    if (agg_count > 0 && bucket != agg_ms){
+        close_aggregate();
+    }
+    if (agg_count == 0){
+        agg_ms = bucket;
+        for (uint8_t i = 0; i < 2; i++){
+            agg_min[i] = vel[i];
+            agg_max[i] = vel[i];
+            agg_sum[i] = 0;
+        }
+    }
+    for (uint8_t i = 0; i < 2; i++){
+        agg_min[i] = vel[i] < agg_min[i] ? vel[i] : agg_min[i];
+        agg_max[i] = vel[i] > agg_max[i] ? vel[i] : agg_max[i];
+        agg_sum[i] += vel[i];
+    }
+    agg_count++;
+
+    if (in_rep){
+        analytics.add(time_ms, bar);
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+/** @brief   Method which marks the start of a rep
+ *  @details A rep which starts more than @c STORE_SET_REST_MS after the last
+ *           one ended starts a new set, and the set aggregates start over.
+ *  @param   time_ms Time the bar started moving in milliseconds
+ */
+void SessionStore::begin_rep(uint32_t time_ms)
+{
+    portENTER_CRITICAL(&lock);
+    if (session.sets == 0 || time_ms - last_rep_ms > STORE_SET_REST_MS){
+        // The bucket still open belongs to the rest before this set
+        if (agg_count > 0){
+            close_aggregate();
+        }
+        session.sets++;
+        set_first = agg_written;
+    }
+    memset(&rep, 0, sizeof(rep));
+    rep.start_ms = time_ms;
+    rep.set = session.sets;
+    analytics.begin(time_ms);
+    in_rep = true;
+    portEXIT_CRITICAL(&lock);
+}
+
+/** @brief   Method which marks the end of a rep and saves its summary
+ *  @param   time_ms Time the rep ended in milliseconds
+ *  @param   failed True if the lifter needed a spot
+ *  @param   rom_mm Range of motion of the rep
+ *  @param   sticking_mm Height of the sticking point above the chest, 0 if none
+ */
+void SessionStore::end_rep(uint32_t time_ms, bool failed, int16_t rom_mm, int16_t sticking_mm)
+{
+    portENTER_CRITICAL(&lock);
+    if (in_rep){
+        uint32_t duration = time_ms - rep.start_ms;
+        rep.duration_ms = duration > 0xFFFF ? 0xFFFF : duration;
+        rep.failed = failed;
+        rep.rom = rom_mm;
+        rep.sticking = sticking_mm;
+        analytics.finish(rep);
+        reps[(session.reps + session.failed) % STORE_REP_SIZE] = rep;
+        if (failed){
+            session.failed++;
+        }
+        else{
+            session.reps++;
+        }
+        session.best_up = rep.peak_up > session.best_up ? rep.peak_up : session.best_up;
+        session.up_ms += rep.concentric_ms;
+        last_rep_ms = time_ms;
+        in_rep = false;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+/** @brief   Method which copies raw rows out of the store
+ *  @details Rows are copied a few at a time, letting go of the lock in
+ *           between. If rows still to be copied are overwritten in the
+ *           meantime the read stops there, so the rows given back always
+ *           follow on from each other.
+ *  @param   row Number of the first row wanted, counting every row ever added.
+ *           It is moved up to the oldest row kept if those rows are gone, and
+ *           is left one past the last row read
+ *  @param   p_rows Array which gets the rows
+ *  @param   max_rows Most rows to read
+ *  @return  Number of rows put in @c p_rows
+ */
+uint16_t SessionStore::read_raw(uint32_t& row, RawRow* p_rows, uint16_t max_rows)
+{
+    uint16_t n = 0;
+    while (n < max_rows){
+        portENTER_CRITICAL(&lock);
+        uint32_t oldest = raw_written > STORE_RAW_SIZE ? raw_written - STORE_RAW_SIZE : 0;
+        if (row < oldest){
+            if (n > 0){
+                portEXIT_CRITICAL(&lock);
+                break;
+            }
+            row = oldest;
+        }
+        if (row > raw_written){
+            row = raw_written;
+        }
+        uint32_t chunk = raw_written - row;
+        chunk = chunk < (uint32_t)(max_rows - n) ? chunk : max_rows - n;
+        chunk = chunk < STORE_READ_CHUNK ? chunk : STORE_READ_CHUNK;
+        for (uint16_t i = 0; i < chunk; i++){
+            p_rows[n + i] = raw[(row + i) % STORE_RAW_SIZE];
+        }
+        portEXIT_CRITICAL(&lock);
+        if (chunk == 0){
+            break;
+        }
+        row += chunk;
+        n += chunk;
+    }
+    return n;
+}
+
+/** @brief   Method which copies the aggregates of the current set out of the store
+ *  @details Aggregates are copied a few at a time like raw rows. If a new set
+ *           starts, or the aggregates still to be copied are overwritten, in
+ *           the meantime the read stops there.
+ *  @param   first Index of the first aggregate wanted, 0 being the start of the
+ *           set. If the set is longer than the ring, the aggregates before the
+ *           oldest one kept are skipped
+ *  @param   p_rows Array which gets the aggregates
+ *  @param   max_rows Most aggregates to read
+ *  @return  Number of aggregates put in @c p_rows
+ */
+uint16_t SessionStore::read_set(uint16_t first, AggregateRow* p_rows, uint16_t max_rows)
+{
+    uint16_t n = 0;
+    uint32_t set = 0;
+    uint32_t start = 0;
+    while (n < max_rows){
+        portENTER_CRITICAL(&lock);
+        uint32_t oldest = agg_written > STORE_AGG_SIZE ? agg_written - STORE_AGG_SIZE : 0;
+        if (n == 0){
+            set = set_first;
+            start = set + first;
+            start = start < oldest ? oldest : start;
+        }
+        else if (set != set_first || start < oldest){
+            portEXIT_CRITICAL(&lock);
+            break;
+        }
+        uint32_t chunk = start < agg_written ? agg_written - start : 0;
+        chunk = chunk < (uint32_t)(max_rows - n) ? chunk : max_rows - n;
+        chunk = chunk < STORE_READ_CHUNK ? chunk : STORE_READ_CHUNK;
+        for (uint16_t i = 0; i < chunk; i++){
+            p_rows[n + i] = aggs[(start + i) % STORE_AGG_SIZE];
+        }
+        portEXIT_CRITICAL(&lock);
+        if (chunk == 0){
+            break;
+        }
+        start += chunk;
+        n += chunk;
+    }
+    return n;
+}
+
+/** @brief   Method which returns the number of reps finished this session
+ */
+uint16_t SessionStore::rep_count(void)
+{
+    portENTER_CRITICAL(&lock);
+    uint16_t count = session.reps + session.failed;
+    portEXIT_CRITICAL(&lock);
+    return count;
+}
+
+/** @brief   Method which copies out the summary of one rep
+ *  @param   index Which rep, 0 being the first of the session
+ *  @param   summary Structure which gets the summary
+ *  @return  False if that rep hasn't happened or is too old to still be kept
+ */
+bool SessionStore::get_rep(uint16_t index, RepSummary& summary)
+{
+    bool ok;
+    portENTER_CRITICAL(&lock);
+    uint16_t count = session.reps + session.failed;
+    ok = index < count && count - index <= STORE_REP_SIZE;
+    if (ok){
+        summary = reps[index % STORE_REP_SIZE];
+    }
+    portEXIT_CRITICAL(&lock);
+    return ok;
+}
+
+/** @brief   Method which copies out the totals for the whole session
+ */
+void SessionStore::get_session(SessionSummary& summary)
+{
+    portENTER_CRITICAL(&lock);
+    summary = session;
+    portEXIT_CRITICAL(&lock);
+}
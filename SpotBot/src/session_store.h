@@ -0,0 +1,108 @@
+/** @file session_store.h
+ *  This is the header for the session store file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _SESSION_STORE_H_
+#define _SESSION_STORE_H_
+
+#include <Arduino.h>
+#include "rep_analytics.h"
+
+#define STORE_RAW_SIZE 512     ///< Raw rows kept, 5 s at the 100 Hz control rate
+#define STORE_AGG_SIZE 600     ///< 100 ms aggregates kept, 60 s of the current set
+#define STORE_REP_SIZE 200     ///< Rep summaries kept for the session
+#define STORE_AGG_MS 100       ///< Length of one aggregate
+#define STORE_SET_REST_MS 60000 ///< Rest between reps which starts a new set
+#define STORE_READ_CHUNK 16    ///< Rows a reader copies per critical section
+
+/** @brief   Right and left velocities at one instant, in mm/s
+ */
+struct RawRow
+{
+    uint32_t time_ms;
+    int16_t vel_r;
+    int16_t vel_l;
+};
+
+/** @brief   Smallest, largest and mean right and left velocities over
+ *           @c STORE_AGG_MS, in mm/s
+ */
+struct AggregateRow
+{
+    uint32_t time_ms;
+    int16_t min_r;
+    int16_t max_r;
+    int16_t mean_r;
+    int16_t min_l;
+    int16_t max_l;
+    int16_t mean_l;
+};
+
+/** @brief   Totals over the whole session
+ */
+struct SessionSummary
+{
+    uint32_t start_ms;
+    uint16_t reps;
+    uint16_t failed;
+    uint8_t sets;
+    int16_t best_up;
+    uint32_t up_ms;
+};
+
+/** @brief   Class which keeps a whole workout in a fixed amount of memory
+ *  @details Data is kept at three resolutions. Raw rows are kept for the last
+ *           few seconds, min/max/mean aggregates of every 100 ms for the
+ *           current set, and one summary per rep for the whole session, along
+ *           with running totals. Every row that comes in is folded into the
+ *           open aggregate and the open rep's analytics right away, so nothing
+ *           has to be gone back over and a rep's summary is done the moment it
+ *           ends. The totals can be read at any time. The rings
+ *           are fixed arrays, and when one is full its oldest rows are dropped.
+ *           The IMU task adds rows, the spot task marks reps and the web server
+ *           reads, so every access is a short critical section. Readers copy
+ *           at most @c STORE_READ_CHUNK rows per critical section, so a big
+ *           read never holds up the IMU task for long.
+ */
+class SessionStore
+{
+protected:
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+    RawRow raw[STORE_RAW_SIZE];
+    uint32_t raw_written = 0;
+
+    AggregateRow aggs[STORE_AGG_SIZE];
+    uint32_t agg_written = 0;
+    uint32_t set_first = 0;
+    uint32_t agg_ms = 0;
+    int16_t agg_min[2];
+    int16_t agg_max[2];
+    int32_t agg_sum[2];
+    uint16_t agg_count = 0;
+
+    RepSummary reps[STORE_REP_SIZE];
+    RepSummary rep;
+    RepAnalytics analytics;
+    bool in_rep = false;
+    uint32_t last_rep_ms = 0;
+
+    SessionSummary session;
+
+    void close_aggregate(void);
+public:
+    SessionStore (void);
+    void add(uint32_t time_ms, float vel_r, float vel_l, float bar_vel);
+    void begin_rep(uint32_t time_ms);
+    void end_rep(uint32_t time_ms, bool failed, int16_t rom_mm, int16_t sticking_mm);
+    uint16_t read_raw(uint32_t& row, RawRow* p_rows, uint16_t max_rows);
+    uint16_t read_set(uint16_t first, AggregateRow* p_rows, uint16_t max_rows);
+    uint16_t rep_count(void);
+    bool get_rep(uint16_t index, RepSummary& summary);
+    void get_session(SessionSummary& summary);
+};
+
+#endif // _SESSION_STORE_H_
@@ -12,28 +12,49 @@
 #ifndef _SHARES_H_
 #define _SHARES_H_
 
-#include "taskqueue.h"
-#include "taskshare.h"
+#include "channels.h"
+#include "sensor_array.h"
+#include "sample_history.h"
+#include "session_store.h"
+#include "velocity_training.h"
 
-// A share which holds boolean whether or not to be spotted
-extern Share<bool> spot_me_bro;
+// A trigger which starts a spot right away, carrying how far the motor has to pull in mm
+extern Trigger<float> spot_trigger;
 
-// A share which holds boolean whether spotting is completed or not
-extern Share<bool> spot_complete;
+// A mailbox which holds boolean whether the press is slowing enough that the motor should get ready
+extern Mailbox<bool> motor_ready;
 
-// A share which holds boolean whether to send data or not
-extern Share<bool> send_data;
+// A mailbox which holds boolean whether the bar has been sitting in the rack
+extern Mailbox<bool> bar_idle;
 
-// A queue which triggers a task to print the count at certain times
-extern Queue<float> vel_queue;
+// A mailbox which holds boolean whether spotting is completed or not
+extern Mailbox<bool> spot_complete;
 
-// A queue which holds time values to be displayed by task_webserver
-extern Queue<float> timer;
+// A mailbox which holds which of the known exercises the lifter is doing
+extern Mailbox<uint8_t> exercise_pick;
 
-// A queue which holds right IMU velocity values to be displayed by task_webserver
-extern Queue<float> vel_r;
+// A mailbox which holds the load on the bar in kg, 0 if it isn't known
+extern Mailbox<float> bar_load;
 
-// A queue which holds left IMU velocity values to be displayed by task_webserver
-extern Queue<float> vel_l;
+// A mailbox which holds the velocity loss in percent at which a set should end, 0 for never
+extern Mailbox<float> loss_limit;
+
+// A mailbox which holds the velocity based training numbers after the latest rep
+extern Mailbox<TrainingStatus> training_status;
+
+// A mailbox which holds boolean whether to send data or not
+extern Mailbox<bool> send_data;
+
+// A queue of records with the velocity of every IMU and the bar velocity combined from
+// the healthy bar IMUs, all from the same instant, from task_IMU to task_spot once every
+// control step
+#define BAR_SAMPLES_SIZE 32 ///< Control steps task_spot can fall behind by (320 ms)
+extern SpscQueue<ImuVelocities, BAR_SAMPLES_SIZE> bar_samples;
+
+// The whole workout kept at three resolutions
+extern SessionStore session;
+
+// A history of times and right and left IMU velocities to be displayed by task_webserver
+extern SampleHistory vel_history;
 
 #endif // _SHARES_H_
\ No newline at end of file
@@ -0,0 +1,108 @@
+/** @file stall_predictor.cpp
+ *  This program contains the class which watches how fast a press is slowing so
+ *  the spot can start as the bar stalls, rather than once it has already come
+ *  back down or the rep has run out of time.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "stall_predictor.h"
+
+#define CONTROL_HZ 100        ///< Control steps per second
+
+// Sums of the age order and its square over a full window, fixed by its length
+#define K_SUM ((int32_t)STALL_WINDOW * (STALL_WINDOW - 1) / 2)
+#define K_SQ_SUM ((int32_t)(STALL_WINDOW - 1) * STALL_WINDOW * (2 * STALL_WINDOW - 1) / 6)
+
+/** @brief   Constructor which creates a predictor with an empty window
+ */
+StallPredictor::StallPredictor (void)
+{
+    reset();
+}
+
+/** @brief   Method which empties the window, such as when the bar velocity
+ *           can't be trusted
+ */
+void StallPredictor::reset(void)
+{
+    idx = 0;
+    fill = 0;
+    sum = 0;
+    sum_k = 0;
+    peak = 0;
+    fit = 0;
+    slope = 0;
+    count = 0;
+    slow = false;
+}
+
+/** @brief   Method which adds one control step's bar velocity
+ *  @param   bar_vel Bar velocity in m/s, positive up
+ */
+void StallPredictor::update(float bar_vel)
+{
+    if (bar_vel != bar_vel){
+        reset();
+        return;
+    }
+    int32_t vel = (int32_t)(bar_vel * 1000);
+
+    // Every velocity left in the window gets one step older
+    if (fill == STALL_WINDOW){
+        int32_t oldest = window[idx];
+        sum_k -= sum - oldest;
+        sum -= oldest;
+        sum_k += (STALL_WINDOW - 1) * vel;
+    }
+    else{
+        sum_k += fill * vel;
+        fill++;
+    }
+    sum += vel;
+    window[idx] = vel;
+    idx = (idx + 1) % STALL_WINDOW;
+
+    // A press can only stall once it has got going, anything else starts it over
+    peak = vel <= 0 ? 0 : vel > peak ? vel : peak;
+    if (fill < STALL_WINDOW){
+        count = 0;
+        slow = false;
+        return;
+    }
+
+    // Least squares line through the window, in mm/s per step
+    slope = (float)((int64_t)STALL_WINDOW * sum_k - (int64_t)K_SUM * sum)
+            / ((int64_t)STALL_WINDOW * K_SQ_SUM - (int64_t)K_SUM * K_SUM);
+    fit = (float)sum / STALL_WINDOW + slope * (STALL_WINDOW - 1) / 2.0f;
+
+    bool stall = peak >= STALL_ARM && fit > 0 && fit < STALL_SLOW
+                 && slope * CONTROL_HZ < -STALL_DECEL && predicted() <= 0;
+    count = stall ? (count < STALL_CONFIRM ? count + 1 : count) : 0;
+    slow = peak >= STALL_ARM && fit > 0 && fit < STALL_READY_SLOW && slope * CONTROL_HZ < -STALL_READY_DECEL;
+}
+
+/** @brief   Method which returns true once a stall has been predicted for
+ *           @c STALL_CONFIRM steps in a row
+ */
+bool StallPredictor::stalling(void)
+{
+    return count >= STALL_CONFIRM;
+}
+
+/** @brief   Method which returns true while a press that got going is slowing
+ *           down enough that it might stall
+ */
+bool StallPredictor::slowing(void)
+{
+    return slow;
+}
+
+/** @brief   Method which returns the bar velocity the trend is headed for
+ *  @return  Velocity @c STALL_HORIZON steps from now in mm/s
+ */
+float StallPredictor::predicted(void)
+{
+    return fit + slope * STALL_HORIZON;
+}
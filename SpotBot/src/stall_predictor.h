@@ -0,0 +1,57 @@
+/** @file stall_predictor.h
+ *  This is the header for the stall predictor file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _STALL_PREDICTOR_H_
+#define _STALL_PREDICTOR_H_
+
+#include <stdint.h>
+
+#define STALL_WINDOW 16       ///< Control steps the velocity trend is fit over (160 ms)
+#define STALL_HORIZON 25      ///< Control steps ahead the trend is carried (250 ms)
+#define STALL_ARM 100         ///< Speed a press must reach before it can stall, mm/s
+#define STALL_SLOW 150        ///< Speed under which a slowing press may be stalling, mm/s
+#define STALL_DECEL 400       ///< Slowing down which may be a stall, mm/s^2
+#define STALL_CONFIRM 3       ///< Control steps in a row a stall must be predicted (30 ms)
+#define STALL_READY_SLOW 300  ///< Speed under which a slowing press is worth getting ready for, mm/s
+#define STALL_READY_DECEL 200 ///< Slowing down which is worth getting ready for, mm/s^2
+
+/** @brief   Class which sees a press grinding to a halt before the bar turns
+ *           back down
+ *  @details A straight line is fit by least squares to the last
+ *           @c STALL_WINDOW bar velocities and carried @c STALL_HORIZON steps
+ *           ahead. Velocities are kept in whole mm/s, so the sums behind the
+ *           fit are updated exactly as samples come and go and each step costs
+ *           the same however long the window is. Once a press has got going, a
+ *           stall is predicted when it is slow, slowing hard and headed for
+ *           zero within the horizon. Presses also slow to a stop at lockout, so
+ *           the caller has to check the bar is still well short of the top.
+ *           A press which is only slowing down, well before it could be called
+ *           a stall, is flagged as well so the motor can get ready.
+ */
+class StallPredictor
+{
+protected:
+    int32_t window[STALL_WINDOW];
+    uint8_t idx = 0;
+    uint8_t fill = 0;
+    int32_t sum = 0;          // Sum of the velocities in the window
+    int32_t sum_k = 0;        // Sum of each velocity times its age order, oldest 0
+    int32_t peak = 0;
+    float fit = 0;
+    float slope = 0;
+    uint8_t count = 0;
+    bool slow = false;
+public:
+    StallPredictor (void);
+    void reset(void);
+    void update(float bar_vel);
+    bool stalling(void);
+    bool slowing(void);
+    float predicted(void);
+};
+
+#endif // _STALL_PREDICTOR_H_
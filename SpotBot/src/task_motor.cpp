@@ -1,9 +1,12 @@
 /** @file task_motor.cpp
  *  This program includes motor task which interfaces with the motor by creating an object
  *  of the motor driver class and turning on/off the motor based on other task data. This
- *  also includes encoder functionality using an ISR to track motor position. Task motor runs
- *  through two states where it is off checking if there is a spot needed or turned on and
- *  checking if it has reached the rack.
+ *  also includes encoder functionality using an ISR to track motor position. The cable
+ *  puller decides what the motor does: off waiting for a spot to be needed, or turned on and
+ *  checking if it has reached the rack, plus getting ready for a spot that looks likely and
+ *  standing down again. The task has the highest priority of all and sleeps
+ *  on the spot trigger while the motor is off, so the motor starts as soon as task_spot
+ *  fires it rather than at the next time the task happens to look.
  * 
  *  @author Christian Clephan
  *  @date   11-25-22
@@ -11,16 +14,29 @@
 
 #include "motor_driver.h"
 #include "task_motor.h"
+#include "cable_puller.h"
 #include "PrintStream.h"
 #include "shares.h"
 #include <Arduino.h>
 
 #define OUTA 36
 #define OUTB 39
+#define POLL_MS 50          ///< Time between encoder checks while the motor is pulling
+#define FORCE_POLL_MS 2     ///< Time between encoder checks until the cable is lifting the bar
+#define IDLE_POLL_MS 20     ///< Time between checks for getting ready while the motor is off
+#define READY_POLL_MS 5     ///< Time between encoder checks while getting ready
+#define ACT_BUCKET_US 100   ///< Width of each bin of the actuation delay histogram
+#define ACT_BUCKETS 10      ///< Bins in the histogram, the last holds everything slower
+
+// #define MEASURE_ACTUATION to print how long the motor takes to start after a spot is
+// fired, or #undef MEASURE_ACTUATION for normal use
+#undef MEASURE_ACTUATION
+
+// #define PRINT_ENCODER to print the cable pulled at every encoder check during a spot, or
+// #undef PRINT_ENCODER for normal use
+#undef PRINT_ENCODER
 
-uint8_t state = 0;
 MotorDriver motor;
-bool spot = 0;
 
 bool OUTA_val1 = digitalRead(OUTA);
 bool OUTA_val2 = digitalRead(OUTA);
@@ -31,9 +47,19 @@ float rev_to_mm = 2*3.1415*3;
 float pos = 0;
 int16_t my_duty = 100;
 float encoder_pos = 0;
-float spot_distance = 207; //(distance from bench to highest rack - depth of persons chest) 
+float spot_distance = 207; //Pull for a spot in mm, sized by task_spot from how far the bar is below the rack
+CablePuller puller(my_duty > 0 ? my_duty : -my_duty); //Decides how hard to pull, measuring every pull from where the cable rested
+
+int16_t last_duty = 0; //Duty the motor was last driven at
+bool spot_ready = false; //The motor was ready when the last spot was fired
 
-Share<bool> spot_complete("Is complete?");
+Mailbox<bool> spot_complete("Is complete?");
+
+#ifdef MEASURE_ACTUATION
+uint16_t actuation[ACT_BUCKETS]; //Histogram of the time from a spot being fired to the motor starting
+int64_t actuation_max = 0;
+int64_t actuation_us = 0; //Time from the last spot being fired to the motor starting
+#endif
 
 /** @brief ISR that updates encoder count when there is a change in encoder digitalRead value
 */
@@ -50,12 +76,40 @@ void update_pos(){
   OUTA_val2 = OUTA_val1;
 }
 
+/** @brief Function which returns how much cable the motor has wound in since startup
+ *  @return Distance in mm, positive in the lifting direction
+ */
+float cable_mm(void){
+    float distance = counter*calib_coeff*rev_to_mm; //convert ticks to revolutions and revolutions to millimeters
+    if (my_duty > 0){    //if duty is positive flip sign
+        distance *= -1;
+    }
+    return distance;
+}
+
+/** @brief Function which drives the motor at a duty from the cable puller
+ *  @param duty Duty in the lifting direction, zero stops the motor
+ */
+void drive(int16_t duty){
+    if (duty == 0){
+        motor.stop();
+    }
+    else{
+        motor.set_duty(my_duty > 0 ? duty : -duty); //This can be varied depending on the weight or if it needs to go faster
+    }
+}
+
 /** @brief Task motor interfaces with other tasks shares to turn on and off motor 
  *  @details First the pins for the encoder are set and the ISRs are set to run when
- *  digitalREAD of either pin OUTA or OUTB is changed. Next, the state machine is run
- *  starting at checking if a spot is needed, and if so spinning the motor and transitioning 
- *  states. In the next state the encoder is used to track motor position to if the barbell
- *  has been pulled enough to reach the safety rack.
+ *  digitalREAD of either pin OUTA or OUTB is changed. Then the task sleeps on the spot
+ *  trigger, and the moment a spot is fired the motor is started. While it pulls the encoder
+ *  is used to track motor position to if the barbell has been pulled enough to reach the
+ *  safety rack, checking often until the cable has started lifting the bar and less often
+ *  after. While waiting, task_spot may say a press is slowing down; the cable puller then
+ *  winds in the slack until the cable comes taut and holds it there, so a spot that follows
+ *  doesn't lose time taking up slack and spinning up, and lets it back out if the press
+ *  makes it. The time from a spot being fired to the cable starting to lift the bar is
+ *  printed after every spot.
 */
 void task_motor(void* p_params){
     pinMode(OUTA, INPUT);
@@ -63,30 +117,47 @@ void task_motor(void* p_params){
     attachInterrupt(OUTA, update_pos, CHANGE);
     attachInterrupt(OUTB, update_pos, CHANGE);
     while(1){
-        if (state == 0){
-            spot = spot_me_bro.get();
-            if(spot){
-                motor.set_duty(my_duty); //This can be varied depending on the weight or if it needs to go faster
-                state = 1;
-            }
+        uint8_t state = puller.get_state();
+        if (state == PULL_SPOT){
+            vTaskDelay(puller.get_force_us() == 0 ? FORCE_POLL_MS : POLL_MS);
         }
-        if (state == 1){
-            encoder_pos = counter*calib_coeff*rev_to_mm; //convert ticks to revolutions and revolutions to millimeters
-            if (my_duty > 0){    //if duty is positive flip sign
-                encoder_pos *= -1;
-            }
+        //Sleeping until a spot is fired, checking now and then if the motor should get ready
+        else if (spot_trigger.wait(spot_distance, state == PULL_IDLE ? IDLE_POLL_MS : READY_POLL_MS)){
+            bool was_ready = state != PULL_IDLE;
+            last_duty = puller.fire(cable_mm(), spot_distance, spot_trigger.get_time());
+            drive(last_duty);
+#ifdef MEASURE_ACTUATION
+            //Only noted here, it is printed once the spot is over so the printing can't hold up the pull
+            actuation_us = esp_timer_get_time() - spot_trigger.get_time();
+            uint32_t bucket = actuation_us / ACT_BUCKET_US;
+            actuation[bucket < ACT_BUCKETS ? bucket : ACT_BUCKETS - 1]++;
+            actuation_max = actuation_us > actuation_max ? actuation_us : actuation_max;
+#endif
+            spot_ready = was_ready;
+            continue;
+        }
+        encoder_pos = cable_mm();
+#ifdef PRINT_ENCODER
+        if (state == PULL_SPOT){
             Serial << encoder_pos << endl;
-            if(encoder_pos >= spot_distance){ //Checks if motor has pulled passed distance between user and rack
-                state = 2;
-            }
         }
-        if (state == 2){
-          motor.stop();
-          spot_complete.put(1); //Set spot complete share to true
-          state = 0;
-          spot_me_bro.put(0); //We no longer need a spot
+#endif
+        int16_t duty = puller.update(encoder_pos, motor_ready.get(), esp_timer_get_time());
+        if (duty != last_duty){
+            drive(duty);
+            last_duty = duty;
+        }
+        if (puller.take_done()){
+            spot_complete.put(1); //Set spot complete share to true
+            Serial << "Time to force: " << (int32_t)(puller.get_force_us() / 1000) << " ms"
+                   << (spot_ready ? " (ready)" : " (cold)") << " | Slack: " << puller.get_slack_mm() << " mm" << endl;
+#ifdef MEASURE_ACTUATION
+            Serial << "Spot to PWM us: " << (int32_t)actuation_us << " | Max: " << (int32_t)actuation_max << endl;
+            for (uint8_t i = 0; i < ACT_BUCKETS; i++){
+                Serial << "  < " << (i + 1) * ACT_BUCKET_US << " us: " << actuation[i] << endl;
+            }
+#endif
         }
-        vTaskDelay(50);
     }
 
-}
\ No newline at end of file
+}
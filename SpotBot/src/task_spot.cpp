@@ -1,15 +1,33 @@
 /** @file task_spot.cpp
  *  This program includes spot task which reads velocity values obtained from task_IMU
- *  determine where the lifter is in the lift and if they need a spot or not. This starts
- *  with setting the spot timer (timer_counter) to 0 and making sure the bar is laying
- *  still. This moves to the next state so it is confirmed the bar is racked and the user
- *  hasn't started to lift. Once the IMUs both see downward motion this moves into the descent
- *  state and starts a timer on limiting the length of the rep.  If the bar is stopped again
- *  the user now has the barbell on their chest where the IMU will now check for upward motion.
- *  If the barbell moves up then down this counts as a fail and starts the motor, otherwise if the
- *  bar reaches a standstill again the bar must be racked (counting as 1 rep). The spot is also
- *  initiated if spot timer reaches 100 (a.k.a. roughly 5 seconds). If the spot is initiated the
- *  IMU values aren't read anymore and the slack must be reset on the robot.
+ *  determine where the lifter is in the lift and if they need a spot or not. Where the
+ *  lifter is in the rep is kept by a table driven state machine, so the same task can
+ *  follow a bench press, which has to stop on the chest, or a squat, which may bounce out
+ *  of the bottom, and the exercise can be picked from the web page while the bar is racked.
+ *  The bar starts out racked, moves into the descent when it moves down and starts a timer
+ *  on limiting the length of the rep. If the bar is stopped again it is at the bottom and
+ *  the machine now checks for upward motion. If the barbell moves up then down this counts
+ *  as a fail and starts the motor, otherwise if the bar reaches a standstill again the bar
+ *  must be racked (counting as 1 rep). The spot is also initiated if the rep timer runs
+ *  out. Which way the bar is going comes from the exercise's speed thresholds, or with @c
+ *  USE_PHASE_MODEL from the phase classifier task_IMU runs. If the spot is initiated the
+ *  IMU values aren't read anymore and the slack must be reset on the robot. Everything runs
+ *  on the bar velocity, which task_IMU combines from whichever bar IMUs are healthy. With
+ *  only one IMU left a fall has to hold for a couple of updates before it counts, so one
+ *  noisy IMU can't trigger a spot, at the cost of at most 100 ms more before a real one.
+ *  With none left the state is held where it is, but the rep timer keeps counting so a
+ *  lifter who loses the IMUs mid rep still gets spotted. A press which is slowing hard well
+ *  short of the top is spotted before it turns back down. If one arm gives out and the bar
+ *  tips to one side while it is off the rack a spot is started right away instead of
+ *  waiting for the rep timer. Once the bar has sat in the rack for 2 s task_IMU is told it
+ *  can slow the IMUs down. The start and end of every rep are marked in the session store
+ *  so the rep can be summarized, and each summary goes toward the set's velocity loss, reps
+ *  in reserve and 1RM. Once the set has slowed past the velocity loss limit the lifter is
+ *  told to rack the bar and, until the set ends, a stall anywhere in the press gets a spot.
+ *  The task sleeps until task_IMU hands it a new sample and runs once for each one, so a
+ *  decision never waits on a fixed delay. A press which starts slowing down short of the
+ *  top gets the motor ready, so it has already taken up the slack in the cable if a spot
+ *  follows.
  * 
  *  @author Christian Clephan
  *  @date   11-26-22
@@ -18,94 +36,211 @@
 #include <PrintStream.h>
 #include "task_spot.h"
 #include "shares.h"
+#include "bar_tracker.h"
+#include "rep_machine.h"
 
-float r_vel;
-float l_vel;
-uint8_t state_spot = 0;
-uint16_t timer_counter = 0;
+#define IDLE_UPDATES (2 * REP_HZ) ///< Updates in a row the bar must sit racked before the IMUs slow down (2 s)
+#define PRINT_UPDATES (REP_HZ / 10) ///< Updates between printouts of where the rep is (100 ms)
+#define LATENCY_REPORT 100 ///< Updates between latency reports
+
+// #define MEASURE_LATENCY to print how long samples take to be acted on, or
+// #undef MEASURE_LATENCY for normal use
+#undef MEASURE_LATENCY
+
+float bar_vel; // Velocity of the bar from the healthy bar IMUs
+float bar_pos; // Position of the bar from the healthy bar IMUs, drifts so only differences are used
+bool stale = false;
+bool tilted = false; // One end of the bar is rising slower than the other
+bool stalling = false; // The press is slowing like it won't make it
+uint8_t fuse_mode = FUSE_ALL;
+uint16_t idle_count = 0; // Updates in a row the bar has sat still in the rack
+uint8_t print_count = 0; // Updates since where the rep is was last printed
+BarTracker bar; // Height of the bar measured from the rack and the chest
+RepMotion motion;
+RepMachine reps(*exercises[0]); // Where the lifter is in the rep, following the chosen exercise
+RepInputs inputs;
+VelocityTraining training(exercises[0]->mvt); // Velocity loss, reps in reserve and 1RM from the rep summaries
+TrainingStatus status;
+RepSummary summary;
+SessionSummary totals;
+bool armed = false; // The set has slowed past the velocity loss limit, spot at the first stall
+ImuVelocities velocities;
+uint8_t state_spot = REP_WAIT;
 uint8_t rep_counter = 0;
-uint16_t spot_counter = 0;
-uint8_t max_time = 60;
+#ifdef MEASURE_LATENCY
+int64_t latency_sum = 0;
+int64_t latency_max = 0;
+uint16_t latency_count = 0;
+#endif
 
-Share<bool> send_data("Send data");
-Share<bool> spot_me_bro("Spot Trigger");
+Mailbox<bool> send_data("Send data");
+Trigger<float> spot_trigger("Spot Trigger");
+Mailbox<bool> motor_ready("Get the motor ready");
+Mailbox<TrainingStatus> training_status("Training status");
+Mailbox<bool> bar_idle("Bar sitting in the rack");
 
 
-/** @brief Task motor interfaces with other tasks shares to turn on and off motor 
- *  @details Interrets the velocity queue values from task IMU to find where the
- *  lifter is in the program. The states go in order of barbell racked, bar descending,
- *  bar stopped at chest, bar moving upward, bar re-racked. If the rep takes to long or
- *  the bar begins descending if it should be moving upward then a spot is requested.
+/** @brief Task spot interfaces with other tasks shares to decide when a spot is needed
+ *  @details Interprets the bar velocity from task IMU to find where the lifter is in the
+ *  rep. The states go in order of barbell racked, bar descending, bar stopped at the
+ *  bottom, bar moving upward, bar re-racked, and the transition table of the chosen
+ *  exercise says when to move between them. If the rep takes too long, the bar falls back
+ *  or sags on the way up or it tilts then a spot is requested. The bar height is measured
+ *  from the rack while racked and from the bottom once the bar gets there, so a press that
+ *  doesn't get near the rack again is only a partial rep and the motor is told exactly how
+ *  far it has to pull. The state machine only returns what happened; everything it asks
+ *  for is done, and printed, here.
 */
 void task_spot(void* p_params){
+    training.get_status(status);
+    training_status.put(status);
     while(1){
-        if(state_spot != 6){
-            r_vel = vel_queue.get();
-            l_vel = vel_queue.get();
-        }
-        if(state_spot == 0){
-            timer_counter = 0;
-            if(r_vel == 0 && l_vel == 0){
-                state_spot = 1;
+        state_spot = reps.get_state();
+        //Switching exercise only while the bar is in the rack
+        if(state_spot <= REP_RACKED){
+            uint8_t pick = exercise_pick.get();
+            if(pick < exercise_count && exercises[pick] != &reps.get_exercise()){
+                reps.select(*exercises[pick]);
+                training.reset(exercises[pick]->mvt);
+                armed = false;
+                Serial << "Exercise: " << exercises[pick]->name << endl;
             }
         }
-        if(state_spot == 1){
-            timer_counter = 0;
-            Serial << "Bar is racked" << endl;
-            if(r_vel < 0 && l_vel < 0){
-                state_spot = 2;
-            }
+        //Sleeping until task_IMU has a new sample, then running the state machine once for it
+        bar_samples.get(velocities);
+        if(state_spot != REP_DONE){
+            bar_vel = velocities.bar_vel;
+            bar_pos = velocities.bar_pos;
+            fuse_mode = velocities.mode;
+            tilted = velocities.tilted;
+            stalling = velocities.stalling;
+            //NaN fails every guard, so with no bar IMU left only the rep timer can move the state
+            stale = fuse_mode == FUSE_NONE;
+            if(stale){
+                bar_vel = NAN;
             }
-        if (state_spot == 2){
-            Serial << "Bar is in descent | Rep timer: " << timer_counter << endl;
-            timer_counter++;
-            if ((r_vel == 0 && r_vel == 0
-            )){
-                state_spot = 3;
-            }
-             if(timer_counter >= max_time){
-                state_spot = 5;
-            }           
         }
-        if (state_spot == 3){
-            Serial << "Bar is stopped at chest | Rep timer: " << timer_counter << endl;
-            timer_counter++;
-            if(r_vel > 0 && l_vel > 0){
-                state_spot = 4;
-                
-            }
-            if(timer_counter >= max_time){
-                state_spot = 5;
-            }
+        if(state_spot == REP_ASCENT && !stale){
+            bar.update(bar_vel, bar_pos);
         }
-        if (state_spot == 4){
-            Serial << "Bar is going up | Rep timer: " << timer_counter << endl;
-            timer_counter++;
-            if (r_vel < -0.06 && l_vel < -0.06){
-                state_spot = 5;
+        inputs.bar_vel = bar_vel;
+        inputs.sagging = bar.sagging();
+        inputs.tilted = tilted;
+        inputs.stalling = stalling && (armed || bar.short_of_top());
+#ifdef USE_PHASE_MODEL
+        inputs.phase = stale ? PHASE_NONE : velocities.phase;
+        //A press also slows hard at lockout, so a failure is only believed short of the top
+        if(inputs.phase == PHASE_FAIL && !(armed || bar.short_of_top())){
+            inputs.phase = PHASE_UP;
+        }
+#else
+        inputs.phase = PHASE_NONE;
+#endif
+        inputs.single = fuse_mode == FUSE_SINGLE;
+        inputs.spotted = state_spot == REP_SPOT && spot_complete.get();
+        inputs.time_us = velocities.time_us;
+
+        uint8_t action = reps.update(inputs);
+        bool changed = reps.get_state() != state_spot;
+        state_spot = reps.get_state();
+#ifdef MEASURE_LATENCY
+        int64_t latency = esp_timer_get_time() - velocities.time_us;
+        latency_sum += latency;
+        latency_max = latency > latency_max ? latency : latency_max;
+        if(++latency_count == LATENCY_REPORT){
+            Serial << "Sample to decision us | Mean: " << (int32_t)(latency_sum / LATENCY_REPORT)
+                   << " | Max: " << (int32_t)latency_max << endl;
+            latency_sum = 0;
+            latency_max = 0;
+            latency_count = 0;
+        }
+#endif
+        if(action == ACT_RACK){
+            bar.rack(bar_pos); //Still on the rack, measuring heights from here
+        }
+        if(action == ACT_START){
+            session.begin_rep(millis());
+            //A new set starts over on the velocity loss
+            session.get_session(totals);
+            if(totals.sets != status.set){
+                armed = false;
             }
-            if (r_vel == 0 && l_vel == 0){
+        }
+        if(action == ACT_BOTTOM){
+            bar.chest(bar_pos); //At the bottom, measuring heights from here
+        }
+        if(action == ACT_REP){
+            bar.finish(motion);
+            if (motion.full){
                 rep_counter++;
                 Serial << "Nice bench bro you've done " << rep_counter << " rep(s)" << endl;
-                send_data.put(1);
-                state_spot = 1;
-                
             }
-            if(timer_counter >= max_time){
-                state_spot = 5;
+            else{
+                Serial << "Partial rep, only " << motion.top << " m of " << motion.rom << " m" << endl;
+            }
+            send_data.put(1);
+            session.end_rep(millis(), false, motion.rom * 1000, motion.sticking * 1000);
+            //Keeping up with how much the set has slowed down
+            training.set_loss_limit(loss_limit.get());
+            if(session.get_rep(session.rep_count() - 1, summary)){
+                training.add_rep(summary, bar_load.get());
+            }
+            training.get_status(status);
+            training_status.put(status);
+            Serial << "Velocity loss: " << status.loss << "% | Reps in reserve: " << status.rir
+                   << " | 1RM: " << status.one_rm << " kg" << endl;
+            if(status.stop && !armed){
+                armed = true;
+                Serial << "Velocity loss limit reached, rack the bar" << endl;
             }
         }
-        if (state_spot == 5){
-            Serial << "Rep failed spotting initiated" << endl;
-            spot_me_bro.put(1);
+        if(action == ACT_SPOT){
+            //Sizing the pull from where the bar is now to the rack and starting the motor first,
+            //everything else can wait
+            bar.finish(motion);
+            spot_trigger.fire(bar.spot_distance() * 1000);
             send_data.put(1);
-            if(spot_complete.get()){
-                state_spot = 6;
+            session.end_rep(millis(), true, motion.rom * 1000, motion.sticking * 1000);
+            if(session.get_rep(session.rep_count() - 1, summary)){
+                training.add_rep(summary, bar_load.get());
+            }
+            training.get_status(status);
+            training_status.put(status);
+        }
+
+        //Printing where the rep is every so often rather than at the control rate, unless it just moved on
+        print_count = !changed && print_count + 1 < PRINT_UPDATES ? print_count + 1 : 0;
+        if(print_count == 0){
+            if(state_spot == REP_RACKED){
+                Serial << "Bar is racked" << endl;
             }
+            if(state_spot == REP_DESCENT){
+                Serial << "Bar is in descent | Rep timer: " << reps.get_ticks() << endl;
+            }
+            if(state_spot == REP_BOTTOM){
+                Serial << "Bar is stopped at the bottom | Rep timer: " << reps.get_ticks() << endl;
+            }
+            if(state_spot == REP_ASCENT){
+                Serial << "Bar is going up | Height: " << bar.height() << " | Rep timer: " << reps.get_ticks() << endl;
+            }
+            if(state_spot == REP_SPOT){
+                Serial << "Rep failed spotting initiated" << (tilted ? " | Bar tilted" : "")
+                       << (stalling ? " | Press stalled" : "") << endl;
+            }
+            if(state_spot == REP_DONE){
+                Serial << "Spot finished reset slack" << endl;
+            }
+        }
+        //Letting task_IMU slow the IMUs down once the bar has sat in the rack for a while
+        if((state_spot <= REP_RACKED && bar_vel == 0) || state_spot == REP_DONE){
+            idle_count = idle_count < IDLE_UPDATES ? idle_count + 1 : idle_count;
         }
-        if (state_spot == 6){
-            Serial << "Spot finished reset slack" << endl;
+        else{
+            idle_count = 0;
         }
-        vTaskDelay(50);
+        bar_idle.put(idle_count >= IDLE_UPDATES);
+        //Having the motor take up the slack once a press short of the top starts to slow down
+        motor_ready.put(state_spot == REP_ASCENT && !stale && (armed || bar.short_of_top())
+                        && (velocities.slowing || stalling || velocities.fail_pct > 0));
     }
-}
\ No newline at end of file
+}
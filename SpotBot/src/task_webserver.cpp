@@ -20,6 +20,7 @@
 #include <WiFi.h>
 #include <WebServer.h>
 #include "shares.h"
+#include "rep_machine.h"
 
 // #define USE_LAN to have the ESP32 join an existing Local Area Network or 
 // #undef USE_LAN to have the ESP32 act as an access point, forming its own LAN
@@ -48,6 +49,10 @@ uint8_t rep_count = 0;
 
 #define FAST_PIN 12         ///< The GPIO pin cranking out a 500 Hz square wave
 
+Mailbox<uint8_t> exercise_pick ("Exercise");
+Mailbox<float> bar_load ("Load kg");
+Mailbox<float> loss_limit ("Velocity loss limit %");
+
 
 /** @brief   The web server object for this project.
  *  @details This server is responsible for responding to HTTP requests from
@@ -130,8 +135,43 @@ void handle_DocumentRoot ()
     HTML_header (a_str, "ESP32 Web Server Test");
     a_str += "<body>\n<div id=\"webpage\">\n";
     a_str += "<h1>SpotBot Main Page</h1>\n";
+
+    // The summary of the last rep is ready as soon as the rep ends
+    RepSummary rep;
+    uint16_t count = session.rep_count ();
+    if (count > 0 && session.get_rep (count - 1, rep))
+    {
+        a_str += "<p>Last rep: ";
+        a_str += rep.failed ? "failed" : "made";
+        a_str += " | Mean up ";
+        a_str += rep.mean_up;
+        a_str += " mm/s | Peak up ";
+        a_str += rep.peak_up;
+        a_str += " mm/s | Down ";
+        a_str += rep.eccentric_ms / 1000.0f;
+        a_str += " s | Pause ";
+        a_str += rep.pause_ms / 1000.0f;
+        a_str += " s | Up ";
+        a_str += rep.concentric_ms / 1000.0f;
+        a_str += " s | Under tension ";
+        a_str += rep.tut_ms / 1000.0f;
+        a_str += " s\n";
+    }
     a_str += "<p><p> <a href=\"/toggle\">Toggle LED</a>\n";
     a_str += "<p><p> <a href=\"/csv\">Show some data in CSV format</a>\n";
+    a_str += "<p><p> <a href=\"/set\">Show the current set in CSV format</a>\n";
+    a_str += "<p><p> <a href=\"/reps\">Show every rep of the session in CSV format</a>\n";
+    a_str += "<p><p> <a href=\"/vbt\">Show velocity based training numbers</a>\n";
+    a_str += "<p><p> Exercise:";
+    for (uint8_t index = 0; index < exercise_count; index++)
+    {
+        a_str += " <a href=\"/exercise?name=";
+        a_str += exercises[index]->name;
+        a_str += "\">";
+        a_str += exercises[index]->name;
+        a_str += "</a>";
+    }
+    a_str += "\n";
     a_str += "</div>\n</body>\n</html>\n";
 
     server.send (200, "text/html", a_str); 
@@ -176,30 +216,202 @@ void handle_Toggle_LED (void)
  *  @details The contrived data is sent in a relatively efficient Comma
  *           Separated Variable (CSV) format which is easily read by Matlab(tm)
  *           and Python and spreadsheets. This contains the time, and velocity
- *           data from both IMUs.
+ *           data from both IMUs. Each request picks up where the last one left
+ *           off in the velocity history.
  */
 void handle_CSV (void)
 {
+    // Next row of the history to send, kept between requests
+    static uint32_t next_row = 0;
+    static HistoryRow rows[200];
+
     // The page will be composed in an Arduino String object, then sent.
     // The first line will be column headers so we know what the data is
     String csv_str = "Time (s), Velocity R (m/s), Velocity L (m/s)\n";
 
-    // Creates 200 rows of data at roughly 100ms intervals with the user's
+    // Creates up to 200 rows of data at roughly 100ms intervals with the user's
     // barbell velocities
-    for (uint8_t index = 0; index < 200; index++)
+    uint16_t count = vel_history.read (next_row, rows, 200);
+    for (uint16_t index = 0; index < count; index++)
     {
-        if(timer.available()){
-            csv_str += timer.get(); //time is counting every 100ms divide  by 10 to get seconds
+        csv_str += rows[index].time_ms / 1000.0f;
+        csv_str += ",";
+        csv_str += rows[index].vel_r;
+        csv_str += ",";
+        csv_str += rows[index].vel_l;
+        csv_str += "\n";
+    }
+
+    // Send the CSV file as plain text so it can be easily saved as a file
+    server.send (200, "text/plain", csv_str);
+}
+
+
+/** @brief   Show the current set, 100 ms at a time, when asked by the web server.
+ *  @details Each row has the smallest, largest and mean velocity of each IMU
+ *           over 100 ms. Up to 200 rows are sent at a time; the rest of a long
+ *           set can be had by asking for @c /set?from=200 and so on.
+ */
+void handle_Set (void)
+{
+    static AggregateRow rows[200];
+    uint16_t from = server.hasArg ("from") ? server.arg ("from").toInt () : 0;
+
+    String csv_str = "Time (s), Min R (mm/s), Max R (mm/s), Mean R (mm/s), "
+                     "Min L (mm/s), Max L (mm/s), Mean L (mm/s)\n";
+    uint16_t count = session.read_set (from, rows, 200);
+    for (uint16_t index = 0; index < count; index++)
+    {
+        csv_str += rows[index].time_ms / 1000.0f;
+        csv_str += ",";
+        csv_str += rows[index].min_r;
+        csv_str += ",";
+        csv_str += rows[index].max_r;
+        csv_str += ",";
+        csv_str += rows[index].mean_r;
+        csv_str += ",";
+        csv_str += rows[index].min_l;
+        csv_str += ",";
+        csv_str += rows[index].max_l;
+        csv_str += ",";
+        csv_str += rows[index].mean_l;
+        csv_str += "\n";
+    }
+    server.send (200, "text/plain", csv_str);
+}
+
+
+/** @brief   Show a summary of every rep of the session when asked by the web
+ *           server.
+ *  @details The first two lines are the totals for the session, followed by
+ *           one line per rep with the velocities of the bar in mm/s, its range
+ *           of motion and sticking point in mm and how long it spent in each
+ *           phase of the rep.
+ */
+void handle_Reps (void)
+{
+    SessionSummary totals;
+    session.get_session (totals);
+
+    String csv_str = "Reps, Failed, Sets, Best up (mm/s), Time moving up (s)\n";
+    csv_str += totals.reps;
+    csv_str += ",";
+    csv_str += totals.failed;
+    csv_str += ",";
+    csv_str += totals.sets;
+    csv_str += ",";
+    csv_str += totals.best_up;
+    csv_str += ",";
+    csv_str += totals.up_ms / 1000.0f;
+    csv_str += "\n";
+
+    csv_str += "Rep, Set, Start (s), Length (s), Failed, Peak down, Peak up, Mean down, Mean up, "
+               "ROM (mm), Sticking point (mm), Eccentric (s), Pause (s), Concentric (s), "
+               "Under tension (s)\n";
+    RepSummary rep;
+    uint16_t count = session.rep_count ();
+    for (uint16_t index = 0; index < count; index++)
+    {
+        if (session.get_rep (index, rep))
+        {
+            csv_str += index + 1;
+            csv_str += ",";
+            csv_str += rep.set;
+            csv_str += ",";
+            csv_str += rep.start_ms / 1000.0f;
+            csv_str += ",";
+            csv_str += rep.duration_ms / 1000.0f;
             csv_str += ",";
-            csv_str += vel_r.get();
+            csv_str += rep.failed;
             csv_str += ",";
-            csv_str += vel_l.get();
+            csv_str += rep.peak_down;
+            csv_str += ",";
+            csv_str += rep.peak_up;
+            csv_str += ",";
+            csv_str += rep.mean_down;
+            csv_str += ",";
+            csv_str += rep.mean_up;
+            csv_str += ",";
+            csv_str += rep.rom;
+            csv_str += ",";
+            csv_str += rep.sticking;
+            csv_str += ",";
+            csv_str += rep.eccentric_ms / 1000.0f;
+            csv_str += ",";
+            csv_str += rep.pause_ms / 1000.0f;
+            csv_str += ",";
+            csv_str += rep.concentric_ms / 1000.0f;
+            csv_str += ",";
+            csv_str += rep.tut_ms / 1000.0f;
             csv_str += "\n";
         }
     }
+    server.send (200, "text/plain", csv_str);
+}
 
-    // Send the CSV file as plain text so it can be easily saved as a file
-    server.send (404, "text/plain", csv_str);
+
+/** @brief   Pick the exercise the spotter follows when asked by the web server.
+ *  @details The exercise is named by @c /exercise?name=squat and so on. The
+ *           spotter only switches over while the bar is in the rack.
+ */
+void handle_Exercise (void)
+{
+    String name = server.hasArg ("name") ? server.arg ("name") : String ("");
+    for (uint8_t index = 0; index < exercise_count; index++)
+    {
+        if (name == exercises[index]->name)
+        {
+            exercise_pick.put (index);
+            server.send (200, "text/plain", String ("Exercise: ") + name);
+            return;
+        }
+    }
+    server.send (404, "text/plain", "No such exercise");
+}
+
+
+/** @brief   Show velocity based training numbers and take the settings for
+ *           them when asked by the web server.
+ *  @details The load on the bar is set with @c /vbt?load=100 in kg and the
+ *           velocity loss at which a set should end with @c /vbt?stop=20 in
+ *           percent, 0 turning it off. Reps in reserve and 1RM are -1 until
+ *           there is enough to estimate them from.
+ */
+void handle_VBT (void)
+{
+    if (server.hasArg ("load"))
+    {
+        bar_load.put (server.arg ("load").toFloat ());
+    }
+    if (server.hasArg ("stop"))
+    {
+        loss_limit.put (server.arg ("stop").toFloat ());
+    }
+    TrainingStatus status = training_status.get ();
+
+    String csv_str = "Set, Reps, Best (mm/s), Last (mm/s), Velocity loss (%), "
+                     "Reps in reserve, 1RM (kg), Stop, Load (kg), Loss limit (%)\n";
+    csv_str += status.set;
+    csv_str += ",";
+    csv_str += status.reps;
+    csv_str += ",";
+    csv_str += status.best_mm_s;
+    csv_str += ",";
+    csv_str += status.last_mm_s;
+    csv_str += ",";
+    csv_str += status.loss;
+    csv_str += ",";
+    csv_str += status.rir;
+    csv_str += ",";
+    csv_str += status.one_rm;
+    csv_str += ",";
+    csv_str += status.stop;
+    csv_str += ",";
+    csv_str += bar_load.get ();
+    csv_str += ",";
+    csv_str += loss_limit.get ();
+    csv_str += "\n";
+    server.send (200, "text/plain", csv_str);
 }
 
 
@@ -218,6 +430,10 @@ void task_webserver (void* p_params)
     server.on ("/", handle_DocumentRoot);
     server.on ("/toggle", handle_Toggle_LED);
     server.on ("/csv", handle_CSV);
+    server.on ("/set", handle_Set);
+    server.on ("/reps", handle_Reps);
+    server.on ("/exercise", handle_Exercise);
+    server.on ("/vbt", handle_VBT);
     server.onNotFound (handle_NotFound);
 
     // Get the web server running
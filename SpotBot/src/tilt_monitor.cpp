@@ -0,0 +1,69 @@
+/** @file tilt_monitor.cpp
+ *  This program contains the class which compares the two ends of the bar so a
+ *  lifter whose one arm gives out is spotted as the bar tips, rather than once
+ *  the whole rep has run out of time.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "tilt_monitor.h"
+#include "velocity_fusion.h"
+
+/** @brief   Constructor which creates a tilt monitor for the IMUs on each end of the bar
+ *  @param   right_imu Index in the sensor array of the IMU on the right end
+ *  @param   left_imu Index in the sensor array of the IMU on the left end
+ */
+TiltMonitor::TiltMonitor (uint8_t right_imu, uint8_t left_imu)
+    : right (right_imu), left (left_imu)
+{
+}
+
+/** @brief   Method which moves the tilt along one control step
+ *  @param   velocities Velocities, health and staleness of every IMU
+ *  @param   time_us Time the velocities are from in microseconds
+ */
+void TiltMonitor::update(const ImuVelocities& velocities, int64_t time_us)
+{
+    uint8_t both = (1 << right) | (1 << left);
+    if (right >= velocities.count || left >= velocities.count || (velocities.stale & both)
+        || velocities.health[right] < FUSE_MIN_HEALTH || velocities.health[left] < FUSE_MIN_HEALTH){
+        // One end can't be seen, starting over once it can
+        running = false;
+        diff = 0;
+        tilt = 0;
+        diff_steps = 0;
+        tilted = false;
+        return;
+    }
+    diff = velocities.vel[right] - velocities.vel[left];
+    if (velocities.vel[right] == 0 && velocities.vel[left] == 0){
+        // Both ends still, whatever tilt was built up is drift
+        tilt = 0;
+    }
+    else if (running){
+        tilt += diff * (time_us - last_time) * 1e-6f;
+    }
+    last_time = time_us;
+    running = true;
+
+    float abs_diff = diff < 0 ? -diff : diff;
+    float abs_tilt = tilt < 0 ? -tilt : tilt;
+    diff_steps = abs_diff > TILT_DIFF_ON ? (diff_steps < TILT_DIFF_STEPS ? diff_steps + 1 : diff_steps) : 0;
+    if (!tilted){
+        tilted = abs_tilt > TILT_ON || diff_steps >= TILT_DIFF_STEPS;
+    }
+    else if (abs_tilt < TILT_OFF && abs_diff < TILT_DIFF_OFF){
+        tilted = false;
+    }
+}
+
+/** @brief   Method which puts the latest tilt into a set of velocities
+ *  @param   velocities Filled in with @c diff_vel, @c tilt and @c tilted
+ */
+void TiltMonitor::fill(ImuVelocities& velocities)
+{
+    velocities.diff_vel = diff;
+    velocities.tilt = tilt;
+    velocities.tilted = tilted;
+}
@@ -0,0 +1,47 @@
+/** @file tilt_monitor.h
+ *  This is the header for the tilt monitor file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _TILT_MONITOR_H_
+#define _TILT_MONITOR_H_
+
+#include <stdint.h>
+#include "sensor_array.h"
+
+#define TILT_DIFF_ON 0.15f    ///< Right minus left velocity which starts to count as lopsided, m/s
+#define TILT_DIFF_OFF 0.08f   ///< Right minus left velocity which stops counting as lopsided, m/s
+#define TILT_DIFF_STEPS 5     ///< Control steps in a row the velocities must be lopsided (50 ms)
+#define TILT_ON 0.05f         ///< One end of the bar higher than the other which is a tilt, m
+#define TILT_OFF 0.03f        ///< One end of the bar higher than the other which is level again, m
+
+/** @brief   Class which watches for one end of the bar rising slower than the other
+ *  @details Each control step the left IMU's velocity is taken from the right
+ *           one's, and that difference is integrated into how much higher the
+ *           right end of the bar is than the left. The tilt is zeroed whenever
+ *           both ends are still, so drift only builds up over one movement. The
+ *           bar counts as tilted once either the tilt or a steady difference in
+ *           velocity passes its on threshold, and only stops once both are back
+ *           under their off thresholds, so it doesn't flicker at the edge. Both
+ *           IMUs have to be fresh and healthy, otherwise nothing is reported.
+ */
+class TiltMonitor
+{
+protected:
+    uint8_t right;
+    uint8_t left;
+    int64_t last_time = 0;
+    bool running = false;
+    float diff = 0;
+    float tilt = 0;
+    uint8_t diff_steps = 0;
+    bool tilted = false;
+public:
+    TiltMonitor (uint8_t right_imu, uint8_t left_imu);
+    void update(const ImuVelocities& velocities, int64_t time_us);
+    void fill(ImuVelocities& velocities);
+};
+
+#endif // _TILT_MONITOR_H_
@@ -0,0 +1,308 @@
+/** @file velocity_estimator.cpp
+ *  This program contains the velocity estimator used by task_IMU for each IMU.
+ *  It replaces dropping the velocity to zero whenever it stops changing, which
+ *  also zeroed slow grinding reps, with a gravity aligned estimate and zero
+ *  velocity updates (ZUPT) that only happen when the sensor is actually still.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <math.h>
+#include "velocity_estimator.h"
+
+#define ALPHA_MOVING 0.002f   ///< Accelerometer weight in the gravity filter while moving
+#define ALPHA_STILL 0.05f     ///< Accelerometer weight in the gravity filter while still
+#define ACCEL_NOISE 5.0e4f    ///< Accelerometer noise used as process noise, um/s^2
+#define ZUPT_NOISE 1.0e6f     ///< Variance of a zero velocity measurement, (um/s)^2
+#define ZUPT_SNAP 1000        ///< Velocities smaller than this are snapped to zero when still, um/s
+
+#define CONTROL_US 10000      ///< Time between integration steps, 100 Hz control rate
+#define RATE_CONFIRM 3        ///< Samples in a row at a new rate before the filter follows it
+
+#define CAL_SCALE_CHANGE 0.002f ///< Relative scale change worth writing to NVS
+#define CAL_BIAS_CHANGE 10.0f    ///< Gyro or accelerometer bias change worth writing to NVS, ticks
+
+/** @brief   Constructor which creates a velocity estimator for one IMU
+ *  @param   ticks_per_ms2 Hand tuned calibration constant, ticks per 1 m/s^2,
+ *           used until the IMU has been calibrated
+ *  @param   dead_band_ms2 Hand tuned dead band used until the IMU has been calibrated
+ *  @param   cal_samples Samples in a still window used for calibration
+ *  @param   decimation Samples per integration step after the decimation filter at
+ *           the starting sample rate; it follows the sample rate after that
+ */
+VelocityEstimator::VelocityEstimator (float ticks_per_ms2, float dead_band_ms2, uint16_t cal_samples, uint16_t decimation)
+    : scaler (ticks_per_ms2, 9.81f, dead_band_ms2), decimator (decimation, true), calibrator (cal_samples)
+{
+    default_calibration(cal, ticks_per_ms2, dead_band_ms2);
+}
+
+/** @brief   Method which puts a calibration into use, such as one loaded from NVS
+ *  @details Until the temperature is known the scale measured at the
+ *           calibration's own reference temperature is used.
+ */
+void VelocityEstimator::set_calibration(const ImuCalibration& new_cal)
+{
+    cal = new_cal;
+    scaler = AccelScaler(scale_at(cal, temp_known ? temp_c : cal.temp_ref), 9.81f, cal.dead_band);
+}
+
+/** @brief   Method which gives the estimator the latest IMU temperature
+ *  @details The accelerometer scale is moved along the temperature slope.
+ *  @param   new_temp_c Temperature of the IMU in deg C
+ */
+void VelocityEstimator::set_temperature(float new_temp_c)
+{
+    temp_c = new_temp_c;
+    temp_known = true;
+    scaler = AccelScaler(scale_at(cal, temp_c), 9.81f, cal.dead_band);
+}
+
+/** @brief   Method which hands out a re-measured calibration once it has moved
+ *           enough to be worth saving
+ *  @param   new_cal Filled with the calibration in use
+ *  @return  True if @c new_cal should be saved
+ */
+bool VelocityEstimator::take_calibration(ImuCalibration& new_cal)
+{
+    if (!cal_changed){
+        return false;
+    }
+    cal_changed = false;
+    new_cal = cal;
+    return true;
+}
+
+/** @brief   Method which moves the gravity direction estimate along one sample
+ *  @details The gyro rotates the gravity vector opposite to the sensor's own
+ *           rotation, then the estimate is blended toward the direction the
+ *           accelerometer measures and normalized again.
+ *  @param   s Raw sample from the IMU
+ *  @param   dt Time since the last sample in seconds
+ */
+void VelocityEstimator::update_gravity(const ImuSample& s, float dt)
+{
+    float ax = s.accel_x;
+    float ay = s.accel_y;
+    float az = s.accel_z;
+    float a_norm = sqrtf(ax*ax + ay*ay + az*az);
+    if (a_norm <= 0){
+        return;
+    }
+    ax /= a_norm;
+    ay /= a_norm;
+    az /= a_norm;
+    if (!leveled){
+        grav[0] = ax;
+        grav[1] = ay;
+        grav[2] = az;
+        leveled = true;
+        return;
+    }
+
+    // g' = g - (w x g) dt
+    float wx = s.gyro_x * GYRO_RAD_PER_TICK * dt;
+    float wy = s.gyro_y * GYRO_RAD_PER_TICK * dt;
+    float wz = s.gyro_z * GYRO_RAD_PER_TICK * dt;
+    float gx = grav[0] - (wy*grav[2] - wz*grav[1]);
+    float gy = grav[1] - (wz*grav[0] - wx*grav[2]);
+    float gz = grav[2] - (wx*grav[1] - wy*grav[0]);
+
+    float alpha = still ? ALPHA_STILL : ALPHA_MOVING;
+    gx += alpha * (ax - gx);
+    gy += alpha * (ay - gy);
+    gz += alpha * (az - gz);
+    float g_norm = sqrtf(gx*gx + gy*gy + gz*gz);
+    grav[0] = gx / g_norm;
+    grav[1] = gy / g_norm;
+    grav[2] = gz / g_norm;
+}
+
+/** @brief   Method which adds a sample to the variance window and decides if
+ *           the IMU is quiet
+ *  @param   accel_vert Vertical acceleration in um/s^2
+ *  @param   s Raw sample, used for the rotation rate
+ *  @return  True if the window is full, quiet, averages near zero and the gyro
+ *           hasn't turned for the whole window
+ */
+bool VelocityEstimator::update_still(int32_t accel_vert, const ImuSample& s)
+{
+    if (win_fill == ZUPT_WINDOW){
+        int32_t oldest = window[win_idx];
+        win_sum -= oldest;
+        win_sq -= (int64_t)oldest * oldest;
+    }
+    else{
+        win_fill++;
+    }
+    window[win_idx] = accel_vert;
+    win_sum += accel_vert;
+    win_sq += (int64_t)accel_vert * accel_vert;
+    win_idx = (win_idx + 1) % ZUPT_WINDOW;
+    // Three full scale axes squared add up past what an int32 holds
+    int64_t gyro_sq = (int64_t)s.gyro_x*s.gyro_x + (int64_t)s.gyro_y*s.gyro_y + (int64_t)s.gyro_z*s.gyro_z;
+    if (gyro_sq < (int64_t)ZUPT_GYRO_TICKS*ZUPT_GYRO_TICKS){
+        gyro_quiet = gyro_quiet < ZUPT_WINDOW ? gyro_quiet + 1 : gyro_quiet;
+    }
+    else{
+        gyro_quiet = 0;
+    }
+    if (win_fill < ZUPT_WINDOW){
+        return false;
+    }
+
+    int64_t mean = win_sum / ZUPT_WINDOW;
+    float variance = (float)(win_sq / ZUPT_WINDOW - mean * mean);
+    return variance < ZUPT_ACCEL_VAR && mean < ZUPT_ACCEL_MEAN && mean > -ZUPT_ACCEL_MEAN
+           && gyro_quiet >= ZUPT_WINDOW;
+}
+
+/** @brief   Method which decides if a quiet IMU is really still
+ *  @details A bar ground up at a steady speed has no acceleration to speak of
+ *           either, so being quiet isn't enough on its own. It has to last a
+ *           while, and the velocity it would take out has to be small enough to
+ *           be drift rather than a lift. Drift can't grow without bound though,
+ *           so after a long quiet stretch it is taken out whatever its size.
+ *  @param   quiet True if the variance window says the IMU is quiet
+ *  @param   velocity Integrated velocity the update would take out, um/s
+ *  @param   time_us Time of the sample in microseconds
+ *  @return  True if a zero velocity update should be done
+ */
+bool VelocityEstimator::confirm_still(bool quiet, int32_t velocity, int64_t time_us)
+{
+    if (!quiet){
+        quiet_since = time_us;
+        return false;
+    }
+    int64_t quiet_us = time_us - quiet_since;
+    if (quiet_us < ZUPT_HOLD_US){
+        return false;
+    }
+    return (velocity < ZUPT_MAX_VEL && velocity > -ZUPT_MAX_VEL) || quiet_us >= ZUPT_FORCE_US;
+}
+
+/** @brief   Method which keeps the decimation filter matched to the sample rate
+ *  @details When the IMU's sample rate is changed the samples already in its
+ *           FIFO were still taken at the old rate. Going by the time between
+ *           samples instead of being told, the filter switches exactly at the
+ *           first samples taken at the new rate, so the control rate stays at
+ *           100 Hz throughout. A few samples in a row are needed so one missed
+ *           sample doesn't set it off.
+ *  @param   dt_us Time since the last sample in microseconds
+ */
+void VelocityEstimator::follow_rate(int64_t dt_us)
+{
+    if (dt_us <= 0){
+        return;
+    }
+    uint16_t want = (CONTROL_US + dt_us / 2) / dt_us;
+    want = want < 1 ? 1 : want > DECIM_MAX_FACTOR ? DECIM_MAX_FACTOR : want;
+    if (want == decimator.get_factor()){
+        rate_count = 0;
+    }
+    else if (++rate_count >= RATE_CONFIRM){
+        decimator.set_factor(want);
+        rate_count = 0;
+    }
+}
+
+/** @brief   Method which runs the estimator for one sample
+ *  @param   raw Raw accelerometer and gyro sample from the IMU
+ *  @param   time_us Time the sample was taken in microseconds
+ *  @return  Vertical velocity in um/s, positive up
+ */
+int32_t VelocityEstimator::update(const ImuSample& raw, int64_t time_us)
+{
+    float dt = leveled ? (time_us - last_time) * 1e-6f : 0;
+    if (leveled){
+        follow_rate(time_us - last_time);
+    }
+    last_time = time_us;
+    ImuSample s = raw;
+    s.accel_x -= (int16_t)cal.accel_bias[0];
+    s.accel_y -= (int16_t)cal.accel_bias[1];
+    s.accel_z -= (int16_t)cal.accel_bias[2];
+    s.gyro_x -= (int16_t)cal.gyro_bias[0];
+    s.gyro_y -= (int16_t)cal.gyro_bias[1];
+    s.gyro_z -= (int16_t)cal.gyro_bias[2];
+    update_gravity(s, dt);
+
+    // Acceleration along gravity in ticks, then to um/s^2 with gravity taken out
+    float along = s.accel_x*grav[0] + s.accel_y*grav[1] + s.accel_z*grav[2];
+    int32_t accel_vert = scaler.to_um_s2((int32_t)lroundf(along));
+    still = confirm_still(update_still(accel_vert, s), integ.get(), time_us);
+
+    // Integrating at the control rate after the decimation filter
+    int32_t filtered;
+    bool stepped = decimator.put(accel_vert, filtered);
+    if (stepped){
+        if (scaler.in_dead_band(filtered)){
+            filtered = 0;
+        }
+        integ.update(filtered, time_us);
+    }
+    int32_t velocity = integ.get();
+
+    // A full still window re-measures the calibration, once there is a temperature to file it under
+    if (temp_known && calibrator.add(raw, temp_c)){
+        ImuCalibration old_cal = cal;
+        if (calibrator.finish(cal)){
+            float scale_change = (cal.accel_scale - old_cal.accel_scale) / old_cal.accel_scale;
+            float bias_change = 0;
+            for (uint8_t i = 0; i < 3; i++){
+                float change = cal.gyro_bias[i] - old_cal.gyro_bias[i];
+                bias_change = change > bias_change ? change : -change > bias_change ? -change : bias_change;
+                change = cal.accel_bias[i] - old_cal.accel_bias[i];
+                bias_change = change > bias_change ? change : -change > bias_change ? -change : bias_change;
+            }
+            // Small changes aren't saved to keep wear on the flash down
+            if (scale_change > CAL_SCALE_CHANGE || scale_change < -CAL_SCALE_CHANGE || bias_change > CAL_BIAS_CHANGE){
+                cal_changed = true;
+            }
+            set_calibration(cal);
+        }
+    }
+
+    // Velocity uncertainty grows with accelerometer noise while integrating
+    var_vel += ACCEL_NOISE * ACCEL_NOISE * dt * dt;
+    if (still){
+        // Zero velocity measurement update
+        float gain = var_vel / (var_vel + ZUPT_NOISE);
+        velocity = (int32_t)(velocity * (1 - gain));
+        var_vel *= 1 - gain;
+        if (velocity < ZUPT_SNAP && velocity > -ZUPT_SNAP){
+            velocity = 0;
+        }
+        integ.reset(velocity);
+    }
+    if (stepped){
+        travel.update(velocity, time_us);
+    }
+    return velocity;
+}
+
+/** @brief   Method which returns the latest vertical velocity
+ *  @return  Velocity in um/s, positive up
+ */
+int32_t VelocityEstimator::get_velocity(void)
+{
+    return integ.get();
+}
+
+/** @brief   Method which returns the vertical distance moved since the estimator
+ *           started
+ *  @details This drifts without bound, so callers take the difference from a
+ *           reading at a recent still point.
+ *  @return  Position in um, positive up
+ */
+int32_t VelocityEstimator::get_position(void)
+{
+    return travel.get();
+}
+
+/** @brief   Method which returns true if the last sample was judged to be still
+ */
+bool VelocityEstimator::is_still(void)
+{
+    return still;
+}
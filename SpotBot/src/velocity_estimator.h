@@ -0,0 +1,93 @@
+/** @file velocity_estimator.h
+ *  This is the header for the velocity estimator file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _VELOCITY_ESTIMATOR_H_
+#define _VELOCITY_ESTIMATOR_H_
+
+#include <stdint.h>
+#include "imu_driver.h"
+#include "accel_scaler.h"
+#include "integrator.h"
+#include "imu_calibration.h"
+#include "decimator.h"
+
+#define ZUPT_WINDOW 64        ///< Samples in the window used to decide the bar is still
+#define ZUPT_ACCEL_VAR 2.5e9f ///< Largest vertical acceleration variance when still, (um/s^2)^2
+#define ZUPT_ACCEL_MEAN 150000 ///< Largest mean vertical acceleration when still, um/s^2
+#define ZUPT_GYRO_TICKS 393   ///< Largest rotation rate when still, ticks (3 deg/s)
+#define ZUPT_HOLD_US 250000   ///< Time the IMU must stay quiet before a zero velocity update
+#define ZUPT_MAX_VEL 50000    ///< Largest integrated velocity a zero velocity update may take out, um/s
+#define ZUPT_FORCE_US 2000000 ///< Time quiet after which drift of any size is taken out
+#define GYRO_RAD_PER_TICK (3.14159265f/180.0f/131.0f) ///< Gyro scale at +-250 deg/s
+
+/** @brief   Class which estimates vertical velocity from one IMU's accelerometer
+ *           and gyro
+ *  @details A complementary filter tracks which way gravity points in the
+ *           sensor's frame: the gyro rotates the estimate every sample and the
+ *           accelerometer slowly pulls it back. The acceleration along gravity
+ *           is low pass filtered and decimated to the control rate, with single
+ *           sample spikes taken out, and then integrated into velocity. The
+ *           decimation follows the IMU's sample rate if it is changed. A
+ *           variance window on vertical acceleration plus a gyro check over the
+ *           same window detects when the bar is quiet. A slow grind at a
+ *           steady speed is just as quiet, so the bar only counts as still once
+ *           it has been quiet for @c ZUPT_HOLD_US and the integrated velocity
+ *           is small enough to be drift; only a long quiet stretch takes out a
+ *           larger one. A one state Kalman filter uses that as a zero velocity
+ *           measurement, taking out drift without clamping slow movement.
+ *           Every long enough still stretch is also used to re-measure the
+ *           IMU's calibration, which then takes effect right away. Nothing is
+ *           measured until the IMU's temperature is known, since each window
+ *           also goes into the fit of scale against temperature. Velocity is
+ *           integrated once more into position, which drifts, so it is only
+ *           good for measuring how far the bar moved since a recent still point.
+ */
+class VelocityEstimator
+{
+protected:
+    AccelScaler scaler;
+    Decimator decimator;
+    Integrator integ;
+    Integrator travel;
+    float grav[3] = {0, 0, 1};
+    bool leveled = false;
+    int64_t last_time = 0;
+    uint8_t rate_count = 0;
+
+    int32_t window[ZUPT_WINDOW];
+    uint8_t win_idx = 0;
+    uint8_t win_fill = 0;
+    int64_t win_sum = 0;
+    int64_t win_sq = 0;
+    uint16_t gyro_quiet = 0;
+    int64_t quiet_since = 0;
+    bool still = false;
+
+    float var_vel = 0;
+
+    ImuCalibration cal;
+    ImuCalibrator calibrator;
+    float temp_c = 0;
+    bool temp_known = false;
+    bool cal_changed = false;
+
+    void update_gravity(const ImuSample& s, float dt);
+    bool update_still(int32_t accel_vert, const ImuSample& s);
+    bool confirm_still(bool quiet, int32_t velocity, int64_t time_us);
+    void follow_rate(int64_t dt_us);
+public:
+    VelocityEstimator (float ticks_per_ms2, float dead_band_ms2, uint16_t cal_samples, uint16_t decimation);
+    void set_calibration(const ImuCalibration& new_cal);
+    void set_temperature(float new_temp_c);
+    bool take_calibration(ImuCalibration& new_cal);
+    int32_t update(const ImuSample& s, int64_t time_us);
+    int32_t get_velocity(void);
+    int32_t get_position(void);
+    bool is_still(void);
+};
+
+#endif // _VELOCITY_ESTIMATOR_H_
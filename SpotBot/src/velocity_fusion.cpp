@@ -0,0 +1,102 @@
+/** @file velocity_fusion.cpp
+ *  This program contains the class which turns the velocities of every IMU on
+ *  the bar into the one velocity the spotter works from, so one flaky or
+ *  unplugged IMU doesn't blind it.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <math.h>
+#include "velocity_fusion.h"
+
+/** @brief   Constructor which creates a fusion of some of the IMUs in an array
+ *  @param   mask Bit i is set if IMU i of the array is on the bar
+ */
+VelocityFusion::VelocityFusion (uint8_t mask)
+    : bar_mask (mask)
+{
+    for (uint8_t i = 0; i < SENSOR_MAX; i++){
+        last_pos[i] = 0;
+    }
+}
+
+/** @brief   Method which fills in the bar velocity, position and mode
+ *  @details Called once for every control step; the bar position is built
+ *           up from the change since the last call.
+ *  @param   velocities Velocities, positions, health and staleness of every
+ *           IMU; @c bar_vel, @c bar_pos, @c used and @c mode are filled in
+ */
+void VelocityFusion::fuse(ImuVelocities& velocities)
+{
+    uint8_t used = 0;
+    uint8_t n = 0;
+    float sorted[SENSOR_MAX];
+    for (uint8_t i = 0; i < velocities.count; i++){
+        if ((bar_mask & (1 << i)) && !(velocities.stale & (1 << i))
+            && velocities.health[i] >= FUSE_MIN_HEALTH){
+            used |= 1 << i;
+            // Insertion sort for the median, there are only a few IMUs
+            uint8_t j = n++;
+            while (j > 0 && sorted[j - 1] > velocities.vel[i]){
+                sorted[j] = sorted[j - 1];
+                j--;
+            }
+            sorted[j] = velocities.vel[i];
+        }
+    }
+    if (n >= 3){
+        float median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+        for (uint8_t i = 0; i < velocities.count; i++){
+            float off = velocities.vel[i] - median;
+            if ((used & (1 << i)) && (off > FUSE_DISAGREE || off < -FUSE_DISAGREE)){
+                used &= ~(1 << i);
+                n--;
+            }
+        }
+    }
+    else if (n == 2 && sorted[1] - sorted[0] > FUSE_DISAGREE){
+        // No majority with two, so keeping the healthier one, or the one closest to the bar so far
+        uint8_t keep = 0xFF;
+        for (uint8_t i = 0; i < velocities.count; i++){
+            if (!(used & (1 << i))){
+                continue;
+            }
+            if (keep == 0xFF || velocities.health[i] > velocities.health[keep]
+                || (velocities.health[i] == velocities.health[keep]
+                    && fabsf(velocities.vel[i] - bar_vel) < fabsf(velocities.vel[keep] - bar_vel))){
+                keep = i;
+            }
+        }
+        used = 1 << keep;
+        n = 1;
+    }
+
+    float weights = 0;
+    float vel = 0;
+    float moved = 0;
+    float moved_weights = 0;
+    for (uint8_t i = 0; i < velocities.count; i++){
+        if (used & (1 << i)){
+            float weight = velocities.health[i];
+            weights += weight;
+            vel += weight * velocities.vel[i];
+            // Only IMUs used last time too have a change in position to add
+            if (last_used & (1 << i)){
+                moved += weight * (velocities.pos[i] - last_pos[i]);
+                moved_weights += weight;
+            }
+        }
+        last_pos[i] = velocities.pos[i];
+    }
+    if (moved_weights > 0){
+        bar_pos += moved / moved_weights;
+    }
+    last_used = used;
+
+    velocities.used = used;
+    velocities.mode = n >= 2 ? FUSE_ALL : n == 1 ? FUSE_SINGLE : FUSE_NONE;
+    bar_vel = weights > 0 ? vel / weights : 0;
+    velocities.bar_vel = bar_vel;
+    velocities.bar_pos = bar_pos;
+}
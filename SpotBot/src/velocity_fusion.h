@@ -0,0 +1,43 @@
+/** @file velocity_fusion.h
+ *  This is the header for the velocity fusion file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _VELOCITY_FUSION_H_
+#define _VELOCITY_FUSION_H_
+
+#include <stdint.h>
+#include "sensor_array.h"
+
+#define FUSE_MIN_HEALTH 50    ///< Lowest health score of an IMU which is still used
+#define FUSE_DISAGREE 0.3f    ///< Distance from the median which gets an IMU voted out, m/s
+
+/** @brief   Class which combines the bar IMUs into one bar velocity and position
+ *  @details Each IMU on the bar is weighted by its health score, and IMUs which
+ *           are stale or score below @c FUSE_MIN_HEALTH are dropped. Voting
+ *           needs at least three IMUs: with three or more left, any which are
+ *           further than @c FUSE_DISAGREE from the median are voted out. Two
+ *           IMUs which disagree can't say which one is wrong, so the fusion
+ *           drops to the one with the better health score, or on a tie the one
+ *           closer to the last bar velocity, and runs in single IMU mode until
+ *           they agree again. Positions drift differently in
+ *           every IMU, so the bar position is built up from the weighted change
+ *           in each IMU's position, which keeps it from jumping when an IMU
+ *           drops out or comes back.
+ */
+class VelocityFusion
+{
+protected:
+    uint8_t bar_mask;
+    float last_pos[SENSOR_MAX];
+    uint8_t last_used = 0;
+    float bar_pos = 0;
+    float bar_vel = 0;
+public:
+    VelocityFusion (uint8_t mask);
+    void fuse(ImuVelocities& velocities);
+};
+
+#endif // _VELOCITY_FUSION_H_
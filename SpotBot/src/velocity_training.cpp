@@ -0,0 +1,179 @@
+/** @file velocity_training.cpp
+ *  This program contains the classes which turn rep summaries into velocity
+ *  based training numbers: how much speed the lifter has lost in the set, how
+ *  many reps they have left and what they could lift once.
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include "velocity_training.h"
+
+/** @brief   Constructor which creates a fit with no points
+ */
+LineFit::LineFit (void)
+{
+}
+
+/** @brief   Method which adds one point to the fit
+ */
+void LineFit::add(float x, float y)
+{
+    points = points < 0xFFFF ? points + 1 : points;
+    n += 1;
+    sx += x;
+    sy += y;
+    sxy += x * y;
+    sxx += x * x;
+}
+
+/** @brief   Method which makes every point added so far count for less
+ *  @param   factor Weight the points keep, 0 to 1
+ */
+void LineFit::scale(float factor)
+{
+    n *= factor;
+    sx *= factor;
+    sy *= factor;
+    sxy *= factor;
+    sxx *= factor;
+}
+
+/** @brief   Method which works out the least squares line
+ *  @param   slope Gets the change in y for each unit of x
+ *  @param   intercept Gets y where x is 0
+ *  @return  False if the points don't spread out enough in x to fit a line
+ */
+bool LineFit::solve(float& slope, float& intercept) const
+{
+    // Compared to the size of x so rounding can't pass for a spread
+    float det = n * sxx - sx * sx;
+    if (points < 2 || det <= VBT_MIN_DET * n * sxx){
+        return false;
+    }
+    slope = (n * sxy - sx * sy) / det;
+    intercept = (sy - slope * sx) / n;
+    return true;
+}
+
+/** @brief   Constructor which creates a tracker with nothing lifted yet
+ *  @param   min_velocity Minimum velocity threshold of the exercise in m/s
+ */
+VelocityTraining::VelocityTraining (float min_velocity)
+{
+    reset(min_velocity);
+}
+
+/** @brief   Method which forgets everything, such as when the exercise changes
+ *  @param   min_velocity Minimum velocity threshold of the exercise in m/s
+ */
+void VelocityTraining::reset(float min_velocity)
+{
+    mvt = min_velocity;
+    set = 0;
+    reps = 0;
+    failed = false;
+    best = 0;
+    last = 0;
+    set_load = 0;
+    in_set = LineFit();
+    profile = LineFit();
+}
+
+/** @brief   Method which sets the velocity loss at which a set should end
+ *  @param   percent Velocity loss in percent, 0 to never end a set early
+ */
+void VelocityTraining::set_loss_limit(float percent)
+{
+    loss_limit = percent;
+}
+
+/** @brief   Method which adds a finished rep
+ *  @details The first rep of a new set puts the last set into the
+ *           load-velocity fit for good. Failed reps end the set's reps in
+ *           reserve but their velocities aren't used.
+ *  @param   rep Summary of the rep from the session store
+ *  @param   load_kg Load on the bar in kg, 0 if it isn't known
+ */
+void VelocityTraining::add_rep(const RepSummary& rep, float load_kg)
+{
+    if (rep.set != set){
+        if (reps > 0 && set_load > 0){
+            profile.scale(VBT_DECAY);
+            profile.add(set_load, best);
+        }
+        set = rep.set;
+        reps = 0;
+        failed = false;
+        best = 0;
+        last = 0;
+        in_set = LineFit();
+    }
+    set_load = load_kg;
+    if (rep.failed){
+        failed = true;
+        return;
+    }
+    float vel = rep.mean_up / 1000.0f;
+    reps++;
+    in_set.add(reps, vel);
+    best = vel > best ? vel : best;
+    last = vel;
+}
+
+/** @brief   Method which returns how much slower the last rep was than the
+ *           fastest of the set
+ *  @return  Velocity loss in percent
+ */
+float VelocityTraining::loss(void)
+{
+    return best > 0 ? (best - last) / best * 100 : 0;
+}
+
+/** @brief   Method which estimates how many more reps the lifter could make
+ *  @return  Reps in reserve, or -1 if the set isn't slowing down yet
+ */
+float VelocityTraining::reps_in_reserve(void)
+{
+    if (failed){
+        return 0;
+    }
+    float slope, intercept;
+    if (!in_set.solve(slope, intercept) || slope >= 0){
+        return -1;
+    }
+    float left = (mvt - intercept) / slope - reps;
+    return left > 0 ? left : 0;
+}
+
+/** @brief   Method which estimates the most the lifter could lift once
+ *  @return  1RM in kg, or -1 if there aren't sets at two loads yet
+ */
+float VelocityTraining::one_rm(void)
+{
+    // Faded the same way it will be once the next set starts, so the estimate doesn't jump then
+    LineFit fit = profile;
+    if (reps > 0 && set_load > 0){
+        fit.scale(VBT_DECAY);
+        fit.add(set_load, best);
+    }
+    float slope, intercept;
+    if (!fit.solve(slope, intercept) || slope >= 0){
+        return -1;
+    }
+    return (mvt - intercept) / slope;
+}
+
+/** @brief   Method which fills in where the lifter stands right now
+ */
+void VelocityTraining::get_status(TrainingStatus& status)
+{
+    status.set = set;
+    status.reps = reps;
+    status.best_mm_s = best * 1000;
+    status.last_mm_s = last * 1000;
+    status.loss = loss();
+    status.rir = reps_in_reserve();
+    status.one_rm = one_rm();
+    status.stop = loss_limit > 0 && status.loss >= loss_limit;
+}
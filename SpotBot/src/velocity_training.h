@@ -0,0 +1,94 @@
+/** @file velocity_training.h
+ *  This is the header for the velocity training file
+ * 
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _VELOCITY_TRAINING_H_
+#define _VELOCITY_TRAINING_H_
+
+#include <stdint.h>
+#include "rep_analytics.h"
+
+#define VBT_DECAY 0.8f        ///< Weight older sets keep each time a set joins the load-velocity fit
+#define VBT_MIN_DET 1.0e-4f   ///< Smallest spread in x a line can be fit through, over the mean square of x
+
+/** @brief   Where the lifter stands in the set and the session
+ *  @details Velocity loss is in percent of the fastest rep of the set. Reps
+ *           in reserve and the 1RM are negative when there isn't enough to go
+ *           on yet. @c stop is set once the velocity loss has reached the limit
+ *           asked for.
+ */
+struct TrainingStatus
+{
+    uint8_t set;
+    uint8_t reps;
+    int16_t best_mm_s;
+    int16_t last_mm_s;
+    float loss;
+    float rir;
+    float one_rm;
+    bool stop;
+};
+
+/** @brief   Class which fits a straight line through points as they come in
+ *  @details Only the five sums behind least squares are kept, never the
+ *           points. Scaling the sums down makes older points count for less,
+ *           so the fit can follow a lifter getting stronger or tired. Scaling
+ *           leaves the weights adding up to less than the number of points,
+ *           so the points are counted on their own.
+ */
+class LineFit
+{
+protected:
+    uint16_t points = 0;
+    float n = 0;
+    float sx = 0;
+    float sy = 0;
+    float sxy = 0;
+    float sxx = 0;
+public:
+    LineFit (void);
+    void add(float x, float y);
+    void scale(float factor);
+    bool solve(float& slope, float& intercept) const;
+};
+
+/** @brief   Class which works out velocity based training numbers from rep
+ *           summaries
+ *  @details Within a set the mean concentric velocity of each rep is compared
+ *           to the fastest rep for the velocity loss, and a line through
+ *           velocity against rep number is carried on to the exercise's
+ *           minimum velocity threshold, the speed of the last rep a lifter can
+ *           make, for the reps left in reserve. Across sets the fastest rep of
+ *           each set against the load on the bar is fit to a line which gives
+ *           the 1RM where it crosses that threshold. The set being lifted is
+ *           put into the fit as it goes, without being kept, so the estimate
+ *           is current after every rep.
+ */
+class VelocityTraining
+{
+protected:
+    float mvt;
+    float loss_limit = 0;
+    uint8_t set = 0;
+    uint8_t reps = 0;
+    bool failed = false;
+    float best = 0;
+    float last = 0;
+    float set_load = 0;
+    LineFit in_set;
+    LineFit profile;
+public:
+    VelocityTraining (float min_velocity);
+    void reset(float min_velocity);
+    void set_loss_limit(float percent);
+    void add_rep(const RepSummary& rep, float load_kg);
+    float loss(void);
+    float reps_in_reserve(void);
+    float one_rm(void);
+    void get_status(TrainingStatus& status);
+};
+
+#endif // _VELOCITY_TRAINING_H_
@@ -0,0 +1,192 @@
+/** @file Arduino.h
+ *  This file stands in for the Arduino and FreeRTOS headers when the modules
+ *  are built on a computer by the @c native environment for the unit tests.
+ *  Only what the tested modules use is here. Task notifications are made with
+ *  threads so the channels can be tested with real waiting, and pins go
+ *  through @c native_pins so a test can play the part of what is wired to them.
+ *
+ *  Time is the computer's clock plus @c native_skew_us. @c delayMicroseconds()
+ *  doesn't sleep, it only moves the clock on, so code which bit-bangs pins
+ *  takes the time it would on the ESP32 without the test taking that long.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _NATIVE_ARDUINO_H_
+#define _NATIVE_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define OUTPUT_OPEN_DRAIN 0x13
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFF
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) / portTICK_PERIOD_MS)
+#define portYIELD_FROM_ISR()
+
+/// Time added to the computer's clock by @c delayMicroseconds()
+inline std::atomic<int64_t> native_skew_us (0);
+
+/** @brief   Function which returns the time since the program started in us
+ */
+inline int64_t native_time_us(void)
+{
+    static const auto start = std::chrono::steady_clock::now();
+    auto now = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count() + native_skew_us;
+}
+
+inline unsigned long micros(void)
+{
+    return (unsigned long)native_time_us();
+}
+
+inline unsigned long millis(void)
+{
+    return (unsigned long)(native_time_us() / 1000);
+}
+
+inline void delayMicroseconds(uint32_t us)
+{
+    native_skew_us += us;
+}
+
+inline void delay(uint32_t ms)
+{
+    native_skew_us += (int64_t)ms * 1000;
+}
+
+/** @brief   Class which a test can derive from to act as whatever is wired to
+ *           the pins; by default every pin reads high
+ */
+class NativePins
+{
+public:
+    virtual void mode(uint8_t pin, uint8_t pin_mode) {}
+    virtual void write(uint8_t pin, uint8_t level) {}
+    virtual int read(uint8_t pin) { return HIGH; }
+};
+
+inline NativePins native_no_pins;
+inline NativePins* native_pins = &native_no_pins;
+
+inline void pinMode(uint8_t pin, uint8_t pin_mode)
+{
+    native_pins->mode(pin, pin_mode);
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t level)
+{
+    native_pins->write(pin, level);
+}
+
+inline int digitalRead(uint8_t pin)
+{
+    return native_pins->read(pin);
+}
+
+/** @brief   The part of a FreeRTOS task the channels use, its notification
+ */
+struct NativeTask
+{
+    std::mutex mutex;
+    std::condition_variable woken;
+    uint32_t notified = 0;
+};
+
+typedef NativeTask* TaskHandle_t;
+
+/** @brief   Function which returns the task of the calling thread
+ */
+inline TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    thread_local NativeTask task;
+    return &task;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> hold (task->mutex);
+        task->notified++;
+    }
+    task->woken.notify_one();
+    return pdPASS;
+}
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* p_woken)
+{
+    xTaskNotifyGive(task);
+    *p_woken = pdTRUE;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    NativeTask* task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> hold (task->mutex);
+    auto given = [task]{ return task->notified > 0; };
+    if (ticks == portMAX_DELAY){
+        task->woken.wait(hold, given);
+    }
+    else{
+        task->woken.wait_for(hold, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS), given);
+    }
+    uint32_t count = task->notified;
+    if (count > 0){
+        task->notified = clear ? 0 : count - 1;
+    }
+    return count;
+}
+
+inline void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+/** @brief   Spinlock standing in for the ESP32's critical sections
+ */
+struct portMUX_TYPE
+{
+    std::atomic<bool> held {false};
+};
+
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+inline void portENTER_CRITICAL(portMUX_TYPE* p_mux)
+{
+    while (p_mux->held.exchange(true, std::memory_order_acquire)){
+        std::this_thread::yield();
+    }
+}
+
+inline void portEXIT_CRITICAL(portMUX_TYPE* p_mux)
+{
+    p_mux->held.store(false, std::memory_order_release);
+}
+
+#define portENTER_CRITICAL_ISR(p_mux) portENTER_CRITICAL(p_mux)
+#define portEXIT_CRITICAL_ISR(p_mux) portEXIT_CRITICAL(p_mux)
+
+#endif // _NATIVE_ARDUINO_H_
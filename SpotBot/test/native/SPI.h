@@ -0,0 +1,46 @@
+/** @file SPI.h
+ *  This file stands in for the Arduino @c SPI library in the @c native
+ *  environment. The methods are virtual so a test can derive a bus with a
+ *  chip on it; on its own every byte reads back as zero.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _NATIVE_SPI_H_
+#define _NATIVE_SPI_H_
+
+#include "Arduino.h"
+
+#define MSBFIRST 1
+#define SPI_MODE3 3
+
+struct SPISettings
+{
+    uint32_t clock;
+    uint8_t bit_order;
+    uint8_t data_mode;
+
+    SPISettings (uint32_t clock_hz, uint8_t order, uint8_t mode)
+        : clock (clock_hz), bit_order (order), data_mode (mode)
+    {
+    }
+};
+
+class SPIClass
+{
+public:
+    virtual void beginTransaction(SPISettings settings) {}
+    virtual void endTransaction(void) {}
+    virtual uint8_t transfer(uint8_t data) { return 0; }
+
+    void transfer(void* p_buf, uint32_t size)
+    {
+        uint8_t* p_bytes = (uint8_t*)p_buf;
+        for (uint32_t i = 0; i < size; i++){
+            p_bytes[i] = transfer(p_bytes[i]);
+        }
+    }
+};
+
+#endif // _NATIVE_SPI_H_
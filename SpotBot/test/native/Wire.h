@@ -0,0 +1,28 @@
+/** @file Wire.h
+ *  This file stands in for the Arduino @c Wire library in the @c native
+ *  environment. The methods are virtual so a test can derive a bus with
+ *  devices, and faults, of its own; on its own nothing answers.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _NATIVE_WIRE_H_
+#define _NATIVE_WIRE_H_
+
+#include "Arduino.h"
+
+class TwoWire
+{
+public:
+    virtual bool begin(int sda, int scl, uint32_t frequency) { return true; }
+    virtual bool end(void) { return true; }
+    virtual void setTimeOut(uint16_t timeout_ms) {}
+    virtual void beginTransmission(uint16_t address) {}
+    virtual size_t write(uint8_t value) { return 1; }
+    virtual uint8_t endTransmission(bool send_stop) { return 2; }
+    virtual size_t requestFrom(uint16_t address, size_t size, bool send_stop) { return 0; }
+    virtual int read(void) { return -1; }
+};
+
+#endif // _NATIVE_WIRE_H_
@@ -0,0 +1,19 @@
+/** @file esp_timer.h
+ *  This file stands in for the ESP-IDF timer header in the @c native
+ *  environment, on the same clock as @c micros()
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#ifndef _NATIVE_ESP_TIMER_H_
+#define _NATIVE_ESP_TIMER_H_
+
+#include "Arduino.h"
+
+inline int64_t esp_timer_get_time(void)
+{
+    return native_time_us();
+}
+
+#endif // _NATIVE_ESP_TIMER_H_
@@ -0,0 +1,421 @@
+/** @file test_bus_recovery.cpp
+ *  This program tests how the IMU side copes with a misbehaving I2C bus. A
+ *  fake @c TwoWire injects NACKs, timeouts, short reads and a device which
+ *  holds SDA low, and the time every failed transaction takes, recovery
+ *  included, is checked against a bound. The sensor array is then checked to
+ *  leave a dead IMU behind without it costing bus time, and to pick it up again.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <string.h>
+#include <deque>
+#include <Wire.h>
+#include "esp_timer.h"
+#include "i2c_bus.h"
+#include "mpu6050.h"
+#include "sensor_array.h"
+
+#define SDA_PIN 21
+#define SCL_PIN 22
+#define DEV_ADDR 0x68
+/// Clearing the bus by hand: 9 clocks and a STOP, 5 us per half clock
+#define CLEAR_US ((9 * 2 + 4) * 5)
+/// Time the test itself may add to a measurement, it runs on a computer
+#define SLACK_US 2000
+#define TICKS_PER_MS2 1670.2f
+
+#define FAULT_NONE 0        ///< Transactions work
+#define FAULT_NACK 1        ///< Device doesn't answer
+#define FAULT_TIMEOUT 2     ///< Controller times out with the bus idle
+#define FAULT_STUCK 3       ///< Device times out the controller and holds SDA low
+#define FAULT_SHORT 4       ///< Device stops part way through a read
+
+/** @brief   Class which acts as a @c TwoWire with faults, and as the SDA and
+ *           SCL pins it is wired to
+ *  @details A timeout takes @c I2C_TIMEOUT_MS on the test's clock, as it
+ *           would on the ESP32. A stuck device lets SDA go after
+ *           @c hold_clocks rising edges on SCL.
+ */
+class FaultyWire : public TwoWire, public NativePins
+{
+public:
+    uint8_t fault = FAULT_NONE;
+    uint8_t faults_left = 0;
+    uint8_t hold_clocks = 0;
+    bool sda_low = false;
+    bool scl_high = true;
+    bool running = true;
+    uint32_t starts = 0;
+    uint8_t reg = 0;
+
+    FaultyWire (void)
+    {
+        native_pins = this;
+    }
+
+    ~FaultyWire (void)
+    {
+        native_pins = &native_no_pins;
+    }
+
+    /** @brief   Method which arms a fault for the next @c times transactions
+     */
+    void inject(uint8_t a_fault, uint8_t times, uint8_t clocks = 0)
+    {
+        fault = a_fault;
+        faults_left = times;
+        hold_clocks = clocks;
+    }
+
+    uint8_t next_fault(void)
+    {
+        if (faults_left == 0){
+            return FAULT_NONE;
+        }
+        faults_left--;
+        return fault;
+    }
+
+    bool begin(int sda, int scl, uint32_t frequency)
+    {
+        running = true;
+        starts++;
+        return true;
+    }
+
+    bool end(void)
+    {
+        running = false;
+        return true;
+    }
+
+    void beginTransmission(uint16_t address)
+    {
+    }
+
+    size_t write(uint8_t value)
+    {
+        reg = value;
+        return 1;
+    }
+
+    uint8_t endTransmission(bool send_stop)
+    {
+        if (!running){
+            return 4;
+        }
+        if (fault == FAULT_SHORT){
+            return 0;
+        }
+        switch (next_fault()){
+            case FAULT_NACK:
+                return 2;
+            case FAULT_TIMEOUT:
+                delay(I2C_TIMEOUT_MS);
+                return 5;
+            case FAULT_STUCK:
+                delay(I2C_TIMEOUT_MS);
+                sda_low = true;
+                return 5;
+        }
+        return 0;
+    }
+
+    size_t requestFrom(uint16_t address, size_t size, bool send_stop)
+    {
+        if (fault == FAULT_SHORT && next_fault() == FAULT_SHORT){
+            return size / 2;
+        }
+        return size;
+    }
+
+    int read(void)
+    {
+        return reg++;
+    }
+
+    void write(uint8_t pin, uint8_t level)
+    {
+        if (pin == SCL_PIN){
+            if (level == HIGH && !scl_high && sda_low && hold_clocks > 0 && --hold_clocks == 0){
+                sda_low = false;
+            }
+            scl_high = level == HIGH;
+        }
+    }
+
+    int read(uint8_t pin)
+    {
+        return pin == SDA_PIN && sda_low ? LOW : HIGH;
+    }
+};
+
+/** @brief   Function which times one register read
+ *  @return  Microseconds it took, as the IMU task would see it
+ */
+static int64_t timed_read(WireBus& bus, bool& ok)
+{
+    uint8_t buf[6];
+    int64_t start = esp_timer_get_time();
+    ok = bus.read_regs(DEV_ADDR, 0x3B, buf, 6);
+    return esp_timer_get_time() - start;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   A read that works returns the bytes and leaves the bus alone
+ */
+void test_clean_read(void)
+{
+    FaultyWire wire;
+    WireBus bus (wire, SDA_PIN, SCL_PIN, 400000);
+    bus.begin();
+    uint8_t buf[4];
+    TEST_ASSERT_TRUE(bus.read_regs(DEV_ADDR, 0x10, buf, 4));
+    TEST_ASSERT_EQUAL_HEX8(0x10, buf[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x13, buf[3]);
+    TEST_ASSERT_EQUAL(0, bus.get_recoveries());
+}
+
+/** @brief   A device holding SDA low is cleared straight away, and the failed
+ *           read, timeout and recovery together stay inside the bound
+ */
+void test_stuck_sda_recovered_in_bound(void)
+{
+    FaultyWire wire;
+    WireBus bus (wire, SDA_PIN, SCL_PIN, 400000);
+    bus.begin();
+    for (uint8_t clocks = 1; clocks <= 9; clocks++){
+        wire.inject(FAULT_STUCK, 1, clocks);
+        bool ok;
+        int64_t took = timed_read(bus, ok);
+        TEST_ASSERT_FALSE(ok);
+        TEST_ASSERT_FALSE(wire.sda_low);
+        TEST_ASSERT_TRUE(wire.running);
+        TEST_ASSERT_EQUAL(clocks, bus.get_recoveries());
+        TEST_ASSERT_LESS_OR_EQUAL(CLEAR_US + SLACK_US, bus.get_recovery_us());
+        TEST_ASSERT_LESS_OR_EQUAL(I2C_TIMEOUT_MS * 1000 + CLEAR_US + SLACK_US, took);
+
+        took = timed_read(bus, ok);
+        TEST_ASSERT_TRUE(ok);
+    }
+}
+
+/** @brief   A device which never lets go still only costs the bound, and the
+ *           bus reports it couldn't be cleared
+ */
+void test_dead_short_bounded(void)
+{
+    FaultyWire wire;
+    WireBus bus (wire, SDA_PIN, SCL_PIN, 400000);
+    bus.begin();
+    wire.inject(FAULT_STUCK, 1, 0);
+    bool ok;
+    int64_t took = timed_read(bus, ok);
+    TEST_ASSERT_FALSE(ok);
+    TEST_ASSERT_TRUE(wire.sda_low);
+    TEST_ASSERT_LESS_OR_EQUAL(I2C_TIMEOUT_MS * 1000 + CLEAR_US + SLACK_US, took);
+    TEST_ASSERT_FALSE(bus.recover());
+}
+
+/** @brief   A timeout recovers the controller at once; NACKs only after
+ *           @c I2C_FAIL_LIMIT in a row, and a good transfer starts the count over
+ */
+void test_failure_counting(void)
+{
+    FaultyWire wire;
+    WireBus bus (wire, SDA_PIN, SCL_PIN, 400000);
+    bus.begin();
+    bool ok;
+
+    wire.inject(FAULT_TIMEOUT, 1);
+    int64_t took = timed_read(bus, ok);
+    TEST_ASSERT_FALSE(ok);
+    TEST_ASSERT_EQUAL(1, bus.get_recoveries());
+    TEST_ASSERT_LESS_OR_EQUAL(I2C_TIMEOUT_MS * 1000 + CLEAR_US + SLACK_US, took);
+
+    wire.inject(FAULT_NACK, I2C_FAIL_LIMIT - 1);
+    for (uint8_t i = 0; i < I2C_FAIL_LIMIT - 1; i++){
+        timed_read(bus, ok);
+        TEST_ASSERT_FALSE(ok);
+    }
+    TEST_ASSERT_EQUAL(1, bus.get_recoveries());
+    timed_read(bus, ok);
+    TEST_ASSERT_TRUE(ok);
+
+    wire.inject(FAULT_NACK, I2C_FAIL_LIMIT);
+    for (uint8_t i = 0; i < I2C_FAIL_LIMIT; i++){
+        timed_read(bus, ok);
+    }
+    TEST_ASSERT_EQUAL(2, bus.get_recoveries());
+    TEST_ASSERT_EQUAL(3, wire.starts);
+}
+
+/** @brief   A read which comes back short fails instead of handing back junk
+ */
+void test_short_read_rejected(void)
+{
+    FaultyWire wire;
+    WireBus bus (wire, SDA_PIN, SCL_PIN, 400000);
+    bus.begin();
+    uint8_t buf[6] = {0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA};
+    wire.inject(FAULT_SHORT, 1);
+    TEST_ASSERT_FALSE(bus.read_regs(DEV_ADDR, 0x3B, buf, 6));
+    for (uint8_t i = 0; i < 6; i++){
+        TEST_ASSERT_EQUAL_HEX8(0xAA, buf[i]);
+    }
+}
+
+/** @brief   Class which acts as an I2C bus with a few MPU-6050s on it, each
+ *           of which can be unplugged
+ */
+class UnpluggableBus : public I2CBus
+{
+public:
+    struct Device
+    {
+        uint8_t regs[128];
+        std::deque<uint8_t> fifo;
+        bool alive;
+        uint32_t tries;
+    } devices[2];
+
+    UnpluggableBus (void)
+    {
+        for (uint8_t i = 0; i < 2; i++){
+            memset(devices[i].regs, 0, sizeof(devices[i].regs));
+            devices[i].alive = true;
+            devices[i].tries = 0;
+        }
+    }
+
+    void add_samples(uint8_t index, uint16_t n)
+    {
+        for (uint16_t i = 0; i < n * 12; i++){
+            devices[index].fifo.push_back(i % 12 == 4 ? 0x40 : 0);
+        }
+    }
+
+    Device* find(uint8_t addr)
+    {
+        Device* p_dev = &devices[addr - DEV_ADDR];
+        p_dev->tries++;
+        return p_dev->alive ? p_dev : NULL;
+    }
+
+    bool write_byte(uint8_t addr, uint8_t value)
+    {
+        return false;
+    }
+
+    bool write_reg(uint8_t addr, uint8_t reg, uint8_t value)
+    {
+        Device* p_dev = find(addr);
+        if (p_dev != NULL && reg == MPU_USER_CTRL && (value & MPU_USER_FIFO_RST)){
+            p_dev->fifo.clear();
+        }
+        return p_dev != NULL;
+    }
+
+    bool read_regs(uint8_t addr, uint8_t reg, uint8_t* p_buf, uint16_t len)
+    {
+        Device* p_dev = find(addr);
+        if (p_dev == NULL){
+            return false;
+        }
+        if (reg == MPU_FIFO_R_W){
+            for (uint16_t i = 0; i < len; i++){
+                p_buf[i] = p_dev->fifo.front();
+                p_dev->fifo.pop_front();
+            }
+        }
+        else if (reg == MPU_FIFO_COUNT_H){
+            p_buf[0] = p_dev->fifo.size() >> 8;
+            p_buf[1] = p_dev->fifo.size() & 0xFF;
+        }
+        else{
+            memcpy(p_buf, &p_dev->regs[reg], len);
+        }
+        return true;
+    }
+
+    uint16_t max_read(void)
+    {
+        return 128;
+    }
+};
+
+/** @brief   An IMU which stops answering is marked stale, tried only every
+ *           @c SENSOR_RETRY drains, doesn't hold the other one up, and is used
+ *           again soon after it answers, even though its FIFO overflowed
+ *           while it was being skipped
+ */
+void test_dead_imu_skipped_and_recovered(void)
+{
+    UnpluggableBus bus;
+    MPU6050 imu_a (bus, DEV_ADDR), imu_b (bus, DEV_ADDR + 1);
+    VelocityEstimator est_a (TICKS_PER_MS2, 0.05f, 1000, 10), est_b (TICKS_PER_MS2, 0.05f, 1000, 10);
+    SensorArray array (1000);
+    array.add(&imu_a, &est_a, NULL, 0, -1);
+    array.add(&imu_b, &est_b, NULL, 0, -1);
+    const ImuConfig config = {1, 0, 0, 0, true};
+    TEST_ASSERT_TRUE(array.begin(config));
+
+    bus.devices[1].alive = false;
+    ImuVelocities velocities;
+    int64_t now_us = 0;
+    for (uint8_t i = 0; i <= SENSOR_STALE_US / 10000 + 1; i++){
+        now_us += 10000;
+        bus.add_samples(0, 10);
+        array.drain(0, now_us);
+        array.update(100);
+    }
+    array.get_velocities(velocities);
+    TEST_ASSERT_EQUAL(0x02, velocities.stale);
+    TEST_ASSERT_EQUAL(now_us, array.get_time());
+
+    uint32_t tries = bus.devices[1].tries;
+    for (uint8_t i = 0; i < 3 * SENSOR_RETRY; i++){
+        now_us += 10000;
+        bus.add_samples(0, 10);
+        array.drain(0, now_us);
+        TEST_ASSERT_EQUAL(10, array.update(100));
+    }
+    TEST_ASSERT_EQUAL(tries + 3, bus.devices[1].tries);
+
+    // 1 kHz of samples overflow its FIFO in the 100 ms between tries
+    bus.devices[1].alive = true;
+    uint8_t drains = 0;
+    do{
+        now_us += 10000;
+        bus.add_samples(0, 10);
+        bus.add_samples(1, 10);
+        array.drain(0, now_us);
+        array.update(100);
+        array.get_velocities(velocities);
+        drains++;
+    } while (velocities.stale != 0 && drains < 5 * SENSOR_RETRY);
+    TEST_ASSERT_EQUAL(0, velocities.stale);
+    TEST_ASSERT_LESS_OR_EQUAL(SENSOR_RETRY + 1, drains);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_clean_read);
+    RUN_TEST(test_stuck_sda_recovered_in_bound);
+    RUN_TEST(test_dead_short_bounded);
+    RUN_TEST(test_failure_counting);
+    RUN_TEST(test_short_read_rejected);
+    RUN_TEST(test_dead_imu_skipped_and_recovered);
+    return UNITY_END();
+}
@@ -0,0 +1,206 @@
+/** @file test_cable_puller.cpp
+ *  This program runs the cable puller against a model of the spotter motor
+ *  and cable, polled the way task_motor polls it, and compares how long a
+ *  spot takes to start lifting the bar from a cold start and after getting
+ *  ready, for different amounts of slack. It also checks that getting ready
+ *  never lifts the bar itself, that a spot pulls the same distance from rest
+ *  either way, and that the cable is let back out when a press recovers.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include "cable_puller.h"
+
+#define SPOT_DUTY 100       ///< Duty a spot pulls at, as in task_motor
+#define SPOT_MM 207.0f      ///< Cable a spot pulls in from rest, mm
+#define FREE_MM_S 4.0f      ///< Speed of a slack cable per unit of duty, mm/s
+#define LIFT_DUTY 40        ///< Duty which just holds the bar up once the cable is taut
+#define MOTOR_TAU_S 0.03f   ///< Time constant of the motor coming up to speed
+#define SIM_US 100          ///< Step of the model
+#define SPOT_POLL_US 2000   ///< task_motor's encoder checks until the cable lifts the bar
+#define LIFT_POLL_US 50000  ///< task_motor's encoder checks once it does
+#define READY_POLL_US 5000  ///< task_motor's encoder checks while getting ready
+#define IDLE_POLL_US 20000  ///< task_motor's checks for getting ready while the motor is off
+
+/** @brief   Model of the motor winding in a cable with slack in it, tied to
+ *           the bar
+ *  @details The motor comes up to a speed set by the duty. Once the slack is
+ *           taken up the bar's weight takes @c LIFT_DUTY of it, and a duty
+ *           under that can't move the bar at all.
+ */
+struct Rig
+{
+    float slack;
+    float pos = 0;
+    float speed = 0;
+    float most = 0;
+
+    Rig (float slack_mm) : slack (slack_mm) {}
+
+    void step(int16_t duty)
+    {
+        float target = duty * FREE_MM_S;
+        if (pos >= slack && duty > 0){
+            target = duty > LIFT_DUTY ? (duty - LIFT_DUTY) * FREE_MM_S : 0;
+            speed = speed > target ? target : speed;
+        }
+        speed += (target - speed) * SIM_US * 1e-6f / MOTOR_TAU_S;
+        pos += speed * SIM_US * 1e-6f;
+        most = pos > most ? pos : most;
+    }
+};
+
+/** @brief   What became of one simulated spot
+ */
+struct Spot
+{
+    float force_ms;         ///< Time from firing to the cable lifting the bar, by the model
+    float measured_ms;      ///< The same, as the puller measured it
+    float pulled_mm;        ///< Cable pulled in from rest by the end of the spot
+    float slack_mm;         ///< Slack the puller measured
+    float before_mm;        ///< Furthest the cable was wound in before the spot fired
+};
+
+/** @brief   Function which runs a spot through the puller and the model
+ *  @param   slack Slack in the cable, mm
+ *  @param   lead_us Time the press looked like it might fail before the spot
+ *           was fired, zero for a cold start
+ */
+static Spot spot(float slack, int64_t lead_us)
+{
+    Rig rig (slack);
+    CablePuller puller (SPOT_DUTY);
+    Spot out = {0, 0, 0, 0, 0};
+    int64_t fire_us = lead_us + IDLE_POLL_US;
+    int64_t next_us = 0;
+    int16_t duty = 0;
+    bool fired = false;
+    for (int64_t t = 0; t < 3000000; t += SIM_US){
+        if (!fired && t >= fire_us){
+            out.before_mm = rig.most;
+            duty = puller.fire(rig.pos, SPOT_MM, t);
+            fired = true;
+            next_us = t + SPOT_POLL_US;
+        }
+        else if (t >= next_us){
+            duty = puller.update(rig.pos, lead_us > 0 && t >= IDLE_POLL_US, t);
+            uint8_t state = puller.get_state();
+            next_us = t + (state == PULL_SPOT ? (puller.get_force_us() ? LIFT_POLL_US : SPOT_POLL_US)
+                           : state == PULL_IDLE ? IDLE_POLL_US : READY_POLL_US);
+        }
+        if (fired && out.force_ms == 0 && rig.pos >= slack + FORCE_MM){
+            out.force_ms = (t - fire_us) / 1000.0f;
+        }
+        rig.step(duty);
+        if (puller.take_done()){
+            out.measured_ms = puller.get_force_us() / 1000.0f;
+            out.pulled_mm = rig.pos;
+            out.slack_mm = puller.get_slack_mm();
+            return out;
+        }
+    }
+    TEST_FAIL_MESSAGE("Spot never finished");
+    return out;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   Getting ready ahead of a spot gets force on the bar sooner than a
+ *           cold start, at every amount of slack
+ */
+void test_time_to_force(void)
+{
+    const float slacks[] = {2, 5, 10, 15, 25};
+    for (uint8_t i = 0; i < 5; i++){
+        Spot cold = spot(slacks[i], 0);
+        Spot early = spot(slacks[i], 100000);
+        Spot ready = spot(slacks[i], 400000);
+        printf("slack %2.0f mm: cold %5.1f ms | 100 ms ready %5.1f ms | 400 ms ready %5.1f ms (measured %5.1f)\n",
+               slacks[i], cold.force_ms, early.force_ms, ready.force_ms, ready.measured_ms);
+        TEST_ASSERT_TRUE(early.force_ms <= cold.force_ms);
+        TEST_ASSERT_LESS_THAN_FLOAT(cold.force_ms, ready.force_ms);
+        // Once it has measured the slack the puller sees force within a poll
+        // of the model; from cold it goes by READY_SLACK_MM instead
+        TEST_ASSERT_FLOAT_WITHIN(SPOT_POLL_US / 1000.0f + 0.1f, ready.force_ms, ready.measured_ms);
+    }
+}
+
+/** @brief   Getting ready never lifts the bar, and measures the slack, even
+ *           past the most it winds in at @c READY_DUTY
+ */
+void test_ready_doesnt_lift(void)
+{
+    const float slacks[] = {2, 5, 10, 15, 25};
+    for (uint8_t i = 0; i < 5; i++){
+        Spot ready = spot(slacks[i], 1000000);
+        TEST_ASSERT_TRUE(ready.before_mm <= slacks[i] + 0.1f);
+        TEST_ASSERT_FLOAT_WITHIN(1.0f, slacks[i], ready.slack_mm);
+    }
+}
+
+/** @brief   A spot pulls the cable in the same distance from rest whether or
+ *           not the motor got ready first
+ */
+void test_same_pull(void)
+{
+    const float slacks[] = {5, 15, 25};
+    for (uint8_t i = 0; i < 3; i++){
+        Spot cold = spot(slacks[i], 0);
+        Spot ready = spot(slacks[i], 400000);
+        TEST_ASSERT_TRUE(cold.pulled_mm >= SPOT_MM);
+        TEST_ASSERT_TRUE(ready.pulled_mm >= SPOT_MM);
+        TEST_ASSERT_FLOAT_WITHIN(LIFT_POLL_US * 1e-6f * (SPOT_DUTY - LIFT_DUTY) * FREE_MM_S,
+                                 cold.pulled_mm, ready.pulled_mm);
+    }
+}
+
+/** @brief   A press which stops looking bad has the cable let back out to
+ *           where it rested, and a spot after that still pulls from rest
+ */
+void test_unwind(void)
+{
+    Rig rig (10);
+    CablePuller puller (SPOT_DUTY);
+    int16_t duty = 0;
+    int64_t t = 0;
+    for (; t < 1000000; t += SIM_US){
+        if (t % READY_POLL_US == 0){
+            duty = puller.update(rig.pos, t < 400000, t);
+        }
+        rig.step(duty);
+    }
+    TEST_ASSERT_EQUAL(PULL_IDLE, puller.get_state());
+    TEST_ASSERT_EQUAL(0, duty);
+    // The motor coasts a little past where it stops being driven
+    TEST_ASSERT_FLOAT_WITHIN(5.0f, 0, rig.pos);
+
+    float rest = rig.pos;
+    duty = puller.fire(rig.pos, SPOT_MM, t);
+    for (; !puller.take_done(); t += SIM_US){
+        if (t % SPOT_POLL_US == 0){
+            duty = puller.update(rig.pos, false, t);
+        }
+        rig.step(duty);
+    }
+    TEST_ASSERT_TRUE(rig.pos - rest >= SPOT_MM);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_time_to_force);
+    RUN_TEST(test_ready_doesnt_lift);
+    RUN_TEST(test_same_pull);
+    RUN_TEST(test_unwind);
+    return UNITY_END();
+}
@@ -0,0 +1,495 @@
+/** @file test_channels.cpp
+ *  This program tests the lock free channels with real threads standing in
+ *  for tasks: that items come out in order and none are lost, that a mailbox
+ *  read never mixes two values, and that a task waiting on a channel wakes
+ *  when something is put in and times out when nothing is. It also times
+ *  each channel against a queue built on a mutex and condition variable,
+ *  which copies every item under the lock the way a kernel queue does, and
+ *  prints items per second and the 50th and 99th percentile time from put to
+ *  get.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+#include "channels.h"
+
+#define ITEMS 200000        ///< Items each thread puts in the stress tests
+#define LATENCY_ITEMS 20000 ///< Items timed one at a time in the benchmarks
+#define PACE_NS 20000       ///< Time between puts while timing latency
+
+/** @brief   Value big enough that copying it isn't one store, so a read that
+ *           overlaps a write would show up as fields which don't agree
+ */
+struct Wide
+{
+    uint32_t fields[8];
+};
+
+/** @brief   Item the size of a bar record, stamped when it is put
+ */
+struct Stamped
+{
+    int64_t put_ns;
+    uint32_t seq;
+    uint32_t pad[13];
+};
+
+/** @brief   Queue which copies items in and out under a mutex and wakes the
+ *           getter with a condition variable, standing in for a kernel queue
+ *  @tparam  T Type of the items
+ *  @tparam  N Number of items which fit
+ */
+template <class T, uint16_t N>
+class LockedQueue
+{
+protected:
+    std::mutex mutex;
+    std::condition_variable ready;
+    T items[N];
+    uint32_t head = 0;
+    uint32_t tail = 0;
+public:
+    bool put(const T& item)
+    {
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            if (head - tail == N){
+                return false;
+            }
+            items[head++ % N] = item;
+        }
+        ready.notify_one();
+        return true;
+    }
+
+    T get(void)
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        ready.wait(lock, [this]{ return head != tail; });
+        return items[tail++ % N];
+    }
+};
+
+/** @brief   Value shared under a mutex, standing in for a @c Share
+ */
+template <class T>
+class LockedShare
+{
+protected:
+    std::mutex mutex;
+    T value = T();
+    uint32_t puts = 0;
+public:
+    void put(const T& item)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        value = item;
+        puts++;
+    }
+
+    T get(void)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        return value;
+    }
+
+    uint32_t count(void)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        return puts;
+    }
+};
+
+/** @brief   What one benchmark run measured
+ */
+struct Bench
+{
+    double ops;             ///< Items through per second
+    double p50_us;          ///< Median time from put to get, us
+    double p99_us;          ///< 99th percentile time from put to get, us
+};
+
+/** @brief   Function which returns a steady time in nanoseconds
+ */
+static int64_t now_ns(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** @brief   Function which passes items from putter threads to this one as
+ *           fast as they go, then again one at a time, and times both
+ *  @param   putters Number of putter threads
+ *  @param   put Puts one item, returning false if the queue was full
+ *  @param   get Waits for and returns one item
+ */
+template <class Put, class Get>
+static Bench run_queue(uint8_t putters, Put put, Get get)
+{
+    Bench bench;
+    for (uint8_t pass = 0; pass < 2; pass++){
+        uint32_t items = pass ? LATENCY_ITEMS : ITEMS;
+        int64_t pace = pass ? PACE_NS * putters : 0;
+        std::vector<std::thread> threads;
+        std::vector<double> latency;
+        latency.reserve(items * putters);
+        int64_t start = now_ns();
+        for (uint8_t p = 0; p < putters; p++){
+            threads.emplace_back([=, &put]{
+                Stamped item = {0, 0, {0}};
+                int64_t next = now_ns();
+                for (uint32_t i = 0; i < items; i++){
+                    while (pace && now_ns() < next);
+                    next += pace;
+                    item.seq = (uint32_t)p << 24 | i;
+                    item.put_ns = now_ns();
+                    while (!put(item)){
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        uint32_t next[4] = {0, 0, 0, 0};
+        bool in_order = true;
+        for (uint32_t i = 0; i < items * putters; i++){
+            Stamped item = get();
+            latency.push_back((now_ns() - item.put_ns) / 1000.0);
+            uint32_t p = item.seq >> 24;
+            in_order = p < putters && (item.seq & 0xFFFFFF) == next[p]++ && in_order;
+        }
+        double secs = (now_ns() - start) / 1e9;
+        for (std::thread& thread : threads){
+            thread.join();
+        }
+        TEST_ASSERT_TRUE(in_order);
+        if (pass){
+            std::sort(latency.begin(), latency.end());
+            bench.p50_us = latency[latency.size() / 2];
+            bench.p99_us = latency[latency.size() * 99 / 100];
+        }
+        else{
+            bench.ops = items * putters / secs;
+        }
+    }
+    return bench;
+}
+
+/** @brief   Function which puts values in a mailbox as fast as they go while
+ *           this thread reads it, then one at a time, and times both
+ *  @details A reader only sees the latest value, so the rate is puts per
+ *           second and the latency is from a put to the reader noticing it.
+ */
+template <class Box>
+static Bench run_mailbox(Box& box)
+{
+    Bench bench;
+    for (uint8_t pass = 0; pass < 2; pass++){
+        uint32_t items = pass ? LATENCY_ITEMS : ITEMS;
+        int64_t pace = pass ? PACE_NS : 0;
+        std::vector<double> latency;
+        latency.reserve(items);
+        uint32_t first = box.count();
+        int64_t start = now_ns();
+        std::thread writer ([=, &box]{
+            Stamped item = {0, 0, {0}};
+            int64_t next = now_ns();
+            for (uint32_t i = 1; i <= items; i++){
+                while (pace && now_ns() < next);
+                next += pace;
+                item.seq = i;
+                item.put_ns = now_ns();
+                box.put(item);
+            }
+        });
+        uint32_t seen = first;
+        bool backwards = false;
+        while (seen != first + items){
+            uint32_t puts = box.count();
+            if (puts == seen){
+                continue;
+            }
+            Stamped item = box.get();
+            latency.push_back((now_ns() - item.put_ns) / 1000.0);
+            backwards = item.seq + first < seen || backwards;
+            seen = item.seq + first;
+        }
+        double secs = (now_ns() - start) / 1e9;
+        writer.join();
+        TEST_ASSERT_FALSE(backwards);
+        if (pass){
+            std::sort(latency.begin(), latency.end());
+            bench.p50_us = latency[latency.size() / 2];
+            bench.p99_us = latency[latency.size() * 99 / 100];
+        }
+        else{
+            bench.ops = items / secs;
+        }
+    }
+    return bench;
+}
+
+/** @brief   Function which prints one benchmark run against its baseline
+ */
+static void report(const char* name, const Bench& bench, const Bench& base)
+{
+    printf("%-8s %10.0f items/s  p50 %7.2f us  p99 %8.2f us | mutex %10.0f items/s  p50 %7.2f us  p99 %8.2f us\n",
+           name, bench.ops, bench.p50_us, bench.p99_us, base.ops, base.p50_us, base.p99_us);
+    TEST_ASSERT_TRUE(bench.ops > 0 && base.ops > 0);
+    TEST_ASSERT_TRUE(bench.p50_us <= bench.p99_us);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   A queue gives items back in order, refuses a put when full and a
+ *           take when empty, and counts what is in it
+ */
+void test_spsc_full_and_empty(void)
+{
+    SpscQueue<uint32_t, 8> queue ("spsc");
+    uint32_t item;
+    TEST_ASSERT_TRUE(queue.is_empty());
+    TEST_ASSERT_FALSE(queue.take(item));
+    for (uint32_t i = 0; i < 8; i++){
+        TEST_ASSERT_TRUE(queue.put(i));
+    }
+    TEST_ASSERT_FALSE(queue.put(99));
+    TEST_ASSERT_EQUAL(8, queue.available());
+    TEST_ASSERT_EQUAL(0, queue.space());
+    for (uint32_t i = 0; i < 8; i++){
+        TEST_ASSERT_TRUE(queue.take(item));
+        TEST_ASSERT_EQUAL(i, item);
+    }
+    TEST_ASSERT_FALSE(queue.take(item));
+    TEST_ASSERT_EQUAL_STRING("spsc", queue.get_name());
+}
+
+/** @brief   Every item put by one thread comes out of another in order, with
+ *           the getter sleeping whenever the queue runs dry
+ */
+void test_spsc_across_threads(void)
+{
+    static SpscQueue<uint32_t, 64> queue;
+    std::thread putter ([]{
+        for (uint32_t i = 0; i < ITEMS; i++){
+            while (!queue.put(i)){
+                std::this_thread::yield();
+            }
+        }
+    });
+    bool in_order = true;
+    for (uint32_t i = 0; i < ITEMS; i++){
+        in_order = queue.get() == i && in_order;
+    }
+    putter.join();
+    TEST_ASSERT_TRUE(in_order);
+    TEST_ASSERT_TRUE(queue.is_empty());
+}
+
+/** @brief   A getter with a timeout gives up when nothing comes
+ */
+void test_spsc_get_times_out(void)
+{
+    SpscQueue<uint32_t, 4> queue (NULL, pdMS_TO_TICKS(20));
+    uint32_t item;
+    TEST_ASSERT_FALSE(queue.get(item));
+}
+
+/** @brief   Items from several putters all arrive, each putter's in order
+ */
+void test_mpsc_across_threads(void)
+{
+    static MpscQueue<uint32_t, 64> queue;
+    const uint32_t putters = 3;
+    std::thread threads[putters];
+    for (uint32_t p = 0; p < putters; p++){
+        threads[p] = std::thread ([p]{
+            for (uint32_t i = 0; i < ITEMS; i++){
+                while (!queue.put(p << 24 | i)){
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    uint32_t next[putters] = {0, 0, 0};
+    bool in_order = true;
+    for (uint32_t i = 0; i < putters * ITEMS; i++){
+        uint32_t item = queue.get();
+        uint32_t p = item >> 24;
+        in_order = p < putters && (item & 0xFFFFFF) == next[p] && in_order;
+        if (p < putters){
+            next[p]++;
+        }
+    }
+    for (uint32_t p = 0; p < putters; p++){
+        threads[p].join();
+        TEST_ASSERT_EQUAL(ITEMS, next[p]);
+    }
+    TEST_ASSERT_TRUE(in_order);
+    TEST_ASSERT_TRUE(queue.is_empty());
+}
+
+/** @brief   A mailbox holds only the latest value and counts the puts
+ */
+void test_mailbox_latest(void)
+{
+    Mailbox<int32_t> mailbox ("mail");
+    TEST_ASSERT_EQUAL(0, mailbox.get());
+    mailbox.put(1);
+    mailbox.put(2);
+    TEST_ASSERT_TRUE(mailbox.ISR_put(3));
+    TEST_ASSERT_EQUAL(3, mailbox.get());
+    TEST_ASSERT_EQUAL(3, mailbox.ISR_get());
+    TEST_ASSERT_EQUAL(3, mailbox.count());
+}
+
+/** @brief   A reader racing a writer never sees a value made of two puts,
+ *           and never sees the values go backwards
+ */
+void test_mailbox_never_torn(void)
+{
+    static Mailbox<Wide> mailbox;
+    std::atomic<bool> done {false};
+    std::thread writer ([&done]{
+        Wide value;
+        for (uint32_t i = 1; i <= ITEMS; i++){
+            for (uint8_t j = 0; j < 8; j++){
+                value.fields[j] = i;
+            }
+            mailbox.put(value);
+        }
+        done = true;
+    });
+    uint32_t torn = 0, backwards = 0, last = 0, reads = 0;
+    while (!done || last != ITEMS){
+        Wide value = mailbox.get();
+        for (uint8_t j = 1; j < 8; j++){
+            if (value.fields[j] != value.fields[0]){
+                torn++;
+                break;
+            }
+        }
+        if (value.fields[0] < last){
+            backwards++;
+        }
+        last = value.fields[0];
+        reads++;
+    }
+    writer.join();
+    TEST_ASSERT_EQUAL(0, torn);
+    TEST_ASSERT_EQUAL(0, backwards);
+    TEST_ASSERT_EQUAL(ITEMS, mailbox.count());
+    TEST_ASSERT_GREATER_THAN(1000, reads);
+}
+
+/** @brief   Firing from another thread wakes a waiting thread with the value,
+ *           and firing twice before it wakes gives it only the newer one
+ */
+void test_trigger_wakes(void)
+{
+    static Trigger<int32_t> trigger ("spot");
+    int32_t value = 0;
+    std::thread firer ([]{
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        trigger.fire(42);
+    });
+    int64_t start = esp_timer_get_time();
+    TEST_ASSERT_TRUE(trigger.wait(value));
+    firer.join();
+    TEST_ASSERT_EQUAL(42, value);
+    TEST_ASSERT_GREATER_OR_EQUAL(start, trigger.get_time());
+    TEST_ASSERT_FALSE(trigger.take(value));
+
+    trigger.fire(1);
+    trigger.fire(2);
+    TEST_ASSERT_TRUE(trigger.take(value));
+    TEST_ASSERT_EQUAL(2, value);
+    TEST_ASSERT_FALSE(trigger.take(value));
+}
+
+/** @brief   A timed wait gives up after about the time asked for if nothing
+ *           fires, and returns at once if something already has
+ */
+void test_trigger_timed_wait(void)
+{
+    Trigger<int32_t> trigger;
+    int32_t value = 0;
+    auto start = std::chrono::steady_clock::now();
+    TEST_ASSERT_FALSE(trigger.wait(value, pdMS_TO_TICKS(30)));
+    auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    TEST_ASSERT_GREATER_OR_EQUAL(30, waited);
+    TEST_ASSERT_LESS_THAN(500, waited);
+
+    trigger.ISR_fire(7);
+    TEST_ASSERT_TRUE(trigger.wait(value, pdMS_TO_TICKS(30)));
+    TEST_ASSERT_EQUAL(7, value);
+}
+
+/** @brief   Times one putter and one getter through a ring against the
+ *           mutex queue
+ */
+void test_bench_spsc(void)
+{
+    static SpscQueue<Stamped, 32> queue;
+    static LockedQueue<Stamped, 32> locked;
+    Bench bench = run_queue(1, [](const Stamped& item){ return queue.put(item); },
+                            []{ return queue.get(); });
+    Bench base = run_queue(1, [](const Stamped& item){ return locked.put(item); },
+                           []{ return locked.get(); });
+    report("spsc", bench, base);
+}
+
+/** @brief   Times three putters and one getter through a ring against the
+ *           mutex queue
+ */
+void test_bench_mpsc(void)
+{
+    static MpscQueue<Stamped, 32> queue;
+    static LockedQueue<Stamped, 32> locked;
+    Bench bench = run_queue(3, [](const Stamped& item){ return queue.put(item); },
+                            []{ return queue.get(); });
+    Bench base = run_queue(3, [](const Stamped& item){ return locked.put(item); },
+                           []{ return locked.get(); });
+    report("mpsc", bench, base);
+}
+
+/** @brief   Times a mailbox against a value shared under a mutex
+ */
+void test_bench_mailbox(void)
+{
+    static Mailbox<Stamped> mailbox;
+    static LockedShare<Stamped> locked;
+    Bench bench = run_mailbox(mailbox);
+    Bench base = run_mailbox(locked);
+    report("mailbox", bench, base);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_spsc_full_and_empty);
+    RUN_TEST(test_spsc_across_threads);
+    RUN_TEST(test_spsc_get_times_out);
+    RUN_TEST(test_mpsc_across_threads);
+    RUN_TEST(test_mailbox_latest);
+    RUN_TEST(test_mailbox_never_torn);
+    RUN_TEST(test_trigger_wakes);
+    RUN_TEST(test_trigger_timed_wait);
+    RUN_TEST(test_bench_spsc);
+    RUN_TEST(test_bench_mpsc);
+    RUN_TEST(test_bench_mailbox);
+    return UNITY_END();
+}
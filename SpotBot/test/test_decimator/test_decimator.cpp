@@ -0,0 +1,210 @@
+/** @file test_decimator.cpp
+ *  This program measures the decimating filter's response: gain in the band a
+ *  lift moves in, rejection of what would alias into it at the control rate,
+ *  its delay, and that it copes with spikes and rate changes. It also times
+ *  @c put() at the 4 kHz SPI rate and the 1 kHz I2C rate.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include "decimator.h"
+
+#define INPUT_HZ 1000.0     ///< Input rate, 1 kHz like the I2C IMUs
+#define FACTOR 10           ///< Down to the 100 Hz control rate
+#define AMPLITUDE 1000000   ///< Test signal amplitude, 1 m/s^2 in um/s^2
+#define BENCH_SAMPLES 8000000 ///< Samples put when timing the filter
+
+/** @brief   Function which runs a sine through a decimator
+ *  @return  Peak output once the filter has settled, over the input amplitude
+ */
+static double gain_at(Decimator& decimator, double hz)
+{
+    int32_t output;
+    double peak = 0;
+    for (uint32_t i = 0; i < 4000; i++){
+        int32_t input = (int32_t)(AMPLITUDE * sin(2 * M_PI * hz * i / INPUT_HZ));
+        if (decimator.put(input, output) && i > 1000){
+            peak = fabs(output) > peak ? fabs(output) : peak;
+        }
+    }
+    return peak / AMPLITUDE;
+}
+
+/** @brief   Function which does the same for the boxcar average the filter
+ *           replaced
+ */
+static double boxcar_gain_at(double hz)
+{
+    double peak = 0;
+    for (uint32_t i = 1000; i < 4000; i += FACTOR){
+        double sum = 0;
+        for (uint32_t j = 0; j < FACTOR; j++){
+            sum += AMPLITUDE * sin(2 * M_PI * hz * (i + j) / INPUT_HZ);
+        }
+        peak = fabs(sum / FACTOR) > peak ? fabs(sum / FACTOR) : peak;
+    }
+    return peak / AMPLITUDE;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   One output for every @c FACTOR inputs, and a steady input comes
+ *           out exactly
+ */
+void test_rate_and_dc_gain(void)
+{
+    Decimator decimator (FACTOR, false);
+    int32_t output = 0;
+    uint16_t outputs = 0;
+    for (uint16_t i = 1; i <= 200; i++){
+        if (decimator.put(123456, output)){
+            outputs++;
+            TEST_ASSERT_EQUAL(0, i % FACTOR);
+        }
+    }
+    TEST_ASSERT_EQUAL(200 / FACTOR, outputs);
+    TEST_ASSERT_INT32_WITHIN(1, 123456, output);
+}
+
+/** @brief   Lifting motion, a few Hz, goes through nearly untouched
+ */
+void test_passband(void)
+{
+    Decimator decimator (FACTOR, false);
+    TEST_ASSERT_FLOAT_WITHIN(0.02, 1.0, gain_at(decimator, 2.0));
+    Decimator fast (FACTOR, false);
+    TEST_ASSERT_FLOAT_WITHIN(0.05, 1.0, gain_at(fast, 5.0));
+}
+
+/** @brief   Vibration above the output Nyquist rate, which would alias into
+ *           the control loop, is cut far more than by a boxcar average
+ */
+void test_stopband(void)
+{
+    const double hz[] = {70.0, 120.0, 150.0, 230.0, 380.0};
+    for (uint8_t i = 0; i < sizeof(hz) / sizeof(hz[0]); i++){
+        Decimator decimator (FACTOR, false);
+        double gain = gain_at(decimator, hz[i]);
+        TEST_ASSERT_LESS_THAN_FLOAT(0.05, gain);
+        TEST_ASSERT_LESS_THAN_FLOAT(boxcar_gain_at(hz[i]), gain);
+    }
+}
+
+/** @brief   The output lags the input by the delay it reports
+ */
+void test_delay(void)
+{
+    Decimator decimator (FACTOR, false);
+    int32_t output;
+    uint32_t step_at = 0;
+    for (uint32_t i = 0; i < 200; i++){
+        if (decimator.put(i >= 100 ? AMPLITUDE : 0, output) && output >= AMPLITUDE / 2 && step_at == 0){
+            step_at = i;
+        }
+    }
+    // The step is half way through by the output after the delay
+    TEST_ASSERT_INT32_WITHIN(FACTOR, 100 + decimator.get_delay(), step_at);
+    TEST_ASSERT_EQUAL((FACTOR * DECIM_TAPS_PER_PHASE - 1) / 2, decimator.get_delay());
+}
+
+/** @brief   A single sample spike is knocked out by the median
+ */
+void test_spike_rejected(void)
+{
+    Decimator plain (FACTOR, false);
+    Decimator median (FACTOR, true);
+    int32_t out_plain, out_median;
+    int32_t worst_plain = 0, worst_median = 0;
+    for (uint32_t i = 0; i < 200; i++){
+        int32_t input = i == 100 ? 30 * AMPLITUDE : 0;
+        if (plain.put(input, out_plain)){
+            worst_plain = abs(out_plain) > worst_plain ? abs(out_plain) : worst_plain;
+        }
+        if (median.put(input, out_median)){
+            worst_median = abs(out_median) > worst_median ? abs(out_median) : worst_median;
+        }
+    }
+    TEST_ASSERT_GREATER_THAN(AMPLITUDE, worst_plain);
+    TEST_ASSERT_EQUAL(0, worst_median);
+}
+
+/** @brief   Changing the factor starts from the last output without a step
+ */
+void test_set_factor(void)
+{
+    Decimator decimator (FACTOR, false);
+    int32_t output;
+    for (uint16_t i = 0; i < 100; i++){
+        decimator.put(500000, output);
+    }
+    decimator.set_factor(4);
+    TEST_ASSERT_EQUAL(4, decimator.get_factor());
+    for (uint16_t i = 0; i < 4; i++){
+        decimator.put(500000, output);
+    }
+    TEST_ASSERT_INT32_WITHIN(1, 500000, output);
+
+    decimator.set_factor(1000);
+    TEST_ASSERT_EQUAL(DECIM_MAX_FACTOR, decimator.get_factor());
+    decimator.set_factor(1);
+    TEST_ASSERT_TRUE(decimator.put(42, output));
+    TEST_ASSERT_EQUAL(42, output);
+}
+
+/** @brief   Times @c put() with the 4 kHz factor of 40 and the 1 kHz factor
+ *           of 10, with and without the median, and prints samples per second
+ *           and how many times faster than 4 kHz that is
+ */
+void test_throughput(void)
+{
+    const uint16_t factors[] = {40, 10};
+    for (uint8_t f = 0; f < 2; f++){
+        for (uint8_t m = 0; m < 2; m++){
+            Decimator decimator (factors[f], m == 1);
+            int32_t output = 0;
+            int64_t sum = 0;
+            uint32_t outputs = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < BENCH_SAMPLES; i++){
+                // A lift with vibration on it, changing every sample
+                int32_t input = (int32_t)((i * 2654435761u) >> 12) - (1 << 19);
+                if (decimator.put(input, output)){
+                    sum += output;
+                    outputs++;
+                }
+            }
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double rate = BENCH_SAMPLES / secs;
+            volatile int64_t kept = sum;
+            printf("factor %2u %-9s %6.1f M samples/s, %5.1f ns each, %7.0fx a 4 kHz IMU\n",
+                   factors[f], m ? "median" : "no median", rate * 1e-6, 1e9 / rate, rate / 4000);
+            (void)kept;
+            TEST_ASSERT_EQUAL(BENCH_SAMPLES / factors[f], outputs);
+            TEST_ASSERT_TRUE(rate > 4000);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_rate_and_dc_gain);
+    RUN_TEST(test_passband);
+    RUN_TEST(test_stopband);
+    RUN_TEST(test_delay);
+    RUN_TEST(test_spike_rejected);
+    RUN_TEST(test_set_factor);
+    RUN_TEST(test_throughput);
+    return UNITY_END();
+}
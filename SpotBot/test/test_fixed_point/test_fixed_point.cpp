@@ -0,0 +1,168 @@
+/** @file test_fixed_point.cpp
+ *  This program checks the integer acceleration to velocity path against the
+ *  same math done in double precision floating point, and times it against
+ *  the single precision divide, subtract and abs path it replaced.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include "accel_scaler.h"
+#include "integrator.h"
+
+#define TICKS_PER_MS2 1670.2f   ///< Nominal MPU-6050 ticks per m/s^2, as in main.cpp
+#define GRAVITY 9.81f           ///< Offset taken out by the scaler, m/s^2
+#define DEAD_BAND 0.05f         ///< Accelerations treated as noise, m/s^2
+#define BENCH_SAMPLES 20000000  ///< Samples run through each path when timing
+#define BENCH_RAW 4096          ///< Made up readings the timing cycles through
+
+/** @brief   The float path task_IMU used before, kept to time against
+ */
+struct FloatPath
+{
+    float value = 0;
+    float last_input = 0;
+    int64_t last_time = 0;
+    bool primed = false;
+
+    float update(int16_t raw, int64_t time_us)
+    {
+        float input = raw / TICKS_PER_MS2 - GRAVITY;
+        if (fabsf(input) < DEAD_BAND){
+            input = 0;
+        }
+        if (primed){
+            float dt = (time_us - last_time) * 1e-6f;
+            value += 0.5f * (input + last_input) * dt;
+        }
+        primed = true;
+        last_input = input;
+        last_time = time_us;
+        return value;
+    }
+};
+
+/** @brief   Function which returns seconds since a start time
+ */
+static double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   Every raw reading converts to within a micrometer per second
+ *           squared of the floating point answer
+ */
+void test_scaler_matches_float(void)
+{
+    AccelScaler scaler (TICKS_PER_MS2, GRAVITY, 0.05f);
+    int32_t worst = 0;
+    for (int32_t raw = -32768; raw <= 32767; raw++){
+        double exact = (raw / (double)TICKS_PER_MS2 - GRAVITY) * 1e6;
+        int32_t error = (int32_t)fabs(scaler.to_um_s2(raw) - exact);
+        worst = error > worst ? error : worst;
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(2, worst);
+}
+
+/** @brief   The dead band is the same either side of zero
+ */
+void test_dead_band(void)
+{
+    AccelScaler scaler (TICKS_PER_MS2, 0, 0.05f);
+    TEST_ASSERT_TRUE(scaler.in_dead_band(0));
+    TEST_ASSERT_TRUE(scaler.in_dead_band(49999));
+    TEST_ASSERT_TRUE(scaler.in_dead_band(-49999));
+    TEST_ASSERT_FALSE(scaler.in_dead_band(50000));
+    TEST_ASSERT_FALSE(scaler.in_dead_band(-50000));
+}
+
+/** @brief   A minute of reps at 1 kHz ends up where double precision does
+ */
+void test_velocity_matches_float(void)
+{
+    AccelScaler scaler (TICKS_PER_MS2, GRAVITY, 0);
+    Integrator integrator;
+    double exact = 0;
+    double last = 0;
+    int32_t worst = 0;
+
+    for (int64_t i = 0; i <= 60000; i++){
+        // Gravity plus 3 m/s^2 at 0.5 Hz, a little noise and a 0.02 m/s^2 bias
+        double t = i / 1000.0;
+        double accel = GRAVITY + 0.02 + 3.0 * sin(M_PI * t) + 0.05 * sin(377.0 * t);
+        int32_t raw = (int32_t)lround(accel * TICKS_PER_MS2);
+        int32_t vel_um = integrator.update(scaler.to_um_s2(raw), i * 1000);
+
+        double now = raw / (double)TICKS_PER_MS2 - GRAVITY;
+        if (i > 0){
+            exact += (now + last) / 2 * 0.001;
+        }
+        last = now;
+        int32_t error = (int32_t)fabs(vel_um - exact * 1e6);
+        worst = error > worst ? error : worst;
+    }
+    // Within 0.1 mm/s after a minute, by which time the bias alone adds 1.2 m/s
+    TEST_ASSERT_LESS_THAN(100, worst);
+}
+
+/** @brief   Times scaling, dead band and integrating one sample at a time in
+ *           fixed point and in float, and prints samples per second for each
+ *  @details Both paths see the same readings a millisecond apart and have to
+ *           end at about the same velocity, so neither can be optimized away.
+ *           The host divides floats in hardware and the ESP32 doesn't, so
+ *           the ratio here doesn't carry over to the board.
+ */
+void test_bench_against_float(void)
+{
+    static int16_t raw[BENCH_RAW];
+    for (uint16_t i = 0; i < BENCH_RAW; i++){
+        float accel = GRAVITY + 3.0f * sinf(i * 2 * (float)M_PI / BENCH_RAW) + 0.2f * sinf(i * 0.7f);
+        raw[i] = (int16_t)lroundf(accel * TICKS_PER_MS2);
+    }
+
+    AccelScaler scaler (TICKS_PER_MS2, GRAVITY, DEAD_BAND);
+    Integrator integrator;
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t i = 0; i < BENCH_SAMPLES; i++){
+        int32_t accel = scaler.to_um_s2(raw[i % BENCH_RAW]);
+        integrator.update(scaler.in_dead_band(accel) ? 0 : accel, (int64_t)i * 1000);
+    }
+    double fixed_s = since(start);
+    volatile int32_t fixed_vel = integrator.get();
+
+    FloatPath path;
+    start = std::chrono::steady_clock::now();
+    for (int32_t i = 0; i < BENCH_SAMPLES; i++){
+        path.update(raw[i % BENCH_RAW], (int64_t)i * 1000);
+    }
+    double float_s = since(start);
+    volatile float float_vel = path.value;
+
+    printf("fixed point %.1f M samples/s | float %.1f M samples/s | %.2fx\n",
+           BENCH_SAMPLES / fixed_s * 1e-6, BENCH_SAMPLES / float_s * 1e-6, float_s / fixed_s);
+    // A float sum this long has lost its low bits, so only a loose match
+    TEST_ASSERT_FLOAT_WITHIN(0.5f, float_vel, fixed_vel * 1e-6f);
+    TEST_ASSERT_TRUE(fixed_s > 0 && float_s > 0);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_scaler_matches_float);
+    RUN_TEST(test_dead_band);
+    RUN_TEST(test_velocity_matches_float);
+    RUN_TEST(test_bench_against_float);
+    return UNITY_END();
+}
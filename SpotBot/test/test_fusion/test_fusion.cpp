@@ -0,0 +1,299 @@
+/** @file test_fusion.cpp
+ *  This program tests how the bar IMUs are combined: weighting by health,
+ *  voting out an IMU which disagrees with the rest, falling back to one IMU
+ *  when two disagree, and keeping the bar position steady while IMUs drop
+ *  out and come back. It also replays bench presses through the fusion and
+ *  the rep machine with one bar IMU dying part way up, and checks how much
+ *  later a failing press gets its spot.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <string.h>
+#include <stdio.h>
+#include "velocity_fusion.h"
+#include "rep_machine.h"
+#include "stall_predictor.h"
+#include "bar_tracker.h"
+
+#define BAR_MASK 0x07       ///< IMUs 0 to 2 are on the bar, 3 is on the body
+#define MAIN_MASK 0x03      ///< The two bar IMUs main.cpp fuses
+#define STEP_US REP_STEP_US ///< One control step
+#define ASCENT_S 1.7f       ///< Time the press starts up in the replays
+#define FAIL_S 2.2f         ///< Time a failing press starts to give out
+#define PRESS_VEL 0.4f      ///< Speed of the press up, m/s
+#define GIVE_MS2 2.0f       ///< How fast a failing press slows and falls back, m/s^2
+#define NO_KILL -1.0f       ///< Kill time which leaves both IMUs alive
+
+static uint32_t seed;
+
+/** @brief   Function which returns noise spread evenly over +-2 mm/s, under
+ *           the bench still band even on one IMU
+ */
+static float noise(void)
+{
+    seed = seed * 1664525 + 1013904223;
+    return 0.002f * ((int32_t)(seed >> 8) - (1 << 23)) / (1 << 23);
+}
+
+/** @brief   Function which returns the bar velocity of a bench press: still in
+ *           the rack, down, still on the chest, then up, and if it fails
+ *           slowing from @c FAIL_S until it falls back
+ */
+static float bench_vel(float t, bool fails)
+{
+    if (t < 0.5f || (t >= 1.5f && t < ASCENT_S)){
+        return 0;
+    }
+    if (t < 1.5f){
+        return -PRESS_VEL;
+    }
+    if (!fails){
+        return t < 2.8f ? PRESS_VEL : 0;
+    }
+    float vel = t < FAIL_S ? PRESS_VEL : PRESS_VEL - GIVE_MS2 * (t - FAIL_S);
+    return vel < -0.5f ? -0.5f : vel;
+}
+
+/** @brief   Function which replays a bench press through the fusion of the two
+ *           bar IMUs, the stall predictor, the bar tracker and the rep
+ *           machine, the way task_IMU and task_spot do
+ *  @details From @c kill_s on, the dead IMU gives no more samples: its last
+ *           velocity is held until the sensor array marks it stale after
+ *           @c SENSOR_STALE_US.
+ *  @param   dead Which IMU dies
+ *  @param   kill_s When it dies, or @c NO_KILL
+ *  @param   fails True for a press which gives out
+ *  @param   counted Set if the rep was counted
+ *  @return  Time of the spot in seconds, or -1 if there wasn't one
+ */
+static float replay(uint8_t dead, float kill_s, bool fails, bool& counted)
+{
+    VelocityFusion fusion (MAIN_MASK);
+    StallPredictor stall;
+    BarTracker bar;
+    RepMachine machine (bench_press);
+    ImuVelocities velocities;
+    memset(&velocities, 0, sizeof(velocities));
+    velocities.count = 2;
+    velocities.health[0] = 100;
+    velocities.health[1] = 100;
+    const float offsets[2] = {0.002f, -0.002f};
+    counted = false;
+    for (int64_t t_us = 0; t_us < 4000000; t_us += STEP_US){
+        float t = t_us * 1e-6f;
+        for (uint8_t i = 0; i < 2; i++){
+            bool gone = i == dead && kill_s != NO_KILL && t >= kill_s;
+            if (!gone){
+                velocities.vel[i] = bench_vel(t, fails) + offsets[i] + noise();
+                velocities.pos[i] += velocities.vel[i] * STEP_US * 1e-6f;
+            }
+            if (gone && (t - kill_s) * 1e6f > SENSOR_STALE_US){
+                velocities.stale |= 1 << i;
+            }
+        }
+        fusion.fuse(velocities);
+        bool none = velocities.mode == FUSE_NONE;
+        float bar_vel = none ? NAN : velocities.bar_vel;
+        stall.update(bar_vel);
+        if (machine.get_state() == REP_ASCENT && !none){
+            bar.update(bar_vel, velocities.bar_pos);
+        }
+        RepInputs in = {bar_vel, bar.sagging(), false, velocities.mode == FUSE_SINGLE, false,
+                        stall.stalling() && bar.short_of_top(), PHASE_NONE, t_us};
+        uint8_t action = machine.update(in);
+        if (action == ACT_RACK){
+            bar.rack(velocities.bar_pos);
+        }
+        if (action == ACT_BOTTOM){
+            bar.chest(velocities.bar_pos);
+        }
+        counted = counted || action == ACT_REP;
+        if (action == ACT_SPOT){
+            return t;
+        }
+    }
+    return -1;
+}
+
+/** @brief   Function which fills in four healthy IMUs moving together
+ */
+static void all_moving(ImuVelocities& velocities, float vel, float pos)
+{
+    memset(&velocities, 0, sizeof(velocities));
+    velocities.count = 4;
+    for (uint8_t i = 0; i < 4; i++){
+        velocities.vel[i] = vel;
+        velocities.pos[i] = pos;
+        velocities.health[i] = 100;
+    }
+}
+
+void setUp(void)
+{
+    seed = 507;
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   IMUs which agree are all used, weighted by health, and the IMU
+ *           which isn't on the bar is left out
+ */
+void test_weighted_by_health(void)
+{
+    VelocityFusion fusion (BAR_MASK);
+    ImuVelocities velocities;
+    all_moving(velocities, 0.5f, 0);
+    velocities.vel[0] = 0.4f;
+    velocities.health[0] = 50;
+    velocities.vel[3] = -2.0f;
+    fusion.fuse(velocities);
+    TEST_ASSERT_EQUAL(FUSE_ALL, velocities.mode);
+    TEST_ASSERT_EQUAL_HEX8(0x07, velocities.used);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, (0.4f * 50 + 0.5f * 200) / 250, velocities.bar_vel);
+}
+
+/** @brief   Stale IMUs and IMUs with poor health are dropped
+ */
+void test_stale_and_unhealthy_dropped(void)
+{
+    VelocityFusion fusion (BAR_MASK);
+    ImuVelocities velocities;
+    all_moving(velocities, 0.3f, 0);
+    velocities.stale = 0x01;
+    velocities.vel[0] = 5.0f;
+    velocities.health[1] = FUSE_MIN_HEALTH - 1;
+    velocities.vel[1] = -5.0f;
+    fusion.fuse(velocities);
+    TEST_ASSERT_EQUAL(FUSE_SINGLE, velocities.mode);
+    TEST_ASSERT_EQUAL_HEX8(0x04, velocities.used);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.3f, velocities.bar_vel);
+
+    velocities.stale = 0x05;
+    fusion.fuse(velocities);
+    TEST_ASSERT_EQUAL(FUSE_NONE, velocities.mode);
+    TEST_ASSERT_EQUAL_HEX8(0, velocities.used);
+    TEST_ASSERT_EQUAL_FLOAT(0, velocities.bar_vel);
+}
+
+/** @brief   With three IMUs one which is off on its own is voted out, however
+ *           healthy it claims to be
+ */
+void test_outlier_voted_out(void)
+{
+    VelocityFusion fusion (BAR_MASK);
+    ImuVelocities velocities;
+    all_moving(velocities, -0.2f, 0);
+    velocities.vel[1] = -0.2f + FUSE_DISAGREE + 0.05f;
+    fusion.fuse(velocities);
+    TEST_ASSERT_EQUAL(FUSE_ALL, velocities.mode);
+    TEST_ASSERT_EQUAL_HEX8(0x05, velocities.used);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, -0.2f, velocities.bar_vel);
+
+    // Inside the limit it is only outweighed
+    velocities.vel[1] = -0.2f + FUSE_DISAGREE - 0.05f;
+    fusion.fuse(velocities);
+    TEST_ASSERT_EQUAL_HEX8(0x07, velocities.used);
+}
+
+/** @brief   Two IMUs which disagree fall back to the healthier one, or on a
+ *           tie to the one closest to the bar velocity so far, until they
+ *           agree again
+ */
+void test_two_disagree_falls_back(void)
+{
+    VelocityFusion fusion (BAR_MASK);
+    ImuVelocities velocities;
+    all_moving(velocities, 0.6f, 0);
+    velocities.stale = 0x04;
+    fusion.fuse(velocities);
+    TEST_ASSERT_EQUAL(FUSE_ALL, velocities.mode);
+
+    velocities.vel[0] = 0.0f;
+    velocities.vel[1] = 0.62f;
+    fusion.fuse(velocities);
+    TEST_ASSERT_EQUAL(FUSE_SINGLE, velocities.mode);
+    TEST_ASSERT_EQUAL_HEX8(0x02, velocities.used);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, 0.62f, velocities.bar_vel);
+
+    velocities.health[0] = 90;
+    velocities.health[1] = 80;
+    fusion.fuse(velocities);
+    TEST_ASSERT_EQUAL_HEX8(0x01, velocities.used);
+
+    velocities.vel[0] = 0.5f;
+    velocities.vel[1] = 0.55f;
+    fusion.fuse(velocities);
+    TEST_ASSERT_EQUAL(FUSE_ALL, velocities.mode);
+    TEST_ASSERT_EQUAL_HEX8(0x03, velocities.used);
+}
+
+/** @brief   The bar position follows the change in every IMU used, so it
+ *           doesn't jump when IMUs which have drifted apart drop out or come back
+ */
+void test_position_steady_through_dropouts(void)
+{
+    VelocityFusion fusion (BAR_MASK);
+    ImuVelocities velocities;
+    all_moving(velocities, 0.1f, 0);
+    float offsets[3] = {0.0f, 0.25f, -0.4f};
+    float expected = 0;
+    for (uint16_t step = 0; step < 300; step++){
+        float pos = step * 0.001f;
+        for (uint8_t i = 0; i < 3; i++){
+            velocities.pos[i] = pos + offsets[i];
+        }
+        // IMU 2 drops out for a while and IMU 1 goes stale later on
+        velocities.stale = (step >= 100 && step < 150 ? 0x04 : 0) | (step >= 200 && step < 220 ? 0x02 : 0);
+        fusion.fuse(velocities);
+        if (step > 0){
+            expected += 0.001f;
+        }
+        TEST_ASSERT_FLOAT_WITHIN(1e-4f, expected, velocities.bar_pos);
+    }
+}
+
+/** @brief   A failing press whose bar IMU dies on the way up, before or after
+ *           it starts to give out, is spotted at most a stale timeout and a
+ *           single IMU confirmation later than with both IMUs, and a good
+ *           press which loses an IMU is still counted and never spotted
+ */
+void test_dead_imu_during_ascent(void)
+{
+    bool counted;
+    float base = replay(0, NO_KILL, true, counted);
+    TEST_ASSERT_TRUE(base > FAIL_S);
+    const float bound = (SENSOR_STALE_US + (bench_press.single_confirm + 1) * STEP_US) * 1e-6f;
+    const float kills[] = {ASCENT_S + 0.1f, FAIL_S - 0.1f, FAIL_S - 0.03f, FAIL_S, FAIL_S + 0.05f, FAIL_S + 0.15f};
+    printf("both IMUs: spot %.0f ms after the press gives out\n", (base - FAIL_S) * 1000);
+    for (uint8_t dead = 0; dead < 2; dead++){
+        for (uint8_t k = 0; k < sizeof(kills) / sizeof(kills[0]); k++){
+            float spot = replay(dead, kills[k], true, counted);
+            printf("IMU %u dies %+4.0f ms from giving out: spot %.0f ms after, %+.0f ms on both IMUs\n",
+                   dead, (kills[k] - FAIL_S) * 1000, (spot - FAIL_S) * 1000, (spot - base) * 1000);
+            TEST_ASSERT_TRUE(spot > 0);
+            TEST_ASSERT_TRUE(spot - base <= bound + 1e-4f);
+            TEST_ASSERT_FALSE(counted);
+
+            float none = replay(dead, kills[k], false, counted);
+            TEST_ASSERT_EQUAL_FLOAT(-1, none);
+            TEST_ASSERT_TRUE(counted);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_weighted_by_health);
+    RUN_TEST(test_stale_and_unhealthy_dropped);
+    RUN_TEST(test_outlier_voted_out);
+    RUN_TEST(test_two_disagree_falls_back);
+    RUN_TEST(test_position_steady_through_dropouts);
+    RUN_TEST(test_dead_imu_during_ascent);
+    return UNITY_END();
+}
@@ -0,0 +1,250 @@
+/** @file test_imu_fifo.cpp
+ *  This program tests draining the MPU-6050 FIFO through the register level
+ *  driver, against a bus with a model of the chip's FIFO on it.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <string.h>
+#include <deque>
+#include "mpu6050.h"
+
+#define ADDR 0x68
+
+/** @brief   Class which acts as an I2C bus with one MPU-6050 on it
+ *  @details Registers are kept in an array, except the FIFO which is a queue
+ *           of bytes that reads of FIFO_R_W pop, and INT_STATUS which clears
+ *           when it is read, as on the chip.
+ */
+class FakeMpuBus : public I2CBus
+{
+public:
+    uint8_t regs[128];
+    std::deque<uint8_t> fifo;
+    uint16_t read_limit = 128;
+    uint16_t fifo_reads = 0;
+    int16_t fail_after = -1;
+
+    FakeMpuBus (void)
+    {
+        memset(regs, 0, sizeof(regs));
+    }
+
+    void push_frame(int16_t ax, int16_t ay, int16_t az, bool gyro, int16_t g = 0)
+    {
+        int16_t values[6] = {ax, ay, az, g, (int16_t)-g, (int16_t)(g + 1)};
+        for (uint8_t i = 0; i < (gyro ? 6 : 3); i++){
+            fifo.push_back((uint16_t)values[i] >> 8);
+            fifo.push_back(values[i] & 0xFF);
+        }
+    }
+
+    bool write_byte(uint8_t addr, uint8_t value)
+    {
+        return false;
+    }
+
+    bool write_reg(uint8_t addr, uint8_t reg, uint8_t value)
+    {
+        if (addr != ADDR){
+            return false;
+        }
+        regs[reg] = value;
+        if (reg == MPU_USER_CTRL && (value & MPU_USER_FIFO_RST)){
+            fifo.clear();
+            regs[reg] &= ~MPU_USER_FIFO_RST;
+        }
+        return true;
+    }
+
+    bool read_regs(uint8_t addr, uint8_t reg, uint8_t* p_buf, uint16_t len)
+    {
+        if (addr != ADDR || len > read_limit || fail_after == 0){
+            return false;
+        }
+        fail_after = fail_after > 0 ? fail_after - 1 : fail_after;
+        if (reg == MPU_FIFO_R_W){
+            fifo_reads++;
+            for (uint16_t i = 0; i < len; i++){
+                p_buf[i] = fifo.empty() ? 0 : fifo.front();
+                if (!fifo.empty()){
+                    fifo.pop_front();
+                }
+            }
+        }
+        else if (reg == MPU_FIFO_COUNT_H){
+            p_buf[0] = fifo.size() >> 8;
+            p_buf[1] = fifo.size() & 0xFF;
+        }
+        else{
+            memcpy(p_buf, &regs[reg], len);
+            if (reg == MPU_INT_STATUS){
+                regs[MPU_INT_STATUS] = 0;
+            }
+        }
+        return true;
+    }
+
+    uint16_t max_read(void)
+    {
+        return read_limit;
+    }
+};
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   Starting the FIFO turns on the right axes and clears it
+ */
+void test_begin_fifo_sets_registers(void)
+{
+    FakeMpuBus bus;
+    MPU6050 imu (bus, ADDR);
+    bus.push_frame(1, 2, 3, true);
+    TEST_ASSERT_TRUE(imu.begin_fifo(true));
+    TEST_ASSERT_EQUAL_HEX8(MPU_FIFO_ACCEL | MPU_FIFO_GYRO, bus.regs[MPU_FIFO_EN]);
+    TEST_ASSERT_EQUAL_HEX8(MPU_USER_FIFO_EN, bus.regs[MPU_USER_CTRL]);
+    TEST_ASSERT_EQUAL(0, bus.fifo.size());
+
+    TEST_ASSERT_TRUE(imu.begin_fifo(false));
+    TEST_ASSERT_EQUAL_HEX8(MPU_FIFO_ACCEL, bus.regs[MPU_FIFO_EN]);
+}
+
+/** @brief   Accelerometer only frames are decoded big endian, signs and all
+ */
+void test_accel_frames_decode(void)
+{
+    FakeMpuBus bus;
+    MPU6050 imu (bus, ADDR);
+    imu.begin_fifo(false);
+    bus.push_frame(16384, -16384, -1, false);
+    bus.push_frame(-32768, 32767, 0x1234, false);
+
+    TEST_ASSERT_EQUAL(2, imu.fifo_samples());
+    ImuSample samples[2];
+    TEST_ASSERT_EQUAL(2, imu.read_fifo(samples, 2));
+    TEST_ASSERT_EQUAL_INT16(16384, samples[0].accel_x);
+    TEST_ASSERT_EQUAL_INT16(-16384, samples[0].accel_y);
+    TEST_ASSERT_EQUAL_INT16(-1, samples[0].accel_z);
+    TEST_ASSERT_EQUAL_INT16(0, samples[0].gyro_x);
+    TEST_ASSERT_EQUAL_INT16(-32768, samples[1].accel_x);
+    TEST_ASSERT_EQUAL_INT16(32767, samples[1].accel_y);
+    TEST_ASSERT_EQUAL_INT16(0x1234, samples[1].accel_z);
+    TEST_ASSERT_EQUAL(0, bus.fifo.size());
+}
+
+/** @brief   A long drain is split into reads the bus can do, whole frames only
+ */
+void test_drain_splits_into_bus_reads(void)
+{
+    FakeMpuBus bus;
+    MPU6050 imu (bus, ADDR);
+    imu.begin_fifo(true);
+    for (int16_t i = 0; i < 30; i++){
+        bus.push_frame(i, 2 * i, 3 * i, true, 100 + i);
+    }
+
+    TEST_ASSERT_EQUAL(30, imu.fifo_samples());
+    ImuSample samples[30];
+    TEST_ASSERT_EQUAL(30, imu.read_fifo(samples, 30));
+    // 128 byte reads hold 10 frames of 12 bytes
+    TEST_ASSERT_EQUAL(3, bus.fifo_reads);
+    for (int16_t i = 0; i < 30; i++){
+        TEST_ASSERT_EQUAL_INT16(i, samples[i].accel_x);
+        TEST_ASSERT_EQUAL_INT16(3 * i, samples[i].accel_z);
+        TEST_ASSERT_EQUAL_INT16(100 + i, samples[i].gyro_x);
+        TEST_ASSERT_EQUAL_INT16(-100 - i, samples[i].gyro_y);
+        TEST_ASSERT_EQUAL_INT16(101 + i, samples[i].gyro_z);
+    }
+}
+
+/** @brief   Asking for fewer samples than are waiting leaves the rest lined up
+ */
+void test_partial_drain_keeps_alignment(void)
+{
+    FakeMpuBus bus;
+    MPU6050 imu (bus, ADDR);
+    imu.begin_fifo(true);
+    for (int16_t i = 0; i < 5; i++){
+        bus.push_frame(i, 0, 0, true);
+    }
+    ImuSample samples[5];
+    TEST_ASSERT_EQUAL(2, imu.read_fifo(samples, 2));
+    TEST_ASSERT_EQUAL(3, imu.fifo_samples());
+    TEST_ASSERT_EQUAL(3, imu.read_fifo(samples, 3));
+    TEST_ASSERT_EQUAL_INT16(2, samples[0].accel_x);
+    TEST_ASSERT_EQUAL_INT16(4, samples[2].accel_x);
+}
+
+/** @brief   An overflow, a count which isn't whole frames or a full FIFO all
+ *           throw the FIFO away rather than read misaligned frames
+ */
+void test_bad_counts_reset_fifo(void)
+{
+    FakeMpuBus bus;
+    MPU6050 imu (bus, ADDR);
+    imu.begin_fifo(true);
+
+    bus.push_frame(1, 1, 1, true);
+    bus.regs[MPU_INT_STATUS] = MPU_FIFO_OFLOW;
+    TEST_ASSERT_EQUAL(0, imu.fifo_samples());
+    TEST_ASSERT_EQUAL(1, imu.get_overflows());
+    TEST_ASSERT_EQUAL(0, bus.fifo.size());
+
+    bus.push_frame(1, 1, 1, true);
+    bus.fifo.push_back(0);
+    TEST_ASSERT_EQUAL(0, imu.fifo_samples());
+    TEST_ASSERT_EQUAL(2, imu.get_overflows());
+    TEST_ASSERT_EQUAL(0, bus.fifo.size());
+
+    for (uint16_t i = 0; i < MPU6050_FIFO_SIZE / 12 + 1; i++){
+        bus.push_frame(1, 1, 1, true);
+    }
+    TEST_ASSERT_EQUAL(0, imu.fifo_samples());
+    TEST_ASSERT_EQUAL(3, imu.get_overflows());
+
+    // The FIFO is usable again afterwards
+    bus.push_frame(7, 8, 9, true);
+    TEST_ASSERT_EQUAL(1, imu.fifo_samples());
+}
+
+/** @brief   A failed read reports what was read and restarts the FIFO clean
+ */
+void test_failed_read_stops_drain(void)
+{
+    FakeMpuBus bus;
+    MPU6050 imu (bus, ADDR);
+    imu.begin_fifo(true);
+    for (int16_t i = 0; i < 25; i++){
+        bus.push_frame(i, 0, 0, true);
+    }
+    TEST_ASSERT_EQUAL(25, imu.fifo_samples());
+    ImuSample samples[25];
+    bus.fail_after = 1;
+    TEST_ASSERT_EQUAL(10, imu.read_fifo(samples, 25));
+    bus.fail_after = -1;
+    TEST_ASSERT_EQUAL(0, bus.fifo.size());
+    TEST_ASSERT_EQUAL_INT16(9, samples[9].accel_x);
+
+    bus.fail_after = 0;
+    TEST_ASSERT_EQUAL(-1, imu.fifo_samples());
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_begin_fifo_sets_registers);
+    RUN_TEST(test_accel_frames_decode);
+    RUN_TEST(test_drain_splits_into_bus_reads);
+    RUN_TEST(test_partial_drain_keeps_alignment);
+    RUN_TEST(test_bad_counts_reset_fifo);
+    RUN_TEST(test_failed_read_stops_drain);
+    return UNITY_END();
+}
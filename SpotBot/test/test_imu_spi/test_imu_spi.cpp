@@ -0,0 +1,178 @@
+/** @file test_imu_spi.cpp
+ *  This program tests the SPI backend of the IMU driver against a fake chip,
+ *  mostly that a missing chip or a register which doesn't take a write fails
+ *  the way it does on I2C even though SPI has no acknowledge.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <string.h>
+#include <deque>
+#include <SPI.h>
+#include "imu_spi.h"
+
+#define CS_PIN 5
+
+/** @brief   Class which acts as an SPI bus with one ICM-20689 on it
+ *  @details The first byte of every transaction is the register address with
+ *           the top bit set for a read, and the address goes up by one for
+ *           each byte after it except on the FIFO. A chip which isn't there
+ *           leaves MISO floating high.
+ */
+class FakeSpiChip : public SPIClass
+{
+public:
+    uint8_t regs[128];
+    std::deque<uint8_t> fifo;
+    bool present = true;
+    int16_t stuck_reg = -1;
+    uint32_t fast_reads = 0;
+    uint32_t clock = 0;
+    bool first = false;
+    bool reading = false;
+    uint8_t reg = 0;
+
+    FakeSpiChip (void)
+    {
+        memset(regs, 0, sizeof(regs));
+        regs[MPU_WHO_AM_I] = ICM20689_ID;
+    }
+
+    void beginTransaction(SPISettings settings)
+    {
+        first = true;
+        clock = settings.clock;
+    }
+
+    uint8_t transfer(uint8_t data)
+    {
+        if (!present){
+            return 0xFF;
+        }
+        if (first){
+            first = false;
+            reading = data & 0x80;
+            reg = data & 0x7F;
+            if (reading && reg == MPU_FIFO_R_W && clock == IMU_SPI_FAST_HZ){
+                fast_reads++;
+            }
+            return 0;
+        }
+        uint8_t out = 0;
+        if (reading && reg == MPU_FIFO_R_W){
+            out = fifo.empty() ? 0 : fifo.front();
+            if (!fifo.empty()){
+                fifo.pop_front();
+            }
+            return out;
+        }
+        if (reading){
+            out = reg == MPU_FIFO_COUNT_H ? fifo.size() >> 8
+                : reg == MPU_FIFO_COUNT_H + 1 ? fifo.size() & 0xFF : regs[reg];
+        }
+        else if (reg != stuck_reg){
+            regs[reg] = data;
+            if (reg == MPU_USER_CTRL && (data & MPU_USER_FIFO_RST)){
+                fifo.clear();
+            }
+            // Reset bits clear themselves
+            regs[MPU_USER_CTRL] &= ~0x07;
+            regs[MPU_PWR_MGMT_1] &= ~0x80;
+        }
+        reg++;
+        return out;
+    }
+};
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   A chip which answers with the right WHO_AM_I starts, with I2C off
+ */
+void test_begin_checks_id(void)
+{
+    FakeSpiChip chip;
+    ImuSpi imu (chip, CS_PIN, ICM20689_FIFO_SIZE, ICM20689_ID);
+    TEST_ASSERT_TRUE(imu.begin());
+    TEST_ASSERT_EQUAL_HEX8(MPU_USER_I2C_DIS, chip.regs[MPU_USER_CTRL]);
+
+    ImuSpi wrong (chip, CS_PIN, MPU6000_FIFO_SIZE, MPU6000_ID);
+    TEST_ASSERT_FALSE(wrong.begin());
+}
+
+/** @brief   With nothing on the bus every read is 0xFF, and starting fails
+ */
+void test_missing_chip_fails(void)
+{
+    FakeSpiChip chip;
+    chip.present = false;
+    ImuSpi imu (chip, CS_PIN, ICM20689_FIFO_SIZE, ICM20689_ID);
+    TEST_ASSERT_FALSE(imu.begin());
+    TEST_ASSERT_FALSE(imu.set_dlpf(1));
+    TEST_ASSERT_FALSE(imu.begin_fifo(true));
+}
+
+/** @brief   A register which doesn't read back as written fails the write,
+ *           while the self clearing reset bits don't
+ */
+void test_readback_mismatch_fails(void)
+{
+    FakeSpiChip chip;
+    ImuSpi imu (chip, CS_PIN, ICM20689_FIFO_SIZE, ICM20689_ID);
+    TEST_ASSERT_TRUE(imu.begin());
+    TEST_ASSERT_TRUE(imu.reset_fifo());
+
+    chip.stuck_reg = MPU_CONFIG;
+    TEST_ASSERT_FALSE(imu.set_dlpf(3));
+    TEST_ASSERT_TRUE(imu.set_rate_div(4));
+    TEST_ASSERT_EQUAL(4, chip.regs[MPU_SMPLRT_DIV]);
+
+    ImuConfig config = {3, 0, 0, 0, true};
+    TEST_ASSERT_FALSE(imu.configure(config));
+}
+
+/** @brief   The FIFO is drained in fast bursts of whole frames
+ */
+void test_fifo_burst(void)
+{
+    FakeSpiChip chip;
+    ImuSpi imu (chip, CS_PIN, ICM20689_FIFO_SIZE, ICM20689_ID);
+    imu.begin();
+    imu.begin_fifo(true);
+    for (int16_t i = 0; i < 50; i++){
+        int16_t frame[6] = {i, (int16_t)-i, 16384, (int16_t)(i * 3), 0, -1};
+        for (uint8_t j = 0; j < 6; j++){
+            chip.fifo.push_back((uint16_t)frame[j] >> 8);
+            chip.fifo.push_back(frame[j] & 0xFF);
+        }
+    }
+    TEST_ASSERT_EQUAL(50, imu.fifo_samples());
+    ImuSample samples[50];
+    TEST_ASSERT_EQUAL(50, imu.read_fifo(samples, 50));
+    // 240 byte bursts hold 20 frames
+    TEST_ASSERT_EQUAL(3, chip.fast_reads);
+    for (int16_t i = 0; i < 50; i++){
+        TEST_ASSERT_EQUAL_INT16(i, samples[i].accel_x);
+        TEST_ASSERT_EQUAL_INT16(-i, samples[i].accel_y);
+        TEST_ASSERT_EQUAL_INT16(16384, samples[i].accel_z);
+        TEST_ASSERT_EQUAL_INT16(i * 3, samples[i].gyro_x);
+        TEST_ASSERT_EQUAL_INT16(-1, samples[i].gyro_z);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_begin_checks_id);
+    RUN_TEST(test_missing_chip_fails);
+    RUN_TEST(test_readback_mismatch_fails);
+    RUN_TEST(test_fifo_burst);
+    return UNITY_END();
+}
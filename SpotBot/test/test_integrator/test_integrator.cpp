@@ -0,0 +1,155 @@
+/** @file test_integrator.cpp
+ *  This program tests the timestamped integrator and the sample clock with
+ *  samples which don't arrive on an even period, as they don't when the IMU
+ *  task is held up by Wi-Fi or another task.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <math.h>
+#include "integrator.h"
+#include "sample_clock.h"
+
+/// Seed of the jitter, the same every run
+static uint32_t jitter_seed;
+
+/** @brief   Function which returns a sample period of 1 ms give or take 400 us
+ */
+static int64_t jittered_period(void)
+{
+    jitter_seed = jitter_seed * 1664525u + 1013904223u;
+    return 600 + (jitter_seed >> 8) % 801;
+}
+
+void setUp(void)
+{
+    jitter_seed = 507;
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   A steady acceleration comes out the same however uneven the samples
+ */
+void test_constant_with_jitter(void)
+{
+    Integrator integrator;
+    int64_t time_us = 1000000;
+    integrator.update(2000000, time_us);
+    while (time_us < 2000000){
+        time_us += jittered_period();
+        integrator.update(2000000, time_us);
+    }
+    // 2 m/s^2 for however long the samples really took
+    int64_t expected = 2 * (time_us - 1000000);
+    TEST_ASSERT_INT32_WITHIN(1, expected, integrator.get());
+}
+
+/** @brief   A changing acceleration is followed to within the trapezoid error,
+ *           which assuming a fixed 1 ms period would not be
+ */
+void test_sine_with_jitter(void)
+{
+    Integrator integrator;
+    int64_t naive = 0;
+    int64_t time_us = 0;
+    // 2 m/s^2 at 1 Hz, like a bar going down and coming up
+    const double w = 2 * M_PI;
+    integrator.update(0, 0);
+    while (time_us < 500000){
+        time_us += jittered_period();
+        int32_t accel = (int32_t)(2e6 * sin(w * time_us / 1e6));
+        integrator.update(accel, time_us);
+        naive += accel / 1000;
+    }
+    int32_t expected = (int32_t)(2e6 / w * (1 - cos(w * time_us / 1e6)));
+    TEST_ASSERT_INT32_WITHIN(100, expected, integrator.get());
+    TEST_ASSERT_GREATER_THAN(1000, fabs((double)naive - expected));
+}
+
+/** @brief   Tiny inputs aren't rounded away as the integral grows
+ */
+void test_no_rounding_loss(void)
+{
+    Integrator integrator;
+    for (int64_t i = 0; i <= 100000; i++){
+        integrator.update(1, i * 1000);
+    }
+    // 1 um/s^2 for 100 s
+    TEST_ASSERT_EQUAL_INT32(100, integrator.get());
+}
+
+/** @brief   A sensor dropping out isn't integrated across, and a reset keeps
+ *           the last sample to integrate on from
+ */
+void test_gap_and_reset(void)
+{
+    Integrator integrator;
+    integrator.update(1000000, 0);
+    integrator.update(1000000, 1000);
+    TEST_ASSERT_EQUAL_INT32(1000, integrator.get());
+
+    integrator.update(1000000, 201000);
+    TEST_ASSERT_EQUAL_INT32(1000, integrator.get());
+
+    integrator.reset(-500);
+    integrator.update(1000000, 202000);
+    TEST_ASSERT_EQUAL_INT32(500, integrator.get());
+}
+
+/** @brief   Stamps come back out in order, one for each sample
+ */
+void test_clock_in_order(void)
+{
+    SampleClock clock;
+    int64_t time_us = 0;
+    int64_t stamps[40];
+    for (uint8_t i = 0; i < 40; i++){
+        time_us += jittered_period();
+        stamps[i] = time_us;
+        clock.stamp(time_us);
+    }
+    TEST_ASSERT_EQUAL_UINT32(40, clock.count());
+    clock.align(40);
+    for (uint8_t i = 0; i < 40; i++){
+        TEST_ASSERT_EQUAL(stamps[i], clock.next());
+    }
+}
+
+/** @brief   When the FIFO holds fewer samples than stamps, such as after it was
+ *           reset, the newest stamps go with the samples
+ */
+void test_clock_realigns(void)
+{
+    SampleClock clock;
+    for (int64_t i = 1; i <= 10; i++){
+        clock.stamp(i * 1000);
+    }
+    clock.align(4);
+    TEST_ASSERT_EQUAL(7000, clock.next());
+
+    // An interrupt or two in flight during the FIFO read is left alone
+    clock.align(3);
+    clock.stamp(11000);
+    clock.align(3);
+    TEST_ASSERT_EQUAL(8000, clock.next());
+
+    // More samples than stamps, interrupts were missed
+    clock.align(6);
+    TEST_ASSERT_EQUAL(6000, clock.next());
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_constant_with_jitter);
+    RUN_TEST(test_sine_with_jitter);
+    RUN_TEST(test_no_rounding_loss);
+    RUN_TEST(test_gap_and_reset);
+    RUN_TEST(test_clock_in_order);
+    RUN_TEST(test_clock_realigns);
+    return UNITY_END();
+}
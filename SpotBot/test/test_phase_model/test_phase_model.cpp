@@ -0,0 +1,374 @@
+/** @file test_phase_model.cpp
+ *  This program benchmarks the phase classifier against the speed thresholds
+ *  of the rep machine on made up, labeled sets of bench presses and squats.
+ *  Both are run the way task_spot runs them, with the bar tracker's sag and
+ *  the stall predictor behind them, and compared on how often they get the
+ *  phase right, how many good reps they count, how many good reps they spot
+ *  by mistake, how much sooner they spot a failing one, and how long the
+ *  classifier takes per update.
+ *
+ *  The sets are made here rather than taken from tools/phase_model.py, with
+ *  their own shapes and noise, so the model isn't only tested on what it was
+ *  trained on.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+#include "rep_machine.h"
+#include "phase_classifier.h"
+#include "bar_tracker.h"
+#include "stall_predictor.h"
+
+#define SETS 400            ///< Sets of each exercise
+#define STEP_S 0.01f        ///< One control step at @c REP_HZ
+
+/** @brief   One control step of a made up set
+ */
+struct Step
+{
+    float vel;
+    uint8_t phase;
+};
+
+/** @brief   A made up set and what should come of it
+ */
+struct Set
+{
+    std::vector<Step> steps;
+    uint16_t good_reps;
+    bool fails;
+    uint32_t fail_step;     ///< Step at which the failing press started up
+    uint32_t stop_step;     ///< Step at which the failing press stopped going up
+};
+
+/** @brief   What a detector made of a set
+ */
+struct Outcome
+{
+    uint16_t reps;
+    bool spotted;
+    uint32_t spot_step;
+    uint32_t right;         ///< Steps whose phase matched the label
+    uint32_t steps;
+};
+
+static uint32_t seed;
+
+/** @brief   Function which returns a random number from 0 to 1
+ */
+static float uniform(void)
+{
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 8) / 16777216.0f;
+}
+
+static float uniform(float low, float high)
+{
+    return low + (high - low) * uniform();
+}
+
+/** @brief   Function which returns normally spread noise
+ */
+static float gauss(float sigma)
+{
+    float u = uniform() + 1e-7f;
+    return sigma * sqrtf(-2 * logf(u)) * cosf(2 * M_PI * uniform());
+}
+
+/** @brief   Function which adds a stretch of one phase to a set
+ *  @param   shape Velocity over the stretch, given the part of it done, 0 to 1
+ */
+template <class F>
+static void add(Set& set, float seconds, uint8_t phase, F shape)
+{
+    uint32_t n = seconds / STEP_S;
+    n = n < 2 ? 2 : n;
+    for (uint32_t i = 0; i < n; i++){
+        set.steps.push_back({shape((i + 0.5f) / n), phase});
+    }
+}
+
+/** @brief   Function which returns how far the bar moved from a step on
+ */
+static float travel(const Set& set, uint32_t from)
+{
+    float distance = 0;
+    for (uint32_t i = from; i < set.steps.size(); i++){
+        distance += set.steps[i].vel * STEP_S;
+    }
+    return distance;
+}
+
+/** @brief   Function which scales the velocities from a step on so the bar
+ *           moves a given distance
+ */
+static void stretch(Set& set, uint32_t from, float distance)
+{
+    float factor = distance / travel(set, from);
+    for (uint32_t i = from; i < set.steps.size(); i++){
+        set.steps[i].vel *= factor;
+    }
+}
+
+/** @brief   Function which makes up one set
+ *  @details Bench reps stop on the chest, squats bounce out of the bottom
+ *           about half the time. Each ascent goes back up as far as the
+ *           descent came down, and may grind, crawling through the sticking
+ *           point at a few mm/s. The last rep may fail partway up, slowing to
+ *           a stop and sinking back, labeled failing from once it has lost
+ *           half its speed. Sensor noise goes on top of the lot.
+ */
+static void make_set(Set& set, bool bench)
+{
+    set.steps.clear();
+    set.good_reps = 0;
+    set.fails = uniform() < 0.4f;
+    set.fail_step = 0;
+    set.stop_step = 0;
+    float noise = uniform(0.001f, 0.003f);
+    bool bounce = !bench && uniform() < 0.5f;
+    uint8_t reps = 1 + uniform() * 6;
+    auto still = [](float){ return 0.0f; };
+
+    add(set, uniform(0.6f, 2.0f), PHASE_STILL, still);
+    for (uint8_t rep = 0; rep < reps && set.stop_step == 0; rep++){
+        float down = uniform(0.25f, 0.6f);
+        uint32_t first = set.steps.size();
+        add(set, uniform(0.8f, 2.2f), PHASE_DOWN, [down](float x){ return -down * sinf(M_PI * x); });
+        float depth = bench ? uniform(0.3f, 0.5f) : uniform(0.4f, 0.7f);
+        stretch(set, first, -depth);
+        if (!bounce){
+            add(set, uniform(0.2f, 0.7f), PHASE_STILL, still);
+        }
+        first = set.steps.size();
+        if (set.fails && rep == reps - 1){
+            set.fail_step = first;
+            float peak = uniform(0.12f, 0.3f);
+            float slow = uniform(0.4f, 1.0f);
+            add(set, uniform(0.25f, 0.45f), PHASE_UP, [peak](float x){ return peak * sinf(M_PI / 2 * x); });
+            add(set, slow / 2, PHASE_UP, [peak](float x){ return peak * (1 - x / 2); });
+            add(set, slow / 2, PHASE_FAIL, [peak](float x){ return peak * (1 - x) / 2; });
+            stretch(set, first, depth * uniform(0.3f, 0.65f));
+            set.stop_step = set.steps.size();
+            float sink = uniform(0.04f, 0.15f);
+            add(set, 0.3f, PHASE_FAIL, [sink](float x){ return -sink * sinf(M_PI / 2 * x); });
+            add(set, uniform(0.3f, 1.0f), PHASE_FAIL, [sink](float){ return -sink; });
+            break;
+        }
+        if (uniform() < 0.3f){
+            // Slowing less hard than the stall predictor looks for
+            float peak = uniform(0.2f, 0.35f);
+            float crawl = uniform(0.02f, 0.1f);
+            float decel = uniform(0.15f, 0.3f);
+            add(set, uniform(0.2f, 0.4f), PHASE_UP, [peak](float x){ return peak * sinf(M_PI / 2 * x); });
+            add(set, (peak - crawl) / decel, PHASE_UP, [peak, crawl](float x){ return peak + (crawl - peak) * x; });
+            add(set, uniform(0.2f, 0.6f), PHASE_UP, [crawl](float){ return crawl; });
+            float seconds = uniform(0.5f, 0.9f);
+            float left = depth - travel(set, first) - crawl * seconds;
+            float finish = left > 0.01f ? left * M_PI / 2 / seconds : 0.01f;
+            add(set, seconds, PHASE_UP, [crawl, finish](float x){ return crawl + finish * sinf(M_PI * x); });
+        }
+        else{
+            float up = uniform(0.3f, 0.8f);
+            add(set, uniform(0.6f, 1.5f), PHASE_UP, [up](float x){ return up * sinf(M_PI * x); });
+        }
+        stretch(set, first, depth);
+        set.good_reps++;
+        add(set, uniform(0.4f, 1.2f), PHASE_STILL, still);
+    }
+    if (set.stop_step == 0){
+        add(set, uniform(0.5f, 1.0f), PHASE_STILL, still);
+    }
+    for (Step& step : set.steps){
+        step.vel += gauss(noise);
+    }
+}
+
+/** @brief   Function which runs a set through the rep machine the way
+ *           task_spot does
+ *  @param   use_model True to go by the phase classifier, false to go by the
+ *           exercise's speed thresholds
+ */
+static Outcome run(const Set& set, const ExerciseDef& def, bool use_model)
+{
+    RepMachine machine (def);
+    PhaseClassifier classifier (phase_model);
+    StallPredictor stall;
+    BarTracker bar;
+    Outcome out = {0, false, 0, 0, 0};
+    float pos = 0;
+    uint8_t last = PHASE_STILL;
+    for (uint32_t i = 0; i < set.steps.size(); i++){
+        float vel = set.steps[i].vel;
+        pos += vel * STEP_S;
+        stall.update(vel);
+        classifier.update(vel);
+        if (machine.get_state() == REP_ASCENT){
+            bar.update(vel, pos);
+        }
+        RepInputs in = {vel, bar.sagging(), false, false, false,
+                        stall.stalling() && bar.short_of_top(), PHASE_NONE, (int64_t)i * REP_STEP_US};
+        uint8_t phase;
+        if (use_model){
+            in.phase = classifier.get_phase();
+            if (in.phase == PHASE_FAIL && !bar.short_of_top()){
+                in.phase = PHASE_UP;
+            }
+            phase = classifier.get_phase();
+        }
+        else{
+            phase = vel < -def.fall && last == PHASE_UP ? PHASE_FAIL
+                  : fabsf(vel) < def.still ? PHASE_STILL
+                  : vel < -def.move ? PHASE_DOWN : vel > def.move ? PHASE_UP : last;
+            last = phase == PHASE_FAIL ? last : phase;
+        }
+        out.right += phase == set.steps[i].phase;
+        out.steps++;
+
+        uint8_t action = machine.update(in);
+        if (action == ACT_RACK){
+            bar.rack(pos);
+        }
+        if (action == ACT_BOTTOM){
+            bar.chest(pos);
+        }
+        if (action == ACT_REP){
+            RepMotion motion;
+            bar.finish(motion);
+            out.reps += motion.full;
+        }
+        if (action == ACT_SPOT){
+            out.spotted = true;
+            out.spot_step = i;
+            return out;
+        }
+    }
+    return out;
+}
+
+/** @brief   Totals over every set of one exercise
+ */
+struct Totals
+{
+    uint32_t right;
+    uint32_t steps;
+    uint32_t reps;
+    uint32_t miscounted;    ///< Sets whose good reps weren't all counted
+    uint32_t false_spots;   ///< Sets spotted during a good rep
+    uint32_t missed;        ///< Failing sets never spotted
+    int32_t lead_sum;       ///< Steps from the spot to the stop, over the caught ones
+    uint32_t caught;
+};
+
+/** @brief   Function which adds what a detector made of a set to the totals
+ */
+static void tally(Totals& totals, const Set& set, const Outcome& out)
+{
+    uint32_t end = set.fails ? set.fail_step : set.steps.size();
+    totals.right += out.right;
+    totals.steps += out.steps;
+    totals.reps += out.reps;
+    totals.miscounted += out.reps != set.good_reps;
+    if (out.spotted && out.spot_step < end){
+        totals.false_spots++;
+    }
+    else if (out.spotted){
+        totals.lead_sum += (int32_t)set.stop_step - (int32_t)out.spot_step;
+        totals.caught++;
+    }
+    else if (set.fails){
+        totals.missed++;
+    }
+}
+
+static void print(const char* name, const Totals& t, uint32_t good_reps, uint32_t fails)
+{
+    printf("  %-18s phase %5.1f%% | reps %4u of %4u, %3u sets off | false spots %3u | "
+           "missed %3u of %3u | spot %4.0f ms before the stop\n",
+           name, 100.0 * t.right / t.steps, t.reps, good_reps, t.miscounted, t.false_spots,
+           t.missed, fails, t.caught ? 1000.0 * STEP_S * t.lead_sum / t.caught : 0.0);
+}
+
+static Totals model_totals[2];
+static Totals threshold_totals[2];
+static uint32_t good_reps[2];
+static uint32_t fails[2];
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   Function which runs every set of one exercise through both
+ */
+static void benchmark(uint8_t e)
+{
+    const ExerciseDef& def = e == 0 ? bench_press : squat;
+    seed = 2024 + e;
+    Set set;
+    for (uint16_t s = 0; s < SETS; s++){
+        make_set(set, e == 0);
+        good_reps[e] += set.good_reps;
+        fails[e] += set.fails;
+        tally(model_totals[e], set, run(set, def, true));
+        tally(threshold_totals[e], set, run(set, def, false));
+    }
+    printf("%s, %u sets\n", def.name, SETS);
+    print("speed thresholds", threshold_totals[e], good_reps[e], fails[e]);
+    print("phase classifier", model_totals[e], good_reps[e], fails[e]);
+
+    // What the rep machine does by default, which the model would have to beat
+    TEST_ASSERT_EQUAL(0, threshold_totals[e].miscounted);
+    TEST_ASSERT_EQUAL(0, threshold_totals[e].false_spots);
+    // The model gets the phase about as right as it did on its own held out sets
+    TEST_ASSERT_GREATER_THAN(95, 100 * model_totals[e].right / model_totals[e].steps);
+}
+
+void test_bench(void)
+{
+    benchmark(0);
+}
+
+void test_squat(void)
+{
+    benchmark(1);
+}
+
+/** @brief   The classifier's time per update, which is bounded by its tables
+ */
+void test_update_time(void)
+{
+    PhaseClassifier classifier (phase_model);
+    seed = 1;
+    std::vector<float> vels;
+    for (uint32_t i = 0; i < 100000; i++){
+        vels.push_back(0.5f * sinf(i * 0.02f) + gauss(0.005f));
+    }
+    uint32_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (float vel : vels){
+        classifier.update(vel);
+        sink += classifier.get_phase();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / vels.size();
+    printf("phase classifier update: %.0f ns on this computer (%u)\n", ns, sink & 1);
+    TEST_ASSERT_LESS_THAN(5000, (int32_t)ns);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_bench);
+    RUN_TEST(test_squat);
+    RUN_TEST(test_update_time);
+    return UNITY_END();
+}
@@ -0,0 +1,325 @@
+/** @file test_rep_machine.cpp
+ *  This program runs every exercise's transition table through the reps and
+ *  failures it has to handle: that each table is laid out the way the machine
+ *  expects, that good reps are counted, and that every way a rep can fail
+ *  ends in a spot, with the differences between the exercises where they
+ *  are meant to be.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <math.h>
+#include "rep_machine.h"
+
+/** @brief   Function which runs one update with only a bar velocity
+ */
+static uint8_t step(RepMachine& machine, float vel)
+{
+    RepInputs in = {vel, false, false, false, false, false, PHASE_NONE, 0};
+    return machine.update(in);
+}
+
+/** @brief   Function which runs updates at one velocity
+ *  @return  The last action other than @c ACT_NONE, or @c ACT_NONE
+ */
+static uint8_t hold(RepMachine& machine, float vel, uint16_t updates)
+{
+    uint8_t last = ACT_NONE;
+    for (uint16_t i = 0; i < updates; i++){
+        uint8_t action = step(machine, vel);
+        last = action != ACT_NONE ? action : last;
+    }
+    return last;
+}
+
+/** @brief   Function which takes a machine from startup to the bottom of a
+ *           rep which stopped there
+ */
+static void to_bottom(RepMachine& machine)
+{
+    const ExerciseDef& def = machine.get_exercise();
+    TEST_ASSERT_EQUAL(ACT_RACK, step(machine, 0));
+    TEST_ASSERT_EQUAL(ACT_START, step(machine, -2 * def.move));
+    hold(machine, -0.4f, 50);
+    TEST_ASSERT_EQUAL(ACT_BOTTOM, step(machine, 0));
+    TEST_ASSERT_EQUAL(REP_BOTTOM, machine.get_state());
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   Every table is grouped by state in order, only names real states
+ *           and actions, has a way out of every state a rep passes through,
+ *           and can reach a spot from each of them
+ */
+void test_tables_well_formed(void)
+{
+    for (uint8_t e = 0; e < exercise_count; e++){
+        const ExerciseDef& def = *exercises[e];
+        TEST_ASSERT_NOT_NULL(def.name);
+        TEST_ASSERT_LESS_THAN_FLOAT(def.move, def.still);
+        TEST_ASSERT_TRUE(def.move <= def.fall);
+        TEST_ASSERT_GREATER_THAN(0, def.single_confirm);
+        bool leaves[REP_STATES] = {false};
+        bool spots[REP_STATES] = {false};
+        for (uint8_t row = 0; row < def.size; row++){
+            const RepTransition& t = def.table[row];
+            if (row > 0){
+                TEST_ASSERT_LESS_OR_EQUAL(t.from, def.table[row - 1].from);
+            }
+            TEST_ASSERT_LESS_THAN(REP_STATES, t.from);
+            TEST_ASSERT_LESS_THAN(REP_STATES, t.to);
+            TEST_ASSERT_LESS_OR_EQUAL(ACT_SPOT_DONE, t.action);
+            leaves[t.from] = leaves[t.from] || t.to != t.from;
+            spots[t.from] = spots[t.from] || (t.to == REP_SPOT && (t.guard & GUARD_TIMEOUT));
+        }
+        for (uint8_t s = REP_WAIT; s <= REP_SPOT; s++){
+            TEST_ASSERT_TRUE_MESSAGE(leaves[s], def.name);
+        }
+        TEST_ASSERT_TRUE_MESSAGE(spots[REP_DESCENT] && spots[REP_BOTTOM] && spots[REP_ASCENT], def.name);
+    }
+}
+
+/** @brief   A clean rep goes round every state and is counted once, in every
+ *           exercise
+ */
+void test_clean_rep(void)
+{
+    for (uint8_t e = 0; e < exercise_count; e++){
+        RepMachine machine (*exercises[e]);
+        for (uint8_t rep = 0; rep < 3; rep++){
+            if (rep > 0){
+                hold(machine, 0, 100);
+                TEST_ASSERT_EQUAL(ACT_START, step(machine, -0.3f));
+                hold(machine, -0.4f, 50);
+                TEST_ASSERT_EQUAL(ACT_BOTTOM, step(machine, 0));
+            }
+            else{
+                to_bottom(machine);
+            }
+            hold(machine, 0, 30);
+            TEST_ASSERT_EQUAL(ACT_NONE, step(machine, 0.3f));
+            TEST_ASSERT_EQUAL(REP_ASCENT, machine.get_state());
+            TEST_ASSERT_EQUAL(ACT_NONE, hold(machine, 0.4f, 80));
+            TEST_ASSERT_EQUAL(ACT_REP, step(machine, 0));
+            TEST_ASSERT_EQUAL(REP_RACKED, machine.get_state());
+            TEST_ASSERT_EQUAL(0, machine.get_ticks());
+        }
+    }
+}
+
+/** @brief   A bar barely moving, between the still and move speeds, doesn't
+ *           start or end anything
+ */
+void test_dead_band(void)
+{
+    for (uint8_t e = 0; e < exercise_count; e++){
+        const ExerciseDef& def = *exercises[e];
+        RepMachine machine (def);
+        step(machine, 0);
+        float between = -(def.still + def.move) / 2;
+        TEST_ASSERT_EQUAL(ACT_NONE, hold(machine, between, 200));
+        TEST_ASSERT_EQUAL(REP_RACKED, machine.get_state());
+    }
+}
+
+/** @brief   The bench press has to stop on the chest; the squat may bounce
+ *           straight out of the bottom
+ */
+void test_bounce_differs(void)
+{
+    RepMachine bench (bench_press);
+    step(bench, 0);
+    step(bench, -0.4f);
+    hold(bench, -0.4f, 50);
+    TEST_ASSERT_EQUAL(ACT_NONE, hold(bench, 0.3f, 20));
+    TEST_ASSERT_EQUAL(REP_DESCENT, bench.get_state());
+
+    RepMachine deep (squat);
+    step(deep, 0);
+    step(deep, -0.4f);
+    hold(deep, -0.4f, 50);
+    TEST_ASSERT_EQUAL(ACT_BOTTOM, step(deep, 0.3f));
+    TEST_ASSERT_EQUAL(REP_ASCENT, deep.get_state());
+}
+
+/** @brief   The bar falling back on the way up spots it straight away, but
+ *           needs to be seen for @c single_confirm updates with one IMU
+ */
+void test_fall_spots(void)
+{
+    for (uint8_t e = 0; e < exercise_count; e++){
+        const ExerciseDef& def = *exercises[e];
+        RepMachine machine (def);
+        to_bottom(machine);
+        step(machine, 0.3f);
+        TEST_ASSERT_EQUAL(ACT_SPOT, step(machine, -def.fall - 0.01f));
+        TEST_ASSERT_EQUAL(REP_SPOT, machine.get_state());
+
+        RepMachine single (def);
+        to_bottom(single);
+        step(single, 0.3f);
+        RepInputs in = {-def.fall - 0.01f, false, false, true, false, false, PHASE_NONE, 0};
+        for (uint8_t i = 1; i < def.single_confirm; i++){
+            TEST_ASSERT_EQUAL(ACT_NONE, single.update(in));
+        }
+        TEST_ASSERT_EQUAL(ACT_SPOT, single.update(in));
+
+        // A single sample blip with one IMU isn't enough
+        RepMachine blip (def);
+        to_bottom(blip);
+        step(blip, 0.3f);
+        blip.update(in);
+        in.bar_vel = 0.3f;
+        blip.update(in);
+        TEST_ASSERT_EQUAL(REP_ASCENT, blip.get_state());
+    }
+}
+
+/** @brief   Sagging, tilting and a predicted stall spot the ascent, and tilt
+ *           spots the descent and bottom as well
+ */
+void test_other_failures(void)
+{
+    for (uint8_t e = 0; e < exercise_count; e++){
+        const ExerciseDef& def = *exercises[e];
+        for (uint8_t which = 0; which < 3; which++){
+            RepMachine machine (def);
+            to_bottom(machine);
+            step(machine, 0.3f);
+            RepInputs in = {0.1f, which == 0, which == 1, false, false, which == 2, PHASE_NONE, 0};
+            TEST_ASSERT_EQUAL(ACT_SPOT, machine.update(in));
+        }
+        RepMachine descent (def);
+        step(descent, 0);
+        step(descent, -0.4f);
+        RepInputs tilted = {-0.4f, false, true, false, false, false, PHASE_NONE, 0};
+        TEST_ASSERT_EQUAL(ACT_SPOT, descent.update(tilted));
+
+        RepMachine bottom (def);
+        to_bottom(bottom);
+        tilted.bar_vel = 0;
+        TEST_ASSERT_EQUAL(ACT_SPOT, bottom.update(tilted));
+    }
+}
+
+/** @brief   A rep which takes longer than the exercise allows is spotted,
+ *           even with no bar IMU to go on, and the squat is given longer
+ */
+void test_timeout(void)
+{
+    for (uint8_t e = 0; e < exercise_count; e++){
+        const ExerciseDef& def = *exercises[e];
+        RepMachine machine (def);
+        to_bottom(machine);
+        uint16_t used = machine.get_ticks();
+        TEST_ASSERT_EQUAL(ACT_NONE, hold(machine, NAN, def.max_ticks - used - 1));
+        TEST_ASSERT_EQUAL(ACT_SPOT, step(machine, NAN));
+    }
+    TEST_ASSERT_GREATER_THAN(bench_press.max_ticks, squat.max_ticks);
+}
+
+/** @brief   With every IMU dead task_IMU publishes a record only every 150 ms,
+ *           and the rep is still spotted once the exercise's time is up
+ */
+void test_timeout_without_records(void)
+{
+    for (uint8_t e = 0; e < exercise_count; e++){
+        const ExerciseDef& def = *exercises[e];
+        RepMachine machine (def);
+        RepInputs in = {0, false, false, false, false, false, PHASE_NONE, 0};
+        int64_t t = 1000000;
+        uint8_t action = ACT_NONE;
+        for (uint16_t i = 0; i < 20; i++, t += REP_STEP_US){
+            in.bar_vel = i < 2 ? 0 : i < 15 ? -0.4f : 0;
+            in.time_us = t;
+            machine.update(in);
+        }
+        TEST_ASSERT_EQUAL(REP_BOTTOM, machine.get_state());
+        int64_t dead = t;
+        in.bar_vel = NAN;
+        while (action != ACT_SPOT && t - dead < 4LL * def.max_ticks * REP_STEP_US){
+            t += 150000;
+            in.time_us = t;
+            action = machine.update(in);
+        }
+        TEST_ASSERT_EQUAL(ACT_SPOT, action);
+        // The descent took 13 steps of the rep's time already
+        TEST_ASSERT_TRUE(t - dead <= (int64_t)def.max_ticks * REP_STEP_US + 150000);
+    }
+}
+
+/** @brief   Once the motor finishes the machine stops until it is restarted
+ */
+void test_spot_done(void)
+{
+    RepMachine machine (bench_press);
+    to_bottom(machine);
+    step(machine, 0.3f);
+    step(machine, -0.5f);
+    RepInputs in = {0, false, false, false, true, false, PHASE_NONE, 0};
+    TEST_ASSERT_EQUAL(ACT_SPOT_DONE, machine.update(in));
+    TEST_ASSERT_EQUAL(ACT_NONE, hold(machine, -0.5f, 50));
+    TEST_ASSERT_EQUAL(REP_DONE, machine.get_state());
+
+    machine.select(squat);
+    TEST_ASSERT_EQUAL(REP_WAIT, machine.get_state());
+    TEST_ASSERT_EQUAL_STRING("squat", machine.get_exercise().name);
+}
+
+/** @brief   A phase from the classifier takes over from the speed thresholds,
+ *           except that a fast fall still spots
+ */
+void test_phase_overrides(void)
+{
+    RepMachine machine (bench_press);
+    RepInputs in = {0.3f, false, false, false, false, false, PHASE_STILL, 0};
+    TEST_ASSERT_EQUAL(ACT_RACK, machine.update(in));
+    in.phase = PHASE_DOWN;
+    in.bar_vel = 0.01f;
+    TEST_ASSERT_EQUAL(ACT_START, machine.update(in));
+    in.phase = PHASE_STILL;
+    TEST_ASSERT_EQUAL(ACT_BOTTOM, machine.update(in));
+    in.phase = PHASE_UP;
+    machine.update(in);
+    TEST_ASSERT_EQUAL(REP_ASCENT, machine.get_state());
+    in.phase = PHASE_FAIL;
+    in.bar_vel = 0.05f;
+    TEST_ASSERT_EQUAL(ACT_SPOT, machine.update(in));
+
+    RepMachine fast (bench_press);
+    in.phase = PHASE_STILL;
+    in.bar_vel = 0;
+    fast.update(in);
+    in.phase = PHASE_DOWN;
+    fast.update(in);
+    in.phase = PHASE_STILL;
+    fast.update(in);
+    in.phase = PHASE_UP;
+    fast.update(in);
+    in.bar_vel = -0.5f;
+    TEST_ASSERT_EQUAL(ACT_SPOT, fast.update(in));
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_tables_well_formed);
+    RUN_TEST(test_clean_rep);
+    RUN_TEST(test_dead_band);
+    RUN_TEST(test_bounce_differs);
+    RUN_TEST(test_fall_spots);
+    RUN_TEST(test_other_failures);
+    RUN_TEST(test_timeout);
+    RUN_TEST(test_timeout_without_records);
+    RUN_TEST(test_spot_done);
+    RUN_TEST(test_phase_overrides);
+    return UNITY_END();
+}
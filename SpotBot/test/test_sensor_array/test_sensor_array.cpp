@@ -0,0 +1,349 @@
+/** @file test_sensor_array.cpp
+ *  This program tests the sensor array with several MPU-6050s sharing one
+ *  address behind a TCA9548A multiplexer: that each channel is only switched
+ *  to once per pass and that samples from every IMU are lined up in time. It
+ *  also measures how long draining takes for each number of IMUs, with and
+ *  without the multiplexer, as time on a 400 kHz bus and on the host.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <string.h>
+#include <stdio.h>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include "i2c_mux.h"
+#include "mpu6050.h"
+#include "sensor_array.h"
+
+#define PERIOD_US 1000          ///< 1 kHz output data rate
+#define TICKS_PER_MS2 1670.2f   ///< Nominal MPU-6050 ticks per m/s^2
+#define I2C_HZ 400000           ///< I2C clock, as in main
+#define DRAIN_SAMPLES 10        ///< Samples per IMU between drains, as in main
+#define DRAIN_PASSES 1000       ///< Drains timed for each number of IMUs
+
+/** @brief   Class which holds the registers and FIFO of one fake MPU-6050
+ */
+class FakeMpu
+{
+public:
+    int8_t channel;
+    uint8_t addr;
+    bool alive = true;
+    uint32_t reads = 0;
+    uint8_t regs[128];
+    std::deque<uint8_t> fifo;
+
+    FakeMpu (int8_t a_channel, uint8_t address)
+        : channel (a_channel), addr (address)
+    {
+        memset(regs, 0, sizeof(regs));
+    }
+
+    /** @brief   Method which queues samples at rest, gravity straight down
+     */
+    void add_samples(uint16_t n)
+    {
+        int16_t frame[6] = {0, 0, (int16_t)(9.81f * TICKS_PER_MS2), 0, 0, 0};
+        for (uint16_t i = 0; i < n; i++){
+            for (uint8_t j = 0; j < 6; j++){
+                fifo.push_back((uint16_t)frame[j] >> 8);
+                fifo.push_back(frame[j] & 0xFF);
+            }
+        }
+    }
+};
+
+/** @brief   Class which acts as an I2C bus with a multiplexer on it and fake
+ *           IMUs behind it, or straight on the bus with channel -1
+ *  @details If two IMUs with the same address can be seen at once the
+ *           transfer fails, as the two would talk over each other.
+ */
+class FakeMuxBus : public I2CBus
+{
+public:
+    uint8_t mask = 0;
+    uint32_t mux_writes = 0;
+    uint32_t bits = 0;
+    FakeMpu* devices[8];
+    uint8_t count = 0;
+
+    void attach(FakeMpu& device)
+    {
+        devices[count++] = &device;
+    }
+
+    FakeMpu* find(uint8_t addr)
+    {
+        FakeMpu* p_found = NULL;
+        for (uint8_t i = 0; i < count; i++){
+            FakeMpu* p_dev = devices[i];
+            bool seen = p_dev->channel < 0 || (mask & (1 << p_dev->channel));
+            if (seen && p_dev->addr == addr){
+                if (p_found != NULL){
+                    return NULL;
+                }
+                p_found = p_dev;
+            }
+        }
+        return p_found != NULL && p_found->alive ? p_found : NULL;
+    }
+
+    /** @brief   Method which counts the clocks of one transfer: a start, each
+     *           byte with its acknowledge, and a stop
+     */
+    void clock(uint16_t bytes)
+    {
+        bits += 2 + 9 * bytes;
+    }
+
+    bool write_byte(uint8_t addr, uint8_t value)
+    {
+        clock(2);
+        if (addr != MUX_ADDR){
+            return false;
+        }
+        mask = value;
+        mux_writes++;
+        return true;
+    }
+
+    bool write_reg(uint8_t addr, uint8_t reg, uint8_t value)
+    {
+        clock(3);
+        FakeMpu* p_dev = find(addr);
+        if (p_dev == NULL){
+            return false;
+        }
+        p_dev->regs[reg] = value;
+        if (reg == MPU_USER_CTRL && (value & MPU_USER_FIFO_RST)){
+            p_dev->fifo.clear();
+        }
+        return true;
+    }
+
+    bool read_regs(uint8_t addr, uint8_t reg, uint8_t* p_buf, uint16_t len)
+    {
+        // Register address written, then a repeated start to read
+        clock(2);
+        clock(1 + len);
+        FakeMpu* p_dev = find(addr);
+        if (p_dev == NULL){
+            return false;
+        }
+        p_dev->reads++;
+        if (reg == MPU_FIFO_R_W){
+            for (uint16_t i = 0; i < len; i++){
+                p_buf[i] = p_dev->fifo.front();
+                p_dev->fifo.pop_front();
+            }
+        }
+        else if (reg == MPU_FIFO_COUNT_H){
+            p_buf[0] = p_dev->fifo.size() >> 8;
+            p_buf[1] = p_dev->fifo.size() & 0xFF;
+        }
+        else{
+            memcpy(p_buf, &p_dev->regs[reg], len);
+        }
+        return true;
+    }
+
+    uint16_t max_read(void)
+    {
+        return 128;
+    }
+};
+
+const ImuConfig config = {1, 0, 0, 0, true};
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   Each multiplexer channel is switched to once per pass, and the
+ *           channel left selected at the end of a pass is used first on the
+ *           next one
+ */
+void test_one_switch_per_channel(void)
+{
+    FakeMuxBus bus;
+    I2CMux mux (bus, MUX_ADDR);
+    MuxChannelBus ch0 (mux, 0), ch1 (mux, 1), ch2 (mux, 2);
+    FakeMpu dev0 (0, 0x68), dev1 (1, 0x68), dev2 (2, 0x68), direct (-1, 0x69);
+    bus.attach(dev0);
+    bus.attach(dev1);
+    bus.attach(dev2);
+    bus.attach(direct);
+    MPU6050 imu0 (ch0, 0x68), imu1 (ch1, 0x68), imu2 (ch2, 0x68), imu3 (bus, 0x69);
+    VelocityEstimator est0 (TICKS_PER_MS2, 0.05f, 1000, 10), est1 (TICKS_PER_MS2, 0.05f, 1000, 10);
+    VelocityEstimator est2 (TICKS_PER_MS2, 0.05f, 1000, 10), est3 (TICKS_PER_MS2, 0.05f, 1000, 10);
+
+    SensorArray array (PERIOD_US);
+    // Added out of channel order on purpose
+    TEST_ASSERT_TRUE(array.add(&imu2, &est2, NULL, 0, 2));
+    TEST_ASSERT_TRUE(array.add(&imu0, &est0, NULL, 0, 0));
+    TEST_ASSERT_TRUE(array.add(&imu3, &est3, NULL, 0, -1));
+    TEST_ASSERT_TRUE(array.add(&imu1, &est1, NULL, 0, 1));
+    TEST_ASSERT_TRUE(array.begin(config));
+
+    // begin() left channel 2 selected and the first pass starts at channel 0
+    array.drain(0, 0);
+    uint32_t switches = mux.get_switches();
+    for (uint8_t pass = 0; pass < 4; pass++){
+        dev0.add_samples(5);
+        dev1.add_samples(5);
+        dev2.add_samples(5);
+        direct.add_samples(5);
+        array.drain(0, 10000 * (pass + 1));
+        TEST_ASSERT_EQUAL(0, dev0.fifo.size());
+        TEST_ASSERT_EQUAL(0, dev1.fifo.size());
+        TEST_ASSERT_EQUAL(0, dev2.fifo.size());
+        TEST_ASSERT_EQUAL(0, direct.fifo.size());
+        // Three channels, the one already selected isn't switched to again
+        TEST_ASSERT_EQUAL(switches + 2, mux.get_switches());
+        switches = mux.get_switches();
+    }
+    TEST_ASSERT_EQUAL(mux.get_switches(), bus.mux_writes);
+}
+
+/** @brief   Steps are only taken once every IMU has caught up, and each step
+ *           uses the samples of every IMU from the same instant
+ */
+void test_steps_line_up(void)
+{
+    FakeMuxBus bus;
+    FakeMpu dev_a (-1, 0x68), dev_b (-1, 0x69);
+    bus.attach(dev_a);
+    bus.attach(dev_b);
+    MPU6050 imu_a (bus, 0x68), imu_b (bus, 0x69);
+    VelocityEstimator est_a (TICKS_PER_MS2, 0.05f, 1000, 10), est_b (TICKS_PER_MS2, 0.05f, 1000, 10);
+    SensorArray array (PERIOD_US);
+    array.add(&imu_a, &est_a, NULL, 0, -1);
+    array.add(&imu_b, &est_b, NULL, 1, -1);
+    array.begin(config);
+
+    // Only the first IMU has been drained, the other one is on the other bus
+    dev_a.add_samples(10);
+    dev_b.add_samples(10);
+    array.drain(0, 100000);
+    TEST_ASSERT_EQUAL(0, array.update(100));
+
+    array.drain(1, 100000);
+    TEST_ASSERT_EQUAL(10, array.update(100));
+    TEST_ASSERT_EQUAL(100000, array.get_time());
+
+    // The first IMU backing up isn't held up forever by a missing one
+    dev_a.add_samples(30);
+    array.drain(0, 130000);
+    TEST_ASSERT_EQUAL(30 - SENSOR_PENDING / 2, array.update(100));
+    TEST_ASSERT_EQUAL(130000 - (SENSOR_PENDING / 2) * PERIOD_US, array.get_time());
+}
+
+/** @brief   The array refuses more IMUs than it has room for
+ */
+void test_array_full(void)
+{
+    FakeMuxBus bus;
+    MPU6050 imu (bus, 0x68);
+    VelocityEstimator est (TICKS_PER_MS2, 0.05f, 1000, 10);
+    SensorArray array (PERIOD_US);
+    for (uint8_t i = 0; i < SENSOR_MAX; i++){
+        TEST_ASSERT_TRUE(array.add(&imu, &est, NULL, 0, i));
+    }
+    TEST_ASSERT_FALSE(array.add(&imu, &est, NULL, 0, 7));
+    TEST_ASSERT_FALSE(array.add(&imu, &est, NULL, SENSOR_BUSES, -1));
+    TEST_ASSERT_EQUAL(SENSOR_MAX, array.size());
+}
+
+/** @brief   Prints the time one drain and update of every IMU takes, for one
+ *           IMU up to @c SENSOR_MAX, each behind its own multiplexer channel
+ *           and each straight on the bus
+ *  @details Bus time counts every clock of every transfer at @c I2C_HZ, with
+ *           no gaps between them, so the real bus is a little slower. Host
+ *           time is how long the array's own code takes, with the bus faked.
+ *           A real MPU-6050 has only two addresses, so more than two on a bus
+ *           without the multiplexer is only there to show what it costs.
+ */
+void test_drain_time(void)
+{
+    const double period_us = DRAIN_SAMPLES * PERIOD_US;
+    const double switch_us = (2 + 9 * 2) * 1e6 / I2C_HZ;
+    double direct_us[SENSOR_MAX + 1];
+    for (uint8_t use_mux = 0; use_mux < 2; use_mux++){
+        double last_bus_us = 0;
+        for (uint8_t n = 1; n <= SENSOR_MAX; n++){
+            FakeMuxBus bus;
+            I2CMux mux (bus, MUX_ADDR);
+            std::vector<std::unique_ptr<FakeMpu>> devices;
+            std::vector<std::unique_ptr<MuxChannelBus>> channels;
+            std::vector<std::unique_ptr<MPU6050>> imus;
+            std::vector<std::unique_ptr<VelocityEstimator>> estimators;
+            SensorArray array (PERIOD_US);
+            for (uint8_t i = 0; i < n; i++){
+                uint8_t addr = use_mux ? 0x68 : 0x68 + i;
+                devices.emplace_back(new FakeMpu (use_mux ? i : -1, addr));
+                bus.attach(*devices[i]);
+                I2CBus* p_bus = &bus;
+                if (use_mux){
+                    channels.emplace_back(new MuxChannelBus (mux, i));
+                    p_bus = channels[i].get();
+                }
+                imus.emplace_back(new MPU6050 (*p_bus, addr));
+                estimators.emplace_back(new VelocityEstimator (TICKS_PER_MS2, 0.05f, 1000, 10));
+                array.add(imus[i].get(), estimators[i].get(), NULL, 0, use_mux ? i : -1);
+            }
+            TEST_ASSERT_TRUE(array.begin(config));
+            array.drain(0, 0);
+
+            uint32_t bits = bus.bits;
+            uint32_t steps = 0;
+            double host_s = 0;
+            for (uint32_t pass = 1; pass <= DRAIN_PASSES; pass++){
+                for (uint8_t i = 0; i < n; i++){
+                    devices[i]->add_samples(DRAIN_SAMPLES);
+                }
+                auto start = std::chrono::steady_clock::now();
+                array.drain(0, pass * period_us);
+                steps += array.update(DRAIN_SAMPLES * 2);
+                host_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            TEST_ASSERT_EQUAL(DRAIN_PASSES * DRAIN_SAMPLES, steps);
+            double bus_us = (bus.bits - bits) * 1e6 / I2C_HZ / DRAIN_PASSES;
+            double host_us = host_s * 1e6 / DRAIN_PASSES;
+            printf("%u IMU%s %-10s bus %7.0f us per drain (%3.0f%% of the %.0f ms between drains) | host %6.1f us\n",
+                   n, n > 1 ? "s" : " ", use_mux ? "with mux" : "direct", bus_us,
+                   100 * bus_us / period_us, period_us / 1000, host_us);
+            // Each IMU adds the same reads, and at most one channel switch
+            TEST_ASSERT_TRUE(bus_us > last_bus_us);
+            last_bus_us = bus_us;
+            if (use_mux){
+                TEST_ASSERT_TRUE(bus_us <= direct_us[n] + (n - 1) * switch_us + 1);
+            }
+            else{
+                direct_us[n] = bus_us;
+            }
+            // Half the array fits on each of the two buses at 1 kHz
+            if (n <= SENSOR_MAX / SENSOR_BUSES){
+                TEST_ASSERT_TRUE(bus_us < period_us);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_one_switch_per_channel);
+    RUN_TEST(test_steps_line_up);
+    RUN_TEST(test_array_full);
+    RUN_TEST(test_drain_time);
+    return UNITY_END();
+}
@@ -0,0 +1,358 @@
+/** @file test_session_store.cpp
+ *  This program tests the session store: that raw rows are kept for as long
+ *  as promised and read back in order, that they are boiled down into 100 ms
+ *  aggregates which match the rows, that sets and reps are split and summed
+ *  up, and what is left once each ring has wrapped. It also runs a session
+ *  of several hours to check the store never grows past its rings, and reads
+ *  while another thread adds to check reads come back whole.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <stdlib.h>
+#include <new>
+#include <thread>
+#include <atomic>
+#include "session_store.h"
+
+#define STEP_MS 10          ///< The 100 Hz control rate
+#define START_MS 1000       ///< Time of the first row
+#define SESSION_HOURS 4     ///< Length of the long session
+#define SET_REPS 8          ///< Reps in each set of the long session
+#define REST_MS 90000       ///< Rest between the long session's sets
+
+static std::atomic<uint32_t> allocations {0};
+
+/** @brief   Operator which counts every allocation made on the heap, so a
+ *           test can check nothing it runs allocates
+ */
+void* operator new(size_t size)
+{
+    allocations++;
+    void* p_mem = malloc(size ? size : 1);
+    if (p_mem == NULL){
+        throw std::bad_alloc();
+    }
+    return p_mem;
+}
+
+void operator delete(void* p_mem) noexcept
+{
+    free(p_mem);
+}
+
+void operator delete(void* p_mem, size_t size) noexcept
+{
+    free(p_mem);
+}
+
+/** @brief   Function which makes up a right side velocity in m/s
+ */
+static float vel_r_at(uint32_t i)
+{
+    return 0.5f * sinf(i * 0.07f);
+}
+
+/** @brief   Function which makes up a left side velocity in m/s
+ */
+static float vel_l_at(uint32_t i)
+{
+    return -0.25f + 0.001f * (i % 37);
+}
+
+/** @brief   Function which adds one rep, a second down and a second up
+ *  @return  Time of the end of the rep
+ */
+static uint32_t add_rep(SessionStore& store, uint32_t time_ms, float down, float up, bool failed)
+{
+    store.begin_rep(time_ms);
+    for (uint16_t i = 0; i < 100; i++, time_ms += STEP_MS){
+        store.add(time_ms, down, down, down);
+    }
+    for (uint16_t i = 0; i < 100; i++, time_ms += STEP_MS){
+        store.add(time_ms, up, up, up);
+    }
+    store.end_rep(time_ms, failed, 450, failed ? 120 : 0);
+    return time_ms;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   The last @c STORE_RAW_SIZE rows are kept, in order, in mm/s
+ *           rounded to the nearest
+ */
+void test_raw_ring(void)
+{
+    static SessionStore store;
+    const uint32_t rows = STORE_RAW_SIZE + 88;
+    for (uint32_t i = 0; i < rows; i++){
+        store.add(START_MS + i * STEP_MS, vel_r_at(i), vel_l_at(i), 0);
+    }
+    uint32_t row = 0;
+    RawRow buf[100];
+    uint32_t got = 0;
+    uint16_t n;
+    while ((n = store.read_raw(row, buf, 100)) > 0){
+        for (uint16_t i = 0; i < n; i++){
+            uint32_t index = rows - STORE_RAW_SIZE + got + i;
+            TEST_ASSERT_EQUAL(START_MS + index * STEP_MS, buf[i].time_ms);
+            TEST_ASSERT_EQUAL((int16_t)lroundf(vel_r_at(index) * 1000), buf[i].vel_r);
+            TEST_ASSERT_EQUAL((int16_t)lroundf(vel_l_at(index) * 1000), buf[i].vel_l);
+        }
+        got += n;
+    }
+    TEST_ASSERT_EQUAL(STORE_RAW_SIZE, got);
+    TEST_ASSERT_EQUAL(rows, row);
+
+    // A reader which is up to date gets only what is new
+    store.add(START_MS + rows * STEP_MS, 1.0f, -1.0f, 0);
+    TEST_ASSERT_EQUAL(1, store.read_raw(row, buf, 100));
+    TEST_ASSERT_EQUAL(1000, buf[0].vel_r);
+    TEST_ASSERT_EQUAL(-1000, buf[0].vel_l);
+}
+
+/** @brief   Each aggregate covers one 100 ms bucket and has the minimum,
+ *           maximum and mean of the rows in it; the bucket still filling
+ *           isn't read
+ */
+void test_aggregates_match_rows(void)
+{
+    static SessionStore store;
+    // Rows arriving with jitter and not lined up with the buckets
+    uint32_t times[2000];
+    uint32_t time_ms = START_MS + 37;
+    uint32_t rows = 0;
+    for (uint32_t i = 0; time_ms < START_MS + 20000; i++){
+        times[rows++] = time_ms;
+        time_ms += STEP_MS + (i * 7 % 5) - 2;
+    }
+    store.begin_rep(times[0]);
+    for (uint32_t i = 0; i < rows; i++){
+        store.add(times[i], vel_r_at(i), vel_l_at(i), 0);
+    }
+
+    static AggregateRow aggs[STORE_AGG_SIZE];
+    uint16_t n = store.read_set(0, aggs, STORE_AGG_SIZE);
+    TEST_ASSERT_EQUAL(times[rows - 1] / STORE_AGG_MS - times[0] / STORE_AGG_MS, n);
+    uint32_t i = 0;
+    for (uint16_t a = 0; a < n; a++){
+        TEST_ASSERT_EQUAL(0, aggs[a].time_ms % STORE_AGG_MS);
+        int16_t min_r = 32767, max_r = -32767;
+        int32_t sum_l = 0, count = 0;
+        for (; i < rows && times[i] < aggs[a].time_ms + STORE_AGG_MS; i++, count++){
+            TEST_ASSERT_GREATER_OR_EQUAL(aggs[a].time_ms, times[i]);
+            int16_t r = lroundf(vel_r_at(i) * 1000);
+            min_r = r < min_r ? r : min_r;
+            max_r = r > max_r ? r : max_r;
+            sum_l += lroundf(vel_l_at(i) * 1000);
+        }
+        TEST_ASSERT_GREATER_THAN(0, count);
+        TEST_ASSERT_EQUAL(min_r, aggs[a].min_r);
+        TEST_ASSERT_EQUAL(max_r, aggs[a].max_r);
+        TEST_ASSERT_EQUAL(sum_l / count, aggs[a].mean_l);
+        TEST_ASSERT_LESS_OR_EQUAL(aggs[a].max_l, aggs[a].mean_l);
+        TEST_ASSERT_GREATER_OR_EQUAL(aggs[a].min_l, aggs[a].mean_l);
+    }
+
+    // Reading from part way through
+    AggregateRow tail[10];
+    TEST_ASSERT_EQUAL(10, store.read_set(n - 10, tail, 10));
+    TEST_ASSERT_EQUAL(aggs[n - 10].time_ms, tail[0].time_ms);
+    TEST_ASSERT_EQUAL(0, store.read_set(n, tail, 10));
+}
+
+/** @brief   A set longer than the ring keeps its last minute
+ */
+void test_long_set_keeps_last_minute(void)
+{
+    static SessionStore store;
+    store.begin_rep(START_MS);
+    uint32_t rows = (STORE_AGG_SIZE + 150) * STORE_AGG_MS / STEP_MS;
+    for (uint32_t i = 0; i <= rows; i++){
+        store.add(START_MS + i * STEP_MS, 0.1f, 0.1f, 0);
+    }
+    static AggregateRow aggs[STORE_AGG_SIZE];
+    TEST_ASSERT_EQUAL(STORE_AGG_SIZE, store.read_set(0, aggs, STORE_AGG_SIZE));
+    TEST_ASSERT_EQUAL(START_MS + 150 * STORE_AGG_MS, aggs[0].time_ms);
+    TEST_ASSERT_EQUAL(START_MS + (STORE_AGG_SIZE + 149) * STORE_AGG_MS, aggs[STORE_AGG_SIZE - 1].time_ms);
+}
+
+/** @brief   Reps get their velocities and phase times, a long rest starts a
+ *           new set whose aggregates start over, and the session adds up
+ */
+void test_reps_and_sets(void)
+{
+    static SessionStore store;
+    uint32_t time_ms = add_rep(store, START_MS, -0.3f, 0.4f, false);
+    time_ms = add_rep(store, time_ms + 2000, -0.3f, 0.6f, false);
+
+    RepSummary rep;
+    TEST_ASSERT_TRUE(store.get_rep(0, rep));
+    TEST_ASSERT_EQUAL(START_MS, rep.start_ms);
+    TEST_ASSERT_EQUAL(2000, rep.duration_ms);
+    TEST_ASSERT_EQUAL(1, rep.set);
+    TEST_ASSERT_EQUAL(-300, rep.peak_down);
+    TEST_ASSERT_EQUAL(400, rep.peak_up);
+    TEST_ASSERT_EQUAL(-300, rep.mean_down);
+    TEST_ASSERT_EQUAL(400, rep.mean_up);
+    TEST_ASSERT_INT_WITHIN(STEP_MS, 1000, rep.eccentric_ms);
+    TEST_ASSERT_INT_WITHIN(STEP_MS, 1000, rep.concentric_ms);
+    TEST_ASSERT_EQUAL(450, rep.rom);
+    TEST_ASSERT_FALSE(rep.failed);
+    TEST_ASSERT_FALSE(store.get_rep(2, rep));
+
+    AggregateRow aggs[STORE_AGG_SIZE];
+    uint16_t first_set = store.read_set(0, aggs, STORE_AGG_SIZE);
+    TEST_ASSERT_GREATER_THAN(35, first_set);
+
+    // Resting past the limit starts set 2
+    time_ms = add_rep(store, time_ms + STORE_SET_REST_MS + 1, -0.3f, 0.2f, true);
+    TEST_ASSERT_TRUE(store.get_rep(2, rep));
+    TEST_ASSERT_EQUAL(2, rep.set);
+    TEST_ASSERT_TRUE(rep.failed);
+    TEST_ASSERT_EQUAL(120, rep.sticking);
+    uint16_t second_set = store.read_set(0, aggs, STORE_AGG_SIZE);
+    TEST_ASSERT_INT_WITHIN(1, 20, second_set);
+    TEST_ASSERT_GREATER_OR_EQUAL(time_ms - 2000 - STORE_AGG_MS, aggs[0].time_ms);
+
+    SessionSummary session;
+    store.get_session(session);
+    TEST_ASSERT_EQUAL(START_MS, session.start_ms);
+    TEST_ASSERT_EQUAL(2, session.reps);
+    TEST_ASSERT_EQUAL(1, session.failed);
+    TEST_ASSERT_EQUAL(2, session.sets);
+    TEST_ASSERT_EQUAL(600, session.best_up);
+    TEST_ASSERT_INT_WITHIN(3 * STEP_MS, 3000, session.up_ms);
+    TEST_ASSERT_EQUAL(3, store.rep_count());
+}
+
+/** @brief   After more reps than the ring holds the oldest are gone and the
+ *           newest are still there
+ */
+void test_rep_ring(void)
+{
+    static SessionStore store;
+    uint32_t time_ms = START_MS;
+    const uint16_t reps = STORE_REP_SIZE + 20;
+    for (uint16_t i = 0; i < reps; i++){
+        time_ms = add_rep(store, time_ms, -0.3f, 0.1f + 0.001f * i, false);
+    }
+    RepSummary rep;
+    TEST_ASSERT_EQUAL(reps, store.rep_count());
+    TEST_ASSERT_FALSE(store.get_rep(19, rep));
+    TEST_ASSERT_TRUE(store.get_rep(20, rep));
+    TEST_ASSERT_EQUAL(120, rep.peak_up);
+    TEST_ASSERT_TRUE(store.get_rep(reps - 1, rep));
+    TEST_ASSERT_EQUAL(100 + reps - 1, rep.peak_up);
+}
+
+/** @brief   A session of @c SESSION_HOURS hours, sets of reps with rests
+ *           between them and rows at the control rate the whole time, never
+ *           allocates, fits in the size of its rings, and ends with each ring
+ *           full of the newest rows
+ */
+void test_hours_long_session(void)
+{
+    static SessionStore store;
+    const size_t rings = STORE_RAW_SIZE * sizeof(RawRow) + STORE_AGG_SIZE * sizeof(AggregateRow)
+                         + (STORE_REP_SIZE + 1) * sizeof(RepSummary);
+    TEST_ASSERT_TRUE(sizeof(SessionStore) <= rings + 256);
+
+    uint32_t before = allocations;
+    const uint32_t end_ms = START_MS + SESSION_HOURS * 3600000u;
+    uint32_t time_ms = START_MS;
+    uint32_t set_start = 0;
+    uint16_t reps = 0;
+    uint8_t sets = 0;
+    while (time_ms < end_ms - 20000){
+        set_start = time_ms;
+        for (uint8_t r = 0; r < SET_REPS; r++){
+            time_ms = add_rep(store, time_ms, -0.3f, 0.3f + 0.01f * r, r == SET_REPS - 1);
+            reps++;
+        }
+        sets++;
+        for (uint32_t rest = 0; rest < REST_MS && time_ms < end_ms; rest += STEP_MS, time_ms += STEP_MS){
+            store.add(time_ms, 0.001f, -0.001f, 0);
+        }
+    }
+    TEST_ASSERT_EQUAL(0, allocations - before);
+
+    SessionSummary session;
+    store.get_session(session);
+    TEST_ASSERT_EQUAL(reps, session.reps + session.failed);
+    TEST_ASSERT_EQUAL(sets, session.failed);
+    TEST_ASSERT_EQUAL(sets, session.sets);
+    RepSummary rep;
+    TEST_ASSERT_FALSE(store.get_rep(reps - STORE_REP_SIZE - 1, rep));
+    TEST_ASSERT_TRUE(store.get_rep(reps - STORE_REP_SIZE, rep));
+    TEST_ASSERT_TRUE(store.get_rep(reps - 1, rep));
+    TEST_ASSERT_TRUE(rep.failed);
+    TEST_ASSERT_EQUAL(sets, rep.set);
+
+    static RawRow raw[STORE_RAW_SIZE + 1];
+    uint32_t row = 0;
+    TEST_ASSERT_EQUAL(STORE_RAW_SIZE, store.read_raw(row, raw, STORE_RAW_SIZE + 1));
+    TEST_ASSERT_EQUAL(time_ms - STEP_MS, raw[STORE_RAW_SIZE - 1].time_ms);
+
+    // The last set and its rest run past the ring, so only its last minute is left
+    static AggregateRow aggs[STORE_AGG_SIZE];
+    TEST_ASSERT_EQUAL(STORE_AGG_SIZE, store.read_set(0, aggs, STORE_AGG_SIZE));
+    TEST_ASSERT_GREATER_THAN(set_start, aggs[0].time_ms);
+    TEST_ASSERT_EQUAL(0, allocations - before);
+}
+
+/** @brief   Reads racing a thread which adds rows at full speed always give
+ *           back rows which follow on from each other and match their numbers
+ */
+void test_read_while_adding(void)
+{
+    static SessionStore store;
+    const uint32_t rows = 300000;
+    std::atomic<bool> done {false};
+    std::thread adder ([&done]{
+        for (uint32_t i = 0; i < rows; i++){
+            store.add(START_MS + i * STEP_MS, 0.001f * (i % 500), 0, 0);
+        }
+        done = true;
+    });
+    static RawRow raw[200];
+    static AggregateRow aggs[200];
+    uint32_t row = 0, reads = 0, bad = 0;
+    while (!done || row < rows){
+        uint16_t n = store.read_raw(row, raw, 200);
+        for (uint16_t i = 0; i < n; i++){
+            uint32_t number = row - n + i;
+            bad += raw[i].time_ms != START_MS + number * STEP_MS || raw[i].vel_r != (int16_t)(number % 500);
+        }
+        n = store.read_set(0, aggs, 200);
+        for (uint16_t i = 1; i < n; i++){
+            bad += aggs[i].time_ms != aggs[i - 1].time_ms + STORE_AGG_MS;
+        }
+        reads++;
+    }
+    adder.join();
+    TEST_ASSERT_EQUAL(0, bad);
+    TEST_ASSERT_GREATER_THAN(10, reads);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_raw_ring);
+    RUN_TEST(test_aggregates_match_rows);
+    RUN_TEST(test_long_set_keeps_last_minute);
+    RUN_TEST(test_reps_and_sets);
+    RUN_TEST(test_rep_ring);
+    RUN_TEST(test_hours_long_session);
+    RUN_TEST(test_read_while_adding);
+    return UNITY_END();
+}
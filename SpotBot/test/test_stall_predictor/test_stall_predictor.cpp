@@ -0,0 +1,286 @@
+/** @file test_stall_predictor.cpp
+ *  This program runs the stall predictor over made up bar velocity traces of
+ *  presses which fail and presses which don't, with sensor noise on top, and
+ *  checks how much warning it gives before the bar stops and that the running
+ *  sums behind its fit stay exact. It also scores it over a spread of made
+ *  up presses, printing how many it got right and wrong and the spread of
+ *  warning it gave.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include "stall_predictor.h"
+
+#define STEP_S 0.01f        ///< One 100 Hz control step
+#define NOISE 0.02f         ///< Largest noise added to the bar velocity, m/s
+#define EVAL_PRESSES 300    ///< Failing presses, and as many good ones, scored
+
+static uint32_t seed;
+
+/** @brief   Function which returns noise spread evenly over +-@c NOISE
+ */
+static float noise(void)
+{
+    seed = seed * 1664525 + 1013904223;
+    return NOISE * ((int32_t)(seed >> 8) - (1 << 23)) / (1 << 23);
+}
+
+/** @brief   Function which returns a number spread evenly between two others
+ */
+static float uniform(float low, float high)
+{
+    seed = seed * 1664525 + 1013904223;
+    return low + (high - low) * (seed >> 8) / (float)(1 << 24);
+}
+
+/** @brief   Function which makes up one step of a press which speeds up to
+ *           @c peak, holds it and then slows at @c decel until it turns back
+ *  @param   t Seconds since the press started
+ *  @param   slow_at Seconds at which it starts to slow down
+ */
+static float press(float t, float peak, float slow_at, float decel)
+{
+    if (t < 0.2f){
+        return peak * t / 0.2f;
+    }
+    if (t < slow_at){
+        return peak;
+    }
+    return peak - decel * (t - slow_at);
+}
+
+/** @brief   Function which runs a failing press through a predictor
+ *  @return  Milliseconds of warning before the bar stopped, or -1 if a stall
+ *           was never predicted before then
+ */
+static int32_t warning_ms(float peak, float decel, bool& slowed_first)
+{
+    StallPredictor predictor;
+    float stop_at = 0.5f + peak / decel;
+    slowed_first = false;
+    bool slowed = false;
+    for (uint16_t i = 0; i * STEP_S < stop_at; i++){
+        float t = i * STEP_S;
+        predictor.update(press(t, peak, 0.5f, decel) + noise());
+        slowed = slowed || predictor.slowing();
+        if (predictor.stalling()){
+            slowed_first = slowed;
+            return (int32_t)lroundf((stop_at - t) * 1000);
+        }
+    }
+    return -1;
+}
+
+void setUp(void)
+{
+    seed = 507;
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   Presses grinding to a halt at different speeds are seen coming
+ *           with at least 100 ms to spare, with the motor told to get ready
+ *           before that
+ */
+void test_grinds_predicted_early(void)
+{
+    const float peaks[] = {0.25f, 0.4f, 0.6f};
+    const float decels[] = {0.5f, 0.75f, 1.0f};
+    for (uint8_t p = 0; p < 3; p++){
+        for (uint8_t d = 0; d < 3; d++){
+            for (uint8_t run = 0; run < 10; run++){
+                bool slowed_first;
+                int32_t warning = warning_ms(peaks[p], decels[d], slowed_first);
+                TEST_ASSERT_GREATER_OR_EQUAL(100, warning);
+                TEST_ASSERT_TRUE(slowed_first);
+            }
+        }
+    }
+}
+
+/** @brief   Presses which die faster than a grind are still seen before the
+ *           bar stops, which is before the falling guard could fire; a bar
+ *           which stops in less than the window is left to that guard
+ */
+void test_fast_failures_before_stop(void)
+{
+    const float peaks[] = {0.4f, 0.6f};
+    const float decels[] = {1.5f, 2.0f};
+    for (uint8_t p = 0; p < 2; p++){
+        for (uint8_t d = 0; d < 2; d++){
+            for (uint8_t run = 0; run < 10; run++){
+                bool slowed_first;
+                TEST_ASSERT_GREATER_OR_EQUAL(20, warning_ms(peaks[p], decels[d], slowed_first));
+            }
+        }
+    }
+}
+
+/** @brief   Presses which slow through a sticking point and speed up again,
+ *           or keep a slow steady speed, are never called a stall
+ */
+void test_no_false_stalls(void)
+{
+    for (uint8_t run = 0; run < 20; run++){
+        StallPredictor predictor;
+        for (uint16_t i = 0; i < 200; i++){
+            float t = i * STEP_S;
+            // Down from 0.5 to 0.2 m/s and back up, like a bench sticking point
+            float vel = t < 0.5f ? press(t, 0.5f, 1, 1) : 0.35f + 0.15f * cosf((t - 0.5f) * 6.0f);
+            predictor.update(vel + noise());
+            TEST_ASSERT_FALSE(predictor.stalling());
+        }
+        StallPredictor steady;
+        for (uint16_t i = 0; i < 300; i++){
+            steady.update(press(i * STEP_S, 0.12f, 10, 1) + noise());
+            TEST_ASSERT_FALSE(steady.stalling());
+        }
+    }
+}
+
+/** @brief   A bar which never got going, like one being unracked, can't stall
+ */
+void test_needs_arming(void)
+{
+    StallPredictor predictor;
+    for (uint16_t i = 0; i < 100; i++){
+        predictor.update(press(i * STEP_S, STALL_ARM * 0.001f - 0.01f, 0.3f, 1.0f));
+        TEST_ASSERT_FALSE(predictor.stalling());
+        TEST_ASSERT_FALSE(predictor.slowing());
+    }
+}
+
+/** @brief   The running sums give the same line as fitting the whole window
+ *           again, after thousands of steps
+ */
+void test_fit_matches_least_squares(void)
+{
+    StallPredictor predictor;
+    int32_t history[5000];
+    for (uint16_t i = 0; i < 5000; i++){
+        float vel = 0.3f * sinf(i * 0.05f) + noise();
+        predictor.update(vel);
+        history[i] = (int32_t)(vel * 1000);
+    }
+    double mean_k = (STALL_WINDOW - 1) / 2.0, mean_v = 0;
+    for (uint8_t k = 0; k < STALL_WINDOW; k++){
+        mean_v += history[5000 - STALL_WINDOW + k];
+    }
+    mean_v /= STALL_WINDOW;
+    double num = 0, den = 0;
+    for (uint8_t k = 0; k < STALL_WINDOW; k++){
+        num += (k - mean_k) * (history[5000 - STALL_WINDOW + k] - mean_v);
+        den += (k - mean_k) * (k - mean_k);
+    }
+    double slope = num / den;
+    double newest = mean_v + slope * (STALL_WINDOW - 1 - mean_k);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, newest + slope * STALL_HORIZON, predictor.predicted());
+}
+
+/** @brief   A missing bar velocity starts the window over
+ */
+void test_nan_resets(void)
+{
+    StallPredictor predictor;
+    for (uint16_t i = 0; i < 70; i++){
+        predictor.update(press(i * STEP_S, 0.4f, 0.5f, 2.0f));
+    }
+    TEST_ASSERT_TRUE(predictor.slowing());
+    predictor.update(NAN);
+    TEST_ASSERT_FALSE(predictor.slowing());
+    TEST_ASSERT_FALSE(predictor.stalling());
+    TEST_ASSERT_EQUAL_FLOAT(0, predictor.predicted());
+}
+
+/** @brief   Over presses failing at random speeds and rates, and good presses
+ *           with random sticking points and slow steady speeds, nearly every
+ *           failure is called and no good press which stays over
+ *           @c STALL_SLOW by more than the noise is; the warning before the
+ *           bar stops is printed as percentiles
+ *  @details Failures which stop in less than the window are left to the
+ *           falling guard, so they are made to take at least that long.
+ *           Sticking points which nearly stop the bar look like a failure
+ *           until the bar speeds up again, so they are counted apart.
+ *           Presses slowing to lockout aren't in the set, since the rep
+ *           machine only acts on a stall well short of the top.
+ */
+void test_evaluate(void)
+{
+    uint16_t tp = 0, fn = 0, fp = 0, tn = 0, near_fp = 0, near_tn = 0;
+    int32_t leads[EVAL_PRESSES];
+    for (uint16_t n = 0; n < EVAL_PRESSES; n++){
+        float peak = uniform(0.2f, 0.7f);
+        float slow_at = uniform(0.3f, 0.8f);
+        float decel = uniform(0.4f, peak / (STALL_WINDOW * STEP_S));
+        float stop_at = slow_at + peak / decel;
+        StallPredictor predictor;
+        int32_t lead = -1;
+        for (uint16_t i = 0; i * STEP_S < stop_at && lead < 0; i++){
+            predictor.update(press(i * STEP_S, peak, slow_at, decel) + noise());
+            if (predictor.stalling()){
+                lead = (int32_t)lroundf((stop_at - i * STEP_S) * 1000);
+            }
+        }
+        if (lead >= 0){
+            leads[tp++] = lead;
+        }
+        else{
+            fn++;
+        }
+    }
+    for (uint16_t n = 0; n < EVAL_PRESSES; n++){
+        float peak = uniform(0.15f, 0.7f);
+        float dip = uniform(0.3f, 0.8f) * peak;
+        float rate = uniform(3.0f, 10.0f);
+        bool sticking = n % 2 == 0;
+        StallPredictor predictor;
+        bool called = false;
+        for (uint16_t i = 0; i < 300; i++){
+            float t = i * STEP_S;
+            // A dip of dip m/s and back up, or a steady press which never slows
+            float vel = !sticking || t < 0.5f ? press(t, peak, 10, 1)
+                        : peak - dip * 0.5f * (1 - cosf((t - 0.5f) * rate));
+            predictor.update(vel + noise());
+            called = called || predictor.stalling();
+        }
+        if (sticking && (peak - dip - NOISE) * 1000 < STALL_SLOW){
+            near_fp += called;
+            near_tn += !called;
+        }
+        else{
+            fp += called;
+            tn += !called;
+        }
+    }
+    std::sort(leads, leads + tp);
+    printf("failing presses: TP %u FN %u | good presses: FP %u TN %u | near stalls: FP %u TN %u\n",
+           tp, fn, fp, tn, near_fp, near_tn);
+    if (tp){
+        printf("warning before the bar stops: min %ld p10 %ld p50 %ld p90 %ld max %ld ms\n",
+               (long)leads[0], (long)leads[tp / 10], (long)leads[tp / 2],
+               (long)leads[tp * 9 / 10], (long)leads[tp - 1]);
+    }
+    TEST_ASSERT_EQUAL(0, fp);
+    TEST_ASSERT_TRUE(fn * 20 <= EVAL_PRESSES);
+    TEST_ASSERT_TRUE(tp > 0 && leads[tp / 2] >= 50);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_grinds_predicted_early);
+    RUN_TEST(test_fast_failures_before_stop);
+    RUN_TEST(test_no_false_stalls);
+    RUN_TEST(test_needs_arming);
+    RUN_TEST(test_fit_matches_least_squares);
+    RUN_TEST(test_nan_resets);
+    RUN_TEST(test_evaluate);
+    return UNITY_END();
+}
@@ -0,0 +1,166 @@
+/** @file test_tilt_monitor.cpp
+ *  This program runs the tilt monitor over the two ends of a bar pressed up
+ *  evenly, with one arm giving out slowly, and with one arm giving out at
+ *  once, and checks when it calls the bar tilted, that it doesn't flicker
+ *  on the way back to level, and that it says nothing without both IMUs.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "tilt_monitor.h"
+#include "velocity_fusion.h"
+
+#define RIGHT 0             ///< Index of the right end's IMU
+#define LEFT 1              ///< Index of the left end's IMU
+#define STEP_US 10000       ///< One 100 Hz control step
+
+static ImuVelocities velocities;
+static int64_t now_us;
+
+/** @brief   Function which runs one control step with a velocity on each end
+ *  @return  True if the bar is tilted after it
+ */
+static bool step(TiltMonitor& monitor, float right, float left)
+{
+    velocities.vel[RIGHT] = right;
+    velocities.vel[LEFT] = left;
+    monitor.update(velocities, now_us);
+    monitor.fill(velocities);
+    now_us += STEP_US;
+    return velocities.tilted;
+}
+
+void setUp(void)
+{
+    memset(&velocities, 0, sizeof(velocities));
+    velocities.count = 2;
+    velocities.health[RIGHT] = 100;
+    velocities.health[LEFT] = 100;
+    now_us = 0;
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   Both ends going up and down together, with a little difference
+ *           between them, never count as tilted
+ */
+void test_even_press(void)
+{
+    TiltMonitor monitor (RIGHT, LEFT);
+    for (uint8_t rep = 0; rep < 5; rep++){
+        for (uint16_t i = 0; i < 100; i++){
+            TEST_ASSERT_FALSE(step(monitor, -0.4f, -0.41f));
+        }
+        for (uint16_t i = 0; i < 20; i++){
+            TEST_ASSERT_FALSE(step(monitor, 0, 0));
+        }
+        for (uint16_t i = 0; i < 100; i++){
+            TEST_ASSERT_FALSE(step(monitor, 0.4f, 0.39f));
+        }
+        for (uint16_t i = 0; i < 20; i++){
+            TEST_ASSERT_FALSE(step(monitor, 0, 0));
+        }
+    }
+}
+
+/** @brief   One end rising 0.1 m/s slower is too little to count on its own,
+ *           but is called once the ends are @c TILT_ON apart
+ */
+void test_slow_tilt(void)
+{
+    TiltMonitor monitor (RIGHT, LEFT);
+    step(monitor, 0.4f, 0.3f);
+    // 0.1 m/s apart reaches 0.05 m after 50 steps
+    for (uint16_t i = 1; i < 49; i++){
+        TEST_ASSERT_FALSE(step(monitor, 0.4f, 0.3f));
+    }
+    uint8_t more = 0;
+    while (!step(monitor, 0.4f, 0.3f)){
+        TEST_ASSERT_LESS_THAN(4, ++more);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.002f, TILT_ON, velocities.tilt);
+}
+
+/** @brief   One arm giving out at once is called after @c TILT_DIFF_STEPS,
+ *           well before the ends are far apart, whichever end it is
+ */
+void test_sudden_tilt(void)
+{
+    TiltMonitor monitor (RIGHT, LEFT);
+    for (uint8_t i = 1; i < TILT_DIFF_STEPS; i++){
+        TEST_ASSERT_FALSE(step(monitor, 0.3f, 0.1f));
+    }
+    TEST_ASSERT_TRUE(step(monitor, 0.3f, 0.1f));
+    TEST_ASSERT_LESS_THAN_FLOAT(TILT_OFF, velocities.tilt);
+
+    TiltMonitor other (RIGHT, LEFT);
+    for (uint8_t i = 1; i < TILT_DIFF_STEPS; i++){
+        step(other, -0.1f, 0.1f);
+    }
+    TEST_ASSERT_TRUE(step(other, -0.1f, 0.1f));
+    TEST_ASSERT_LESS_THAN_FLOAT(0, velocities.diff_vel);
+}
+
+/** @brief   A tilt stays called until the ends are back within @c TILT_OFF
+ *           and moving together, and a still bar starts over from level
+ */
+void test_hysteresis(void)
+{
+    TiltMonitor monitor (RIGHT, LEFT);
+    while (!step(monitor, 0.3f, 0.1f));
+    for (uint8_t i = 0; i < 50; i++){
+        step(monitor, 0.3f, 0.1f);
+    }
+    // Left end catching up, still tilted until the ends are nearly level
+    float tilt = velocities.tilt;
+    while (velocities.tilt > TILT_OFF){
+        TEST_ASSERT_TRUE(step(monitor, 0.1f, 0.2f));
+    }
+    TEST_ASSERT_LESS_THAN_FLOAT(tilt, velocities.tilt);
+    while (velocities.tilt > TILT_OFF - 0.01f){
+        step(monitor, 0.1f, 0.2f);
+    }
+    // A difference between the on and off speeds still holds the tilt
+    TEST_ASSERT_TRUE(step(monitor, 0.2f, 0.1f));
+    TEST_ASSERT_FALSE(step(monitor, 0.2f, 0.2f));
+
+    TEST_ASSERT_FALSE(step(monitor, 0, 0));
+    TEST_ASSERT_EQUAL_FLOAT(0, velocities.tilt);
+}
+
+/** @brief   Without both ends fresh and healthy nothing is reported, and the
+ *           tilt starts over once they are back
+ */
+void test_needs_both(void)
+{
+    TiltMonitor monitor (RIGHT, LEFT);
+    while (!step(monitor, 0.3f, 0.1f));
+    velocities.stale = 1 << LEFT;
+    TEST_ASSERT_FALSE(step(monitor, 0.3f, 0.1f));
+    TEST_ASSERT_EQUAL_FLOAT(0, velocities.tilt);
+    velocities.stale = 0;
+    velocities.health[RIGHT] = FUSE_MIN_HEALTH - 1;
+    TEST_ASSERT_FALSE(step(monitor, 0.3f, 0.1f));
+    velocities.health[RIGHT] = 100;
+    TEST_ASSERT_FALSE(step(monitor, 0.3f, 0.1f));
+    TEST_ASSERT_EQUAL_FLOAT(0, velocities.tilt);
+
+    TiltMonitor missing (RIGHT, 2);
+    TEST_ASSERT_FALSE(step(missing, 0.3f, 0.1f));
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_even_press);
+    RUN_TEST(test_slow_tilt);
+    RUN_TEST(test_sudden_tilt);
+    RUN_TEST(test_hysteresis);
+    RUN_TEST(test_needs_both);
+    return UNITY_END();
+}
@@ -0,0 +1,224 @@
+/** @file test_velocity_estimator.cpp
+ *  This program replays made up IMU samples through the velocity estimator
+ *  while the sample rate is dropped for the rack and brought back up, the way
+ *  task_IMU does it, and checks that the decimation follows the rate and that
+ *  a lift which starts in the slow samples comes out the same as one sampled
+ *  at full rate the whole time. It also times how long a lift takes to show
+ *  up as a velocity just after the rate is brought back up.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include "velocity_estimator.h"
+
+#define TICKS_PER_MS2 1825.5f ///< Accelerometer ticks per m/s^2, as in main
+#define FAST_US 1000        ///< Sample spacing at the full rate
+#define SLOW_US 5000        ///< Sample spacing while racked
+#define FAST_FACTOR 10      ///< Decimation down to 100 Hz at the full rate
+#define SLOW_FACTOR 2       ///< Decimation down to 100 Hz while racked
+#define LIFT_MS2 2.0f       ///< Acceleration of the made up lift, m/s^2
+#define LIFT_S 0.3f         ///< Time spent speeding up, then as long slowing down
+
+/** @brief   Velocity estimator which shows its decimation factor and its
+ *           quiet check
+ */
+class ProbedEstimator : public VelocityEstimator
+{
+public:
+    ProbedEstimator (void) : VelocityEstimator (TICKS_PER_MS2, 0.3f, 1000, 10) {}
+    uint16_t factor(void) { return decimator.get_factor(); }
+    bool quiet(int32_t accel_vert, const ImuSample& s) { return update_still(accel_vert, s); }
+};
+
+static uint32_t seed;
+
+/** @brief   Function which makes up a sample of a level IMU
+ *  @param   accel Vertical acceleration, m/s^2
+ */
+static ImuSample sample(float accel)
+{
+    seed = seed * 1664525 + 1013904223;
+    int16_t noise = (int16_t)((seed >> 16) % 41) - 20;
+    ImuSample s = {noise, (int16_t)-noise, (int16_t)lroundf((9.81f + accel) * TICKS_PER_MS2 + noise), 0, 0, 0};
+    return s;
+}
+
+/** @brief   Function which returns the made up lift's acceleration
+ *  @param   t Seconds since the lift started
+ */
+static float lift(float t)
+{
+    return t < 0 ? 0 : t < LIFT_S ? LIFT_MS2 : t < 2 * LIFT_S ? -LIFT_MS2 : 0;
+}
+
+/** @brief   Function which runs a still bar, then a lift, through an estimator
+ *  @param   slow_until_us Time until which samples come at the slow rate,
+ *           zero to sample at full rate the whole time
+ *  @param   peak Filled with the fastest velocity seen, um/s
+ *  @return  Velocity a second after the lift, um/s
+ */
+static int32_t replay(ProbedEstimator& est, int64_t slow_until_us, int32_t& peak)
+{
+    const int64_t rack_us = 1000000;
+    const int64_t lift_us = 3000000;
+    int64_t t = 0;
+    peak = 0;
+    while (t < lift_us + 2000000){
+        bool slow = t >= rack_us && t < slow_until_us;
+        int32_t vel = est.update(sample(lift((t - lift_us) * 1e-6f)), t);
+        peak = vel > peak ? vel : peak;
+        if (slow && t > rack_us + 100000 && t < lift_us){
+            TEST_ASSERT_EQUAL(SLOW_FACTOR, est.factor());
+        }
+        if (!slow && t > slow_until_us + 100000){
+            TEST_ASSERT_EQUAL(FAST_FACTOR, est.factor());
+        }
+        t += slow ? SLOW_US : FAST_US;
+    }
+    return est.get_velocity();
+}
+
+/** @brief   Function which runs a bar still at the slow rate, brings the rate
+ *           back up and then lifts, and times the first velocity
+ *  @param   switch_us Time the rate goes up, zero to sample fast throughout
+ *  @param   lift_us Time the lift starts
+ *  @param   moved_early Set if any velocity came out before the lift
+ *  @return  Time from the start of the lift to the first velocity which
+ *           isn't zero, or -1 if none came within a second
+ */
+static int64_t first_motion_us(int64_t switch_us, int64_t lift_us, bool& moved_early)
+{
+    ProbedEstimator est;
+    moved_early = false;
+    int64_t t = 0;
+    while (t < lift_us + 1000000){
+        int32_t vel = est.update(sample(lift((t - lift_us) * 1e-6f)), t);
+        if (vel != 0){
+            if (t < lift_us){
+                moved_early = true;
+            }
+            else{
+                return t - lift_us;
+            }
+        }
+        t += t < switch_us ? SLOW_US : FAST_US;
+    }
+    return -1;
+}
+
+void setUp(void)
+{
+    seed = 507;
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   A still bar stays still through the rate going down and back up
+ */
+void test_still_through_switch(void)
+{
+    ProbedEstimator est;
+    int64_t t = 0;
+    for (uint16_t i = 0; i < 3000; i++){
+        bool slow = i >= 1000 && i < 2000;
+        TEST_ASSERT_INT_WITHIN(20000, 0, est.update(sample(0), t));
+        t += slow ? SLOW_US : FAST_US;
+    }
+    TEST_ASSERT_EQUAL(FAST_FACTOR, est.factor());
+}
+
+/** @brief   A lift whose first 50 ms are sampled slowly, before the rate is
+ *           brought back up, reaches the same speed as one sampled fast, and
+ *           both come back to rest
+ */
+void test_lift_across_switch(void)
+{
+    ProbedEstimator fast;
+    int32_t fast_peak;
+    int32_t fast_end = replay(fast, 0, fast_peak);
+
+    ProbedEstimator switched;
+    int32_t switched_peak;
+    int32_t switched_end = replay(switched, 3050000, switched_peak);
+
+    TEST_ASSERT_INT_WITHIN(30000, (int32_t)(LIFT_MS2 * LIFT_S * 1e6f), fast_peak);
+    TEST_ASSERT_INT_WITHIN(10000, fast_peak, switched_peak);
+    TEST_ASSERT_INT_WITHIN(20000, 0, fast_end);
+    TEST_ASSERT_INT_WITHIN(20000, 0, switched_end);
+}
+
+/** @brief   One late sample doesn't switch the decimation
+ */
+void test_one_gap_ignored(void)
+{
+    ProbedEstimator est;
+    int64_t t = 0;
+    for (uint16_t i = 0; i < 500; i++){
+        est.update(sample(0), t);
+        t += i == 250 ? SLOW_US : FAST_US;
+        TEST_ASSERT_EQUAL(FAST_FACTOR, est.factor());
+    }
+}
+
+/** @brief   A bar spun fast enough to saturate the gyro axes is never quiet,
+ *           even with no vertical acceleration
+ */
+void test_saturated_gyro_not_quiet(void)
+{
+    const int16_t spins[][3] = {{32767, 32767, 32767}, {-32768, -32768, -32768}, {-32768, 0, -32768}};
+    for (uint8_t i = 0; i < 3; i++){
+        ProbedEstimator est;
+        ImuSample s = {0, 0, 0, spins[i][0], spins[i][1], spins[i][2]};
+        for (uint16_t n = 0; n < 3 * ZUPT_WINDOW; n++){
+            TEST_ASSERT_FALSE(est.quiet(0, s));
+        }
+    }
+    ProbedEstimator still;
+    ImuSample s = {0, 0, 0, 10, -10, 10};
+    for (uint16_t n = 1; n < ZUPT_WINDOW; n++){
+        still.quiet(0, s);
+    }
+    TEST_ASSERT_TRUE(still.quiet(0, s));
+}
+
+/** @brief   A lift which starts at, or soon after, the rate going from 200 Hz
+ *           back to 1 kHz shows up as a velocity at most one slow sample and
+ *           one control step later than with the rate up all along, and the
+ *           switch itself never makes a still bar move
+ */
+void test_first_motion_after_switch(void)
+{
+    const int64_t switch_us = 2000000;
+    bool moved_early;
+    int64_t fast = first_motion_us(0, switch_us, moved_early);
+    TEST_ASSERT_FALSE(moved_early);
+    TEST_ASSERT_GREATER_THAN(0, fast);
+    printf("1 kHz all along: first velocity %lld ms into the lift\n", (long long)fast / 1000);
+
+    const int64_t delays[] = {0, 5000, 10000, 20000, 50000, 100000, 300000};
+    for (uint8_t i = 0; i < sizeof(delays) / sizeof(delays[0]); i++){
+        int64_t latency = first_motion_us(switch_us, switch_us + delays[i], moved_early);
+        printf("lift %3lld ms after 200 Hz -> 1 kHz: first velocity %lld ms into the lift\n",
+               (long long)delays[i] / 1000, (long long)latency / 1000);
+        TEST_ASSERT_FALSE(moved_early);
+        TEST_ASSERT_GREATER_THAN(0, latency);
+        TEST_ASSERT_TRUE(latency <= fast + SLOW_US + FAST_FACTOR * FAST_US);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_still_through_switch);
+    RUN_TEST(test_lift_across_switch);
+    RUN_TEST(test_one_gap_ignored);
+    RUN_TEST(test_saturated_gyro_not_quiet);
+    RUN_TEST(test_first_motion_after_switch);
+    return UNITY_END();
+}
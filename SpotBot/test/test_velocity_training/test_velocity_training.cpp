@@ -0,0 +1,181 @@
+/** @file test_velocity_training.cpp
+ *  This program checks the velocity based training numbers against sets with
+ *  answers worked out by hand: the line fit, velocity loss, reps in reserve
+ *  and the 1RM from the load-velocity profile.
+ *
+ *  @author agent
+ *  @date   10-17-26
+ */
+
+#include <unity.h>
+#include <string.h>
+#include "velocity_training.h"
+
+#define MVT 0.17f           ///< Bench press minimum velocity threshold, m/s
+
+/** @brief   Function which makes up the summary of a rep
+ */
+static RepSummary make_rep(uint8_t set, int16_t mean_up, bool failed = false)
+{
+    RepSummary rep;
+    memset(&rep, 0, sizeof(rep));
+    rep.set = set;
+    rep.mean_up = mean_up;
+    rep.failed = failed;
+    return rep;
+}
+
+/** @brief   Function which lifts a set whose fastest rep follows the line
+ *           v = 1.2 - 0.01 * load, slowing by 30 mm/s a rep
+ */
+static void lift_set(VelocityTraining& training, uint8_t set, float load_kg, uint8_t reps)
+{
+    int16_t first = (int16_t)(1200 - 10 * load_kg);
+    for (uint8_t i = 0; i < reps; i++){
+        training.add_rep(make_rep(set, first - 30 * i), load_kg);
+    }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/** @brief   Points on a line give that line back, scaling them all doesn't
+ *           move it, and points at one x can't be fit
+ */
+void test_line_fit(void)
+{
+    LineFit fit;
+    float slope, intercept;
+    TEST_ASSERT_FALSE(fit.solve(slope, intercept));
+    for (uint8_t i = 0; i < 6; i++){
+        fit.add(20.0f * i, 3.0f - 0.5f * i);
+    }
+    TEST_ASSERT_TRUE(fit.solve(slope, intercept));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, -0.025f, slope);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 3.0f, intercept);
+    fit.scale(0.3f);
+    TEST_ASSERT_TRUE(fit.solve(slope, intercept));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, -0.025f, slope);
+
+    // Sets at one load, faded by different amounts so rounding creeps in
+    LineFit flat;
+    for (uint8_t i = 0; i < 10; i++){
+        flat.scale(0.8f);
+        flat.add(62.5f, 0.5f - 0.01f * i);
+        TEST_ASSERT_FALSE(flat.solve(slope, intercept));
+    }
+}
+
+/** @brief   Velocity loss is against the fastest rep, not the first, and the
+ *           set is flagged to stop once it reaches the limit
+ */
+void test_velocity_loss(void)
+{
+    VelocityTraining training (MVT);
+    training.set_loss_limit(20);
+    const int16_t reps[] = {480, 500, 470, 440, 410, 395};
+    TrainingStatus status;
+    for (uint8_t i = 0; i < 6; i++){
+        training.add_rep(make_rep(1, reps[i]), 0);
+        training.get_status(status);
+        TEST_ASSERT_EQUAL(i == 5, status.stop);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 21.0f, training.loss());
+    TEST_ASSERT_EQUAL(500, status.best_mm_s);
+    TEST_ASSERT_EQUAL(395, status.last_mm_s);
+    TEST_ASSERT_EQUAL(6, status.reps);
+    TEST_ASSERT_EQUAL(1, status.set);
+}
+
+/** @brief   Reps in reserve carry the set's slowdown on to the minimum
+ *           velocity threshold, and a failed rep leaves none
+ */
+void test_reps_in_reserve(void)
+{
+    VelocityTraining training (MVT);
+    training.add_rep(make_rep(1, 500), 0);
+    TEST_ASSERT_EQUAL_FLOAT(-1, training.reps_in_reserve());
+    training.add_rep(make_rep(1, 450), 0);
+    training.add_rep(make_rep(1, 400), 0);
+    // v = 0.55 - 0.05 * rep reaches 0.17 at rep 7.6, three reps are done
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 4.6f, training.reps_in_reserve());
+
+    training.add_rep(make_rep(1, 120, true), 0);
+    TEST_ASSERT_EQUAL_FLOAT(0, training.reps_in_reserve());
+    // The failed rep's speed doesn't count as the last rep
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 20.0f, training.loss());
+
+    // A set which isn't slowing down can't say
+    VelocityTraining fresh (MVT);
+    fresh.add_rep(make_rep(1, 400), 0);
+    fresh.add_rep(make_rep(1, 420), 0);
+    TEST_ASSERT_EQUAL_FLOAT(-1, fresh.reps_in_reserve());
+}
+
+/** @brief   The 1RM is where the load-velocity line reaches the minimum
+ *           velocity threshold: 1.2 - 0.01 * load = 0.17 at 103 kg
+ */
+void test_one_rm(void)
+{
+    VelocityTraining training (MVT);
+    lift_set(training, 1, 40, 5);
+    TEST_ASSERT_EQUAL_FLOAT(-1, training.one_rm());
+    lift_set(training, 2, 60, 4);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 103, training.one_rm());
+    lift_set(training, 3, 80, 3);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 103, training.one_rm());
+
+    // Sets with no load given don't go into the profile
+    lift_set(training, 4, 0, 3);
+    training.add_rep(make_rep(5, 300), 90);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 103, training.one_rm());
+}
+
+/** @brief   The estimate made during a set is the one kept once the next set
+ *           starts, and a lifter getting stronger pulls it up as older sets
+ *           fade
+ */
+void test_one_rm_follows_lifter(void)
+{
+    VelocityTraining training (MVT);
+    lift_set(training, 1, 40, 3);
+    lift_set(training, 2, 60, 3);
+    // Off the line, so how much each set counts matters
+    training.add_rep(make_rep(3, 450), 80);
+    float during = training.one_rm();
+    // A first rep with no load leaves only the finished sets in the fit
+    training.add_rep(make_rep(4, 500), 0);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, during, training.one_rm());
+
+    // Same loads moving 100 mm/s faster, a 10 kg stronger lifter
+    VelocityTraining stronger (MVT);
+    lift_set(stronger, 1, 40, 3);
+    lift_set(stronger, 2, 60, 3);
+    float before = stronger.one_rm();
+    for (uint8_t set = 3; set < 20; set++){
+        float load = set % 2 ? 50 : 70;
+        stronger.add_rep(make_rep(set, (int16_t)(1300 - 10 * load)), load);
+    }
+    float after = stronger.one_rm();
+    TEST_ASSERT_GREATER_THAN_FLOAT(before + 9, after);
+    TEST_ASSERT_LESS_THAN_FLOAT(before + 10.5f, after);
+
+    stronger.reset(MVT);
+    TEST_ASSERT_EQUAL_FLOAT(-1, stronger.one_rm());
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_line_fit);
+    RUN_TEST(test_velocity_loss);
+    RUN_TEST(test_reps_in_reserve);
+    RUN_TEST(test_one_rm);
+    RUN_TEST(test_one_rm_follows_lifter);
+    return UNITY_END();
+}
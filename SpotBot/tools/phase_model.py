@@ -0,0 +1,409 @@
+#!/usr/bin/env python3
+"""@file phase_model.py
+This script trains the phase classifier's tree ensemble from labeled bar
+velocity and writes it out as the int8 tables in phase_classifier.cpp.
+
+The features are worked out exactly the way PhaseClassifier::update() does it,
+in int8, so the thresholds the trees learn are the ones the ESP32 compares.
+The trees are grown with AdaBoost (SAMME) on weighted Gini splits, each no
+deeper than PHASE_DEPTH, and every leaf keeps the boosted share of each phase
+which is then scaled into int8.
+
+Labeled data is one CSV per recording, one row per control step (100 Hz) of
+@c bar_vel in m/s and @c phase, which is one of still, down, up or fail. The
+classifier's window is emptied at the start of every file and at any blank
+line. With no recordings the script can make up synthetic sets of reps
+instead, which is what the tables in the repo were trained on.
+
+Only the Python standard library is used so the script runs anywhere.
+
+Examples:
+    python tools/phase_model.py --synthetic 400 --write src/phase_classifier.cpp
+    python tools/phase_model.py sets/*.csv --print
+
+@author agent
+@date   10-17-26
+"""
+
+import argparse
+import csv
+import math
+import random
+import re
+import sys
+
+# These have to match phase_classifier.h
+PHASE_STILL, PHASE_DOWN, PHASE_UP, PHASE_FAIL = range(4)
+PHASE_CLASSES = 4
+PHASE_WINDOW = 16
+PHASE_UNIT = 10
+PHASE_TREES = 3
+PHASE_DEPTH = 4
+FEATURES = ["FEAT_NOW", "FEAT_MEAN", "FEAT_SLOPE", "FEAT_MIN", "FEAT_MAX", "FEAT_PEAK"]
+NAMES = ["still", "down", "up", "fail"]
+
+REP_HZ = 100           # Control steps per second
+MIN_LEAF = 40          # Fewest samples a leaf may be grown from
+BEGIN_MARK = "// BEGIN PHASE MODEL"
+END_MARK = "// END PHASE MODEL"
+
+
+def quantize(vel):
+    """Quantizes a velocity in m/s the same way phase_classifier.cpp does"""
+    q = vel * (1000.0 / PHASE_UNIT)
+    q = 127.0 if q > 127 else -127.0 if q < -127 else q
+    return int(q - 0.5) if q < 0 else int(q + 0.5)
+
+
+def features(recording):
+    """Runs a recording through the classifier's window
+    @param recording List of (bar velocity, phase) pairs
+    @return List of (feature tuple, phase) pairs, one for every step after the
+            window filled
+    """
+    out = []
+    window = [0] * PHASE_WINDOW
+    idx = fill = total = peak = 0
+    for vel, phase in recording:
+        v = quantize(vel)
+        if fill == PHASE_WINDOW:
+            total -= window[idx]
+        else:
+            fill += 1
+        window[idx] = v
+        total += v
+        idx = (idx + 1) % PHASE_WINDOW
+        peak = 0 if v <= 0 else max(v, peak)
+        if fill < PHASE_WINDOW:
+            continue
+        slope = max(-127, min(127, v - window[idx]))
+        # C division of a negative sum rounds toward zero
+        mean = int(total / PHASE_WINDOW)
+        out.append(((v, mean, slope, min(window), max(window), peak), phase))
+    return out
+
+
+# ---------------------------------------------------------------------------
+# Labeled data
+
+def read_csv(path):
+    """Reads one recording, split into pieces at blank lines"""
+    recordings = [[]]
+    with open(path, newline="") as f:
+        for row in csv.reader(f):
+            if not row or not row[0].strip():
+                recordings.append([])
+                continue
+            try:
+                vel = float(row[0])
+            except ValueError:
+                continue    # header
+            label = row[1].strip().lower()
+            phase = NAMES.index(label) if label in NAMES else int(label)
+            recordings[-1].append((vel, phase))
+    return [r for r in recordings if r]
+
+
+def synthetic_set(rng):
+    """Makes up one set of reps, labeled, like a lifter on a bench or squat
+    @details The set starts and ends in the rack. Bench reps pause on the
+             chest and squat reps may bounce out of the bottom. Some ascents
+             grind through a sticking point slower than the rep machine's move
+             speed without stopping, and the last rep of some sets fails: the
+             bar slows to a stop and sinks back, labeled as failing from once
+             it has lost half its speed.
+    """
+    rec = []
+    noise = rng.uniform(0.002, 0.005)
+
+    def add(vels, phase):
+        for v in vels:
+            rec.append((v + rng.gauss(0, noise), phase))
+
+    def still(seconds):
+        add([0.0] * int(seconds * REP_HZ), PHASE_STILL)
+
+    def sine(seconds, peak, start=0.0, end=math.pi):
+        n = max(int(seconds * REP_HZ), 2)
+        return [peak * math.sin(start + (end - start) * (i + 0.5) / n) for i in range(n)]
+
+    bounce = rng.random() < 0.4
+    fails = rng.random() < 0.4
+    reps = rng.randint(1, 6)
+    still(rng.uniform(0.5, 2.0))
+    for rep in range(reps):
+        add([-v for v in sine(rng.uniform(0.7, 2.0), rng.uniform(0.2, 0.7))], PHASE_DOWN)
+        if not bounce:
+            still(rng.uniform(0.15, 0.8))
+        kind = rng.random()
+        if fails and rep == reps - 1:
+            peak = rng.uniform(0.1, 0.35)
+            rise = sine(rng.uniform(0.2, 0.5), peak, 0, math.pi / 2)
+            add(rise, PHASE_UP)
+            fall = rng.uniform(0.3, 0.9)
+            sink = rng.uniform(0.03, 0.15)
+            n = int(fall * REP_HZ)
+            slow = [peak * (1 - (i + 1) / n) for i in range(n)]
+            slow += [-sink * math.sin(math.pi / 2 * (i + 1) / 30) for i in range(30)]
+            slow += [-sink] * rng.randint(10, 40)
+            for v in slow:
+                add([v], PHASE_UP if v > peak / 2 else PHASE_FAIL)
+            return rec
+        elif kind < 0.3:
+            # Grind, the bar crawls through the sticking point then finishes
+            peak = rng.uniform(0.15, 0.4)
+            crawl = rng.uniform(0.006, 0.04)
+            add(sine(rng.uniform(0.2, 0.4), peak, 0, math.pi / 2), PHASE_UP)
+            n = int(rng.uniform(0.2, 0.4) * REP_HZ)
+            add([peak + (crawl - peak) * (i + 1) / n for i in range(n)], PHASE_UP)
+            add([crawl] * int(rng.uniform(0.4, 1.5) * REP_HZ), PHASE_UP)
+            add([crawl + v for v in sine(rng.uniform(0.4, 0.8), rng.uniform(0.1, 0.3))], PHASE_UP)
+        else:
+            add(sine(rng.uniform(0.6, 1.6), rng.uniform(0.25, 0.8)), PHASE_UP)
+        still(rng.uniform(0.3, 1.2))
+    still(rng.uniform(0.5, 1.0))
+    return rec
+
+
+# ---------------------------------------------------------------------------
+# Training
+
+class Node:
+    def __init__(self, feature=-1, threshold=0, left=None, right=None, dist=None):
+        self.feature = feature
+        self.threshold = threshold
+        self.left = left
+        self.right = right
+        self.dist = dist
+
+
+def gini(counts):
+    total = sum(counts)
+    if total <= 0:
+        return 0.0
+    return 1.0 - sum((c / total) ** 2 for c in counts)
+
+
+def grow(samples, weights, rows, depth):
+    """Grows one tree of at most @c depth splits on the rows given"""
+    counts = [0.0] * PHASE_CLASSES
+    for r in rows:
+        counts[samples[r][1]] += weights[r]
+    total = sum(counts)
+    dist = [c / total for c in counts]
+    if depth == 0 or len(rows) < 2 * MIN_LEAF or max(dist) > 0.995:
+        return Node(dist=dist)
+
+    best = None
+    parent = gini(counts) * total
+    for f in range(len(FEATURES)):
+        # Weight of each class at each int8 value, then sweep the thresholds
+        hist = {}
+        for r in rows:
+            value = samples[r][0][f]
+            h = hist.setdefault(value, [0.0] * (PHASE_CLASSES + 1))
+            h[samples[r][1]] += weights[r]
+            h[PHASE_CLASSES] += 1
+        left = [0.0] * PHASE_CLASSES
+        n_left = 0
+        for value in sorted(hist)[:-1]:
+            h = hist[value]
+            for c in range(PHASE_CLASSES):
+                left[c] += h[c]
+            n_left += h[PHASE_CLASSES]
+            if n_left < MIN_LEAF or len(rows) - n_left < MIN_LEAF:
+                continue
+            right = [counts[c] - left[c] for c in range(PHASE_CLASSES)]
+            cost = gini(left) * sum(left) + gini(right) * sum(right)
+            if best is None or cost < best[0]:
+                best = (cost, f, value)
+    if best is None or best[0] >= parent - 1e-9 * total:
+        return Node(dist=dist)
+
+    _, f, threshold = best
+    lo = [r for r in rows if samples[r][0][f] <= threshold]
+    hi = [r for r in rows if samples[r][0][f] > threshold]
+    node = Node(f, threshold, grow(samples, weights, lo, depth - 1), grow(samples, weights, hi, depth - 1))
+    # A split whose sides agree only costs time on the ESP32
+    if node.left.feature < 0 and node.right.feature < 0:
+        if argmax(node.left.dist) == argmax(node.right.dist):
+            return Node(dist=dist)
+    return node
+
+
+def argmax(values):
+    return max(range(len(values)), key=lambda i: values[i])
+
+
+def walk(node, feats):
+    while node.feature >= 0:
+        node = node.left if feats[node.feature] <= node.threshold else node.right
+    return node
+
+
+def train(samples, trees):
+    """Boosts @c trees trees, returns a list of (root, alpha)"""
+    weights = [1.0 / len(samples)] * len(samples)
+    rows = list(range(len(samples)))
+    model = []
+    for _ in range(trees):
+        root = grow(samples, weights, rows, PHASE_DEPTH)
+        wrong = [argmax(walk(root, s[0]).dist) != s[1] for s in samples]
+        err = sum(w for w, bad in zip(weights, wrong) if bad) / sum(weights)
+        err = min(max(err, 1e-6), 1 - 1e-6)
+        alpha = math.log((1 - err) / err) + math.log(PHASE_CLASSES - 1)
+        model.append((root, alpha))
+        weights = [w * math.exp(alpha) if bad else w for w, bad in zip(weights, wrong)]
+        total = sum(weights)
+        weights = [w / total for w in weights]
+    return model
+
+
+# ---------------------------------------------------------------------------
+# Exporting
+
+def export(model):
+    """Flattens the trees into the int8 tables
+    @return (leaf rows, node rows, roots), leaf rows scaled so the largest
+            score is 127
+    """
+    top = max(alpha * max(n.dist) for root, alpha in model for n in leaves_of(root))
+    scale = 127.0 / top
+    leaves = []
+    nodes = []
+    roots = []
+
+    def flatten(node, alpha):
+        at = len(nodes)
+        nodes.append(None)
+        if node.feature < 0:
+            row = tuple(int(round(alpha * p * scale)) for p in node.dist)
+            if row not in leaves:
+                leaves.append(row)
+            nodes[at] = (-1, 0, leaves.index(row), 0, NAMES[argmax(node.dist)])
+        else:
+            left = flatten(node.left, alpha)
+            right = flatten(node.right, alpha)
+            nodes[at] = (node.feature, node.threshold, left, right, "")
+        return at
+
+    for root, alpha in model:
+        roots.append(flatten(root, alpha))
+    if len(nodes) > 255 or len(leaves) > 255:
+        sys.exit("model is too big for uint8 indexes")
+    return leaves, nodes, roots
+
+
+def leaves_of(node):
+    if node.feature < 0:
+        return [node]
+    return leaves_of(node.left) + leaves_of(node.right)
+
+
+def classify(tables, feats):
+    """Runs the exported tables the way PhaseClassifier::update() does"""
+    leaves, nodes, roots = tables
+    scores = [0] * PHASE_CLASSES
+    for root in roots:
+        at = root
+        for _ in range(PHASE_DEPTH):
+            if nodes[at][0] < 0:
+                break
+            at = nodes[at][2] if feats[nodes[at][0]] <= nodes[at][1] else nodes[at][3]
+        if nodes[at][0] < 0:
+            for c in range(PHASE_CLASSES):
+                scores[c] += leaves[nodes[at][2]][c]
+    best = 0
+    for c in range(PHASE_CLASSES):
+        best = c if scores[c] > scores[best] else best
+    return best
+
+
+def source(tables, note):
+    leaves, nodes, roots = tables
+    lines = [BEGIN_MARK, "// Made by tools/phase_model.py " + note + ", don't edit by hand", ""]
+    lines.append("/// Leaf scores for still, down, up and fail")
+    lines.append("static const int8_t phase_leaves[][PHASE_CLASSES] =")
+    lines.append("{")
+    for i, row in enumerate(leaves):
+        lines.append("    {%s},    // %d" % (", ".join("%3d" % v for v in row), i))
+    lines.append("};")
+    lines.append("")
+    lines.append("/// Nodes of every tree, feature -1 marks a leaf")
+    lines.append("static const PhaseNode phase_nodes[] =")
+    lines.append("{")
+    for i, (f, threshold, left, right, name) in enumerate(nodes):
+        if i in roots:
+            lines.append("    // Tree %d" % roots.index(i))
+        feature = (FEATURES[f] + ",").ljust(12) if f >= 0 else "-1,".ljust(12)
+        comment = "// %d %s" % (i, name) if name else "// %d" % i
+        lines.append("    {%s%4d, %3d, %3d},   %s" % (feature, threshold, left, right, comment))
+    lines.append("};")
+    lines.append("")
+    lines.append("/// Root node of every tree")
+    lines.append("static const uint8_t phase_roots[PHASE_TREES] = {%s};" % ", ".join(map(str, roots)))
+    lines.append(END_MARK)
+    return "\n".join(lines)
+
+
+def report(title, tables, samples):
+    right = [[0] * PHASE_CLASSES for _ in range(PHASE_CLASSES)]
+    for feats, phase in samples:
+        right[phase][classify(tables, feats)] += 1
+    total = sum(map(sum, right))
+    correct = sum(right[c][c] for c in range(PHASE_CLASSES))
+    print("%s: %.1f%% of %d steps" % (title, 100.0 * correct / total, total), file=sys.stderr)
+    for c in range(PHASE_CLASSES):
+        n = sum(right[c])
+        print("  %-5s %5.1f%%  %s" % (NAMES[c], 100.0 * right[c][c] / max(n, 1),
+              " ".join("%6d" % v for v in right[c])), file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    parser.add_argument("csv", nargs="*", help="labeled recordings, bar_vel,phase per control step")
+    parser.add_argument("--synthetic", type=int, default=0, help="number of made up sets to train on as well")
+    parser.add_argument("--seed", type=int, default=507, help="seed for the made up sets")
+    parser.add_argument("--trees", type=int, default=PHASE_TREES, help="trees to boost, up to PHASE_TREES")
+    parser.add_argument("--holdout", type=float, default=0.25, help="share of recordings kept out to test on")
+    parser.add_argument("--write", metavar="CPP", help="replace the tables in this phase_classifier.cpp")
+    parser.add_argument("--print", action="store_true", help="print the tables")
+    args = parser.parse_args()
+
+    recordings = []
+    for path in args.csv:
+        recordings += read_csv(path)
+    rng = random.Random(args.seed)
+    recordings += [synthetic_set(rng) for _ in range(args.synthetic)]
+    if not recordings:
+        parser.error("no recordings, give some CSV files or --synthetic")
+    if args.trees < 1 or args.trees > PHASE_TREES:
+        parser.error("--trees must be 1 to %d" % PHASE_TREES)
+
+    rng.shuffle(recordings)
+    cut = int(len(recordings) * args.holdout)
+    train_set = [s for r in recordings[cut:] for s in features(r)]
+    test_set = [s for r in recordings[:cut] for s in features(r)]
+    tables = export(train(train_set, args.trees))
+    report("train", tables, train_set)
+    if test_set:
+        report("held out", tables, test_set)
+
+    note = "from %d recordings" % len(args.csv) if args.csv else ""
+    if args.synthetic:
+        note = (note + " and " if note else "from ") + "%d synthetic sets, seed %d" % (args.synthetic, args.seed)
+    text = source(tables, note)
+    if args.print or not args.write:
+        print(text)
+    if args.write:
+        with open(args.write) as f:
+            cpp = f.read()
+        pattern = re.compile(re.escape(BEGIN_MARK) + ".*?" + re.escape(END_MARK), re.S)
+        if not pattern.search(cpp):
+            sys.exit("%s has no %s ... %s block" % (args.write, BEGIN_MARK, END_MARK))
+        with open(args.write, "w") as f:
+            f.write(pattern.sub(lambda m: text, cpp))
+
+
+if __name__ == "__main__":
+    main()